@@ -0,0 +1,364 @@
+/*
+ * Copyright © 2026 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Manager.ApplyToDevices(): stage one exported device state on a set of
+ * devices and commit them in parallel.
+ *
+ * Everything but the commit itself happens on the main thread: the
+ * import, the device resume (which needs the udev context) and all bus
+ * traffic. The commits run on a small pool of worker threads, a device
+ * is marked busy while it is committed and the bus refuses to touch it.
+ * Finished jobs are handed back to the main thread through an eventfd.
+ *
+ * The devices only share the struct ratbag. What a commit touches in it,
+ * the interned macros and the HID trace ring, is locked in libratbag.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <systemd/sd-bus.h>
+#include <systemd/sd-event.h>
+#include "ratbagd.h"
+#include "shared-macro.h"
+
+#include "libratbag-util.h"
+
+/* Commits are mostly spent waiting for the device, more threads than
+ * this just queue up on the USB bus */
+#define RATBAGD_APPLY_MAX_WORKERS 8
+
+struct ratbagd_apply_job {
+	struct list link;
+	struct ratbagd_device *device;
+	bool staged;
+	int result;
+};
+
+struct ratbagd_apply {
+	struct ratbagd *ctx;
+
+	int event_fd;
+	sd_event_source *event_source;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct list pending; /* jobs waiting for a worker */
+	struct list done; /* jobs waiting for the main thread */
+	unsigned int n_pending;
+	unsigned int n_idle;
+	bool quit;
+
+	unsigned int n_workers;
+	pthread_t workers[RATBAGD_APPLY_MAX_WORKERS];
+};
+
+static void ratbagd_apply_job_free(struct ratbagd_apply_job *job)
+{
+	ratbagd_device_unref(job->device);
+	free(job);
+}
+
+/* Called with the lock held */
+static void ratbagd_apply_complete(struct ratbagd_apply *apply,
+				   struct ratbagd_apply_job *job)
+{
+	uint64_t one = 1;
+
+	list_append(&apply->done, &job->link);
+	if (write(apply->event_fd, &one, sizeof(one)) != sizeof(one))
+		log_error("Failed to signal a finished commit: %m\n");
+}
+
+static void *ratbagd_apply_worker(void *data)
+{
+	struct ratbagd_apply *apply = data;
+	struct ratbagd_apply_job *job;
+	int result;
+
+	pthread_mutex_lock(&apply->lock);
+	while (true) {
+		while (!apply->quit && list_empty(&apply->pending))
+			pthread_cond_wait(&apply->cond, &apply->lock);
+
+		if (apply->quit)
+			break;
+
+		job = container_of(apply->pending.next, job, link);
+		list_remove(&job->link);
+		--apply->n_pending;
+		--apply->n_idle;
+		pthread_mutex_unlock(&apply->lock);
+
+		result = ratbagd_device_commit_staged(job->device);
+
+		pthread_mutex_lock(&apply->lock);
+		++apply->n_idle;
+		job->result = result;
+		ratbagd_apply_complete(apply, job);
+	}
+	pthread_mutex_unlock(&apply->lock);
+
+	return NULL;
+}
+
+static int ratbagd_apply_event(sd_event_source *source,
+			       int fd,
+			       uint32_t mask,
+			       void *userdata)
+{
+	struct ratbagd_apply *apply = userdata;
+	struct ratbagd_apply_job *job, *tmp;
+	struct list done;
+	uint64_t count;
+
+	if (read(apply->event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+		return -errno;
+
+	list_init(&done);
+
+	pthread_mutex_lock(&apply->lock);
+	list_for_each_safe(job, tmp, &apply->done, link) {
+		list_remove(&job->link);
+		list_append(&done, &job->link);
+	}
+	pthread_mutex_unlock(&apply->lock);
+
+	list_for_each_safe(job, tmp, &done, link) {
+		list_remove(&job->link);
+
+		if (job->staged)
+			ratbagd_device_finish_commit(job->device, job->result);
+
+		(void) sd_bus_emit_signal(apply->ctx->bus,
+					  RATBAGD_OBJ_ROOT,
+					  RATBAGD_NAME_ROOT ".Manager",
+					  "DeviceApplied",
+					  "oi",
+					  ratbagd_device_get_path(job->device),
+					  job->result);
+
+		ratbagd_apply_job_free(job);
+	}
+
+	return 0;
+}
+
+int ratbagd_apply_new(struct ratbagd_apply **out, struct ratbagd *ctx)
+{
+	struct ratbagd_apply *apply;
+	int r;
+
+	apply = zalloc(sizeof(*apply));
+	apply->ctx = ctx;
+	apply->event_fd = -1;
+	list_init(&apply->pending);
+	list_init(&apply->done);
+	pthread_mutex_init(&apply->lock, NULL);
+	pthread_cond_init(&apply->cond, NULL);
+
+	apply->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (apply->event_fd < 0) {
+		r = -errno;
+		goto error;
+	}
+
+	r = sd_event_add_io(ctx->event,
+			    &apply->event_source,
+			    apply->event_fd,
+			    EPOLLIN,
+			    ratbagd_apply_event,
+			    apply);
+	if (r < 0)
+		goto error;
+
+	*out = apply;
+	return 0;
+
+error:
+	ratbagd_apply_free(apply);
+	return r;
+}
+
+struct ratbagd_apply *ratbagd_apply_free(struct ratbagd_apply *apply)
+{
+	struct ratbagd_apply_job *job, *tmp;
+	unsigned int i;
+
+	if (!apply)
+		return NULL;
+
+	pthread_mutex_lock(&apply->lock);
+	apply->quit = true;
+	pthread_cond_broadcast(&apply->cond);
+	pthread_mutex_unlock(&apply->lock);
+
+	/* a worker finishes the commit it is running, we don't cut off
+	 * a device in the middle of a write */
+	for (i = 0; i < apply->n_workers; i++)
+		pthread_join(apply->workers[i], NULL);
+
+	list_for_each_safe(job, tmp, &apply->pending, link) {
+		list_remove(&job->link);
+		ratbagd_device_finish_commit(job->device, -ECANCELED);
+		ratbagd_apply_job_free(job);
+	}
+
+	list_for_each_safe(job, tmp, &apply->done, link) {
+		list_remove(&job->link);
+		if (job->staged)
+			ratbagd_device_finish_commit(job->device, job->result);
+		ratbagd_apply_job_free(job);
+	}
+
+	apply->event_source = sd_event_source_unref(apply->event_source);
+	safe_close(apply->event_fd);
+	pthread_cond_destroy(&apply->cond);
+	pthread_mutex_destroy(&apply->lock);
+
+	return mfree(apply);
+}
+
+/* Called with the lock held */
+static void ratbagd_apply_spawn_worker(struct ratbagd_apply *apply)
+{
+	int r;
+
+	/* idle workers that haven't picked up their job yet are still
+	 * counted as idle, compare against the queue instead */
+	if (apply->n_pending < apply->n_idle ||
+	    apply->n_workers >= RATBAGD_APPLY_MAX_WORKERS)
+		return;
+
+	r = pthread_create(&apply->workers[apply->n_workers], NULL,
+			   ratbagd_apply_worker, apply);
+	if (r != 0) {
+		log_error("Failed to start a commit thread: %s\n", strerror(r));
+		return;
+	}
+
+	++apply->n_workers;
+	++apply->n_idle;
+}
+
+static void ratbagd_apply_queue(struct ratbagd_apply *apply,
+				struct ratbagd_device *device,
+				int result)
+{
+	struct ratbagd_apply_job *job;
+
+	job = zalloc(sizeof(*job));
+	job->device = ratbagd_device_ref(device);
+	job->staged = result == 0;
+	job->result = result;
+
+	pthread_mutex_lock(&apply->lock);
+	if (job->staged) {
+		ratbagd_apply_spawn_worker(apply);
+
+		/* without a thread to run it, commit right here */
+		if (apply->n_workers == 0) {
+			pthread_mutex_unlock(&apply->lock);
+			job->result = ratbagd_device_commit_staged(device);
+			pthread_mutex_lock(&apply->lock);
+		} else {
+			list_append(&apply->pending, &job->link);
+			++apply->n_pending;
+			pthread_cond_signal(&apply->cond);
+			job = NULL;
+		}
+	}
+	if (job)
+		ratbagd_apply_complete(apply, job);
+	pthread_mutex_unlock(&apply->lock);
+}
+
+int ratbagd_apply_to_devices(sd_bus_message *m,
+			     void *userdata,
+			     sd_bus_error *error)
+{
+	struct ratbagd *ctx = userdata;
+	_cleanup_(freep) struct ratbagd_device **devices = NULL;
+	struct ratbagd_device **tmp;
+	const void *data;
+	size_t size;
+	unsigned int n_devices = 0, n_staged = 0;
+	const char *path;
+	unsigned int i;
+	int r;
+
+	CHECK_CALL(sd_bus_message_enter_container(m, 'a', "o"));
+
+	/* resolve all paths first so a typo doesn't leave us with half of
+	 * the devices staged */
+	while ((r = sd_bus_message_read(m, "o", &path)) > 0) {
+		_cleanup_(freep) char *name = NULL;
+		struct ratbagd_device *device;
+
+		r = sd_bus_path_decode_many(path,
+					    RATBAGD_OBJ_ROOT "/device/%",
+					    &name);
+		device = r > 0 ? ratbagd_device_lookup(ctx, name) : NULL;
+		if (!device)
+			return sd_bus_error_setf(error,
+						 SD_BUS_ERROR_INVALID_ARGS,
+						 "Unknown device '%s'", path);
+
+		tmp = realloc(devices, (n_devices + 1) * sizeof(*devices));
+		if (!tmp)
+			return -ENOMEM;
+		devices = tmp;
+		devices[n_devices++] = device;
+	}
+	if (r < 0)
+		return r;
+
+	CHECK_CALL(sd_bus_message_exit_container(m));
+	CHECK_CALL(sd_bus_message_read_array(m, 'y', &data, &size));
+
+	/* the import validates the data against each device's own layout,
+	 * a device that can't take it gets its DeviceApplied signal with
+	 * the error right away and the others carry on */
+	for (i = 0; i < n_devices; i++) {
+		r = ratbagd_device_stage(devices[i], data, size);
+		if (r < 0) {
+			log_error("%s: failed to stage the device state: %s\n",
+				  ratbagd_device_get_sysname(devices[i]),
+				  strerror(-r));
+		} else {
+			++n_staged;
+		}
+
+		ratbagd_apply_queue(ctx->apply, devices[i], r);
+	}
+
+	return sd_bus_reply_method_return(m, "u", n_staged);
+}
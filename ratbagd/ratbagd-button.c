@@ -43,6 +43,11 @@ struct ratbagd_button {
 	struct ratbag_button *lib_button;
 	unsigned int index;
 	char *path;
+
+	/* macro events as (type, value) pairs */
+	struct ratbagd_u32_cache macro;
+	/* supported action types, fixed at probe time */
+	struct ratbagd_u32_cache action_types;
 };
 
 static int ratbagd_button_get_button(sd_bus *bus,
@@ -209,47 +214,66 @@ static int ratbagd_button_get_macro(sd_bus *bus,
 				    sd_bus_error *error)
 {
 	struct ratbagd_button *button = userdata;
-	_cleanup_(ratbag_button_macro_unrefp) struct ratbag_button_macro *macro = NULL;
-	unsigned int idx;
+	unsigned int generation = ratbag_button_get_generation(button->lib_button);
+	size_t idx;
+
+	if (!ratbagd_u32_cache_is_valid(&button->macro, generation)) {
+		_cleanup_(ratbag_button_macro_unrefp) struct ratbag_button_macro *macro = NULL;
+		_cleanup_free_ unsigned int *events = NULL;
+		unsigned int nevents = 0;
+
+		macro = ratbag_button_get_macro(button->lib_button);
+		if (macro)
+			nevents = ratbag_button_macro_get_num_events(macro);
+
+		/* cached as (type, value) pairs, the layout of a(uu). An
+		 * empty macro caches nothing and replies with an empty
+		 * array, zalloc() may abort on a zero-sized allocation */
+		if (nevents > 0)
+			events = zalloc(2 * nevents * sizeof(*events));
+
+		for (idx = 0; idx < nevents; idx++) {
+			enum ratbag_macro_event_type type;
+			int value;
+
+			type = ratbag_button_macro_get_event_type(macro, idx);
+			switch (type) {
+			case RATBAG_MACRO_EVENT_INVALID:
+				abort();
+				break;
+			case RATBAG_MACRO_EVENT_NONE:
+				goto done;
+			case RATBAG_MACRO_EVENT_KEY_PRESSED:
+			case RATBAG_MACRO_EVENT_KEY_RELEASED:
+				value = ratbag_button_macro_get_event_key(macro, idx);
+				break;
+			case RATBAG_MACRO_EVENT_WAIT:
+				value = ratbag_button_macro_get_event_timeout(macro, idx);
+				break;
+			default:
+				abort();
+			}
+
+			verify_unsigned_int(type);
+			verify_unsigned_int(value);
+
+			events[2 * idx] = type;
+			events[2 * idx + 1] = value;
+		}
+done:
+		ratbagd_u32_cache_set(&button->macro, generation, events, 2 * idx);
+	}
 
 	CHECK_CALL(sd_bus_message_open_container(reply, SD_BUS_TYPE_STRUCT, "uv"));
 	CHECK_CALL(sd_bus_message_append(reply, "u", RATBAG_BUTTON_ACTION_TYPE_MACRO));
 	CHECK_CALL(sd_bus_message_open_container(reply, 'v', "a(uu)"));
 	CHECK_CALL(sd_bus_message_open_container(reply, 'a', "(uu)"));
 
-	macro = ratbag_button_get_macro(button->lib_button);
-	if (!macro)
-		goto out;
-
-	for (idx = 0; idx < ratbag_button_macro_get_num_events(macro); idx++) {
-		enum ratbag_macro_event_type type;
-		int value;
-
-		type = ratbag_button_macro_get_event_type(macro, idx);
-		switch (type) {
-		case RATBAG_MACRO_EVENT_INVALID:
-			abort();
-			break;
-		case RATBAG_MACRO_EVENT_NONE:
-			goto out;
-		case RATBAG_MACRO_EVENT_KEY_PRESSED:
-		case RATBAG_MACRO_EVENT_KEY_RELEASED:
-			value = ratbag_button_macro_get_event_key(macro, idx);
-			break;
-		case RATBAG_MACRO_EVENT_WAIT:
-			value = ratbag_button_macro_get_event_timeout(macro, idx);
-			break;
-		default:
-			abort();
-		}
+	for (idx = 0; idx < button->macro.nvalues; idx += 2)
+		CHECK_CALL(sd_bus_message_append(reply, "(uu)",
+						 button->macro.values[idx],
+						 button->macro.values[idx + 1]));
 
-		verify_unsigned_int(type);
-		verify_unsigned_int(value);
-
-		CHECK_CALL(sd_bus_message_append(reply, "(uu)", type, value));
-	}
-
-out:
 	CHECK_CALL(sd_bus_message_close_container(reply)); /* a(uu) */
 	CHECK_CALL(sd_bus_message_close_container(reply)); /* v */
 	CHECK_CALL(sd_bus_message_close_container(reply)); /* ) */
@@ -446,29 +470,29 @@ static int ratbagd_button_get_action_types(sd_bus *bus,
 					   sd_bus_error *error)
 {
 	struct ratbagd_button *button = userdata;
-	enum ratbag_button_action_type types[] = {
+
+	return ratbagd_u32_cache_append(reply, &button->action_types);
+}
+
+static void ratbagd_button_init_action_types(struct ratbagd_button *button)
+{
+	const enum ratbag_button_action_type types[] = {
 		RATBAG_BUTTON_ACTION_TYPE_NONE,
 		RATBAG_BUTTON_ACTION_TYPE_BUTTON,
 		RATBAG_BUTTON_ACTION_TYPE_SPECIAL,
 		RATBAG_BUTTON_ACTION_TYPE_KEY,
 		RATBAG_BUTTON_ACTION_TYPE_MACRO
 	};
-	enum ratbag_button_action_type *t;
-
-
-	CHECK_CALL(sd_bus_message_open_container(reply, 'a', "u"));
+	unsigned int supported[ARRAY_LENGTH(types)];
+	const enum ratbag_button_action_type *t;
+	size_t n = 0;
 
 	ARRAY_FOR_EACH(types, t) {
-		if (!ratbag_button_has_action_type(button->lib_button, *t))
-			continue;
-
-		verify_unsigned_int(*t);
-		CHECK_CALL(sd_bus_message_append(reply, "u", *t));
+		if (ratbag_button_has_action_type(button->lib_button, *t))
+			supported[n++] = *t;
 	}
 
-	CHECK_CALL(sd_bus_message_close_container(reply));
-
-	return 0;
+	ratbagd_u32_cache_set(&button->action_types, 0, supported, n);
 }
 
 const sd_bus_vtable ratbagd_button_vtable[] = {
@@ -500,6 +524,7 @@ int ratbagd_button_new(struct ratbagd_button **out,
 	button->device = device;
 	button->lib_button = lib_button;
 	button->index = index;
+	ratbagd_button_init_action_types(button);
 
 	sprintf(profile_buffer, "p%u", ratbagd_profile_get_index(profile));
 	sprintf(button_buffer, "b%u", index);
@@ -528,6 +553,8 @@ struct ratbagd_button *ratbagd_button_free(struct ratbagd_button *button)
 		return NULL;
 
 	button->path = mfree(button->path);
+	ratbagd_u32_cache_reset(&button->macro);
+	ratbagd_u32_cache_reset(&button->action_types);
 	button->lib_button = ratbag_button_unref(button->lib_button);
 
 	return mfree(button);
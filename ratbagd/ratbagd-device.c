@@ -48,6 +48,8 @@ struct ratbagd_device {
 	char *sysname;
 	char *path;
 	struct ratbag_device *lib_device;
+	bool busy; /* a commit is running outside the main thread */
+	unsigned int commits_pending; /* Device.Commit tasks not run yet */
 
 	sd_bus_slot *profile_vtable_slot;
 	sd_bus_slot *profile_enum_slot;
@@ -77,6 +79,9 @@ static int ratbagd_device_find_profile(sd_bus *bus,
 	if (r <= 0)
 		return r;
 
+	if (device->busy)
+		return -EBUSY;
+
 	r = safe_atou(name, &index);
 	if (r < 0)
 		return 0;
@@ -191,18 +196,15 @@ static int ratbagd_device_get_profiles(sd_bus *bus,
 static void ratbagd_device_commit_pending(void *data)
 {
 	struct ratbagd_device *device = data;
-	int r;
 
-	r = ratbag_device_commit(device->lib_device);
-	if (r)
-		log_error("error committing device (%d)\n", r);
-	if (r < 0)
-		ratbagd_device_resync(device, device->ctx->bus);
-
-	ratbagd_for_each_profile_signal(device->ctx->bus,
-					device,
-					ratbagd_profile_notify_dirty);
+	/* ratbagd_device_stage() refuses a device with a commit pending,
+	 * nothing else may be committing it now */
+	assert(device->commits_pending > 0);
+	assert(!device->busy);
+	device->commits_pending--;
 
+	ratbagd_device_finish_commit(device,
+				     ratbag_device_commit(device->lib_device));
 	ratbagd_device_unref(device);
 }
 
@@ -212,6 +214,10 @@ static int ratbagd_device_commit(sd_bus_message *m,
 {
 	struct ratbagd_device *device = userdata;
 
+	if (device->busy)
+		return -EBUSY;
+
+	device->commits_pending++;
 	ratbagd_schedule_task(device->ctx,
 			      ratbagd_device_commit_pending,
 			      ratbagd_device_ref(device));
@@ -275,6 +281,56 @@ const sd_bus_vtable ratbagd_device_vtable[] = {
 	SD_BUS_VTABLE_END,
 };
 
+static int
+ratbagd_device_get_stats(sd_bus *bus,
+			 const char *path,
+			 const char *interface,
+			 const char *property,
+			 sd_bus_message *reply,
+			 void *userdata,
+			 sd_bus_error *error)
+{
+	struct ratbagd_device *device = userdata;
+	_cleanup_(freep) struct ratbag_io_stats *stats = NULL;
+	size_t nstats, i;
+
+	nstats = ratbag_device_get_stats(device->lib_device, NULL, 0);
+	if (nstats > 0) {
+		stats = zalloc(nstats * sizeof(*stats));
+		nstats = ratbag_device_get_stats(device->lib_device, stats, nstats);
+	}
+
+	CHECK_CALL(sd_bus_message_open_container(reply, 'a', "(uutttttttat)"));
+
+	for (i = 0; i < nstats; i++) {
+		struct ratbag_io_stats *s = &stats[i];
+
+		CHECK_CALL(sd_bus_message_open_container(reply, 'r', "uutttttttat"));
+		CHECK_CALL(sd_bus_message_append(reply, "uuttttttt",
+						 s->type,
+						 s->id,
+						 s->requests,
+						 s->errors,
+						 s->timeouts,
+						 s->retries,
+						 s->bytes_sent,
+						 s->bytes_received,
+						 s->latency_total_us));
+		CHECK_CALL(sd_bus_message_append_array(reply, 't',
+						       s->latency,
+						       sizeof(s->latency)));
+		CHECK_CALL(sd_bus_message_close_container(reply));
+	}
+
+	return sd_bus_message_close_container(reply);
+}
+
+const sd_bus_vtable ratbagd_device_stats_vtable[] = {
+	SD_BUS_VTABLE_START(0),
+	SD_BUS_PROPERTY("Requests", "a(uutttttttat)", ratbagd_device_get_stats, 0, 0),
+	SD_BUS_VTABLE_END,
+};
+
 int ratbagd_device_new(struct ratbagd_device **out,
 		       struct ratbagd *ctx,
 		       const char *sysname,
@@ -398,6 +454,102 @@ unsigned int ratbagd_device_get_num_leds(struct ratbagd_device *device)
 	return ratbag_device_get_num_leds(device->lib_device);
 }
 
+void ratbagd_device_suspend(struct ratbagd_device *device)
+{
+	if (device->busy)
+		return;
+
+	if (ratbag_device_suspend(device->lib_device) != RATBAG_SUCCESS)
+		log_error("%s: failed to release the device\n",
+			  ratbagd_device_get_sysname(device));
+}
+
+bool ratbagd_device_is_busy(struct ratbagd_device *device)
+{
+	return device->busy;
+}
+
+static int ratbagd_device_errno(enum ratbag_error_code error)
+{
+	switch (error) {
+	case RATBAG_SUCCESS:
+		return 0;
+	case RATBAG_ERROR_DEVICE:
+		return -ENODEV;
+	case RATBAG_ERROR_CAPABILITY:
+	case RATBAG_ERROR_VALUE:
+		return -EINVAL;
+	case RATBAG_ERROR_IMPLEMENTATION:
+		return -ENOTSUP;
+	default:
+		return -EIO;
+	}
+}
+
+/*
+ * Import the state in data and prepare the device for a commit through
+ * ratbagd_device_commit_staged(). On success, the device is busy until
+ * ratbagd_device_finish_commit() and must not be touched by anything but
+ * the commit. A device with a Device.Commit pending is refused with
+ * -EBUSY.
+ */
+int ratbagd_device_stage(struct ratbagd_device *device,
+			 const void *data,
+			 size_t size)
+{
+	enum ratbag_error_code error;
+
+	assert(device);
+
+	/* a Device.Commit that hasn't run yet would commit on the main
+	 * thread while the staged commit runs on a worker */
+	if (device->busy || device->commits_pending)
+		return -EBUSY;
+
+	/* resume first, the udev lookup must happen on the main thread and
+	 * a device that is gone should not end up with an imported state
+	 * that is never committed */
+	error = ratbag_device_resume(device->lib_device);
+	if (error == RATBAG_SUCCESS)
+		error = ratbag_device_import(device->lib_device, data, size);
+	if (error != RATBAG_SUCCESS)
+		return ratbagd_device_errno(error);
+
+	device->busy = true;
+	return 0;
+}
+
+/*
+ * Commit a device staged with ratbagd_device_stage(). This is the only
+ * call that may happen outside the main thread, it does not touch the
+ * bus or the ratbagd context.
+ */
+int ratbagd_device_commit_staged(struct ratbagd_device *device)
+{
+	assert(device->busy);
+
+	return ratbagd_device_errno(ratbag_device_commit(device->lib_device));
+}
+
+void ratbagd_device_finish_commit(struct ratbagd_device *device, int result)
+{
+	device->busy = false;
+
+	if (result)
+		log_error("error committing device (%d)\n", result);
+
+	/* the device was removed while the commit was running */
+	if (!ratbagd_device_linked(device))
+		return;
+
+	if (result < 0)
+		ratbagd_device_resync(device, device->ctx->bus);
+
+	ratbagd_for_each_profile_signal(device->ctx->bus,
+					device,
+					ratbagd_profile_notify_dirty);
+}
+
 int ratbagd_device_resync(struct ratbagd_device *device, sd_bus *bus)
 {
 	assert(device);
@@ -64,232 +64,750 @@
    ratbagd uses a minimum sane device (1 profile, 1 resolution, etc.) and any
    JSON instructions get merged into that device. Which means you usually
    only need to set those bits you care about being checked.
+
+   The parser is a single pass over the string that writes straight into
+   the test device, there is no intermediate tree. Member names and enum
+   strings are looked up in perfect hash tables. CI loads thousands of
+   test devices, see test/bench-ratbagd-json.c for the numbers.
  */
 
+#include <limits.h>
+#include <stdint.h>
+
 #include "libratbag-util.h"
 #include "ratbagd-json.h"
 #include "ratbagd-test.h"
-#include <json-glib/json-glib.h>
 #include <libevdev/libevdev.h>
 
-/* Hack because we don't do proper data passing */
-static int num_resolutions;
-static int num_buttons;
-static int num_leds;
+/* Nesting limit for values we skip */
+#define JSON_MAX_DEPTH 32
+/* Longest string we read, profile names and macro keys are short */
+#define JSON_MAX_STRING 256
+
+struct json_parser {
+	const char *data;
+	const char *pos;
+	int error;
+
+	/* the key of the member currently parsed */
+	char key[JSON_MAX_STRING];
+
+	/* the largest number of elements in any profile */
+	unsigned int num_resolutions;
+	unsigned int num_buttons;
+	unsigned int num_leds;
+};
+
+#define parser_error(p_, element_) \
+	json_error((p_), __func__, __LINE__, (element_))
+
+static void
+json_error(struct json_parser *p, const char *func, int line,
+	   const char *element)
+{
+	/* only the first error is useful, the rest is fallout */
+	if (p->error)
+		return;
+
+	log_error("json: parser error: %s:%d: element '%s' at offset %td\n",
+		  func, line, element, p->pos - p->data);
+	p->error = -EINVAL;
+}
+
+/*
+ * Perfect hash tables for the member names and enum strings. The seed of
+ * each table is picked so its keywords don't collide, adding a keyword
+ * likely needs a new seed. Collisions are logged and checked by
+ * ratbagd_json_check_keywords() in the test suite.
+ */
+struct keyword {
+	const char *name;
+	int value;
+};
+
+struct keyword_table {
+	uint32_t seed;
+	unsigned int size; /* power of two */
+	const struct keyword *keywords;
+	size_t nkeywords;
+	const struct keyword **slots;
+	bool initialized;
+};
+
+#define KEYWORD_TABLE(seed_, size_, keywords_) { \
+	.seed = (seed_), \
+	.size = (size_), \
+	.keywords = (keywords_), \
+	.nkeywords = ARRAY_LENGTH(keywords_), \
+	.slots = (const struct keyword *[size_]) { NULL }, \
+}
 
-static int parse_error = 0;
+static uint32_t
+keyword_hash(uint32_t seed, const char *str, size_t len)
+{
+	uint32_t h = 2166136261u ^ seed;
+
+	for (size_t i = 0; i < len; i++) {
+		h ^= (uint8_t)str[i];
+		h *= 16777619u;
+	}
 
-#define parser_error(element_) { \
-	log_error("json: parser error: %s:%d: element '%s'\n", __func__, __LINE__, (element_)); \
-	parse_error = -EINVAL; \
-	goto out; \
+	/* the low bits of FNV-1a only depend on the low bits of the input,
+	 * fold in the high bits before masking */
+	return h ^ (h >> 15);
 }
 
-static void parse_resolution_member(JsonObject *obj, const gchar *name,
-				    JsonNode *node, void *data)
+/* Returns -EEXIST if two keywords collide, the later one then can't be
+ * looked up */
+static int
+keyword_table_init(struct keyword_table *table)
 {
-	struct ratbag_test_resolution *resolution = data;
-
-	if (streq(name, "xres")) {
-		gboolean v = json_object_get_int_member(obj, name);
-
-		if (v < 0 || v > 20000)
-			parser_error("xres");
-
-		resolution->xres = v;
-		log_verbose("json:    xres: %d\n", v);
-	} else if (streq(name, "yres")) {
-		gboolean v = json_object_get_int_member(obj, name);
-
-		if (v < 0 || v > 20000)
-			parser_error("yres");
-
-		resolution->yres = v;
-		log_verbose("json:    yres: %d\n", v);
-	} else if (streq(name, "dpi_min")) {
-		gboolean v = json_object_get_int_member(obj, name);
-
-		if (v < 0 || v > 20000)
-			parser_error("dpi_min");
-
-		resolution->dpi_min = v;
-		log_verbose("json:    dpi_min: %d\n", v);
-	} else if (streq(name, "dpi_max")) {
-		gboolean v = json_object_get_int_member(obj, name);
-
-		if (v < 0 || v > 20000)
-			parser_error("dpi_min");
-
-		resolution->dpi_max = v;
-		log_verbose("json:    dpi_max: %d\n", v);
-	} else if (streq(name, "is_active")) {
-		gboolean v = json_object_get_boolean_member(obj, name);
-		resolution->active = v;
-		log_verbose("json:    is_active: %d\n", v);
-	} else if (streq(name, "is_default")) {
-		gboolean v = json_object_get_boolean_member(obj, name);
-		resolution->dflt = v;
-		log_verbose("json:    is_default: %d\n", v);
-	} else if (streq(name, "is_disabled")) {
-		gboolean v = json_object_get_boolean_member(obj, name);
-		resolution->disabled = v;
-		log_verbose("json:    is_disabled: %d\n", v);
-	} else if (streq(name, "capabilities")) {
-		JsonArray *a = json_object_get_array_member(obj, name);
-
-		assert(json_array_get_length(a) < ARRAY_LENGTH(resolution->caps));
-		for (size_t s = 0; s < json_array_get_length(a); s++) {
-			int v = json_array_get_int_element(a, s);
-			if (v > RATBAG_RESOLUTION_CAP_DISABLE)
-				parser_error("capabilities");
-			resolution->caps[s] = v;
+	int rc = 0;
+
+	memset(table->slots, 0, table->size * sizeof(*table->slots));
+
+	for (size_t i = 0; i < table->nkeywords; i++) {
+		const struct keyword *kw = &table->keywords[i];
+		uint32_t slot = keyword_hash(table->seed,
+					     kw->name,
+					     strlen(kw->name)) & (table->size - 1);
+
+		if (table->slots[slot]) {
+			log_error("json: keyword '%s' collides with '%s', the table needs a new seed\n",
+				  kw->name, table->slots[slot]->name);
+			rc = -EEXIST;
+			continue;
 		}
+		table->slots[slot] = kw;
+	}
 
-		log_verbose("json:    caps: %d %d %d %d %d...\n",
-			    resolution->caps[0],
-			    resolution->caps[1],
-			    resolution->caps[2],
-			    resolution->caps[3],
-			    resolution->caps[4]);
-	} else {
-		log_error("json:    unknown resolution key '%s'\n", name);
-		parse_error = -EINVAL;
+	table->initialized = true;
+
+	return rc;
+}
+
+static bool
+keyword_lookup(struct keyword_table *table, const char *str, size_t len,
+	       int *value)
+{
+	const struct keyword *kw;
+
+	if (!table->initialized)
+		keyword_table_init(table);
+
+	kw = table->slots[keyword_hash(table->seed, str, len) & (table->size - 1)];
+	if (!kw || !strneq(kw->name, str, len) || kw->name[len] != '\0')
+		return false;
+
+	*value = kw->value;
+	return true;
+}
+
+enum json_key {
+	JSON_KEY_PROFILES,
+	JSON_KEY_NAME,
+	JSON_KEY_IS_ACTIVE,
+	JSON_KEY_IS_DEFAULT,
+	JSON_KEY_IS_DISABLED,
+	JSON_KEY_RATE,
+	JSON_KEY_REPORT_RATES,
+	JSON_KEY_CAPABILITIES,
+	JSON_KEY_RESOLUTIONS,
+	JSON_KEY_BUTTONS,
+	JSON_KEY_LEDS,
+	JSON_KEY_XRES,
+	JSON_KEY_YRES,
+	JSON_KEY_DPI_MIN,
+	JSON_KEY_DPI_MAX,
+	JSON_KEY_MODE,
+	JSON_KEY_DURATION,
+	JSON_KEY_BRIGHTNESS,
+	JSON_KEY_COLOR,
+	JSON_KEY_ACTION_TYPE,
+	JSON_KEY_BUTTON,
+	JSON_KEY_KEY,
+	JSON_KEY_SPECIAL,
+	JSON_KEY_MACRO,
+
+	JSON_KEY_UNKNOWN,
+};
+
+static const struct keyword key_keywords[] = {
+	{ "profiles", JSON_KEY_PROFILES },
+	{ "name", JSON_KEY_NAME },
+	{ "is_active", JSON_KEY_IS_ACTIVE },
+	{ "is_default", JSON_KEY_IS_DEFAULT },
+	{ "is_disabled", JSON_KEY_IS_DISABLED },
+	{ "rate", JSON_KEY_RATE },
+	{ "report_rates", JSON_KEY_REPORT_RATES },
+	{ "capabilities", JSON_KEY_CAPABILITIES },
+	{ "resolutions", JSON_KEY_RESOLUTIONS },
+	{ "buttons", JSON_KEY_BUTTONS },
+	{ "leds", JSON_KEY_LEDS },
+	{ "xres", JSON_KEY_XRES },
+	{ "yres", JSON_KEY_YRES },
+	{ "dpi_min", JSON_KEY_DPI_MIN },
+	{ "dpi_max", JSON_KEY_DPI_MAX },
+	{ "mode", JSON_KEY_MODE },
+	{ "duration", JSON_KEY_DURATION },
+	{ "brightness", JSON_KEY_BRIGHTNESS },
+	{ "color", JSON_KEY_COLOR },
+	{ "action_type", JSON_KEY_ACTION_TYPE },
+	{ "button", JSON_KEY_BUTTON },
+	{ "key", JSON_KEY_KEY },
+	{ "special", JSON_KEY_SPECIAL },
+	{ "macro", JSON_KEY_MACRO },
+};
+
+static const struct keyword special_keywords[] = {
+	{ "invalid", RATBAG_BUTTON_ACTION_SPECIAL_INVALID},
+	{ "unknown", RATBAG_BUTTON_ACTION_SPECIAL_UNKNOWN},
+	{ "doubleclick", RATBAG_BUTTON_ACTION_SPECIAL_DOUBLECLICK},
+	{ "wheel-left", RATBAG_BUTTON_ACTION_SPECIAL_WHEEL_LEFT},
+	{ "wheel-right", RATBAG_BUTTON_ACTION_SPECIAL_WHEEL_RIGHT},
+	{ "wheel-up", RATBAG_BUTTON_ACTION_SPECIAL_WHEEL_UP},
+	{ "wheel-down", RATBAG_BUTTON_ACTION_SPECIAL_WHEEL_DOWN},
+	{ "ratchet-mode-switch", RATBAG_BUTTON_ACTION_SPECIAL_RATCHET_MODE_SWITCH},
+	{ "resolution-cycle-up", RATBAG_BUTTON_ACTION_SPECIAL_RESOLUTION_CYCLE_UP},
+	{ "resolution-cycle-down", RATBAG_BUTTON_ACTION_SPECIAL_RESOLUTION_CYCLE_DOWN},
+	{ "resolution-up", RATBAG_BUTTON_ACTION_SPECIAL_RESOLUTION_UP},
+	{ "resolution-down", RATBAG_BUTTON_ACTION_SPECIAL_RESOLUTION_DOWN},
+	{ "resolution-alternate", RATBAG_BUTTON_ACTION_SPECIAL_RESOLUTION_ALTERNATE},
+	{ "resolution-default", RATBAG_BUTTON_ACTION_SPECIAL_RESOLUTION_DEFAULT},
+	{ "profile-cycle-up", RATBAG_BUTTON_ACTION_SPECIAL_PROFILE_CYCLE_UP},
+	{ "profile-cycle-down", RATBAG_BUTTON_ACTION_SPECIAL_PROFILE_CYCLE_DOWN},
+	{ "profile-up", RATBAG_BUTTON_ACTION_SPECIAL_PROFILE_UP},
+	{ "profile-down", RATBAG_BUTTON_ACTION_SPECIAL_PROFILE_DOWN},
+	{ "second-mode", RATBAG_BUTTON_ACTION_SPECIAL_SECOND_MODE},
+	{ "battery-level", RATBAG_BUTTON_ACTION_SPECIAL_BATTERY_LEVEL},
+};
+
+static const struct keyword action_type_keywords[] = {
+	{ "none", RATBAG_BUTTON_ACTION_TYPE_NONE},
+	{ "button", RATBAG_BUTTON_ACTION_TYPE_BUTTON},
+	{ "special", RATBAG_BUTTON_ACTION_TYPE_SPECIAL},
+	{ "key", RATBAG_BUTTON_ACTION_TYPE_KEY},
+	{ "macro", RATBAG_BUTTON_ACTION_TYPE_MACRO},
+	{ "unknown", RATBAG_BUTTON_ACTION_TYPE_UNKNOWN},
+};
+
+static struct keyword_table key_table =
+	KEYWORD_TABLE(241, 64, key_keywords);
+static struct keyword_table special_table =
+	KEYWORD_TABLE(2019, 32, special_keywords);
+static struct keyword_table action_type_table =
+	KEYWORD_TABLE(37, 8, action_type_keywords);
+
+int
+ratbagd_json_check_keywords(void)
+{
+	struct keyword_table *tables[] = {
+		&key_table,
+		&special_table,
+		&action_type_table,
+	};
+	struct keyword_table **table;
+	int rc = 0;
+
+	ARRAY_FOR_EACH(tables, table) {
+		int r = keyword_table_init(*table);
+
+		if (r < 0)
+			rc = r;
 	}
-out:
-	return;
+
+	return rc;
 }
 
-static void parse_resolution(JsonNode *node,
-			     struct ratbag_test_resolution *resolution)
+/*
+ * Tokenizer. All json_* calls are no-ops once an error is set, so callers
+ * only need to check for the error where they'd otherwise loop or store
+ * garbage.
+ */
+
+static void
+json_skip_ws(struct json_parser *p)
 {
-	JsonObject *obj = json_node_get_object(node);
+	while (*p->pos == ' ' || *p->pos == '\t' ||
+	       *p->pos == '\n' || *p->pos == '\r')
+		p->pos++;
+}
 
-	json_object_foreach_member(obj, parse_resolution_member, resolution);
+static bool
+json_accept(struct json_parser *p, char c)
+{
+	json_skip_ws(p);
+	if (*p->pos != c)
+		return false;
+
+	p->pos++;
+	return true;
 }
 
-static void parse_led_member(JsonObject *obj, const gchar *name,
-			     JsonNode *node, void *data)
+static bool
+json_expect(struct json_parser *p, char c, const char *element)
 {
-	struct ratbag_test_led *led = data;
-
-	if (streq(name, "mode")) {
-		gboolean v = json_object_get_int_member(obj, name);
-
-		if (v < 0 || v > RATBAG_LED_BREATHING)
-			parser_error("mode");
-
-		led->mode = v;
-		log_verbose("json:    mode: %d\n", v);
-	} else if (streq(name, "duration")) {
-		gboolean v = json_object_get_int_member(obj, name);
-
-		if (v < 0 || v > 10000)
-			parser_error("duration");
-
-		led->ms = v;
-		log_verbose("json:    duration: %d\n", v);
-	} else if (streq(name, "brightness")) {
-		gboolean v = json_object_get_int_member(obj, name);
-
-		if (v < 0 || v > 100)
-			parser_error("brightness");
-
-		led->brightness = v;
-		log_verbose("json:    brightness: %d\n", v);
-	} else if (streq(name, "color")) {
-		JsonArray *a = json_object_get_array_member(obj, name);
-
-		assert(json_array_get_length(a) == 3);
-		led->color.red   = json_array_get_int_element(a, 0);
-		led->color.green = json_array_get_int_element(a, 1);
-		led->color.blue  = json_array_get_int_element(a, 2);
-		log_verbose("json:    color: %02x%02x%02x\n",
-			    led->color.red,
-			    led->color.green,
-			    led->color.blue);
-	} else {
-		log_error("json:    unknown led key '%s'\n", name);
-		parse_error = -EINVAL;
+	if (p->error)
+		return false;
+
+	if (!json_accept(p, c)) {
+		parser_error(p, element);
+		return false;
 	}
-out:
-	return;
+
+	return true;
 }
 
-static void parse_led(JsonNode *node, struct ratbag_test_led *led)
+static bool
+json_accept_literal(struct json_parser *p, const char *literal)
 {
-	JsonObject *obj = json_node_get_object(node);
+	size_t len = strlen(literal);
 
-	json_object_foreach_member(obj, parse_led_member, led);
+	json_skip_ws(p);
+	if (!strneq(p->pos, literal, len))
+		return false;
+
+	p->pos += len;
+	return true;
 }
 
-static enum ratbag_button_action_special
-special_lookup(const char *string)
+static int
+json_hex_digit(char c)
 {
-	const struct {
-		const char *key;
-		enum ratbag_button_action_special special;
-	} lut[] = {
-		{ "invalid", RATBAG_BUTTON_ACTION_SPECIAL_INVALID},
-		{ "unknown", RATBAG_BUTTON_ACTION_SPECIAL_UNKNOWN},
-		{ "doubleclick", RATBAG_BUTTON_ACTION_SPECIAL_DOUBLECLICK},
-		{ "wheel-left", RATBAG_BUTTON_ACTION_SPECIAL_WHEEL_LEFT},
-		{ "wheel-right", RATBAG_BUTTON_ACTION_SPECIAL_WHEEL_RIGHT},
-		{ "wheel-up", RATBAG_BUTTON_ACTION_SPECIAL_WHEEL_UP},
-		{ "wheel-down", RATBAG_BUTTON_ACTION_SPECIAL_WHEEL_DOWN},
-		{ "ratchet-mode-switch", RATBAG_BUTTON_ACTION_SPECIAL_RATCHET_MODE_SWITCH},
-		{ "resolution-cycle-up", RATBAG_BUTTON_ACTION_SPECIAL_RESOLUTION_CYCLE_UP},
-		{ "resolution-cycle-down", RATBAG_BUTTON_ACTION_SPECIAL_RESOLUTION_CYCLE_DOWN},
-		{ "resolution-up", RATBAG_BUTTON_ACTION_SPECIAL_RESOLUTION_UP},
-		{ "resolution-down", RATBAG_BUTTON_ACTION_SPECIAL_RESOLUTION_DOWN},
-		{ "resolution-alternate", RATBAG_BUTTON_ACTION_SPECIAL_RESOLUTION_ALTERNATE},
-		{ "resolution-default", RATBAG_BUTTON_ACTION_SPECIAL_RESOLUTION_DEFAULT},
-		{ "profile-cycle-up", RATBAG_BUTTON_ACTION_SPECIAL_PROFILE_CYCLE_UP},
-		{ "profile-cycle-down", RATBAG_BUTTON_ACTION_SPECIAL_PROFILE_CYCLE_DOWN},
-		{ "profile-up", RATBAG_BUTTON_ACTION_SPECIAL_PROFILE_UP},
-		{ "profile-down", RATBAG_BUTTON_ACTION_SPECIAL_PROFILE_DOWN},
-		{ "second-mode", RATBAG_BUTTON_ACTION_SPECIAL_SECOND_MODE},
-		{ "battery-level", RATBAG_BUTTON_ACTION_SPECIAL_BATTERY_LEVEL},
-	};
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
 
-	for (size_t i = 0; i < ARRAY_LENGTH(lut); i++) {
-		if (streq(string, lut[i].key))
-			return lut[i].special;
+/* Decodes the escape sequence after the backslash into out, returns the
+ * number of bytes written or 0 if the sequence is invalid. Surrogate
+ * pairs are not supported, nothing we parse needs them. */
+static size_t
+json_unescape(struct json_parser *p, char out[3])
+{
+	unsigned int cp = 0;
+
+	switch (*p->pos++) {
+	case '"': out[0] = '"'; return 1;
+	case '\\': out[0] = '\\'; return 1;
+	case '/': out[0] = '/'; return 1;
+	case 'b': out[0] = '\b'; return 1;
+	case 'f': out[0] = '\f'; return 1;
+	case 'n': out[0] = '\n'; return 1;
+	case 'r': out[0] = '\r'; return 1;
+	case 't': out[0] = '\t'; return 1;
+	case 'u':
+		for (int i = 0; i < 4; i++) {
+			int d = json_hex_digit(*p->pos);
+
+			if (d < 0)
+				return 0;
+			cp = (cp << 4) | d;
+			p->pos++;
+		}
+		break;
+	default:
+		return 0;
 	}
 
-	parser_error("special");
+	if (cp == 0 || (cp >= 0xd800 && cp <= 0xdfff))
+		return 0;
 
-out:
-	return RATBAG_BUTTON_ACTION_SPECIAL_INVALID;
+	if (cp < 0x80) {
+		out[0] = cp;
+		return 1;
+	} else if (cp < 0x800) {
+		out[0] = 0xc0 | (cp >> 6);
+		out[1] = 0x80 | (cp & 0x3f);
+		return 2;
+	}
+
+	out[0] = 0xe0 | (cp >> 12);
+	out[1] = 0x80 | ((cp >> 6) & 0x3f);
+	out[2] = 0x80 | (cp & 0x3f);
+	return 3;
 }
 
-static enum ratbag_button_action_type
-action_type_lookup(const char *string)
+/* Reads a string into buf as a NUL-terminated string and its length in
+ * len. With a NULL buf, the string is only skipped. */
+static bool
+json_read_string(struct json_parser *p, char *buf, size_t *len,
+		 const char *element)
 {
-	const struct {
-		const char *key;
-		enum ratbag_button_action_type type;
-	} lut[] = {
-		{ "none", RATBAG_BUTTON_ACTION_TYPE_NONE},
-		{ "button", RATBAG_BUTTON_ACTION_TYPE_BUTTON},
-		{ "special", RATBAG_BUTTON_ACTION_TYPE_SPECIAL},
-		{ "key", RATBAG_BUTTON_ACTION_TYPE_KEY},
-		{ "macro", RATBAG_BUTTON_ACTION_TYPE_MACRO},
-		{ "unknown", RATBAG_BUTTON_ACTION_TYPE_UNKNOWN},
-	};
+	size_t n = 0;
 
-	for (size_t i = 0; i < ARRAY_LENGTH(lut); i++) {
-		if (streq(string, lut[i].key))
-			return lut[i].type;
+	if (!json_expect(p, '"', element))
+		return false;
+
+	while (*p->pos != '"') {
+		char c[3];
+		size_t nc;
+
+		if (*p->pos == '\0' || (unsigned char)*p->pos < 0x20) {
+			parser_error(p, element);
+			return false;
+		}
+
+		if (*p->pos == '\\') {
+			p->pos++;
+			nc = json_unescape(p, c);
+			if (nc == 0) {
+				parser_error(p, element);
+				return false;
+			}
+		} else {
+			c[0] = *p->pos++;
+			nc = 1;
+		}
+
+		if (buf) {
+			if (n + nc >= JSON_MAX_STRING) {
+				parser_error(p, element);
+				return false;
+			}
+			memcpy(buf + n, c, nc);
+		}
+		n += nc;
 	}
+	p->pos++;
 
-	parser_error("action_type");
+	if (buf)
+		buf[n] = '\0';
+	if (len)
+		*len = n;
 
-out:
-	return RATBAG_BUTTON_ACTION_TYPE_UNKNOWN;
+	return true;
+}
+
+static bool
+json_read_int(struct json_parser *p, int min, int max, int *value,
+	      const char *element)
+{
+	bool negative = false;
+	long long v = 0;
+
+	if (p->error)
+		return false;
+
+	json_skip_ws(p);
+	if (*p->pos == '-') {
+		negative = true;
+		p->pos++;
+	}
+
+	if (*p->pos < '0' || *p->pos > '9')
+		goto error;
+
+	while (*p->pos >= '0' && *p->pos <= '9') {
+		v = v * 10 + (*p->pos++ - '0');
+		if (v > INT_MAX)
+			goto error;
+	}
+
+	/* integers only, nothing here takes fractions */
+	if (*p->pos == '.' || *p->pos == 'e' || *p->pos == 'E')
+		goto error;
+
+	if (negative)
+		v = -v;
+	if (v < min || v > max)
+		goto error;
+
+	*value = v;
+	return true;
+
+error:
+	parser_error(p, element);
+	return false;
+}
+
+static bool
+json_read_bool(struct json_parser *p, bool *value, const char *element)
+{
+	if (p->error)
+		return false;
+
+	if (json_accept_literal(p, "true")) {
+		*value = true;
+	} else if (json_accept_literal(p, "false")) {
+		*value = false;
+	} else {
+		parser_error(p, element);
+		return false;
+	}
+
+	return true;
+}
+
+static bool
+json_read_keyword(struct json_parser *p, struct keyword_table *table,
+		  int *value, const char *element)
+{
+	char buf[JSON_MAX_STRING];
+	size_t len;
+
+	if (!json_read_string(p, buf, &len, element))
+		return false;
+
+	if (!keyword_lookup(table, buf, len, value)) {
+		parser_error(p, element);
+		return false;
+	}
+
+	return true;
+}
+
+/* Call after the opening brace. Returns true if another member follows,
+ * with its key in p->key and its key's enum json_key in key. */
+static bool
+json_next_member(struct json_parser *p, bool *first, int *key)
+{
+	size_t len;
+
+	if (p->error)
+		return false;
+
+	if (json_accept(p, '}'))
+		return false;
+
+	if (!*first && !json_expect(p, ',', "object"))
+		return false;
+	*first = false;
+
+	if (!json_read_string(p, p->key, &len, "key") ||
+	    !json_expect(p, ':', p->key))
+		return false;
+
+	if (!keyword_lookup(&key_table, p->key, len, key))
+		*key = JSON_KEY_UNKNOWN;
+
+	return true;
+}
+
+/* Call after the opening bracket. Returns true if another element
+ * follows. */
+static bool
+json_next_element(struct json_parser *p, bool *first)
+{
+	if (p->error)
+		return false;
+
+	if (json_accept(p, ']'))
+		return false;
+
+	if (!*first && !json_expect(p, ',', "array"))
+		return false;
+	*first = false;
+
+	return true;
+}
+
+static void
+json_skip_value(struct json_parser *p, unsigned int depth)
+{
+	bool first = true;
+	int key;
+
+	if (p->error)
+		return;
+
+	if (depth > JSON_MAX_DEPTH) {
+		parser_error(p, p->key);
+		return;
+	}
+
+	json_skip_ws(p);
+	switch (*p->pos) {
+	case '{':
+		p->pos++;
+		while (json_next_member(p, &first, &key))
+			json_skip_value(p, depth + 1);
+		break;
+	case '[':
+		p->pos++;
+		while (json_next_element(p, &first))
+			json_skip_value(p, depth + 1);
+		break;
+	case '"':
+		json_read_string(p, NULL, NULL, "string");
+		break;
+	default:
+		if (json_accept_literal(p, "true") ||
+		    json_accept_literal(p, "false") ||
+		    json_accept_literal(p, "null"))
+			break;
+
+		/* a number, or garbage */
+		if (*p->pos == '-')
+			p->pos++;
+		if (*p->pos < '0' || *p->pos > '9') {
+			parser_error(p, "value");
+			break;
+		}
+		while ((*p->pos >= '0' && *p->pos <= '9') ||
+		       *p->pos == '.' || *p->pos == 'e' || *p->pos == 'E' ||
+		       *p->pos == '+' || *p->pos == '-')
+			p->pos++;
+		break;
+	}
+}
+
+/* Reads an array of ints into values, the array stays zero-terminated */
+static void
+json_read_int_array(struct json_parser *p, uint32_t *values, size_t nvalues,
+		    int min, int max, const char *element)
+{
+	bool first = true;
+	size_t idx = 0;
+	int v;
+
+	if (!json_expect(p, '[', element))
+		return;
+
+	while (json_next_element(p, &first)) {
+		if (idx >= nvalues - 1) {
+			parser_error(p, element);
+			return;
+		}
+
+		if (json_read_int(p, min, max, &v, element))
+			values[idx++] = v;
+	}
+}
+
+/*
+ * The test device
+ */
+
+static void
+parse_resolution(struct json_parser *p,
+		 struct ratbag_test_resolution *resolution)
+{
+	bool first = true;
+	int key;
+
+	if (!json_expect(p, '{', "resolution"))
+		return;
+
+	while (json_next_member(p, &first, &key)) {
+		switch (key) {
+		case JSON_KEY_XRES:
+			json_read_int(p, 0, 20000, &resolution->xres, "xres");
+			log_verbose("json:    xres: %d\n", resolution->xres);
+			break;
+		case JSON_KEY_YRES:
+			json_read_int(p, 0, 20000, &resolution->yres, "yres");
+			log_verbose("json:    yres: %d\n", resolution->yres);
+			break;
+		case JSON_KEY_DPI_MIN:
+			json_read_int(p, 0, 20000, &resolution->dpi_min, "dpi_min");
+			log_verbose("json:    dpi_min: %d\n", resolution->dpi_min);
+			break;
+		case JSON_KEY_DPI_MAX:
+			json_read_int(p, 0, 20000, &resolution->dpi_max, "dpi_max");
+			log_verbose("json:    dpi_max: %d\n", resolution->dpi_max);
+			break;
+		case JSON_KEY_IS_ACTIVE:
+			json_read_bool(p, &resolution->active, "is_active");
+			log_verbose("json:    is_active: %d\n", resolution->active);
+			break;
+		case JSON_KEY_IS_DEFAULT:
+			json_read_bool(p, &resolution->dflt, "is_default");
+			log_verbose("json:    is_default: %d\n", resolution->dflt);
+			break;
+		case JSON_KEY_IS_DISABLED:
+			json_read_bool(p, &resolution->disabled, "is_disabled");
+			log_verbose("json:    is_disabled: %d\n", resolution->disabled);
+			break;
+		case JSON_KEY_CAPABILITIES:
+			json_read_int_array(p, resolution->caps,
+					    ARRAY_LENGTH(resolution->caps),
+					    0, RATBAG_RESOLUTION_CAP_DISABLE,
+					    "capabilities");
+			log_verbose("json:    caps: %d %d %d %d %d...\n",
+				    resolution->caps[0],
+				    resolution->caps[1],
+				    resolution->caps[2],
+				    resolution->caps[3],
+				    resolution->caps[4]);
+			break;
+		default:
+			log_error("json:    unknown resolution key '%s'\n", p->key);
+			p->error = -EINVAL;
+			break;
+		}
+	}
+}
+
+static void
+parse_led(struct json_parser *p, struct ratbag_test_led *led)
+{
+	bool first = true;
+	int key, v;
+
+	if (!json_expect(p, '{', "led"))
+		return;
+
+	while (json_next_member(p, &first, &key)) {
+		switch (key) {
+		case JSON_KEY_MODE:
+			if (json_read_int(p, 0, RATBAG_LED_BREATHING, &v, "mode"))
+				led->mode = v;
+			log_verbose("json:    mode: %d\n", led->mode);
+			break;
+		case JSON_KEY_DURATION:
+			if (json_read_int(p, 0, 10000, &v, "duration"))
+				led->ms = v;
+			log_verbose("json:    duration: %d\n", led->ms);
+			break;
+		case JSON_KEY_BRIGHTNESS:
+			if (json_read_int(p, 0, 100, &v, "brightness"))
+				led->brightness = v;
+			log_verbose("json:    brightness: %d\n", led->brightness);
+			break;
+		case JSON_KEY_COLOR: {
+			uint32_t color[4] = {0};
+			bool f = true;
+			size_t n = 0;
+
+			if (!json_expect(p, '[', "color"))
+				break;
+			while (json_next_element(p, &f)) {
+				if (n >= 3) {
+					parser_error(p, "color");
+					break;
+				}
+				if (json_read_int(p, 0, 255, &v, "color"))
+					color[n++] = v;
+			}
+			if (n != 3) {
+				parser_error(p, "color");
+				break;
+			}
+
+			led->color.red = color[0];
+			led->color.green = color[1];
+			led->color.blue = color[2];
+			log_verbose("json:    color: %02x%02x%02x\n",
+				    led->color.red,
+				    led->color.green,
+				    led->color.blue);
+			break;
+		}
+		default:
+			log_error("json:    unknown led key '%s'\n", p->key);
+			p->error = -EINVAL;
+			break;
+		}
+	}
 }
 
 static inline struct ratbag_test_macro_event
-parse_macro(const char *m)
+parse_macro(struct json_parser *p, const char *m)
 {
 	struct ratbag_test_macro_event event = {
 		.type = RATBAG_MACRO_EVENT_INVALID,
@@ -321,7 +839,7 @@ parse_macro(const char *m)
 		log_verbose("json:     macro: t%d\n", event.value);
 		break;
 	default:
-		parser_error("macro");
+		parser_error(p, "macro");
 		break;
 	}
 
@@ -329,232 +847,229 @@ out:
 	return event;
 }
 
-
-static void parse_button_member(JsonObject *obj, const gchar *name,
-				JsonNode *node, void *data)
+static void
+parse_button(struct json_parser *p, struct ratbag_test_button *button)
 {
-	struct ratbag_test_button *button = data;
-
-	if (streq(name, "action_type")) {
-		const gchar* v = json_object_get_string_member(obj, name);
-		button->action_type = action_type_lookup(v);
-		log_verbose("json:    action_type: %s\n", v);
-	} else if (streq(name, "button")) {
-		gint v = json_object_get_int_member(obj, name);
-
-		if (v < 0 || v > 32)
-			parser_error("button");
-
-		button->button = v;
-		log_verbose("json:    button: %d\n", v);
-	} else if (streq(name, "key")) {
-		gint v = json_object_get_int_member(obj, name);
-
-		if (v < 0 || v > KEY_MAX)
-			parser_error("key");
-
-		button->key = v;
-		log_verbose("json:    key: %d\n", v);
-	} else if (streq(name, "special")) {
-		const gchar *v = json_object_get_string_member(obj, name);
-		button->special = special_lookup(v);
-		log_verbose("json:    special: %s\n", v);
-	} else if (streq(name, "macro")) {
-		JsonArray *a = json_object_get_array_member(obj, name);
-
-		assert(json_array_get_length(a) < ARRAY_LENGTH(button->macro));
-		for (size_t s = 0; s < json_array_get_length(a); s++) {
-			const gchar *v = json_array_get_string_element(a, s);
-			button->macro[s] = parse_macro(v);
+	char buf[JSON_MAX_STRING];
+	bool first = true;
+	int key, v;
+
+	if (!json_expect(p, '{', "button"))
+		return;
+
+	while (json_next_member(p, &first, &key)) {
+		switch (key) {
+		case JSON_KEY_ACTION_TYPE:
+			if (json_read_keyword(p, &action_type_table, &v, "action_type"))
+				button->action_type = v;
+			log_verbose("json:    action_type: %d\n", button->action_type);
+			break;
+		case JSON_KEY_BUTTON:
+			json_read_int(p, 0, 32, &button->button, "button");
+			log_verbose("json:    button: %d\n", button->button);
+			break;
+		case JSON_KEY_KEY:
+			json_read_int(p, 0, KEY_MAX, &button->key, "key");
+			log_verbose("json:    key: %d\n", button->key);
+			break;
+		case JSON_KEY_SPECIAL:
+			if (json_read_keyword(p, &special_table, &v, "special"))
+				button->special = v;
+			log_verbose("json:    special: %#x\n", button->special);
+			break;
+		case JSON_KEY_MACRO: {
+			bool f = true;
+			size_t n = 0;
+
+			if (!json_expect(p, '[', "macro"))
+				break;
+			while (json_next_element(p, &f)) {
+				if (n >= ARRAY_LENGTH(button->macro) - 1) {
+					parser_error(p, "macro");
+					break;
+				}
+				if (json_read_string(p, buf, NULL, "macro"))
+					button->macro[n++] = parse_macro(p, buf);
+			}
+			break;
+		}
+		default:
+			log_error("json: unknown button key '%s'\n", p->key);
+			p->error = -EINVAL;
+			break;
 		}
-	} else {
-		log_error("json: unknown button key '%s'\n", name);
-		parse_error = -EINVAL;
 	}
-out:
-	return;
 }
 
-static void parse_button(JsonNode *node, struct ratbag_test_button *button)
+static void
+parse_profile(struct json_parser *p, struct ratbag_test_profile *profile)
 {
-	JsonObject *obj = json_node_get_object(node);
-
-	json_object_foreach_member(obj, parse_button_member, button);
-}
-
-static void parse_profile_member(JsonObject *obj, const gchar *name,
-				 JsonNode *node, void *data)
-{
-	struct ratbag_test_profile *profile = data;
-
-	if (streq(name, "name")) {
-		const char *v = json_object_get_string_member(obj, name);
-
-		if (v == NULL)
-			parser_error("name");
-
-		free(profile->name);
-		profile->name = strdup_safe(v);
-		log_verbose("name: %s\n", v);
-	} else if (streq(name, "is_default")) {
-		gboolean v = json_object_get_boolean_member(obj, name);
-		profile->dflt = v;
-		log_verbose("json:  is_default: %d\n", v);
-	} else if (streq(name, "is_active")) {
-		gboolean v = json_object_get_boolean_member(obj, name);
-		profile->active = v;
-		log_verbose("json:  is_active: %d\n", v);
-	} else if (streq(name, "is_disabled")) {
-		gboolean v = json_object_get_boolean_member(obj, name);
-		profile->disabled = v;
-		log_verbose("json:  is_disabled: %d\n", v);
-	} else if (streq(name, "rate")) {
-		gboolean v = json_object_get_int_member(obj, name);
-
-		if (v < 0 || v > 20000)
-			parser_error("rate");
-
-		profile->hz = v;
-		log_verbose("json:  rate: %d\n", v);
-	} else if (streq(name, "report_rates")) {
-		JsonArray *a = json_object_get_array_member(obj, name);
-		assert(json_array_get_length(a) < ARRAY_LENGTH(profile->report_rates));
-		for (size_t s = 0; s < json_array_get_length(a); s++) {
-			int v = json_array_get_int_element(a, s);
-			if (v < 0 || v > 20000)
-				parser_error("report_rate");
-			profile->report_rates[s] = v;
-		}
-
-		log_verbose("json:  report rates: %d %d %d %d %d\n",
-			    profile->report_rates[0],
-			    profile->report_rates[1],
-			    profile->report_rates[2],
-			    profile->report_rates[3],
-			    profile->report_rates[4]);
-	} else if (streq(name, "capabilities")) {
-		JsonArray *a = json_object_get_array_member(obj, name);
-
-		assert(json_array_get_length(a) < ARRAY_LENGTH(profile->caps));
-		for (size_t s = 0; s < json_array_get_length(a); s++) {
-			int v = json_array_get_int_element(a, s);
-			profile->caps[s] = v;
+	char buf[JSON_MAX_STRING];
+	bool first = true;
+	int key;
+
+	if (!json_expect(p, '{', "profile"))
+		return;
+
+	while (json_next_member(p, &first, &key)) {
+		bool f = true;
+		unsigned int idx = 0;
+
+		switch (key) {
+		case JSON_KEY_NAME:
+			if (!json_read_string(p, buf, NULL, "name"))
+				break;
+
+			free(profile->name);
+			profile->name = strdup_safe(buf);
+			log_verbose("name: %s\n", buf);
+			break;
+		case JSON_KEY_IS_DEFAULT:
+			json_read_bool(p, &profile->dflt, "is_default");
+			log_verbose("json:  is_default: %d\n", profile->dflt);
+			break;
+		case JSON_KEY_IS_ACTIVE:
+			json_read_bool(p, &profile->active, "is_active");
+			log_verbose("json:  is_active: %d\n", profile->active);
+			break;
+		case JSON_KEY_IS_DISABLED:
+			json_read_bool(p, &profile->disabled, "is_disabled");
+			log_verbose("json:  is_disabled: %d\n", profile->disabled);
+			break;
+		case JSON_KEY_RATE:
+			json_read_int(p, 0, 20000, &profile->hz, "rate");
+			log_verbose("json:  rate: %d\n", profile->hz);
+			break;
+		case JSON_KEY_REPORT_RATES:
+			json_read_int_array(p, profile->report_rates,
+					    ARRAY_LENGTH(profile->report_rates),
+					    0, 20000, "report_rate");
+			log_verbose("json:  report rates: %d %d %d %d %d\n",
+				    profile->report_rates[0],
+				    profile->report_rates[1],
+				    profile->report_rates[2],
+				    profile->report_rates[3],
+				    profile->report_rates[4]);
+			break;
+		case JSON_KEY_CAPABILITIES:
+			json_read_int_array(p, profile->caps,
+					    ARRAY_LENGTH(profile->caps),
+					    0, INT_MAX, "capabilities");
+			log_verbose("json:  caps: %d %d %d %d %d...\n",
+				    profile->caps[0],
+				    profile->caps[1],
+				    profile->caps[2],
+				    profile->caps[3],
+				    profile->caps[4]);
+			break;
+		case JSON_KEY_RESOLUTIONS:
+			if (!json_expect(p, '[', "resolutions"))
+				break;
+			while (json_next_element(p, &f)) {
+				if (idx >= RATBAG_TEST_MAX_RESOLUTIONS) {
+					parser_error(p, "resolutions");
+					break;
+				}
+				log_verbose("json:  processing resolution %d\n", idx);
+				parse_resolution(p, &profile->resolutions[idx++]);
+			}
+			p->num_resolutions = max(idx, p->num_resolutions);
+			break;
+		case JSON_KEY_LEDS:
+			if (!json_expect(p, '[', "leds"))
+				break;
+			while (json_next_element(p, &f)) {
+				if (idx >= RATBAG_TEST_MAX_LEDS) {
+					parser_error(p, "leds");
+					break;
+				}
+				log_verbose("json:  processing LED %d\n", idx);
+				parse_led(p, &profile->leds[idx++]);
+			}
+			p->num_leds = max(idx, p->num_leds);
+			break;
+		case JSON_KEY_BUTTONS:
+			if (!json_expect(p, '[', "buttons"))
+				break;
+			while (json_next_element(p, &f)) {
+				if (idx >= RATBAG_TEST_MAX_BUTTONS) {
+					parser_error(p, "buttons");
+					break;
+				}
+				log_verbose("json:  processing button %d\n", idx);
+				parse_button(p, &profile->buttons[idx++]);
+			}
+			p->num_buttons = max(idx, p->num_buttons);
+			break;
+		default:
+			log_error("json: unknown profile key '%s'\n", p->key);
+			p->error = -EINVAL;
+			break;
 		}
-
-		log_verbose("json:  caps: %d %d %d %d %d...\n",
-			    profile->caps[0],
-			    profile->caps[1],
-			    profile->caps[2],
-			    profile->caps[3],
-			    profile->caps[4]);
-	} else if (streq(name, "resolutions")) {
-		JsonArray *a = json_object_get_array_member(obj, name);
-		GList *list = json_array_get_elements(a);
-		GList *l = list;
-		int idx = 0;
-		while (l != NULL) {
-			log_verbose("json:  processing resolution %d\n", idx);
-			parse_resolution(l->data, &profile->resolutions[idx]);
-			l = g_list_next(l);
-			idx++;
-		}
-		g_list_free(list);
-		num_resolutions = max(idx, num_resolutions);
-	} else if (streq(name, "leds")) {
-		JsonArray *a = json_object_get_array_member(obj, name);
-		GList *list = json_array_get_elements(a);
-		GList *l = list;
-		int idx = 0;
-		while (l != NULL) {
-			log_verbose("json:  processing LED %d\n", idx);
-			parse_led(l->data, &profile->leds[idx]);
-			l = g_list_next(l);
-			idx++;
-		}
-		g_list_free(list);
-		num_leds = max(idx, num_leds);
-	} else if (streq(name, "buttons")) {
-		JsonArray *a = json_object_get_array_member(obj, name);
-		GList *list = json_array_get_elements(a);
-		GList *l = list;
-		int idx = 0;
-		while (l != NULL) {
-			log_verbose("json:  processing button %d\n", idx);
-			parse_button(l->data, &profile->buttons[idx]);
-			l = g_list_next(l);
-			idx++;
-		}
-		g_list_free(list);
-		num_buttons = max(idx, num_buttons);
-	} else {
-		log_error("json: unknown profile key '%s'\n", name);
-		parse_error = -EINVAL;
 	}
-out:
-	return;
-}
-
-static void parse_profile(JsonNode *node,
-			 struct ratbag_test_profile *profile)
-{
-	JsonObject *obj = json_node_get_object(node);
-
-	json_object_foreach_member(obj, parse_profile_member, profile);
 }
 
 /* declared here because this isn't really public API, we just need to
  * access it from the tests */
 int ratbagd_parse_json(const char *data, struct ratbag_test_device *device)
 {
-	g_autoptr(JsonParser) parser = NULL;
-	JsonNode *root;
-	JsonObject *obj;
-	JsonArray *arr;
-	int r = -EINVAL;
-	g_autoptr(GError) error = NULL;
-	g_autoptr(GList) list = NULL;
-
-	error = 0;
-	parser = json_parser_new();
-	if (!json_parser_load_from_data(parser, data, strlen(data), &error)) {
-		log_error("Failed to load JSON: %s\n", error->message);
-		r = -EINVAL;
-		goto out;
-	}
+	struct json_parser parser = {
+		.data = data,
+		.pos = data,
+		/* Our test device is preloaded with sane defaults, let's
+		 * keep those */
+		.num_resolutions = device->num_resolutions,
+		.num_buttons = device->num_buttons,
+		.num_leds = device->num_leds,
+	};
+	struct json_parser *p = &parser;
+	unsigned int num_profiles = 0;
+	bool have_profiles = false;
+	bool first = true;
+	int key;
 
 	log_verbose("json: data: %s\n", data);
 
-	root = json_parser_get_root(parser);
-	if (JSON_NODE_TYPE(root) != JSON_NODE_OBJECT)
-		parser_error("root");
-
-	obj = json_node_get_object(root);
-	arr = json_object_get_array_member(obj, "profiles");
-	if (!arr)
-		parser_error("profiles");
-
-	/* Our test device is preloaded with sane defaults, let's keep those */
-	num_resolutions = device->num_resolutions;
-	num_buttons = device->num_buttons;
-	num_leds = device->num_leds;
-
-	list = json_array_get_elements(arr);
-	GList *l = list;
-	int idx = 0;
-	while (l != NULL) {
-		log_verbose("json: processing profile %d\n", idx);
-		parse_profile(l->data, &device->profiles[idx]);
-		if (parse_error != 0)
-			goto out;;
-		l = g_list_next(l);
-		idx++;
+	if (!json_expect(p, '{', "root"))
+		return p->error;
+
+	while (json_next_member(p, &first, &key)) {
+		bool f = true;
+
+		/* anything else at the top level is ignored */
+		if (key != JSON_KEY_PROFILES) {
+			json_skip_value(p, 0);
+			continue;
+		}
+
+		if (!json_expect(p, '[', "profiles"))
+			break;
+
+		num_profiles = 0;
+		while (json_next_element(p, &f)) {
+			if (num_profiles >= RATBAG_TEST_MAX_PROFILES) {
+				parser_error(p, "profiles");
+				break;
+			}
+			log_verbose("json: processing profile %d\n", num_profiles);
+			parse_profile(p, &device->profiles[num_profiles++]);
+		}
+		have_profiles = true;
 	}
-	device->num_profiles = idx;
-	device->num_resolutions = num_resolutions;
-	device->num_buttons = num_buttons;
-	device->num_leds = num_leds;
 
-	r = 0;
-out:
-	return r;
+	json_skip_ws(p);
+	if (*p->pos != '\0')
+		parser_error(p, "root");
+	if (!have_profiles)
+		parser_error(p, "profiles");
+
+	if (p->error)
+		return p->error;
+
+	device->num_profiles = num_profiles;
+	device->num_resolutions = p->num_resolutions;
+	device->num_buttons = p->num_buttons;
+	device->num_leds = p->num_leds;
+
+	return 0;
 }
@@ -26,3 +26,7 @@
 #include "libratbag-test.h"
 
 int ratbagd_parse_json(const char *data, struct ratbag_test_device *device);
+
+/* Returns 0 if the keywords of every lookup table hash to distinct slots,
+ * or -EEXIST otherwise */
+int ratbagd_json_check_keywords(void);
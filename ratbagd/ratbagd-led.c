@@ -38,6 +38,8 @@ struct ratbagd_led {
 	unsigned int index;
 	char *path;
 	enum ratbag_led_colordepth colordepth;
+
+	struct ratbagd_u32_cache modes;
 };
 
 static int ratbagd_led_get_modes(sd_bus *bus,
@@ -49,18 +51,21 @@ static int ratbagd_led_get_modes(sd_bus *bus,
 				sd_bus_error *error)
 {
 	struct ratbagd_led *led = userdata;
-	enum ratbag_led_mode mode = 0;
+	unsigned int generation = ratbag_led_get_generation(led->lib_led);
 
-	CHECK_CALL(sd_bus_message_open_container(reply, 'a', "u"));
+	if (!ratbagd_u32_cache_is_valid(&led->modes, generation)) {
+		unsigned int modes[RATBAG_LED_BREATHING + 1];
+		size_t nmodes = 0;
 
+		for (enum ratbag_led_mode mode = 0; mode <= RATBAG_LED_BREATHING; mode++) {
+			if (ratbag_led_has_mode(led->lib_led, mode))
+				modes[nmodes++] = mode;
+		}
 
-	while (mode <= RATBAG_LED_BREATHING) {
-		if (ratbag_led_has_mode(led->lib_led, mode))
-			CHECK_CALL(sd_bus_message_append(reply, "u", mode));
-		mode++;
+		ratbagd_u32_cache_set(&led->modes, generation, modes, nmodes);
 	}
 
-	CHECK_CALL(sd_bus_message_close_container(reply));
+	CHECK_CALL(ratbagd_u32_cache_append(reply, &led->modes));
 
 	return 0;
 }
@@ -330,6 +335,7 @@ struct ratbagd_led *ratbagd_led_free(struct ratbagd_led *led)
 		return NULL;
 
 	led->path = mfree(led->path);
+	ratbagd_u32_cache_reset(&led->modes);
 	led->lib_led = ratbag_led_unref(led->lib_led);
 
 	return mfree(led);
@@ -60,6 +60,9 @@ struct ratbagd_profile {
 	sd_bus_slot *led_enum_slot;
 	unsigned int n_leds;
 	struct ratbagd_led **leds;
+
+	struct ratbagd_u32_cache report_rates;
+	struct ratbagd_u32_cache debounces;
 };
 
 static int ratbagd_profile_find_resolution(sd_bus *bus,
@@ -82,6 +85,9 @@ static int ratbagd_profile_find_resolution(sd_bus *bus,
 	if (r <= 0)
 		return r;
 
+	if (ratbagd_device_is_busy(profile->device))
+		return -EBUSY;
+
 	r = safe_atou(name, &index);
 	if (r < 0)
 		return 0;
@@ -235,6 +241,9 @@ static int ratbagd_profile_find_button(sd_bus *bus,
 	if (r <= 0)
 		return r;
 
+	if (ratbagd_device_is_busy(profile->device))
+		return -EBUSY;
+
 	r = safe_atou(name, &index);
 	if (r < 0)
 		return 0;
@@ -266,6 +275,9 @@ static int ratbagd_profile_find_led(sd_bus *bus,
 	if (r <= 0)
 		return r;
 
+	if (ratbagd_device_is_busy(profile->device))
+		return -EBUSY;
+
 	r = safe_atou(name, &index);
 	if (r < 0)
 		return 0;
@@ -522,26 +534,23 @@ ratbagd_profile_get_report_rates(sd_bus *bus,
 {
 	struct ratbagd_profile *profile = userdata;
 	struct ratbag_profile *lib_profile = profile->lib_profile;
-	unsigned int rates[8];
-	unsigned int nrates = ARRAY_LENGTH(rates);
-	int r;
+	unsigned int generation = ratbag_profile_get_generation(lib_profile);
 
-	r = sd_bus_message_open_container(reply, 'a', "u");
-	if (r < 0)
-		return r;
+	if (!ratbagd_u32_cache_is_valid(&profile->report_rates, generation)) {
+		unsigned int rates[8];
+		unsigned int nrates = ARRAY_LENGTH(rates);
 
-	nrates = ratbag_profile_get_report_rate_list(lib_profile,
-						     rates, nrates);
-	assert(nrates <= ARRAY_LENGTH(rates));
+		nrates = ratbag_profile_get_report_rate_list(lib_profile,
+							     rates, nrates);
+		assert(nrates <= ARRAY_LENGTH(rates));
 
-	for (unsigned int i = 0; i < nrates; i++) {
-		verify_unsigned_int(rates[i]);
-		r = sd_bus_message_append(reply, "u", rates[i]);
-		if (r < 0)
-			return r;
+		for (unsigned int i = 0; i < nrates; i++)
+			verify_unsigned_int(rates[i]);
+
+		ratbagd_u32_cache_set(&profile->report_rates, generation, rates, nrates);
 	}
 
-	return sd_bus_message_close_container(reply);
+	return ratbagd_u32_cache_append(reply, &profile->report_rates);
 }
 
 static int
@@ -555,25 +564,22 @@ ratbagd_profile_get_debounces(sd_bus *bus,
 {
 	struct ratbagd_profile *profile = userdata;
 	struct ratbag_profile *lib_profile = profile->lib_profile;
-	unsigned int debounces[8];
-	unsigned int ndebounces = ARRAY_LENGTH(debounces);
-	int r;
+	unsigned int generation = ratbag_profile_get_generation(lib_profile);
 
-	r = sd_bus_message_open_container(reply, 'a', "u");
-	if (r < 0)
-		return r;
+	if (!ratbagd_u32_cache_is_valid(&profile->debounces, generation)) {
+		unsigned int debounces[8];
+		unsigned int ndebounces = ARRAY_LENGTH(debounces);
 
-	ndebounces = ratbag_profile_get_debounce_list(lib_profile, debounces, ndebounces);
-	assert(ndebounces <= ARRAY_LENGTH(debounces));
+		ndebounces = ratbag_profile_get_debounce_list(lib_profile, debounces, ndebounces);
+		assert(ndebounces <= ARRAY_LENGTH(debounces));
 
-	for (unsigned int i = 0; i < ndebounces; i++) {
-		verify_unsigned_int(debounces[i]);
-		r = sd_bus_message_append(reply, "u", debounces[i]);
-		if (r < 0)
-			return r;
+		for (unsigned int i = 0; i < ndebounces; i++)
+			verify_unsigned_int(debounces[i]);
+
+		ratbagd_u32_cache_set(&profile->debounces, generation, debounces, ndebounces);
 	}
 
-	return sd_bus_message_close_container(reply);
+	return ratbagd_u32_cache_append(reply, &profile->debounces);
 }
 
 static int
@@ -830,6 +836,9 @@ struct ratbagd_profile *ratbagd_profile_free(struct ratbagd_profile *profile)
 	mfree(profile->buttons);
 	mfree(profile->resolutions);
 
+	ratbagd_u32_cache_reset(&profile->report_rates);
+	ratbagd_u32_cache_reset(&profile->debounces);
+
 	profile->path = mfree(profile->path);
 	profile->lib_profile = ratbag_profile_unref(profile->lib_profile);
 
@@ -43,6 +43,8 @@ struct ratbagd_resolution {
 	struct ratbag_resolution *lib_resolution;
 	unsigned int index;
 	char *path;
+
+	struct ratbagd_u32_cache dpis;
 };
 
 int ratbagd_resolution_resync(sd_bus *bus,
@@ -224,26 +226,29 @@ ratbagd_resolution_get_resolutions(sd_bus *bus,
 {
 	struct ratbagd_resolution *resolution = userdata;
 	struct ratbag_resolution *lib_resolution = resolution->lib_resolution;
-	unsigned int dpis[300];
-	unsigned int ndpis = ARRAY_LENGTH(dpis);
-	int r;
-
-	r = sd_bus_message_open_container(reply, 'a', "u");
-	if (r < 0)
-		return r;
+	unsigned int generation = ratbag_resolution_get_generation(lib_resolution);
+
+	if (!ratbagd_u32_cache_is_valid(&resolution->dpis, generation)) {
+		unsigned int dpis[300];
+		_cleanup_free_ unsigned int *heap = NULL;
+		const unsigned int *values = dpis;
+		size_t ndpis;
+
+		ndpis = ratbag_resolution_get_dpi_list(lib_resolution,
+						       dpis, ARRAY_LENGTH(dpis));
+		if (ndpis > ARRAY_LENGTH(dpis)) {
+			heap = zalloc(ndpis * sizeof(*heap));
+			ratbag_resolution_get_dpi_list(lib_resolution, heap, ndpis);
+			values = heap;
+		}
 
-	ndpis = ratbag_resolution_get_dpi_list(lib_resolution,
-					       dpis, ndpis);
-	assert(ndpis <= ARRAY_LENGTH(dpis));
+		for (size_t i = 0; i < ndpis; i++)
+			verify_unsigned_int(values[i]);
 
-	for (unsigned int i = 0; i < ndpis; i++) {
-		verify_unsigned_int(dpis[i]);
-		r = sd_bus_message_append(reply, "u", dpis[i]);
-		if (r < 0)
-			return r;
+		ratbagd_u32_cache_set(&resolution->dpis, generation, values, ndpis);
 	}
 
-	return sd_bus_message_close_container(reply);
+	return ratbagd_u32_cache_append(reply, &resolution->dpis);
 }
 
 static int
@@ -410,6 +415,7 @@ struct ratbagd_resolution *ratbagd_resolution_free(struct ratbagd_resolution *re
 		return NULL;
 
 	resolution->path = mfree(resolution->path);
+	ratbagd_u32_cache_reset(&resolution->dpis);
 	resolution->lib_resolution = ratbag_resolution_unref(resolution->lib_resolution);
 
 	return mfree(resolution);
@@ -30,6 +30,7 @@
 #include <systemd/sd-event.h>
 
 #include "libratbag-test.h"
+#include "libratbag-util.h"
 #include "ratbagd-json.h"
 
 static int load_test_device(sd_bus_message *m,
@@ -127,6 +128,101 @@ int ratbagd_load_test_device(sd_bus_message *m,
 	return sd_bus_reply_method_return(m, "i", r);
 }
 
+/* Devices added by GenerateTestDevices(), replaced on every call */
+static struct ratbagd_device **generated_devices;
+static unsigned int n_generated_devices;
+
+static void remove_generated_devices(void)
+{
+	for (unsigned int i = 0; i < n_generated_devices; i++) {
+		ratbagd_device_unlink(generated_devices[i]);
+		ratbagd_device_unref(generated_devices[i]);
+	}
+
+	generated_devices = mfree(generated_devices);
+	n_generated_devices = 0;
+}
+
+/* Enough to see how ratbagd scales, not enough to take the machine down */
+#define MAX_GENERATED_DEVICES 1000
+#define MAX_GENERATED_BUTTONS 256
+#define MAX_GENERATED_LEDS 64
+/* libratbag's device sanity check refuses anything outside 1..16 */
+#define MAX_GENERATED_PROFILES 16
+#define MAX_GENERATED_RESOLUTIONS 16
+
+int ratbagd_generate_test_devices(sd_bus_message *m,
+				  void *userdata,
+				  sd_bus_error *error)
+{
+	struct ratbagd *ctx = userdata;
+	unsigned int n_devices, n_profiles, n_resolutions, n_buttons, n_leds;
+
+	CHECK_CALL(sd_bus_message_read(m, "uuuuu", &n_devices, &n_profiles,
+				       &n_resolutions, &n_buttons, &n_leds));
+
+	if (n_devices > MAX_GENERATED_DEVICES ||
+	    n_buttons > MAX_GENERATED_BUTTONS ||
+	    n_leds > MAX_GENERATED_LEDS)
+		return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS,
+					 "At most %u devices, %u buttons and %u LEDs",
+					 MAX_GENERATED_DEVICES,
+					 MAX_GENERATED_BUTTONS,
+					 MAX_GENERATED_LEDS);
+
+	if (n_profiles < 1 || n_profiles > MAX_GENERATED_PROFILES ||
+	    n_resolutions < 1 || n_resolutions > MAX_GENERATED_RESOLUTIONS)
+		return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS,
+					 "Need 1 to %u profiles and 1 to %u resolutions",
+					 MAX_GENERATED_PROFILES,
+					 MAX_GENERATED_RESOLUTIONS);
+
+	remove_generated_devices();
+
+	generated_devices = zalloc(max(n_devices, 1U) * sizeof(*generated_devices));
+
+	for (unsigned int i = 0; i < n_devices; i++) {
+		struct ratbag_test_device *td;
+		struct ratbag_device *device;
+		struct ratbagd_device *d;
+		char devicename[64];
+		int r;
+
+		/* seeded with the index, the same call gives the same devices */
+		td = ratbag_test_device_generate(n_profiles, n_resolutions,
+						 n_buttons, n_leds, i);
+		device = ratbag_device_new_test_device(ctx->lib_ctx, td);
+		ratbag_test_device_free(td);
+		if (!device) {
+			log_error("Cannot create generated test device %u\n", i);
+			break;
+		}
+
+		snprintf(devicename, sizeof(devicename), "generated%u", i);
+		r = ratbagd_device_new(&d, ctx, devicename, device);
+
+		/* the ratbagd_device takes its own reference, drop ours */
+		ratbag_device_unref(device);
+
+		if (r < 0) {
+			log_error("Cannot track generated test device %u\n", i);
+			break;
+		}
+
+		ratbagd_device_link(d);
+		generated_devices[n_generated_devices++] = d;
+	}
+
+	/* once for all devices, not once per device */
+	(void) sd_bus_emit_properties_changed(ctx->bus,
+					      RATBAGD_OBJ_ROOT,
+					      RATBAGD_NAME_ROOT ".Manager",
+					      "Devices",
+					      NULL);
+
+	return sd_bus_reply_method_return(m, "u", n_generated_devices);
+}
+
 #endif
 
 void ratbagd_init_test_device(struct ratbagd *ctx)
@@ -138,3 +234,12 @@ void ratbagd_init_test_device(struct ratbagd *ctx)
 #endif
 }
 
+void ratbagd_free_test_devices(struct ratbagd *ctx)
+{
+#ifdef RATBAG_DEVELOPER_EDITION
+	/* the array holds our references, drop them before the device
+	 * list is torn down so nothing is left pointing at freed devices */
+	remove_generated_devices();
+#endif
+}
+
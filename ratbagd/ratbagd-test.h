@@ -27,6 +27,7 @@
 #include "ratbagd.h"
 
 void ratbagd_init_test_device(struct ratbagd *ctx);
+void ratbagd_free_test_devices(struct ratbagd *ctx);
 
 #ifdef RATBAG_DEVELOPER_EDITION
 int ratbagd_reset_test_device(sd_bus_message *m,
@@ -35,4 +36,7 @@ int ratbagd_reset_test_device(sd_bus_message *m,
 int ratbagd_load_test_device(sd_bus_message *m,
 			     void *userdata,
 			     sd_bus_error *error);
+int ratbagd_generate_test_devices(sd_bus_message *m,
+				  void *userdata,
+				  sd_bus_error *error);
 #endif /* RATBAG_DEVELOPER_EDITION */
@@ -32,8 +32,10 @@
 #include <libgen.h>
 #include <libratbag.h>
 #include <libudev.h>
+#include <malloc.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 #include <sys/resource.h>
 #include <systemd/sd-bus.h>
 #include <systemd/sd-event.h>
@@ -50,6 +52,14 @@ enum log_level {
 	LL_RAW,
 } log_level = LL_INFO;
 
+#define TRACE_DEFAULT_RECORDS 4096
+
+/* number of HID trace records to keep, 0 if disabled */
+static unsigned int trace_records;
+static const char *cache_dir;
+static bool resident;
+static unsigned long memory_limit_kb;
+
 void log_info(const char *fmt, ...)
 {
 	va_list args;
@@ -81,6 +91,40 @@ void log_error(const char *fmt, ...)
 	va_end(args);
 }
 
+void ratbagd_u32_cache_set(struct ratbagd_u32_cache *cache,
+			   unsigned int generation,
+			   const unsigned int *values,
+			   size_t nvalues)
+{
+	_Static_assert(sizeof(*values) == sizeof(*cache->values), "type mismatch");
+
+	ratbagd_u32_cache_reset(cache);
+
+	if (nvalues > 0) {
+		cache->values = zalloc(nvalues * sizeof(*cache->values));
+		memcpy(cache->values, values, nvalues * sizeof(*cache->values));
+	}
+	cache->nvalues = nvalues;
+	cache->generation = generation;
+	cache->valid = true;
+}
+
+void ratbagd_u32_cache_reset(struct ratbagd_u32_cache *cache)
+{
+	cache->values = mfree(cache->values);
+	cache->nvalues = 0;
+	cache->valid = false;
+}
+
+int ratbagd_u32_cache_append(sd_bus_message *reply,
+			     const struct ratbagd_u32_cache *cache)
+{
+	assert(cache->valid);
+
+	return sd_bus_message_append_array(reply, 'u', cache->values,
+					   cache->nvalues * sizeof(*cache->values));
+}
+
 static int ratbagd_find_device(sd_bus *bus,
 			       const char *path,
 			       const char *interface,
@@ -103,6 +147,10 @@ static int ratbagd_find_device(sd_bus *bus,
 	if (!device)
 		return 0;
 
+	/* the device belongs to an ApplyToDevices() commit until it is done */
+	if (ratbagd_device_is_busy(device))
+		return -EBUSY;
+
 	*found = device;
 	return 1;
 }
@@ -165,12 +213,39 @@ static int ratbagd_get_devices(sd_bus *bus,
 	return 0;
 }
 
+static int ratbagd_dump_trace(sd_bus_message *m,
+			      void *userdata,
+			      sd_bus_error *error)
+{
+	struct ratbagd *ctx = userdata;
+	_cleanup_close_ int fd = -1;
+	int r;
+
+	fd = memfd_create("ratbagd-trace", MFD_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	r = ratbag_trace_write(ctx->lib_ctx, fd);
+	if (r < 0)
+		return r;
+
+	if (lseek(fd, 0, SEEK_SET) < 0)
+		return -errno;
+
+	/* sd-bus duplicates the fd, ours is closed on return */
+	return sd_bus_reply_method_return(m, "h", fd);
+}
+
 static const sd_bus_vtable ratbagd_vtable[] = {
 	SD_BUS_VTABLE_START(0),
 	SD_BUS_PROPERTY("APIVersion", "i", 0, offsetof(struct ratbagd, api_version), SD_BUS_VTABLE_PROPERTY_CONST),
 	SD_BUS_PROPERTY("Devices", "ao", ratbagd_get_devices, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+	SD_BUS_METHOD("DumpTrace", "", "h", ratbagd_dump_trace, 0),
+	SD_BUS_METHOD("ApplyToDevices", "aoay", "u", ratbagd_apply_to_devices, 0),
+	SD_BUS_SIGNAL("DeviceApplied", "oi", 0),
 #ifdef RATBAG_DEVELOPER_EDITION
 	SD_BUS_METHOD("LoadTestDevice", "s", "i", ratbagd_load_test_device, SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_METHOD("GenerateTestDevices", "uuuuu", "u", ratbagd_generate_test_devices, SD_BUS_VTABLE_UNPRIVILEGED),
 #endif /* RATBAG_DEVELOPER_EDITION */
 	SD_BUS_VTABLE_END,
 };
@@ -283,6 +358,11 @@ static struct ratbagd *ratbagd_free(struct ratbagd *ctx)
 	if (!ctx)
 		return NULL;
 
+	/* waits for running commits, the devices must still be around */
+	ctx->apply = ratbagd_apply_free(ctx->apply);
+
+	ratbagd_free_test_devices(ctx);
+
 	RATBAGD_DEVICE_FOREACH_SAFE(device, tmp, ctx) {
 		ratbagd_device_unlink(device);
 		ratbagd_device_unref(device);
@@ -372,10 +452,29 @@ static int ratbagd_new(struct ratbagd **out)
 		ratbag_log_set_priority(ctx->lib_ctx,
 					RATBAG_LOG_PRIORITY_DEBUG);
 
+	if (trace_records > 0) {
+		log_verbose("Tracing the last %u HID reports\n", trace_records);
+		r = ratbag_trace_enable(ctx->lib_ctx, trace_records);
+		if (r < 0)
+			return r;
+	}
+
+	if (cache_dir) {
+		log_verbose("Caching device state in %s\n", cache_dir);
+		r = ratbag_cache_enable(ctx->lib_ctx, cache_dir);
+		if (r < 0)
+			log_error("Failed to enable the cache in %s: %s\n",
+				  cache_dir, strerror(-r));
+	}
+
 	r = ratbagd_init_monitor(ctx);
 	if (r < 0)
 		return r;
 
+	r = ratbagd_apply_new(&ctx->apply, ctx);
+	if (r < 0)
+		return r;
+
 	r = sd_bus_open_system(&ctx->bus);
 	if (r < 0)
 		return r;
@@ -399,6 +498,16 @@ static int ratbagd_new(struct ratbagd **out)
 	if (r < 0)
 		return r;
 
+	r = sd_bus_add_fallback_vtable(ctx->bus,
+				       NULL,
+				       RATBAGD_OBJ_ROOT "/device",
+				       RATBAGD_NAME_ROOT ".Stats",
+				       ratbagd_device_stats_vtable,
+				       ratbagd_find_device,
+				       ctx);
+	if (r < 0)
+		return r;
+
 	r = sd_bus_add_node_enumerator(ctx->bus,
 				       NULL,
 				       RATBAGD_OBJ_ROOT "/device",
@@ -464,8 +573,58 @@ exit:
 	return r;
 }
 
+static unsigned long ratbagd_get_rss_kb(void)
+{
+	FILE *fp;
+	unsigned long size, rss;
+	int n;
+
+	fp = fopen("/proc/self/statm", "re");
+	if (!fp)
+		return 0;
+
+	n = fscanf(fp, "%lu %lu", &size, &rss);
+	fclose(fp);
+	if (n != 2)
+		return 0;
+
+	return rss * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* Returns true if ratbagd can stay resident */
+static bool ratbagd_suspend(struct ratbagd *ctx)
+{
+	struct ratbagd_device *device;
+	unsigned long rss_kb;
+
+	RATBAGD_DEVICE_FOREACH(device, ctx)
+		ratbagd_device_suspend(device);
+
+	malloc_trim(0);
+
+	if (memory_limit_kb == 0)
+		return true;
+
+	rss_kb = ratbagd_get_rss_kb();
+	if (rss_kb > memory_limit_kb) {
+		log_info("Resident size %lu kB exceeds the limit of %lu kB\n",
+			 rss_kb, memory_limit_kb);
+		return false;
+	}
+
+	return true;
+}
+
 static int on_timeout_cb(sd_event_source *s, uint64_t usec, void *userdata)
 {
+	struct ratbagd *ctx = userdata;
+
+	if (resident && ratbagd_suspend(ctx)) {
+		log_verbose("Suspending devices after idle\n");
+		ctx->idle_suspended = true;
+		return 0;
+	}
+
 	log_info("Exiting after idle\n");
 	sd_event_exit(sd_event_source_get_event(s), 0);
 	return 0;
@@ -481,6 +640,18 @@ static int before_idle_cb(sd_event_source *s, void *userdata)
 	usec += min2us(20);
 	sd_event_source_set_time(ctx->timeout_source, usec);
 
+	/* The timer is a oneshot source and disabled once it fired. In
+	 * resident mode we keep running, so arm it again for the next idle
+	 * period - but not for the post dispatch of the timeout itself,
+	 * otherwise we'd wake up every 20 minutes for nothing. The next
+	 * real event re-arms it.
+	 */
+	if (ctx->idle_suspended) {
+		ctx->idle_suspended = false;
+		return 0;
+	}
+	sd_event_source_set_enabled(ctx->timeout_source, SD_EVENT_ONESHOT);
+
 	return 0;
 }
 
@@ -509,7 +680,10 @@ static int ratbagd_run(struct ratbagd *ctx)
 
 	/* exit-on-idle: we set up a timer to simply exit. Since we don't
 	 * store anything, it doesn't matter and we can just restart next
-	 * time someone wants us.
+	 * time someone wants us. With --resident, we release the device
+	 * nodes instead and keep the device state, the nodes are reopened
+	 * on the next commit. The timer is re-armed by the next event after
+	 * that, so every later idle period suspends the devices again.
 	 *
 	 * since we don't want to monitor every single dbus call, we just
 	 * set up a post source that gets called before we go idle. That
@@ -625,21 +799,39 @@ int main(int argc, char *argv[])
 	setrlimit(RLIMIT_CORE, &corelimit);
 #endif
 
-	if (argc > 1) {
-		if (streq(argv[1], "--version")) {
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		char *end;
+
+		if (streq(arg, "--version")) {
 			printf("%s\n", RATBAG_VERSION);
 			return 0;
-		} else if (streq(argv[1], "--quiet")) {
+		} else if (streq(arg, "--quiet")) {
 			log_level = LL_QUIET;
-		} else if (streq(argv[1], "--verbose") || streq(argv[1], "--verbose=raw")) {
+		} else if (streq(arg, "--verbose") || streq(arg, "--verbose=raw")) {
 			log_level = LL_RAW;
-		} else if (streq(argv[1], "--verbose=debug")) {
+		} else if (streq(arg, "--verbose=debug")) {
 			log_level = LL_VERBOSE;
+		} else if (streq(arg, "--trace")) {
+			trace_records = TRACE_DEFAULT_RECORDS;
+		} else if (strneq(arg, "--trace=", 8)) {
+			errno = 0;
+			trace_records = strtoul(arg + 8, &end, 10);
+			if (errno || *end != '\0' || end == arg + 8)
+				goto usage;
+		} else if (streq(arg, "--resident")) {
+			resident = true;
+		} else if (strneq(arg, "--memory-limit=", 15)) {
+			errno = 0;
+			memory_limit_kb = strtoul(arg + 15, &end, 10) * 1024;
+			if (errno || *end != '\0' || end == arg + 15)
+				goto usage;
+		} else if (streq(arg, "--cache")) {
+			cache_dir = RATBAG_CACHE_DIR;
+		} else if (strneq(arg, "--cache=", 8) && arg[8] != '\0') {
+			cache_dir = arg + 8;
 		} else {
-			fprintf(stderr, "Usage: %s [--version | --quiet | --verbose[=debug]]\n",
-				program_invocation_short_name);
-			r = -EINVAL;
-			goto exit;
+			goto usage;
 		}
 	}
 
@@ -669,6 +861,12 @@ exit:
 	}
 
 	return EXIT_SUCCESS;
+
+usage:
+	fprintf(stderr, "Usage: %s [--version | --quiet | --verbose[=debug]] [--trace[=records]] [--cache[=directory]]\n"
+		"       [--resident [--memory-limit=MiB]]\n",
+		program_invocation_short_name);
+	return EXIT_FAILURE;
 }
 
 struct ratbagd_callback
@@ -53,6 +53,7 @@ struct ratbagd_profile;
 struct ratbagd_resolution;
 struct ratbagd_button;
 struct ratbagd_led;
+struct ratbagd_apply;
 
 void log_info(const char *fmt, ...) _printf_(1, 2);
 void log_verbose(const char *fmt, ...) _printf_(1, 2);
@@ -165,6 +166,7 @@ DEFINE_TRIVIAL_CLEANUP_FUNC(struct ratbagd_led *, ratbagd_led_free);
  */
 
 extern const sd_bus_vtable ratbagd_device_vtable[];
+extern const sd_bus_vtable ratbagd_device_stats_vtable[];
 
 int ratbagd_device_new(struct ratbagd_device **out,
 		       struct ratbagd *ctx,
@@ -177,6 +179,13 @@ const char *ratbagd_device_get_path(struct ratbagd_device *device);
 unsigned int ratbagd_device_get_num_buttons(struct ratbagd_device *device);
 unsigned int ratbagd_device_get_num_leds(struct ratbagd_device *device);
 int ratbagd_device_resync(struct ratbagd_device *device, sd_bus *bus);
+void ratbagd_device_suspend(struct ratbagd_device *device);
+bool ratbagd_device_is_busy(struct ratbagd_device *device);
+int ratbagd_device_stage(struct ratbagd_device *device,
+			 const void *data,
+			 size_t size);
+int ratbagd_device_commit_staged(struct ratbagd_device *device);
+void ratbagd_device_finish_commit(struct ratbagd_device *device, int result);
 
 bool ratbagd_device_linked(struct ratbagd_device *device);
 void ratbagd_device_link(struct ratbagd_device *device);
@@ -213,6 +222,39 @@ struct ratbagd_device *ratbagd_device_next(struct ratbagd_device *device);
 		return -EINVAL; \
 	} } while(0)
 
+/*
+ * Reply cache for array properties. Filled on first read and keyed by the
+ * generation of the libratbag object the values were read from, i.e. the
+ * cache is stale once ratbag_*_get_generation() returns something else.
+ *
+ * Only the array properties and the button macro are cached, as decoded
+ * values that are appended in one go. Get and GetAll still call the
+ * property getters: a pre-marshalled a{sv} has to be copied with
+ * sd_bus_message_copy(), which re-appends every element and is slower
+ * than the getters, see test/bench-ratbagd-properties.c.
+ */
+struct ratbagd_u32_cache {
+	uint32_t *values;
+	size_t nvalues;
+	unsigned int generation;
+	bool valid;
+};
+
+static inline bool
+ratbagd_u32_cache_is_valid(const struct ratbagd_u32_cache *cache,
+			   unsigned int generation)
+{
+	return cache->valid && cache->generation == generation;
+}
+
+void ratbagd_u32_cache_set(struct ratbagd_u32_cache *cache,
+			   unsigned int generation,
+			   const unsigned int *values,
+			   size_t nvalues);
+void ratbagd_u32_cache_reset(struct ratbagd_u32_cache *cache);
+int ratbagd_u32_cache_append(sd_bus_message *reply,
+			     const struct ratbagd_u32_cache *cache);
+
 /*
  * Context
  */
@@ -226,13 +268,26 @@ struct ratbagd {
 	sd_event_source *timeout_source;
 	sd_event_source *monitor_source;
 	sd_bus *bus;
+	bool idle_suspended; /* timeout fired, devices are suspended */
 
 	RBTree device_map;
 	size_t n_devices;
 
+	struct ratbagd_apply *apply;
+
 	const char **themes; /* NULL-terminated */
 };
 
+/*
+ * Parallel commits, see ratbagd-apply.c
+ */
+
+int ratbagd_apply_new(struct ratbagd_apply **out, struct ratbagd *ctx);
+struct ratbagd_apply *ratbagd_apply_free(struct ratbagd_apply *apply);
+int ratbagd_apply_to_devices(sd_bus_message *m,
+			     void *userdata,
+			     sd_bus_error *error);
+
 typedef void (*ratbagd_callback_t)(void *userdata);
 
 void ratbagd_schedule_task(struct ratbagd *ctx,
@@ -102,20 +102,33 @@ asus_find_button_by_code(uint8_t asus_code)
 	return NULL;
 }
 
+_Static_assert(ARRAY_LENGTH(ASUS_KEY_MAPPING) <= UINT8_MAX, "ASUS key codes exceed uint8_t");
+
+/* reverse of ASUS_KEY_MAPPING, ASUS code + 1 indexed by Linux key code,
+ * 0 if there is none. Filled once when the library is loaded. */
+static uint8_t ASUS_KEY_CODES[UINT8_MAX + 1];
+
+__attribute__((constructor))
+static void
+asus_key_codes_init(void)
+{
+	for (size_t i = ARRAY_LENGTH(ASUS_KEY_MAPPING); i-- > 0; )
+		ASUS_KEY_CODES[ASUS_KEY_MAPPING[i]] = i + 1;
+}
+
 /* search for ASUS key code by Linux key code */
 int
 asus_find_key_code(unsigned int linux_code)
 {
-	for (unsigned int i = 0; i < ARRAY_LENGTH(ASUS_KEY_MAPPING); i++) {
-		if (ASUS_KEY_MAPPING[i] == linux_code)
-			return i;
-	}
-	return -1;
+	if (linux_code >= ARRAY_LENGTH(ASUS_KEY_CODES))
+		return -1;
+
+	return (int)ASUS_KEY_CODES[linux_code] - 1;
 }
 
 int
 asus_get_linux_key_code(uint8_t asus_code) {
-	if (asus_code > ARRAY_LENGTH(ASUS_KEY_MAPPING)) {
+	if (asus_code >= ARRAY_LENGTH(ASUS_KEY_MAPPING)) {
 		return -1;
 	}
 	return ASUS_KEY_MAPPING[asus_code];
@@ -482,7 +482,7 @@ etekcity_write_macro(struct ratbag_button *button)
 	macro = &drv_data->macros[button->profile->index][button->index];
 	buf = (uint8_t*)macro;
 
-	for (i = 0; i < MAX_MACRO_EVENTS && count < ETEKCITY_MAX_MACRO_LENGTH; i++) {
+	for (i = 0; i < action->macro->nevents && count < ETEKCITY_MAX_MACRO_LENGTH; i++) {
 		if (action->macro->events[i].type == RATBAG_MACRO_EVENT_INVALID)
 			return -EINVAL; /* should not happen, ever */
 
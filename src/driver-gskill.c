@@ -649,7 +649,7 @@ gskill_mouse_button_macro_code_to_keycode(uint8_t code)
 
 static uint8_t
 gskill_macro_code_from_event(struct ratbag_device *device,
-			     struct ratbag_macro_event *event)
+			     const struct ratbag_macro_event *event)
 {
 	uint8_t macro_code;
 
@@ -697,6 +697,7 @@ gskill_macro_from_report(struct ratbag_device *device,
 	struct ratbag_button_macro *macro;
 	enum ratbag_macro_event_type type;
 	const uint8_t *data = (uint8_t*)&report->macro_content;
+	_cleanup_free_ char *name = NULL;
 	unsigned int event_data;
 	int ret, i, event_idx, increment;
 
@@ -714,14 +715,13 @@ gskill_macro_from_report(struct ratbag_device *device,
 	 * Since the length is only 8 bits long, it's impossible to specify a
 	 * length that's too large for the macro name
 	 */
-	macro = ratbag_button_macro_new(NULL);
 	ret = ratbag_utf8_from_enc(report->macro_name,
 				   report->macro_name_length, "UTF-16LE",
-				   &macro->macro.name);
-	if (ret < 0) {
-		ratbag_button_macro_unref(macro);
+				   &name);
+	if (ret < 0)
 		return NULL;
-	}
+
+	macro = ratbag_button_macro_new(name);
 
 	for (i = 0, event_idx = 0, increment = 1;
 	     i < report->macro_length;
@@ -788,21 +788,17 @@ gskill_macro_from_report(struct ratbag_device *device,
 	return macro;
 }
 
-/* FIXME: the macro struct here should be a const, but it looks like there's a
- * couple of functions in ratbag that need to have a const qualifier added to
- * their function declarations
- */
 static struct gskill_macro_report *
 gskill_macro_to_report(struct ratbag_device *device,
-		       struct ratbag_button_macro *macro,
+		       const struct ratbag_macro *macro,
 		       unsigned int profile, unsigned int button)
 {
 	struct gskill_data *drv_data = ratbag_get_drv_data(device);
 	struct gskill_macro_report *report =
 		&drv_data->profile_data[profile].macros[button];
 	struct gskill_macro_delay *delay;
-	unsigned int event_num = ratbag_button_macro_get_num_events(macro);
-	struct ratbag_macro_event *event;
+	unsigned int event_num = macro->nevents;
+	const struct ratbag_macro_event *event;
 	uint8_t *buf = report->macro_content;
 	int profile_pos, increment, event_idx;
 	ssize_t ret;
@@ -813,7 +809,7 @@ gskill_macro_to_report(struct ratbag_device *device,
 	 * G.Skill's configuration software will cry if we don't have a name,
 	 * so make sure we assign one
 	 */
-	if (!macro->macro.name || macro->macro.name[0] == '\0') {
+	if (!macro->name || macro->name[0] == '\0') {
 		ret = ratbag_utf8_to_enc(report->macro_name,
 					 sizeof(report->macro_name), "UTF-16LE",
 					 "Ratbag macro for profile %d button %d",
@@ -821,7 +817,7 @@ gskill_macro_to_report(struct ratbag_device *device,
 	} else {
 		ret = ratbag_utf8_to_enc(report->macro_name,
 					 sizeof(report->macro_name), "UTF-16LE",
-					 "%s", macro->macro.name);
+					 "%s", macro->name);
 	}
 
 	if (ret < 0)
@@ -836,7 +832,7 @@ gskill_macro_to_report(struct ratbag_device *device,
 	for (profile_pos = 0, increment = 1, event_idx = 0;
 	     event_idx < (signed)event_num;
 	     event_idx++, profile_pos += increment, increment = 1) {
-		event = &macro->macro.events[event_idx];
+		event = &macro->events[event_idx];
 
 		switch (event->type) {
 		case RATBAG_MACRO_EVENT_WAIT:
@@ -1249,12 +1245,11 @@ gskill_update_button(struct ratbag_button *button)
 	struct ratbag_profile *profile = button->profile;
 	struct ratbag_device *device = profile->device;
 	struct ratbag_button_action *action = &button->action;
-	struct ratbag_button_macro *macro = NULL;
+	const struct ratbag_macro *macro = action->macro;
 	struct gskill_profile_data *pdata = profile_to_pdata(profile);
 	struct gskill_button_cfg *bcfg = &pdata->report.btn_cfgs[button->index];
 	uint16_t code = 0;
 
-	macro = container_of(action->macro, macro, macro);
 	memset(&bcfg->params, 0, sizeof(bcfg->params));
 
 	switch (action->type) {
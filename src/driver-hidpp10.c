@@ -38,6 +38,7 @@
 #include <linux/types.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -486,6 +487,14 @@ hidpp10_log(void *userdata, enum hidpp_log_priority priority, const char *format
 	log_msg_va(device->ratbag, (enum ratbag_log_priority)priority, format, args);
 }
 
+static enum hidpp_log_priority
+hidpp10_log_priority(void *userdata)
+{
+	struct ratbag_device *device = userdata;
+
+	return (enum hidpp_log_priority)ratbag_log_get_priority(device->ratbag);
+}
+
 static int
 hidpp10drv_commit(struct ratbag_device *device)
 {
@@ -557,9 +566,52 @@ hidpp10drv_commit(struct ratbag_device *device)
 		}
 	}
 
+	ratbag_device_cache_write(device, "pages", dev->page_cache,
+				  sizeof(dev->page_cache));
+
 	return RATBAG_SUCCESS;
 }
 
+/* The page cache from an earlier run, or a zeroed cache if there is none
+ * or it doesn't look like one */
+static void
+hidpp10drv_load_page_cache(struct ratbag_device *device,
+			   struct hidpp10_device *dev)
+{
+	uint8_t raw[sizeof(dev->page_cache)];
+	char fw[16];
+	uint8_t major, minor, build;
+
+	memset(dev->page_cache, 0, sizeof(dev->page_cache));
+
+	/* the firmware version is part of the cache key, without it the
+	 * cache isn't used at all */
+	if (!device->ratbag->cache_dir ||
+	    hidpp10_get_firmware_information(dev, &major, &minor, &build) != 0)
+		return;
+
+	snprintf(fw, sizeof(fw), "%d.%d.%d", major, minor, build);
+	ratbag_device_set_firmware_version(device, fw);
+
+	if (ratbag_device_cache_read(device, "pages", raw, sizeof(raw)) < 0)
+		return;
+
+	/* raw bytes from disk, a bool other than 0 or 1 is undefined */
+	_Static_assert(sizeof(bool) == 1, "bool is not a byte");
+	for (size_t i = 0; i < ARRAY_LENGTH(dev->page_cache); i++) {
+		size_t offset = i * sizeof(dev->page_cache[0]) +
+				offsetof(struct hidpp10_cached_page, valid);
+
+		if (raw[offset] > 1) {
+			log_debug(device->ratbag, "%s: ignoring invalid page cache\n",
+				  device->name);
+			return;
+		}
+	}
+
+	memcpy(dev->page_cache, raw, sizeof(raw));
+}
+
 static int
 hidpp10drv_probe(struct ratbag_device *device)
 {
@@ -578,7 +630,14 @@ hidpp10drv_probe(struct ratbag_device *device)
 
 	drv_data = zalloc(sizeof(*drv_data));
 	hidpp_device_init(&base, device->hidraw[0].fd);
-	hidpp_device_set_log_handler(&base, hidpp10_log, HIDPP_LOG_PRIORITY_RAW, device);
+	/* Use the context priority so disabled messages are dropped before
+	 * they are formatted. Later priority changes don't apply here. */
+	hidpp_device_set_log_handler(&base, hidpp10_log, hidpp10_log_priority, device);
+	hidpp_device_set_io_stats(&base, device->io_stats);
+	hidpp_device_set_trace(&base, &device->ratbag->trace, device->trace_id);
+	if (ratbag_device_data_get_request_timeout(device->data))
+		hidpp_device_set_timeout_ceiling(&base,
+						 ratbag_device_data_get_request_timeout(device->data));
 
 	typestr = ratbag_device_data_hidpp10_get_profile_type(device->data);
 	if (typestr) {
@@ -650,10 +709,17 @@ hidpp10drv_probe(struct ratbag_device *device)
 				  device->name);
 	}
 
+	/* pages from an earlier run only save the reads if they are still
+	 * current, hidpp10_read_page() checks them against the device */
+	hidpp10drv_load_page_cache(device, dev);
+
 	rc = hidpp10_device_read_profiles(dev);
 	if (rc)
 		goto err;
 
+	ratbag_device_cache_write(device, "pages", dev->page_cache,
+				  sizeof(dev->page_cache));
+
 	drv_data->dev = dev;
 	ratbag_set_drv_data(device, drv_data);
 
@@ -694,6 +760,100 @@ err:
 	return rc;
 }
 
+static bool
+hidpp10drv_pages_changed(struct hidpp10_device *dev,
+			 const struct hidpp10_cached_page *before)
+{
+	const struct hidpp10_cached_page *old, *new;
+
+	for (size_t i = 0; i < HIDPP10_PAGE_CACHE_SIZE; i++) {
+		bool found = false;
+
+		old = &before[i];
+		if (!old->valid)
+			continue;
+
+		/* a page written by our own commit was dropped from the
+		 * cache and shows up as changed too */
+		ARRAY_FOR_EACH(dev->page_cache, new) {
+			if (new->valid && new->page == old->page) {
+				found = memcmp(new->data, old->data,
+					       sizeof(old->data)) == 0;
+				break;
+			}
+		}
+
+		if (!found)
+			return true;
+	}
+
+	return false;
+}
+
+static int
+hidpp10drv_refresh(struct ratbag_device *device)
+{
+	struct hidpp10drv_data *drv_data = ratbag_get_drv_data(device);
+	struct hidpp10_device *dev = drv_data->dev;
+	struct hidpp10_cached_page before[HIDPP10_PAGE_CACHE_SIZE];
+	struct ratbag_profile *profile;
+	struct ratbag_resolution *resolution;
+	struct ratbag_button *button;
+	struct ratbag_led *led;
+	bool changed;
+	uint8_t idx;
+
+	if (dev->profile_type == HIDPP10_PROFILE_UNKNOWN)
+		return 0;
+
+	/* a cached page costs one read of its last 16 bytes, only pages
+	 * that differ are read in full */
+	memcpy(before, dev->page_cache, sizeof(before));
+	hidpp10_device_read_profiles(dev);
+	changed = hidpp10drv_pages_changed(dev, before);
+
+	if (!changed && hidpp10_get_current_profile(dev, &idx) == 0) {
+		list_for_each(profile, &device->profiles, link) {
+			if (profile->index == idx && !profile->is_active)
+				changed = true;
+		}
+	}
+
+	if (!changed)
+		return 0;
+
+	log_debug(device->ratbag, "%s: profiles changed, re-reading them\n",
+		  device->name);
+
+	ratbag_device_cache_write(device, "pages", dev->page_cache,
+				  sizeof(dev->page_cache));
+
+	list_for_each(profile, &device->profiles, link) {
+		if (profile->dirty) {
+			ratbag_profile_for_each_button(profile, button) {
+				if (!button->dirty)
+					hidpp10drv_read_button(button);
+			}
+			ratbag_profile_for_each_led(profile, led) {
+				if (!led->dirty)
+					hidpp10drv_read_led(led);
+			}
+			continue;
+		}
+
+		/* hidpp10drv_read_profile() only ever sets these */
+		profile->is_active = false;
+		ratbag_profile_for_each_resolution(profile, resolution) {
+			resolution->is_active = false;
+			resolution->is_default = false;
+		}
+
+		hidpp10drv_read_profile(profile);
+	}
+
+	return 1;
+}
+
 static void
 hidpp10drv_remove(struct ratbag_device *device)
 {
@@ -717,4 +877,5 @@ struct ratbag_driver hidpp10_driver = {
 	.remove = hidpp10drv_remove,
 	.set_active_profile = hidpp10drv_set_current_profile,
 	.commit = hidpp10drv_commit,
+	.refresh = hidpp10drv_refresh,
 };
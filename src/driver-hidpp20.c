@@ -68,6 +68,7 @@ struct hidpp20drv_data {
 	struct hidpp20_sensor *sensors;
 	unsigned num_controls;
 	struct hidpp20_control_id *controls;
+	bool controls_read; /* 1b04 controls are current, see hidpp20drv_read_special_key_mouse() */
 	struct hidpp20_profiles *profiles;
 	struct hidpp20_led *leds;
 	union hidpp20_generic_led_zone_info led_infos;
@@ -508,11 +509,14 @@ hidpp20drv_update_button_1b04(struct ratbag_button *button)
 	control->reporting.updated = 1;
 
 	rc = hidpp20_special_key_mouse_set_control(drv_data->dev, control);
-	if (rc)
+	if (rc) {
 		log_error(device->ratbag,
 			  "Error while writing profile: '%s' (%d)\n",
 			  strerror(-rc),
 			  rc);
+		/* our copy no longer matches the device */
+		drv_data->controls_read = false;
+	}
 
 	return rc;
 }
@@ -1083,13 +1087,19 @@ hidpp20drv_read_special_key_mouse(struct ratbag_device *device)
 	if (!(drv_data->capabilities & HIDPP_CAP_BUTTON_KEY_1b04))
 		return 0;
 
+	/* the controls are the same for every profile and
+	 * hidpp20drv_update_button_1b04() keeps them up to date */
+	if (drv_data->controls_read)
+		return 0;
+
 	free(drv_data->controls);
 	drv_data->controls = NULL;
 	drv_data->num_controls = 0;
 	rc = hidpp20_special_key_mouse_get_controls(drv_data->dev, &drv_data->controls);
 	log_raw(device->ratbag, "num_control %d\n", rc);
-	if (rc > 0) {
+	if (rc >= 0) {
 		drv_data->num_controls = rc;
+		drv_data->controls_read = true;
 		rc = 0;
 	}
 
@@ -1555,6 +1565,69 @@ hidpp20drv_commit(struct ratbag_device *device)
 	return RATBAG_SUCCESS;
 }
 
+static int
+hidpp20drv_refresh(struct ratbag_device *device)
+{
+	struct hidpp20drv_data *drv_data = ratbag_get_drv_data(device);
+	struct ratbag_profile *profile;
+	struct ratbag_resolution *resolution;
+	struct ratbag_button *button;
+	struct ratbag_led *led;
+	int rc, active;
+
+	/* without onboard profiles the state is not read from the device */
+	if (!(drv_data->capabilities & HIDPP_CAP_ONBOARD_PROFILES_8100))
+		return 0;
+
+	rc = hidpp20_onboard_profiles_get_current_profile(drv_data->dev);
+	if (rc < 0)
+		return rc;
+	active = rc;
+
+	rc = hidpp20_onboard_profiles_check_crcs(drv_data->dev, drv_data->profiles);
+	if (rc < 0)
+		return rc;
+
+	if (rc == 0 && active == drv_data->profiles->active_profile_index)
+		return 0;
+
+	log_debug(device->ratbag, "%s: onboard profiles changed, re-reading them\n",
+		  device->name);
+
+	drv_data->profiles->active_profile_index = active;
+	rc = hidpp20_onboard_profiles_initialize(drv_data->dev, drv_data->profiles);
+	if (rc < 0)
+		return rc;
+
+	list_for_each(profile, &device->profiles, link) {
+		if (profile->dirty) {
+			ratbag_profile_for_each_button(profile, button) {
+				if (!button->dirty)
+					hidpp20drv_read_button(button);
+			}
+			ratbag_profile_for_each_led(profile, led) {
+				if (!led->dirty)
+					hidpp20drv_read_led(led);
+			}
+			if (!profile->rate_dirty)
+				profile->hz = drv_data->profiles->profiles[profile->index].report_rate;
+			continue;
+		}
+
+		/* hidpp20drv_read_profile_8100() only ever sets these */
+		profile->is_active = false;
+		ratbag_profile_for_each_resolution(profile, resolution) {
+			resolution->is_active = false;
+			resolution->is_default = false;
+			resolution->is_disabled = false;
+		}
+
+		hidpp20drv_read_profile(profile);
+	}
+
+	return 1;
+}
+
 static int
 hidpp20drv_20_probe(struct ratbag_device *device)
 {
@@ -1609,6 +1682,14 @@ hidpp20_log(void *userdata, enum hidpp_log_priority priority, const char *format
 	log_msg_va(device->ratbag, (enum ratbag_log_priority)priority, format, args);
 }
 
+static enum hidpp_log_priority
+hidpp20_log_priority(void *userdata)
+{
+	struct ratbag_device *device = userdata;
+
+	return (enum hidpp_log_priority)ratbag_log_get_priority(device->ratbag);
+}
+
 static void
 hidpp20drv_remove(struct ratbag_device *device)
 {
@@ -1690,7 +1771,14 @@ hidpp20drv_probe(struct ratbag_device *device)
 	drv_data = zalloc(sizeof(*drv_data));
 	ratbag_set_drv_data(device, drv_data);
 	hidpp_device_init(&base, device->hidraw[0].fd);
-	hidpp_device_set_log_handler(&base, hidpp20_log, HIDPP_LOG_PRIORITY_RAW, device);
+	/* Use the context priority so disabled messages are dropped before
+	 * they are formatted. Later priority changes don't apply here. */
+	hidpp_device_set_log_handler(&base, hidpp20_log, hidpp20_log_priority, device);
+	hidpp_device_set_io_stats(&base, device->io_stats);
+	hidpp_device_set_trace(&base, &device->ratbag->trace, device->trace_id);
+	if (ratbag_device_data_get_request_timeout(device->data))
+		hidpp_device_set_timeout_ceiling(&base,
+						 ratbag_device_data_get_request_timeout(device->data));
 
 	device_idx = ratbag_device_data_hidpp20_get_index(device->data);
 	if (device_idx == -1)
@@ -1744,4 +1832,5 @@ struct ratbag_driver hidpp20_driver = {
 	.remove = hidpp20drv_remove,
 	.commit = hidpp20drv_commit,
 	.set_active_profile = hidpp20drv_set_current_profile,
+	.refresh = hidpp20drv_refresh,
 };
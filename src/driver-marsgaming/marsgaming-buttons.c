@@ -262,7 +262,8 @@ marsgaming_keycodes_from_ratbag_macro(struct ratbag_button_action *action, unsig
 			return -EINVAL;
 	}
 
-	for (i = 0; i < MAX_MACRO_EVENTS; i++) {
+	/* the event after the last one is always RATBAG_MACRO_EVENT_NONE */
+	for (i = 0; i <= macro->nevents; i++) {
 		struct ratbag_macro_event event;
 
 		event = macro->events[i];
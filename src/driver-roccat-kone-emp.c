@@ -616,7 +616,7 @@ roccat_write_profile(struct ratbag_profile *profile)
 			}
 			strncpy(macro->name, button->action.macro->name, ROCCAT_MACRO_NAME_LENGTH); 
 
-			for (i = 0; i < MAX_MACRO_EVENTS && count < ROCCAT_MAX_MACRO_LENGTH; i++) {
+			for (i = 0; i < (int)button->action.macro->nevents && count < ROCCAT_MAX_MACRO_LENGTH; i++) {
 				if (button->action.macro->events[i].type == RATBAG_MACRO_EVENT_INVALID)
 					return -EINVAL; /* should not happen, ever */
 
@@ -745,13 +745,13 @@ static void roccat_read_macro(struct roccat_macro* macro, struct ratbag_button*
 
 	m = ratbag_button_macro_new(name);
 	// libratbag does offer API for macro groups
-	m->macro.group = (char*)zalloc(ROCCAT_MACRO_GROUP_NAME_LENGTH+1);
-	strncpy(m->macro.group, macro->group, ROCCAT_MACRO_GROUP_NAME_LENGTH);
+	m->group = (char*)zalloc(ROCCAT_MACRO_GROUP_NAME_LENGTH+1);
+	strncpy(m->group, macro->group, ROCCAT_MACRO_GROUP_NAME_LENGTH);
 
 	log_debug(button->profile->device->ratbag,
 		"macro on button %d of profile %d is named '%s' (from folder '%s'), and contains %d events:\n",
 		button->index, button->profile->index,
-		name, m->macro.group, macro->length);
+		name, m->group, macro->length);
 	// libratbag can't keep track of the whole macro (MAX_MACRO_EVENTS)
 	// In libratbag, each event is implemented as two separate (KEY_PRESS/KEY_RELEASE and WAIT)
 	for (j = 0; j < macro->length && j < MAX_MACRO_EVENTS/2; j++) {
@@ -496,7 +496,7 @@ roccat_write_macro(struct ratbag_button *button,
 
 	memset(buf, 0, ROCCAT_REPORT_SIZE_MACRO);
 
-	for (i = 0; i < MAX_MACRO_EVENTS && count < ROCCAT_MAX_MACRO_LENGTH; i++) {
+	for (i = 0; i < action->macro->nevents && count < ROCCAT_MAX_MACRO_LENGTH; i++) {
 		if (action->macro->events[i].type == RATBAG_MACRO_EVENT_INVALID)
 			return -EINVAL; /* should not happen, ever */
 
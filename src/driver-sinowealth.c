@@ -1463,7 +1463,7 @@ sinowealth_button_key_action_from_simple_macro(
 		return -EINVAL;
 	}
 
-	for (unsigned int i = 0; i < MAX_MACRO_EVENTS; ++i) {
+	for (unsigned int i = 0; i < button->action.macro->nevents; ++i) {
 		const struct ratbag_macro_event ratbag_macro_event = button->action.macro->events[i];
 		switch (ratbag_macro_event.type) {
 		case RATBAG_MACRO_EVENT_KEY_PRESSED:
@@ -1579,26 +1579,36 @@ sinowealth_update_macro_events_from_action(
 	struct ratbag_button *button,
 	struct sinowealth_macro_report *mouse_macro)
 {
-	struct ratbag_button_action *action = &button->action;
+	const struct ratbag_macro *macro = button->action.macro;
 
 	if (button->action.type != RATBAG_BUTTON_ACTION_TYPE_MACRO) {
 		log_bug_libratbag(device->ratbag, "Button's action is not a macro");
 		return -EINVAL;
 	}
 
+	/* Macros are shared between buttons, work on a copy and replace
+	 * the button's macro if we had to adjust it to the mouse.
+	 */
+	struct ratbag_macro_event events[MAX_MACRO_EVENTS];
+	unsigned int nevents = macro->nevents;
+	bool adjusted = false;
+
+	memcpy(events, macro->events, nevents * sizeof(events[0]));
+
 	/* Reset the `events` field. Even if we don't do this, the mouse will ignore unneeded data. */
 	memset(mouse_macro->events, 0, sizeof(mouse_macro->events));
 
 	uint8_t raw_event_count = 0;
-	for (unsigned int i = 0; i < MAX_MACRO_EVENTS; ++i) {
-		struct ratbag_macro_event *ratbag_macro_event = &action->macro->events[i];
+	for (unsigned int i = 0; i < nevents; ++i) {
+		struct ratbag_macro_event *ratbag_macro_event = &events[i];
 		if (raw_event_count >= SINOWEALTH_MACRO_LENGTH_MAX) {
 			log_error(device->ratbag, "There are more events in the macro than the mouse supports\n");
 
-			/* Update the type of this event so that libratbag ignores
+			/* Drop the remaining events so that libratbag ignores
 			 * unused events.
 			 */
-			ratbag_macro_event->type = RATBAG_MACRO_EVENT_NONE;
+			nevents = i;
+			adjusted = true;
 			break;
 		};
 
@@ -1661,8 +1671,10 @@ sinowealth_update_macro_events_from_action(
 
 			struct sinowealth_macro_event *prev_mouse_macro_event = &mouse_macro->events[raw_event_count - 1];
 
-			if (*timeout > SINOWEALTH_MACRO_MAX_POSSIBLE_TIMEOUT)
+			if (*timeout > SINOWEALTH_MACRO_MAX_POSSIBLE_TIMEOUT) {
 				*timeout = SINOWEALTH_MACRO_MAX_POSSIBLE_TIMEOUT;
+				adjusted = true;
+			}
 
 			prev_mouse_macro_event->delay = (uint8_t)*timeout;
 			break;
@@ -1679,6 +1691,10 @@ sinowealth_update_macro_events_from_action(
 	/* Update the event counter in the macro. */
 	mouse_macro->event_count = raw_event_count;
 
+	if (adjusted)
+		ratbag_button_set_macro_events(button, macro->name, macro->group,
+					       events, nevents);
+
 	return 0;
 }
 
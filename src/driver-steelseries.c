@@ -447,11 +447,13 @@ steelseries_write_dpi(struct ratbag_resolution *resolution)
 		size_t i = 0;
 		/* when using lists the entries are enumerated in reverse */
 		if (dpilist) {
-			for (i = 0; i < resolution->ndpis; i++) {
-				if (resolution->dpis[i] == resolution->dpi_x)
+			const struct ratbag_dpi_table *table = resolution->dpi_table;
+
+			for (i = 0; i < table->ndpis; i++) {
+				if (table->dpis[i] == resolution->dpi_x)
 					break;
 			}
-			i = resolution->ndpis - i;
+			i = table->ndpis - i;
 		} else {
 			i = resolution->dpi_x / (size_t)dpirange->step - 1U;
 		}
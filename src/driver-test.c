@@ -29,10 +29,42 @@
 #include "libratbag-private.h"
 #include "libratbag-test.h"
 
+/* The test device description is only used during probe, all the driver
+ * keeps around is what it needs to check the device is still valid */
+struct test_data {
+	unsigned int num_profiles;
+	void (*destroyed)(struct ratbag_device *device, void *data);
+	void *destroyed_data;
+};
+
+static inline const struct ratbag_test_profile *
+test_profile(const struct ratbag_test_device *d, unsigned int index)
+{
+	return d->profile_list ? &d->profile_list[index] : &d->profiles[index];
+}
+
+static inline const struct ratbag_test_button *
+test_button(const struct ratbag_test_profile *p, unsigned int index)
+{
+	return p->button_list ? &p->button_list[index] : &p->buttons[index];
+}
+
+static inline const struct ratbag_test_resolution *
+test_resolution(const struct ratbag_test_profile *p, unsigned int index)
+{
+	return p->resolution_list ? &p->resolution_list[index] : &p->resolutions[index];
+}
+
+static inline const struct ratbag_test_led *
+test_led(const struct ratbag_test_profile *p, unsigned int index)
+{
+	return p->led_list ? &p->led_list[index] : &p->leds[index];
+}
+
 static int
 test_set_active_profile(struct ratbag_device *device, unsigned int index)
 {
-	struct ratbag_test_device *d = ratbag_get_drv_data(device);
+	struct test_data *d = ratbag_get_drv_data(device);
 
 	/* check if the device is still valid */
 	assert(d != NULL);
@@ -41,14 +73,12 @@ test_set_active_profile(struct ratbag_device *device, unsigned int index)
 }
 
 static void
-test_read_button(struct ratbag_button *button)
+test_read_button(struct ratbag_button *button,
+		 const struct ratbag_test_profile *p)
 {
-	struct ratbag_device *device = button->profile->device;
-	struct ratbag_test_device *d = ratbag_get_drv_data(device);
-	struct ratbag_test_profile *p = &d->profiles[button->profile->index];
-	struct ratbag_test_button *b = &p->buttons[button->index];
+	const struct ratbag_test_button *b = test_button(p, button->index);
+	const struct ratbag_test_macro_event *e;
 	struct ratbag_button_macro *m;
-	struct ratbag_test_macro_event *e;
 	int idx;
 
 	switch (b->action_type) {
@@ -57,11 +87,11 @@ test_read_button(struct ratbag_button *button)
 		break;
 	case RATBAG_BUTTON_ACTION_TYPE_BUTTON:
 		button->action.type = RATBAG_BUTTON_ACTION_TYPE_BUTTON;
-		button->action.action.button = p->buttons[button->index].button;
+		button->action.action.button = b->button;
 		break;
 	case RATBAG_BUTTON_ACTION_TYPE_KEY:
 		button->action.type = RATBAG_BUTTON_ACTION_TYPE_KEY;
-		button->action.action.key.key = p->buttons[button->index].key;
+		button->action.action.key.key = b->key;
 		break;
 	case RATBAG_BUTTON_ACTION_TYPE_MACRO:
 		button->action.type = RATBAG_BUTTON_ACTION_TYPE_MACRO;
@@ -78,7 +108,7 @@ test_read_button(struct ratbag_button *button)
 		break;
 	case RATBAG_BUTTON_ACTION_TYPE_SPECIAL:
 		button->action.type = RATBAG_BUTTON_ACTION_TYPE_SPECIAL;
-		button->action.action.special = p->buttons[button->index].special;
+		button->action.action.special = b->special;
 		break;
 	default:
 		button->action.type = RATBAG_BUTTON_ACTION_TYPE_UNKNOWN;
@@ -92,12 +122,9 @@ test_read_button(struct ratbag_button *button)
 }
 
 static void
-test_read_led(struct ratbag_led *led)
+test_read_led(struct ratbag_led *led, const struct ratbag_test_profile *p)
 {
-	struct ratbag_device *device = led->profile->device;
-	struct ratbag_test_device *d = ratbag_get_drv_data(device);
-	struct ratbag_test_profile *p = &d->profiles[led->profile->index];
-	struct ratbag_test_led t_led = p->leds[led->index];
+	struct ratbag_test_led t_led = *test_led(p, led->index);
 
 	ratbag_led_set_mode_capability(led, RATBAG_LED_ON);
 	ratbag_led_set_mode_capability(led, RATBAG_LED_CYCLE);
@@ -131,13 +158,13 @@ test_fake_probe(struct ratbag_device *device)
 }
 
 static void
-test_read_profile(struct ratbag_profile *profile)
+test_read_profile(struct ratbag_profile *profile,
+		  const struct ratbag_test_device *d)
 {
-	struct ratbag_test_device *d = ratbag_get_drv_data(profile->device);
-	struct ratbag_test_profile *p;
-	struct ratbag_test_profile *p0;
-	struct ratbag_test_resolution *r;
-	struct ratbag_test_resolution *r0;
+	const struct ratbag_test_profile *p;
+	const struct ratbag_test_profile *p0;
+	const struct ratbag_test_resolution *r;
+	const struct ratbag_test_resolution *r0;
 	struct ratbag_button *button;
 	struct ratbag_led *led;
 	unsigned int i;
@@ -147,9 +174,9 @@ test_read_profile(struct ratbag_profile *profile)
 
 	assert(profile->index < d->num_profiles);
 
-	p = &d->profiles[profile->index];
-	p0 = &d->profiles[0];
-	r0 = &p0->resolutions[0];
+	p = test_profile(d, profile->index);
+	p0 = test_profile(d, 0);
+	r0 = test_resolution(p0, 0);
 
 	for (size_t report_rate_index = 0;
 	     report_rate_index < ARRAY_LENGTH(p0->report_rates);
@@ -167,7 +194,7 @@ test_read_profile(struct ratbag_profile *profile)
 	for (i = 0; i < d->num_resolutions; i++) {
 		_cleanup_resolution_ struct ratbag_resolution *res = NULL;
 
-		r = &p->resolutions[i];
+		r = test_resolution(p, i);
 
 		res = ratbag_profile_get_resolution(profile, i);
 		assert(res);
@@ -204,10 +231,10 @@ test_read_profile(struct ratbag_profile *profile)
 	}
 
 	ratbag_profile_for_each_button(profile, button)
-		test_read_button(button);
+		test_read_button(button, p);
 
 	ratbag_profile_for_each_led(profile, led)
-		test_read_led(led);
+		test_read_led(led, p);
 
 	profile->is_active = p->active;
 	profile->is_enabled = !p->disabled;
@@ -221,16 +248,48 @@ test_read_profile(struct ratbag_profile *profile)
 	}
 }
 
+/* The embedded arrays are fixed-size, anything larger needs the lists */
+static bool
+test_check_topology(struct ratbag_device *device,
+		    const struct ratbag_test_device *d)
+{
+	if (!d->profile_list && d->num_profiles > RATBAG_TEST_MAX_PROFILES)
+		goto error;
+
+	for (unsigned int i = 0; i < d->num_profiles; i++) {
+		const struct ratbag_test_profile *p = test_profile(d, i);
+
+		if ((!p->button_list && d->num_buttons > RATBAG_TEST_MAX_BUTTONS) ||
+		    (!p->resolution_list && d->num_resolutions > RATBAG_TEST_MAX_RESOLUTIONS) ||
+		    (!p->led_list && d->num_leds > RATBAG_TEST_MAX_LEDS))
+			goto error;
+	}
+
+	return true;
+
+error:
+	log_bug_client(device->ratbag,
+		       "%s: test device topology exceeds its arrays\n",
+		       device->name);
+	return false;
+}
+
 static int
 test_probe(struct ratbag_device *device, const void *data)
 {
-	struct ratbag_test_device *test_device;
+	const struct ratbag_test_device *test_device = data;
 	struct ratbag_profile *profile;
+	struct test_data *d;
+
+	if (!test_check_topology(device, test_device))
+		return -EINVAL;
 
-	test_device = zalloc(sizeof(*test_device));
-	memcpy(test_device, data, sizeof(*test_device));
+	d = zalloc(sizeof(*d));
+	d->num_profiles = test_device->num_profiles;
+	d->destroyed = test_device->destroyed;
+	d->destroyed_data = test_device->destroyed_data;
 
-	ratbag_set_drv_data(device, test_device);
+	ratbag_set_drv_data(device, d);
 	ratbag_device_init_profiles(device,
 				    test_device->num_profiles,
 				    test_device->num_resolutions,
@@ -238,7 +297,7 @@ test_probe(struct ratbag_device *device, const void *data)
 				    test_device->num_leds);
 
 	ratbag_device_for_each_profile(device, profile)
-		test_read_profile(profile);
+		test_read_profile(profile, test_device);
 
 	return 0;
 }
@@ -246,7 +305,7 @@ test_probe(struct ratbag_device *device, const void *data)
 static void
 test_remove(struct ratbag_device *device)
 {
-	struct ratbag_test_device *d = ratbag_get_drv_data(device);
+	struct test_data *d = ratbag_get_drv_data(device);
 
 	/* remove must be called only once */
 	assert(d != NULL);
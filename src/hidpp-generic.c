@@ -231,49 +231,300 @@ hidpp20_led_get_location_mapping_name(uint16_t value)
 	return "UNKNOWN";
 }
 
+static inline uint8_t
+hidpp_request_tag(const struct hidpp_device *dev, uint8_t address)
+{
+	return address & ~dev->address_mask;
+}
+
+/* the oldest request waiting for its reply, NULL if there is none */
+static struct hidpp_request *
+hidpp_device_oldest_request(struct hidpp_device *dev)
+{
+	struct hidpp_request *request, *oldest = NULL;
+
+	ARRAY_FOR_EACH(dev->requests, request) {
+		if (request->time_us &&
+		    (!oldest || request->time_us < oldest->time_us))
+			oldest = request;
+	}
+
+	return oldest;
+}
+
+/* the oldest request with this tag, NULL if there is none */
+static struct hidpp_request *
+hidpp_device_find_request(struct hidpp_device *dev, uint8_t tag)
+{
+	struct hidpp_request *request, *oldest = NULL;
+
+	ARRAY_FOR_EACH(dev->requests, request) {
+		if (request->time_us && request->tag == tag &&
+		    (!oldest || request->time_us < oldest->time_us))
+			oldest = request;
+	}
+
+	return oldest;
+}
+
+static struct hidpp_request *
+hidpp_device_new_request(struct hidpp_device *dev, uint8_t tag)
+{
+	struct hidpp_request *request, *unused = NULL;
+
+	/* A tag is only reused once its request is done or given up on,
+	 * an entry still using it never got its reply */
+	if (tag != 0) {
+		request = hidpp_device_find_request(dev, tag);
+		if (request)
+			return request;
+	}
+
+	ARRAY_FOR_EACH(dev->requests, request) {
+		if (!request->time_us) {
+			unused = request;
+			break;
+		}
+	}
+
+	return unused ? unused : hidpp_device_oldest_request(dev);
+}
+
 int
 hidpp_write_command(struct hidpp_device *dev, uint8_t *cmd, int size)
 {
+	struct hidpp_request *request;
 	int fd = dev->hidraw_fd;
+	uint8_t tag;
 	int res;
 
 	if (size < 1 || !cmd || fd < 0)
 		return -EINVAL;
 
 	hidpp_log_buf_raw(dev, "hidpp write: ", cmd, size);
+	dev->request_idx = size >= 2 ? cmd[1] : 0;
+	ratbag_trace_add(dev->trace, dev->trace_id, RATBAG_TRACE_HIDPP_WRITE,
+			 cmd, size, 0);
+
+	tag = size >= 4 ? hidpp_request_tag(dev, cmd[3]) : 0;
+	request = hidpp_device_new_request(dev, tag);
+	request->time_us = now(CLOCK_MONOTONIC) / 1000;
+	request->tag = tag;
+	request->stats = size >= 4 ?
+		ratbag_io_stats_get(dev->io_stats, RATBAG_IO_HIDPP,
+				    cmd[2] << 8 | (cmd[3] & dev->address_mask)) : NULL;
+	if (request->stats) {
+		request->stats->requests++;
+		request->stats->bytes_sent += size;
+	}
+
 	res = write(fd, cmd, size);
 	if (res < 0) {
 		res = -errno;
 		hidpp_log_error(dev, "Error: %s (%d)\n", strerror(-res), -res);
+		if (request->stats)
+			request->stats->errors++;
+		memset(request, 0, sizeof(*request));
 	}
 
 	return res < 0 ? res : 0;
 }
 
+void
+hidpp_mux_init(struct hidpp_mux *mux, int fd)
+{
+	memset(mux, 0, sizeof(*mux));
+	mux->fd = fd;
+}
+
+void
+hidpp_device_set_mux(struct hidpp_device *dev, struct hidpp_mux *mux)
+{
+	assert(!mux || mux->fd == dev->hidraw_fd);
+
+	dev->mux = mux;
+}
+
+static void
+hidpp_mux_push(struct hidpp_mux *mux, const uint8_t *buf, size_t len)
+{
+	struct hidpp_mux_message *m;
+
+	if (mux->count == HIDPP_MUX_QUEUE_LEN) {
+		mux->head = (mux->head + 1) % HIDPP_MUX_QUEUE_LEN;
+		mux->count--;
+		mux->dropped++;
+	}
+
+	m = &mux->queue[(mux->head + mux->count) % HIDPP_MUX_QUEUE_LEN];
+	m->len = min(len, sizeof(m->data));
+	memcpy(m->data, buf, m->len);
+	mux->count++;
+}
+
+/**
+ * Queue the message if it is a HID++ message for another device index
+ * than device_idx. Returns true if the message was queued.
+ */
+static bool
+hidpp_mux_queue_foreign(struct hidpp_mux *mux, uint8_t device_idx,
+			const uint8_t *buf, size_t len)
+{
+	if (len < 2 ||
+	    (buf[0] != REPORT_ID_SHORT && buf[0] != REPORT_ID_LONG) ||
+	    buf[1] == device_idx)
+		return false;
+
+	hidpp_mux_push(mux, buf, len);
+
+	return true;
+}
+
+/**
+ * Remove the oldest queued message for device_idx and copy it into buf.
+ * Returns the length of the message or 0 if there is none.
+ */
+static int
+hidpp_mux_take(struct hidpp_mux *mux, uint8_t device_idx,
+	       uint8_t *buf, size_t size)
+{
+	unsigned int i;
+	int len;
+
+	for (i = 0; i < mux->count; i++) {
+		struct hidpp_mux_message *m;
+
+		m = &mux->queue[(mux->head + i) % HIDPP_MUX_QUEUE_LEN];
+		if (m->data[1] != device_idx)
+			continue;
+
+		len = min(m->len, size);
+		memcpy(buf, m->data, len);
+
+		/* close the gap, keeping the order of the others */
+		for (; i + 1 < mux->count; i++)
+			mux->queue[(mux->head + i) % HIDPP_MUX_QUEUE_LEN] =
+				mux->queue[(mux->head + i + 1) % HIDPP_MUX_QUEUE_LEN];
+		mux->count--;
+
+		return len;
+	}
+
+	return 0;
+}
+
+int
+hidpp_mux_read_pending(struct hidpp_mux *mux, uint8_t *buf, size_t size)
+{
+	struct pollfd fds;
+	int rc;
+
+	if (size < 1 || !buf || mux->fd < 0)
+		return -EINVAL;
+
+	if (mux->count > 0) {
+		struct hidpp_mux_message *m = &mux->queue[mux->head];
+
+		rc = min(m->len, size);
+		memcpy(buf, m->data, rc);
+		mux->head = (mux->head + 1) % HIDPP_MUX_QUEUE_LEN;
+		mux->count--;
+
+		return rc;
+	}
+
+	fds.fd = mux->fd;
+	fds.events = POLLIN;
+
+	rc = poll(&fds, 1, 0);
+	if (rc == -1)
+		return -errno;
+	if (rc == 0)
+		return 0;
+
+	rc = read(mux->fd, buf, size);
+
+	return rc >= 0 ? rc : -errno;
+}
+
 int
 hidpp_read_response(struct hidpp_device *dev, uint8_t *buf, size_t size)
 {
+	struct hidpp_request *oldest;
 	int fd = dev->hidraw_fd;
 	struct pollfd fds;
+	unsigned int timeout, waited = 0;
 	int rc;
 
 	if (size < 1 || !buf || fd < 0)
 		return -EINVAL;
 
+	/* someone else may have read our reply already */
+	if (dev->mux) {
+		rc = hidpp_mux_take(dev->mux, dev->request_idx, buf, size);
+		if (rc > 0) {
+			hidpp_log_buf_raw(dev, "hidpp read:  ", buf, rc);
+			dev->reply_len = rc;
+			return rc;
+		}
+	}
+
 	fds.fd = fd;
 	fds.events = POLLIN;
 
-	rc = poll(&fds, 1, 1000);
-	if (rc == -1)
-		return -errno;
+	for (;;) {
+		/* Start with the timeout derived from the device's
+		 * round-trip times and back off a bounded number of times,
+		 * the ceiling only caps the total wait. With several
+		 * requests in flight, the wait is accounted to the oldest.
+		 */
+		oldest = hidpp_device_oldest_request(dev);
+		for (;;) {
+			timeout = min(rtt_estimator_timeout(&dev->rtt),
+				      dev->rtt.ceiling - waited);
+			rc = poll(&fds, 1, timeout);
+			if (rc == -1)
+				return -errno;
+			if (rc > 0)
+				break;
+
+			waited += timeout;
+			if (waited >= dev->rtt.ceiling ||
+			    !rtt_estimator_backoff(&dev->rtt)) {
+				/* a late reply must not be taken for the
+				 * reply of a later request */
+				if (oldest) {
+					if (oldest->stats) {
+						oldest->stats->timeouts++;
+						oldest->stats->errors++;
+					}
+					memset(oldest, 0, sizeof(*oldest));
+				}
+				return -ETIMEDOUT;
+			}
 
-	if (rc == 0)
-		return -ETIMEDOUT;
+			if (oldest && oldest->stats)
+				oldest->stats->retries++;
+		}
+
+		rc = read(fd, buf, size);
+		if (rc <= 0)
+			break;
 
-	rc = read(fd, buf, size);
+		ratbag_trace_add(dev->trace, dev->trace_id, RATBAG_TRACE_HIDPP_READ,
+				 buf, rc,
+				 oldest ? now(CLOCK_MONOTONIC) / 1000 - oldest->time_us : 0);
+
+		if (dev->mux &&
+		    hidpp_mux_queue_foreign(dev->mux, dev->request_idx, buf, rc)) {
+			hidpp_log_buf_raw(dev, "hidpp queue: ", buf, rc);
+			continue;
+		}
 
-	if (rc > 0)
 		hidpp_log_buf_raw(dev, "hidpp read:  ", buf, rc);
+		dev->reply_len = rc;
+		break;
+	}
 
 	return rc >= 0 ? rc : -errno;
 }
@@ -313,7 +564,7 @@ hidpp_log(struct hidpp_device *dev,
 {
 	va_list args;
 
-	if (dev->log_priority > priority)
+	if (!hidpp_log_is_enabled(dev, priority))
 		return;
 
 	va_start(args, format);
@@ -345,6 +596,9 @@ hidpp_log_buffer(struct hidpp_device *dev,
 	_cleanup_free_ char *output_buf = NULL;
 	_cleanup_free_ char *bytes = NULL;
 
+	if (!hidpp_log_is_enabled(dev, priority))
+		return;
+
 	bytes = hidpp_buffer_to_string(buf, len);
 	asprintf(&output_buf, "%s %s", header ? header : "", bytes);
 
@@ -357,22 +611,151 @@ simple_log(void *userdata, enum hidpp_log_priority priority, const char *format,
 	vprintf(format, args);
 }
 
+static enum hidpp_log_priority
+simple_log_priority(void *userdata)
+{
+	return HIDPP_LOG_PRIORITY_INFO;
+}
+
 void
 hidpp_device_init(struct hidpp_device *dev, int fd)
 {
 	dev->hidraw_fd = fd;
-	hidpp_device_set_log_handler(dev, simple_log, HIDPP_LOG_PRIORITY_INFO, NULL);
+	hidpp_device_set_log_handler(dev, simple_log, simple_log_priority, NULL);
 	dev->supported_report_types = 0;
+	rtt_estimator_init(&dev->rtt, RTT_TIMEOUT_DEFAULT_MS);
+	dev->disconnected_ms = 0;
+	dev->io_stats = NULL;
+	memset(dev->requests, 0, sizeof(dev->requests));
+	dev->reply_len = 0;
+	dev->trace = NULL;
+	dev->trace_id = 0;
+	dev->mux = NULL;
+	dev->request_idx = 0;
+	dev->address_mask = 0xff;
+}
+
+void
+hidpp_device_set_io_stats(struct hidpp_device *dev,
+			  struct ratbag_io_stats_table *io_stats)
+{
+	dev->io_stats = io_stats;
+	memset(dev->requests, 0, sizeof(dev->requests));
+}
+
+void
+hidpp_device_set_trace(struct hidpp_device *dev,
+		       struct ratbag_trace *trace,
+		       uint16_t trace_id)
+{
+	dev->trace = trace;
+	dev->trace_id = trace_id;
+}
+
+void
+hidpp_device_set_timeout_ceiling(struct hidpp_device *dev, unsigned int ms)
+{
+	rtt_estimator_init(&dev->rtt, ms);
+}
+
+void
+hidpp_device_request_done(struct hidpp_device *dev, uint8_t address,
+			  uint8_t hidpp_err)
+{
+	struct hidpp_request *request;
+	uint64_t rtt;
+
+	request = hidpp_device_find_request(dev, hidpp_request_tag(dev, address));
+	if (!request)
+		return;
+
+	rtt = now(CLOCK_MONOTONIC) / 1000 - request->time_us;
+	rtt_estimator_sample(&dev->rtt, rtt);
+
+	if (request->stats) {
+		ratbag_io_stats_add_latency(request->stats, rtt);
+		request->stats->bytes_received += dev->reply_len;
+		if (hidpp_err)
+			request->stats->errors++;
+	}
+
+	memset(request, 0, sizeof(*request));
+}
+
+void
+hidpp_device_set_disconnected(struct hidpp_device *dev)
+{
+	if (dev->disconnected_ms == 0)
+		hidpp_log_debug(dev, "hidpp: device is not connected\n");
+
+	dev->disconnected_ms = max(now(CLOCK_MONOTONIC) / 1000 / 1000, 1ULL);
+}
+
+bool
+hidpp_device_update_connection(struct hidpp_device *dev, uint8_t device_idx,
+			       const uint8_t *buf, size_t len)
+{
+	if (len < SHORT_MESSAGE_LENGTH ||
+	    buf[0] != REPORT_ID_SHORT ||
+	    buf[1] != device_idx ||
+	    buf[2] != HIDPP_DEVICE_CONNECTION_NOTIF)
+		return false;
+
+	if (buf[4] & HIDPP_LINK_NOT_ESTABLISHED) {
+		hidpp_device_set_disconnected(dev);
+		return true;
+	}
+
+	if (dev->disconnected_ms)
+		hidpp_log_debug(dev, "hidpp: device is connected again\n");
+	dev->disconnected_ms = 0;
+
+	return false;
+}
+
+bool
+hidpp_device_is_disconnected(struct hidpp_device *dev, uint8_t device_idx)
+{
+	struct pollfd fds;
+	uint8_t buf[LONG_MESSAGE_LENGTH];
+	uint64_t ms;
+	int rc;
+
+	if (dev->disconnected_ms == 0)
+		return false;
+
+	fds.fd = dev->hidraw_fd;
+	fds.events = POLLIN;
+
+	while (dev->disconnected_ms && poll(&fds, 1, 0) > 0) {
+		rc = read(dev->hidraw_fd, buf, sizeof(buf));
+		if (rc <= 0)
+			break;
+		if (dev->mux && hidpp_mux_queue_foreign(dev->mux, device_idx, buf, rc))
+			continue;
+		hidpp_device_update_connection(dev, device_idx, buf, rc);
+	}
+
+	if (dev->disconnected_ms == 0)
+		return false;
+
+	ms = now(CLOCK_MONOTONIC) / 1000 / 1000;
+	if (ms - dev->disconnected_ms >= HIDPP_DISCONNECT_HOLDOFF_MS) {
+		dev->disconnected_ms = 0;
+		return false;
+	}
+
+	return true;
 }
 
 void
 hidpp_device_set_log_handler(struct hidpp_device *dev,
 			     hidpp_log_handler log_handler,
-			     enum hidpp_log_priority priority,
+			     hidpp_log_priority_handler log_priority,
 			     void *userdata)
 {
 	dev->log_handler = log_handler;
-	dev->log_priority = priority;
+	dev->log_priority = log_priority;
 	dev->userdata = userdata;
 }
 
@@ -382,7 +765,7 @@ hidpp_device_set_log_handler(struct hidpp_device *dev,
 #define CRC_CCITT_SEED	0xFFFF
 
 uint16_t
-hidpp_crc_ccitt(uint8_t *data, unsigned int length)
+hidpp_crc_ccitt(const uint8_t *data, unsigned int length)
 {
 	uint16_t crc, temp, quick;
 	unsigned int i;
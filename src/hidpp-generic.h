@@ -33,6 +33,8 @@
 #include <stddef.h>
 
 #include "libratbag-util.h"
+#include "libratbag-stats.h"
+#include "libratbag-trace.h"
 
 #define HIDPP_RECEIVER_IDX			0xFF
 #define HIDPP_WIRED_DEVICE_IDX			0x00
@@ -78,6 +80,14 @@
 #define HIDPP20_ERR_BUSY			0x08
 #define HIDPP20_ERR_UNSUPPORTED			0x09
 
+#define HIDPP_DEVICE_DISCONNECTION_NOTIF	0x40
+#define HIDPP_DEVICE_CONNECTION_NOTIF		0x41
+#define HIDPP_LINK_NOT_ESTABLISHED		(1 << 6)
+
+/* how long requests fail immediately after the receiver told us the
+ * device is not connected, unless a connection notification arrives */
+#define HIDPP_DISCONNECT_HOLDOFF_MS		5000
+
 /* Keep this in sync with ratbag_log_priority */
 enum hidpp_log_priority {
 	/**
@@ -95,18 +105,67 @@ typedef void (*hidpp_log_handler)(void *userdata,
 				  const char *format, va_list args)
 	__attribute__ ((format (printf, 3, 0)));
 
+/* the lowest priority that is logged, asked for on every message so a
+ * change of the priority takes effect right away */
+typedef enum hidpp_log_priority (*hidpp_log_priority_handler)(void *userdata);
+
 struct hidpp_hid_report {
 	unsigned int report_id;
 	unsigned int usage_page;
 	unsigned int usage;
 };
 
+/* number of messages for other devices a hidpp_mux keeps around */
+#define HIDPP_MUX_QUEUE_LEN			32
+
+struct hidpp_mux_message {
+	uint8_t len;
+	uint8_t data[LONG_MESSAGE_LENGTH];
+};
+
+/**
+ * A reader shared by all hidpp devices that talk through the same hidraw
+ * node, i.e. the paired devices of a receiver. Every read from the node
+ * goes through the mux, messages addressed to a device index other than
+ * the one of the pending request are queued instead of being dropped and
+ * handed out when a request to that device index reads next.
+ *
+ * The mux is owned by the caller and must outlive all devices using it.
+ */
+struct hidpp_mux {
+	int fd;
+	unsigned int head;	/* index of the oldest queued message */
+	unsigned int count;	/* number of queued messages */
+	uint64_t dropped;	/* messages evicted because the queue was full */
+	struct hidpp_mux_message queue[HIDPP_MUX_QUEUE_LEN];
+};
+
+/* requests that may be waiting for their reply at the same time */
+#define HIDPP_MAX_IN_FLIGHT	16
+
+/* a request written to the device and not answered yet */
+struct hidpp_request {
+	uint64_t time_us;		/* CLOCK_MONOTONIC of the write, 0 if unused */
+	struct ratbag_io_stats *stats;	/* may be NULL */
+	uint8_t tag;			/* address bits outside address_mask */
+};
+
 struct hidpp_device {
 	int hidraw_fd;
 	void *userdata;
 	hidpp_log_handler log_handler;
-	enum hidpp_log_priority log_priority;
+	hidpp_log_priority_handler log_priority;
 	unsigned supported_report_types;
+	struct rtt_estimator rtt;
+	uint64_t disconnected_ms;	/* CLOCK_MONOTONIC of the disconnect, 0 if connected */
+	struct ratbag_io_stats_table *io_stats;
+	struct hidpp_request requests[HIDPP_MAX_IN_FLIGHT];
+	size_t reply_len;		/* length of the last report read */
+	struct ratbag_trace *trace;
+	uint16_t trace_id;
+	struct hidpp_mux *mux;		/* NULL if the hidraw node is not shared */
+	uint8_t address_mask;		/* address bits identifying a request in the stats */
+	uint8_t request_idx;		/* device index of the last write */
 };
 
 #define HIDPP_REPORT_SHORT	(1 << 0)
@@ -117,9 +176,91 @@ hidpp_device_init(struct hidpp_device *dev, int fd);
 void
 hidpp_device_set_log_handler(struct hidpp_device *dev,
 			     hidpp_log_handler log_handler,
-			     enum hidpp_log_priority priority,
+			     hidpp_log_priority_handler log_priority,
 			     void *userdata);
 
+/**
+ * Set the upper bound in ms for how long a response is waited for. The
+ * actual timeout is derived from the round-trip times seen so far.
+ */
+void
+hidpp_device_set_timeout_ceiling(struct hidpp_device *dev, unsigned int ms);
+
+/**
+ * Account the I/O of this device in the given statistics table, may be
+ * NULL.
+ */
+void
+hidpp_device_set_io_stats(struct hidpp_device *dev,
+			  struct ratbag_io_stats_table *io_stats);
+
+/**
+ * Record the reports of this device in the given trace as device
+ * trace_id, trace may be NULL.
+ */
+void
+hidpp_device_set_trace(struct hidpp_device *dev,
+		       struct ratbag_trace *trace,
+		       uint16_t trace_id);
+
+void
+hidpp_mux_init(struct hidpp_mux *mux, int fd);
+
+/**
+ * Hand out the oldest message queued in the mux regardless of its device
+ * index, or read one that is pending on the hidraw node without blocking.
+ * Use this to consume notifications outside of a request.
+ *
+ * @return the length of the message, 0 if nothing is pending or a
+ * negative errno on error
+ */
+int
+hidpp_mux_read_pending(struct hidpp_mux *mux, uint8_t *buf, size_t size);
+
+/**
+ * Route all reads of this device through the given mux. The mux must be
+ * for the same hidraw fd as the device.
+ */
+void
+hidpp_device_set_mux(struct hidpp_device *dev, struct hidpp_mux *mux);
+
+/**
+ * Call when the reply (or HID++ error) to the request with the given
+ * address byte was received. Feeds the time since that request was
+ * written into the round-trip time estimate and the I/O statistics.
+ *
+ * Requests are told apart by the address bits outside address_mask, the
+ * HID++ 2.0 software id. Requests without such bits are answered in
+ * order, the oldest one is done.
+ */
+void
+hidpp_device_request_done(struct hidpp_device *dev, uint8_t address,
+			  uint8_t hidpp_err);
+
+/**
+ * Updates the connection state if buf is a receiver connection
+ * notification for the device at device_idx.
+ *
+ * @return true if the notification reports the device as disconnected
+ */
+bool
+hidpp_device_update_connection(struct hidpp_device *dev, uint8_t device_idx,
+			       const uint8_t *buf, size_t len);
+
+/**
+ * Mark the device as disconnected, requests fail with -ENOTCONN until
+ * either a connection notification arrives or the holdoff expires.
+ */
+void
+hidpp_device_set_disconnected(struct hidpp_device *dev);
+
+/**
+ * Checks whether the device was reported disconnected. Pending
+ * notifications are drained without blocking so a reconnect is noticed.
+ */
+bool
+hidpp_device_is_disconnected(struct hidpp_device *dev, uint8_t device_idx);
+
 extern const char *hidpp10_errors[0x100];
 extern const char *hidpp20_errors[0x100];
 
@@ -165,17 +306,45 @@ hidpp_log_buffer(struct hidpp_device *dev,
 		 const char *header,
 		 uint8_t *buf, size_t len);
 
-#define hidpp_log_raw(li_, ...) hidpp_log((li_), HIDPP_LOG_PRIORITY_RAW, __VA_ARGS__)
-#define hidpp_log_debug(li_, ...) hidpp_log((li_), HIDPP_LOG_PRIORITY_DEBUG, __VA_ARGS__)
-#define hidpp_log_info(li_, ...) hidpp_log((li_), HIDPP_LOG_PRIORITY_INFO, __VA_ARGS__)
-#define hidpp_log_error(li_, ...) hidpp_log((li_), HIDPP_LOG_PRIORITY_ERROR, __VA_ARGS__)
-#define hidpp_log_bug_kernel(li_, ...) hidpp((li_), HIDPP_LOG_PRIORITY_ERROR, "kernel bug: " __VA_ARGS__)
-#define hidpp_log_buf_raw(li_, h_, buf_, len_) hidpp_log_buffer(li_, HIDPP_LOG_PRIORITY_RAW, h_, buf_, len_)
-#define hidpp_log_buf_debug(li_, h_, buf_, len_) hidpp_log_buffer(li_, HIDPP_LOG_PRIORITY_DEBUG, h_, buf_, len_)
-#define hidpp_log_buf_info(li_, h_, buf_, len_) hidpp_log_buffer(li_, HIDPP_LOG_PRIORITY_INFO, h_, buf_, len_)
-#define hidpp_log_buf_error(li_, h_, buf_, len_) hidpp_log_buffer(li_, HIDPP_LOG_PRIORITY_ERROR, h_, buf_, len_)
-
-uint16_t hidpp_crc_ccitt(uint8_t *data, unsigned int length);
+/* Messages below this priority are compiled out, see the log-level
+ * build option. The values match enum ratbag_log_priority. */
+#ifndef RATBAG_LOG_PRIORITY_MIN
+#define RATBAG_LOG_PRIORITY_MIN HIDPP_LOG_PRIORITY_RAW
+#endif
+
+static inline bool
+hidpp_log_is_enabled(const struct hidpp_device *dev,
+		     enum hidpp_log_priority priority)
+{
+	return (int)priority >= (int)RATBAG_LOG_PRIORITY_MIN &&
+	       dev->log_priority(dev->userdata) <= priority;
+}
+
+/* see the log_* macros in libratbag-private.h */
+#define hidpp_log_if_enabled_(li_, p_, ...) \
+	do { \
+		struct hidpp_device *hidpp_log_dev_ = (li_); \
+		if (hidpp_log_is_enabled(hidpp_log_dev_, (p_))) \
+			hidpp_log(hidpp_log_dev_, (p_), __VA_ARGS__); \
+	} while (0)
+#define hidpp_log_buffer_if_enabled_(li_, p_, h_, buf_, len_) \
+	do { \
+		struct hidpp_device *hidpp_log_dev_ = (li_); \
+		if (hidpp_log_is_enabled(hidpp_log_dev_, (p_))) \
+			hidpp_log_buffer(hidpp_log_dev_, (p_), (h_), (buf_), (len_)); \
+	} while (0)
+
+#define hidpp_log_raw(li_, ...) hidpp_log_if_enabled_((li_), HIDPP_LOG_PRIORITY_RAW, __VA_ARGS__)
+#define hidpp_log_debug(li_, ...) hidpp_log_if_enabled_((li_), HIDPP_LOG_PRIORITY_DEBUG, __VA_ARGS__)
+#define hidpp_log_info(li_, ...) hidpp_log_if_enabled_((li_), HIDPP_LOG_PRIORITY_INFO, __VA_ARGS__)
+#define hidpp_log_error(li_, ...) hidpp_log_if_enabled_((li_), HIDPP_LOG_PRIORITY_ERROR, __VA_ARGS__)
+#define hidpp_log_bug_kernel(li_, ...) hidpp_log_if_enabled_((li_), HIDPP_LOG_PRIORITY_ERROR, "kernel bug: " __VA_ARGS__)
+#define hidpp_log_buf_raw(li_, h_, buf_, len_) hidpp_log_buffer_if_enabled_(li_, HIDPP_LOG_PRIORITY_RAW, h_, buf_, len_)
+#define hidpp_log_buf_debug(li_, h_, buf_, len_) hidpp_log_buffer_if_enabled_(li_, HIDPP_LOG_PRIORITY_DEBUG, h_, buf_, len_)
+#define hidpp_log_buf_info(li_, h_, buf_, len_) hidpp_log_buffer_if_enabled_(li_, HIDPP_LOG_PRIORITY_INFO, h_, buf_, len_)
+#define hidpp_log_buf_error(li_, h_, buf_, len_) hidpp_log_buffer_if_enabled_(li_, HIDPP_LOG_PRIORITY_ERROR, h_, buf_, len_)
+
+uint16_t hidpp_crc_ccitt(const uint8_t *data, unsigned int length);
 
 static inline uint16_t
 hidpp_be_u16_to_cpu(uint16_t data)
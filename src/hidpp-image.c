@@ -0,0 +1,281 @@
+/*
+ * Copyright © 2026 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hidpp-image.h"
+#include "libratbag-util.h"
+
+struct hidpp_image *
+hidpp_image_new(uint16_t sector_size)
+{
+	struct hidpp_image *image;
+
+	image = zalloc(sizeof(*image));
+	memcpy(image->header.magic, HIDPP_IMAGE_MAGIC, sizeof(image->header.magic));
+	image->header.version = HIDPP_IMAGE_VERSION;
+	image->header.sector_size = sector_size;
+
+	return image;
+}
+
+void
+hidpp_image_destroy(struct hidpp_image *image)
+{
+	if (!image)
+		return;
+
+	free(image->sectors);
+	free(image->data);
+	free(image);
+}
+
+void
+hidpp_image_add_sector(struct hidpp_image *image, uint16_t id,
+		       enum hidpp_image_sector_status status,
+		       const uint8_t *data)
+{
+	size_t n = image->header.nsectors;
+	size_t sector_size = image->header.sector_size;
+	uint8_t *dest;
+
+	assert(n < UINT16_MAX);
+
+	image->sectors = realloc(image->sectors, (n + 1) * sizeof(*image->sectors));
+	image->data = realloc(image->data, (n + 1) * sector_size);
+	if (!image->sectors || (!image->data && sector_size))
+		abort();
+
+	image->sectors[n] = (struct hidpp_image_sector) {
+		.id = id,
+		.status = status,
+	};
+
+	dest = image->data + n * sector_size;
+	if (data)
+		memcpy(dest, data, sector_size);
+	else
+		memset(dest, 0, sector_size);
+
+	image->header.nsectors++;
+}
+
+const uint8_t *
+hidpp_image_get_sector(const struct hidpp_image *image, uint16_t id,
+		       enum hidpp_image_sector_status *status)
+{
+	unsigned int i;
+
+	for (i = 0; i < image->header.nsectors; i++) {
+		if (image->sectors[i].id != id)
+			continue;
+
+		if (status)
+			*status = image->sectors[i].status;
+		return image->data + i * image->header.sector_size;
+	}
+
+	return NULL;
+}
+
+static int
+write_all(int fd, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	ssize_t rc;
+
+	while (len > 0) {
+		rc = write(fd, p, len);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		p += rc;
+		len -= rc;
+	}
+
+	return 0;
+}
+
+/* returns 0 on success, -EBADMSG on a short read or a negative errno */
+static int
+read_all(int fd, void *data, size_t len)
+{
+	uint8_t *p = data;
+	ssize_t rc;
+
+	while (len > 0) {
+		rc = read(fd, p, len);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (rc == 0)
+			return -EBADMSG;
+		p += rc;
+		len -= rc;
+	}
+
+	return 0;
+}
+
+#define HEADER_OFFSET(field_) offsetof(struct hidpp_image_header, field_)
+#define SECTOR_OFFSET(field_) offsetof(struct hidpp_image_sector, field_)
+
+static void
+hidpp_image_encode_header(const struct hidpp_image_header *header,
+			  uint8_t buf[sizeof(struct hidpp_image_header)])
+{
+	memset(buf, 0, sizeof(*header));
+	memcpy(&buf[HEADER_OFFSET(magic)], header->magic, sizeof(header->magic));
+	set_unaligned_le_u32(&buf[HEADER_OFFSET(version)], header->version);
+	set_unaligned_le_u16(&buf[HEADER_OFFSET(bustype)], header->bustype);
+	set_unaligned_le_u16(&buf[HEADER_OFFSET(vendor)], header->vendor);
+	set_unaligned_le_u16(&buf[HEADER_OFFSET(product)], header->product);
+	buf[HEADER_OFFSET(proto_major)] = header->proto_major;
+	buf[HEADER_OFFSET(proto_minor)] = header->proto_minor;
+	memcpy(&buf[HEADER_OFFSET(fw_prefix)], header->fw_prefix,
+	       sizeof(header->fw_prefix));
+	buf[HEADER_OFFSET(fw_major)] = header->fw_major;
+	buf[HEADER_OFFSET(fw_minor)] = header->fw_minor;
+	set_unaligned_le_u16(&buf[HEADER_OFFSET(fw_build)], header->fw_build);
+	set_unaligned_le_u16(&buf[HEADER_OFFSET(sector_size)], header->sector_size);
+	set_unaligned_le_u16(&buf[HEADER_OFFSET(nsectors)], header->nsectors);
+}
+
+static void
+hidpp_image_decode_header(const uint8_t buf[sizeof(struct hidpp_image_header)],
+			  struct hidpp_image_header *header)
+{
+	memcpy(header->magic, &buf[HEADER_OFFSET(magic)], sizeof(header->magic));
+	header->version = get_unaligned_le_u32(&buf[HEADER_OFFSET(version)]);
+	header->bustype = get_unaligned_le_u16(&buf[HEADER_OFFSET(bustype)]);
+	header->vendor = get_unaligned_le_u16(&buf[HEADER_OFFSET(vendor)]);
+	header->product = get_unaligned_le_u16(&buf[HEADER_OFFSET(product)]);
+	header->proto_major = buf[HEADER_OFFSET(proto_major)];
+	header->proto_minor = buf[HEADER_OFFSET(proto_minor)];
+	memcpy(header->fw_prefix, &buf[HEADER_OFFSET(fw_prefix)],
+	       sizeof(header->fw_prefix));
+	header->fw_major = buf[HEADER_OFFSET(fw_major)];
+	header->fw_minor = buf[HEADER_OFFSET(fw_minor)];
+	header->fw_build = get_unaligned_le_u16(&buf[HEADER_OFFSET(fw_build)]);
+	header->sector_size = get_unaligned_le_u16(&buf[HEADER_OFFSET(sector_size)]);
+	header->nsectors = get_unaligned_le_u16(&buf[HEADER_OFFSET(nsectors)]);
+}
+
+int
+hidpp_image_write_fd(const struct hidpp_image *image, int fd)
+{
+	const struct hidpp_image_header *header = &image->header;
+	uint8_t header_buf[sizeof(*header)];
+	_cleanup_free_ uint8_t *sectors = NULL;
+	size_t sectors_size = header->nsectors * sizeof(*image->sectors);
+	uint8_t *s;
+	int rc;
+
+	hidpp_image_encode_header(header, header_buf);
+	rc = write_all(fd, header_buf, sizeof(header_buf));
+	if (rc)
+		return rc;
+
+	sectors = zalloc(max(sectors_size, 1U));
+	for (unsigned int i = 0; i < header->nsectors; i++) {
+		s = &sectors[i * sizeof(*image->sectors)];
+		set_unaligned_le_u16(&s[SECTOR_OFFSET(id)], image->sectors[i].id);
+		s[SECTOR_OFFSET(status)] = image->sectors[i].status;
+	}
+
+	rc = write_all(fd, sectors, sectors_size);
+	if (rc)
+		return rc;
+
+	return write_all(fd, image->data,
+			 (size_t)header->nsectors * header->sector_size);
+}
+
+int
+hidpp_image_read_fd(int fd, struct hidpp_image **out)
+{
+	struct hidpp_image *image;
+	struct hidpp_image_header header;
+	uint8_t header_buf[sizeof(header)];
+	_cleanup_free_ uint8_t *sectors = NULL;
+	size_t sectors_size, data_size;
+	const uint8_t *s;
+	int rc;
+
+	rc = read_all(fd, header_buf, sizeof(header_buf));
+	if (rc == -EBADMSG)
+		return -EINVAL;
+	if (rc)
+		return rc;
+
+	hidpp_image_decode_header(header_buf, &header);
+
+	if (memcmp(header.magic, HIDPP_IMAGE_MAGIC, sizeof(header.magic)) != 0 ||
+	    header.version != HIDPP_IMAGE_VERSION)
+		return -EINVAL;
+
+	/* don't let a corrupt header make us allocate up to 4GB */
+	sectors_size = header.nsectors * sizeof(*image->sectors);
+	data_size = (size_t)header.nsectors * header.sector_size;
+	if (data_size > HIDPP_IMAGE_MAX_DATA_SIZE)
+		return -EBADMSG;
+
+	image = zalloc(sizeof(*image));
+	image->header = header;
+	image->sectors = zalloc(max(sectors_size, 1U));
+	image->data = zalloc(max(data_size, 1U));
+	sectors = zalloc(max(sectors_size, 1U));
+
+	rc = read_all(fd, sectors, sectors_size);
+	if (rc == 0)
+		rc = read_all(fd, image->data, data_size);
+	if (rc) {
+		hidpp_image_destroy(image);
+		return rc;
+	}
+
+	for (unsigned int i = 0; i < header.nsectors; i++) {
+		s = &sectors[i * sizeof(*image->sectors)];
+		image->sectors[i].id = get_unaligned_le_u16(&s[SECTOR_OFFSET(id)]);
+		image->sectors[i].status = s[SECTOR_OFFSET(status)];
+		if (image->sectors[i].status > HIDPP_IMAGE_SECTOR_UNREADABLE) {
+			hidpp_image_destroy(image);
+			return -EBADMSG;
+		}
+	}
+
+	*out = image;
+
+	return 0;
+}
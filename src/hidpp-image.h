@@ -0,0 +1,130 @@
+/*
+ * Copyright © 2026 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Image of the onboard memory of a HID++ device, i.e. the flash pages of a
+ * HID++ 1.0 device or the flash and ROM sectors of a HID++ 2.0 device.
+ * Images are written by hidpp10-dump-page and hidpp20-dump-page and can
+ * be loaded with hidpp_image_read_fd() to replay a device's memory.
+ *
+ * The file format is a struct hidpp_image_header, followed by nsectors
+ * struct hidpp_image_sector, followed by nsectors * sector_size bytes of
+ * sector data in the same order. The structs are laid out without padding
+ * and all multi-byte values are little-endian in the file, in memory they
+ * are in host byte order.
+ */
+
+#define HIDPP_IMAGE_MAGIC		"HPPIMG\0\0"
+#define HIDPP_IMAGE_VERSION		1
+
+/* Upper limit of nsectors * sector_size accepted by hidpp_image_read_fd(),
+ * well above the onboard memory of any known device */
+#define HIDPP_IMAGE_MAX_DATA_SIZE	(4 * 1024 * 1024)
+
+enum hidpp_image_sector_status {
+	HIDPP_IMAGE_SECTOR_OK = 0,
+	HIDPP_IMAGE_SECTOR_BAD_CRC,	/* data as read, the CRC does not match */
+	HIDPP_IMAGE_SECTOR_UNREADABLE,	/* data is all zeroes */
+};
+
+struct hidpp_image_header {
+	char magic[8];
+	uint32_t version;
+	uint16_t bustype;
+	uint16_t vendor;
+	uint16_t product;
+	uint8_t proto_major;
+	uint8_t proto_minor;
+	char fw_prefix[4];	/* NUL-padded, empty for HID++ 1.0 */
+	uint8_t fw_major;
+	uint8_t fw_minor;
+	uint16_t fw_build;
+	uint16_t sector_size;
+	uint16_t nsectors;
+};
+
+struct hidpp_image_sector {
+	uint16_t id;		/* HID++ 1.0 page or HID++ 2.0 sector */
+	uint8_t status;		/* enum hidpp_image_sector_status */
+	uint8_t reserved;
+};
+
+_Static_assert(sizeof(struct hidpp_image_header) == 32, "image header size changed");
+_Static_assert(sizeof(struct hidpp_image_sector) == 4, "image sector size changed");
+
+struct hidpp_image {
+	struct hidpp_image_header header;
+	struct hidpp_image_sector *sectors;
+	uint8_t *data;		/* header.nsectors * header.sector_size */
+};
+
+/**
+ * Create an empty image for sectors of sector_size bytes. The caller
+ * fills in the rest of the header.
+ */
+struct hidpp_image *
+hidpp_image_new(uint16_t sector_size);
+
+void
+hidpp_image_destroy(struct hidpp_image *image);
+
+/**
+ * Append a sector to the image. data must be sector_size bytes, it is
+ * copied. If data is NULL, the sector is stored as all zeroes.
+ */
+void
+hidpp_image_add_sector(struct hidpp_image *image, uint16_t id,
+		       enum hidpp_image_sector_status status,
+		       const uint8_t *data);
+
+/**
+ * Find the sector with the given id.
+ *
+ * @return the sector's data or NULL if the image does not contain it
+ */
+const uint8_t *
+hidpp_image_get_sector(const struct hidpp_image *image, uint16_t id,
+		       enum hidpp_image_sector_status *status);
+
+/**
+ * @return 0 on success or a negative errno on error
+ */
+int
+hidpp_image_write_fd(const struct hidpp_image *image, int fd);
+
+/**
+ * Load an image written by hidpp_image_write_fd().
+ *
+ * @return 0 on success or a negative errno on error
+ * @retval -EINVAL The file is not a HID++ image
+ * @retval -EBADMSG The file is truncated or inconsistent, e.g. a sector
+ * has an unknown status, or the sector data exceeds
+ * HIDPP_IMAGE_MAX_DATA_SIZE
+ */
+int
+hidpp_image_read_fd(int fd, struct hidpp_image **out);
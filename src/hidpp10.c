@@ -184,16 +184,23 @@ hidpp10_request_command(struct hidpp10_device *dev, union hidpp10_message *msg)
 		return -EINVAL;
 	}
 
+	/* don't wait for a device the receiver told us is gone */
+	if (msg->msg.device_idx != HIDPP_RECEIVER_IDX &&
+	    hidpp_device_is_disconnected(&dev->base, msg->msg.device_idx))
+		return -ENOTCONN;
+
 	/* create the expected header */
 	expected_header = *msg;
 
-	txdata = hidpp_buffer_to_string(&msg->data[4], command_size - 4);
-	hidpp_log_raw(&dev->base, "hidpp10 tx:  %02x | %02x | %02x | %02x | %s\n",
-		      msg->msg.report_id,
-		      msg->msg.device_idx,
-		      msg->msg.sub_id,
-		      msg->msg.address,
-		      txdata);
+	if (hidpp_log_is_enabled(&dev->base, HIDPP_LOG_PRIORITY_RAW)) {
+		txdata = hidpp_buffer_to_string(&msg->data[4], command_size - 4);
+		hidpp_log_raw(&dev->base, "hidpp10 tx:  %02x | %02x | %02x | %02x | %s\n",
+			      msg->msg.report_id,
+			      msg->msg.device_idx,
+			      msg->msg.sub_id,
+			      msg->msg.address,
+			      txdata);
+	}
 
 	/* response message length doesn't depend on request length */
 #if 0
@@ -211,13 +218,15 @@ hidpp10_request_command(struct hidpp10_device *dev, union hidpp10_message *msg)
 	 * loop until we get the actual answer or an error code.
 	 */
 	do {
+		/* hidpp_read_response() backs off and retries on timeouts */
 		ret = hidpp_read_response(&dev->base, read_buffer.data, LONG_MESSAGE_LENGTH);
+		if (ret < 0)
+			break;
 
-		/* Wait and retry if the USB timed out */
-		if (ret == -ETIMEDOUT) {
-			msleep(10);
-			ret = hidpp_read_response(&dev->base, read_buffer.data, LONG_MESSAGE_LENGTH);
-		}
+		if (msg->msg.device_idx != HIDPP_RECEIVER_IDX &&
+		    hidpp_device_update_connection(&dev->base, msg->msg.device_idx,
+						   read_buffer.data, ret))
+			return -ENOTCONN;
 
 		/* Overwrite the return device index with ours. The kernel
 		 * sets our device index on write, but gives us the real
@@ -227,12 +236,23 @@ hidpp10_request_command(struct hidpp10_device *dev, union hidpp10_message *msg)
 		read_buffer.msg.device_idx = msg->msg.device_idx;
 
 		/* actual answer */
-		if (!memcmp(&read_buffer.data[1], &expected_header.data[1], 3))
+		if (!memcmp(&read_buffer.data[1], &expected_header.data[1], 3)) {
+			hidpp_device_request_done(&dev->base, msg->msg.address, 0);
 			break;
+		}
 
 		/* error */
 		if (!memcmp(read_buffer.data, expected_error_dev.data, 5)) {
 			hidpp_err = read_buffer.msg.parameters[1];
+			hidpp_device_request_done(&dev->base, msg->msg.address, hidpp_err);
+
+			/* the receiver can't reach the device */
+			if (msg->msg.device_idx != HIDPP_RECEIVER_IDX &&
+			    hidpp_err == HIDPP10_ERR_RESOURCE_ERROR) {
+				hidpp_device_set_disconnected(&dev->base);
+				return -ENOTCONN;
+			}
+
 			hidpp_log_raw(&dev->base,
 				"    HID++ error from the %s (%d): %s (%02x)\n",
 				read_buffer.msg.device_idx == HIDPP_RECEIVER_IDX ? "receiver" : "device",
@@ -249,13 +269,15 @@ hidpp10_request_command(struct hidpp10_device *dev, union hidpp10_message *msg)
 		goto out_err;
 	}
 
-	rxdata = hidpp_buffer_to_string(&read_buffer.data[4], ret - 4);
-	hidpp_log_raw(&dev->base, "hidpp10 rx:  %02x | %02x | %02x | %02x | %s\n",
-		      read_buffer.msg.report_id,
-		      read_buffer.msg.device_idx,
-		      read_buffer.msg.sub_id,
-		      read_buffer.msg.address,
-		      rxdata);
+	if (hidpp_log_is_enabled(&dev->base, HIDPP_LOG_PRIORITY_RAW)) {
+		rxdata = hidpp_buffer_to_string(&read_buffer.data[4], ret - 4);
+		hidpp_log_raw(&dev->base, "hidpp10 rx:  %02x | %02x | %02x | %02x | %s\n",
+			      read_buffer.msg.report_id,
+			      read_buffer.msg.device_idx,
+			      read_buffer.msg.sub_id,
+			      read_buffer.msg.address,
+			      rxdata);
+	}
 
 	if (!hidpp_err) {
 		/* copy the answer for the caller */
@@ -2248,6 +2270,50 @@ hidpp10_set_usb_refresh_rate(struct hidpp10_device *dev,
 	return hidpp10_request_command(dev, &refresh);
 }
 
+/* -------------------------------------------------------------------------- */
+/* Flash page cache                                                           */
+/* -------------------------------------------------------------------------- */
+
+static struct hidpp10_cached_page *
+hidpp10_page_cache_find(struct hidpp10_device *dev, uint8_t page)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_LENGTH(dev->page_cache); i++) {
+		if (dev->page_cache[i].valid && dev->page_cache[i].page == page)
+			return &dev->page_cache[i];
+	}
+
+	return NULL;
+}
+
+static void
+hidpp10_page_cache_drop(struct hidpp10_device *dev, uint8_t page)
+{
+	struct hidpp10_cached_page *cached;
+
+	cached = hidpp10_page_cache_find(dev, page);
+	if (cached)
+		cached->valid = false;
+}
+
+static void
+hidpp10_page_cache_store(struct hidpp10_device *dev, uint8_t page,
+			 const uint8_t bytes[HIDPP10_PAGE_SIZE])
+{
+	struct hidpp10_cached_page *cached;
+
+	cached = hidpp10_page_cache_find(dev, page);
+	if (!cached) {
+		cached = &dev->page_cache[dev->page_cache_next];
+		dev->page_cache_next = (dev->page_cache_next + 1) % ARRAY_LENGTH(dev->page_cache);
+	}
+
+	cached->valid = true;
+	cached->page = page;
+	memcpy(cached->data, bytes, HIDPP10_PAGE_SIZE);
+}
+
 /* -------------------------------------------------------------------------- */
 /* 0xA0: Generic Memory Management                                            */
 /* -------------------------------------------------------------------------- */
@@ -2287,6 +2353,8 @@ hidpp10_erase_memory(struct hidpp10_device *dev, uint8_t page)
 
 	hidpp_log_raw(&dev->base, "Erasing page 0x%02x\n", page);
 
+	hidpp10_page_cache_drop(dev, page);
+
 	return hidpp10_request_command(dev, &erase);
 }
 
@@ -2314,6 +2382,8 @@ hidpp10_write_flash(struct hidpp10_device *dev,
 		      src_page, src_offset,
 		      dst_page, dst_offset);
 
+	hidpp10_page_cache_drop(dev, dst_page);
+
 	return hidpp10_request_command(dev, &copy);
 }
 
@@ -2469,6 +2539,8 @@ hidpp10_send_hot_payload(struct hidpp10_device *dev,
 	unsigned int index = 0;
 	int res;
 
+	hidpp10_page_cache_drop(dev, dst_page);
+
 	res = hidpp10_hot_ctrl_reset(dev);
 	if (res < 0)
 		return res;
@@ -2531,13 +2603,139 @@ hidpp10_read_memory(struct hidpp10_device *dev, uint8_t page, uint16_t offset,
 	return 0;
 }
 
+/* number of 0xA2 reads hidpp10_read_page() keeps in flight */
+#define HIDPP10_READ_WINDOW			4
+
+static bool
+hidpp10_page_crc_is_valid(uint8_t bytes[HIDPP10_PAGE_SIZE])
+{
+	uint16_t crc, read_crc;
+
+	crc = hidpp_crc_ccitt(bytes, HIDPP10_PAGE_SIZE - 2);
+	read_crc = get_unaligned_be_u16(&bytes[HIDPP10_PAGE_SIZE - 2]);
+
+	return crc == read_crc;
+}
+
+/**
+ * Read a page with up to HIDPP10_READ_WINDOW requests outstanding. The
+ * replies don't carry the page or offset they belong to, so they are
+ * assigned in the order the requests went out; the page CRC catches
+ * anything that arrived out of order.
+ */
+static int
+hidpp10_read_page_pipelined(struct hidpp10_device *dev, uint8_t page,
+			    uint8_t bytes[HIDPP10_PAGE_SIZE])
+{
+	const unsigned int nchunks = HIDPP10_PAGE_SIZE / 16;
+	unsigned int sent = 0, received = 0;
+	union hidpp10_message reply;
+	int res = 0;
+
+	if (hidpp_device_is_disconnected(&dev->base, dev->index))
+		return -ENOTCONN;
+
+	while (received < nchunks) {
+		while (sent < nchunks && sent - received < HIDPP10_READ_WINDOW) {
+			union hidpp10_message readmem = CMD_READ_MEMORY(dev->index, page, sent * 16 / 2);
+
+			res = hidpp_write_command(&dev->base, readmem.data, SHORT_MESSAGE_LENGTH);
+			if (res)
+				goto out;
+			sent++;
+		}
+
+		res = hidpp_read_response(&dev->base, reply.data, LONG_MESSAGE_LENGTH);
+		if (res < 0)
+			goto out;
+
+		if (hidpp_device_update_connection(&dev->base, dev->index,
+						   reply.data, res))
+			return -ENOTCONN;
+
+		/* the kernel rewrites the device index on receiver nodes,
+		 * only match on the register */
+		if (reply.msg.sub_id == GET_LONG_REGISTER_RSP &&
+		    reply.msg.address == __CMD_READ_MEMORY) {
+			hidpp_device_request_done(&dev->base, reply.msg.address, 0);
+			memcpy(bytes + received * 16, reply.msg.string, 16);
+			received++;
+			continue;
+		}
+
+		if (reply.msg.sub_id == __ERROR_MSG &&
+		    reply.msg.address == GET_LONG_REGISTER_REQ &&
+		    reply.msg.parameters[0] == __CMD_READ_MEMORY) {
+			hidpp_device_request_done(&dev->base, reply.msg.parameters[0],
+						  reply.msg.parameters[1]);
+			received++;
+			res = -EIO;
+			goto out;
+		}
+	}
+
+	return 0;
+
+out:
+	/* drain what is still in flight so the next request starts clean */
+	while (received < sent) {
+		if (hidpp_read_response(&dev->base, reply.data, LONG_MESSAGE_LENGTH) < 0)
+			break;
+		if (reply.msg.sub_id == GET_LONG_REGISTER_RSP ||
+		    reply.msg.sub_id == __ERROR_MSG) {
+			/* replies are in order, this is the oldest request */
+			hidpp_device_request_done(&dev->base, reply.msg.address,
+						  reply.msg.sub_id == __ERROR_MSG ?
+						  reply.msg.parameters[1] : 0);
+			received++;
+		}
+	}
+
+	return res;
+}
+
 int
 hidpp10_read_page(struct hidpp10_device *dev, uint8_t page,
 		  uint8_t bytes[HIDPP10_PAGE_SIZE])
 {
+	struct hidpp10_cached_page *cached;
 	unsigned int i;
 	int res;
-	uint16_t crc, read_crc;
+
+	if (page > HIDPP10_MAX_PAGE_NUMBER)
+		return -EINVAL;
+
+	cached = hidpp10_page_cache_find(dev, page);
+	if (cached) {
+		uint8_t tail[16];
+
+		res = hidpp10_read_memory(dev, page, HIDPP10_PAGE_SIZE - 16, tail);
+		if (res < 0)
+			return res;
+
+		/* the cache may have been loaded from disk, check the CRC too */
+		if (res == 0 &&
+		    memcmp(tail, &cached->data[HIDPP10_PAGE_SIZE - 16], sizeof(tail)) == 0 &&
+		    hidpp10_page_crc_is_valid(cached->data)) {
+			memcpy(bytes, cached->data, HIDPP10_PAGE_SIZE);
+			return 0;
+		}
+
+		cached->valid = false;
+	}
+
+	res = hidpp10_read_page_pipelined(dev, page, bytes);
+	if (res == -ENOTCONN)
+		return res;
+
+	if (res == 0 && hidpp10_page_crc_is_valid(bytes)) {
+		hidpp10_page_cache_store(dev, page, bytes);
+		return 0;
+	}
+
+	hidpp_log_debug(&dev->base,
+			"Pipelined read of page %d failed (%d), reading it sequentially\n",
+			page, res);
 
 	for (i = 0; i < HIDPP10_PAGE_SIZE; i += 16) {
 		res = hidpp10_read_memory(dev, page, i, bytes + i);
@@ -2545,12 +2743,11 @@ hidpp10_read_page(struct hidpp10_device *dev, uint8_t page,
 			return res;
 	}
 
-	crc = hidpp_crc_ccitt(bytes, HIDPP10_PAGE_SIZE - 2);
-	read_crc = get_unaligned_be_u16(&bytes[HIDPP10_PAGE_SIZE - 2]);
-
-	if (crc != read_crc)
+	if (!hidpp10_page_crc_is_valid(bytes))
 		return -EILSEQ; /* return illegal sequence */
 
+	hidpp10_page_cache_store(dev, page, bytes);
+
 	return 0;
 }
 
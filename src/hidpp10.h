@@ -42,6 +42,11 @@ struct dpi_range;
 
 #define HIDPP10_MAX_PAGE_NUMBER 31
 
+#define HIDPP10_PAGE_SIZE		(16 * 2 * 16)
+
+/* number of flash pages hidpp10_read_page() keeps per device */
+#define HIDPP10_PAGE_CACHE_SIZE		8
+
 enum hidpp10_profile_type {
 	HIDPP10_PROFILE_UNKNOWN = -1,
 	HIDPP10_PROFILE_G500,
@@ -57,6 +62,12 @@ struct hidpp10_dpi_mapping {
 	unsigned dpi;
 };
 
+struct hidpp10_cached_page {
+	bool valid;
+	uint8_t page;
+	uint8_t data[HIDPP10_PAGE_SIZE];
+};
+
 struct hidpp10_device  {
 	struct hidpp_device base;
 	unsigned index;
@@ -67,6 +78,9 @@ struct hidpp10_device  {
 	enum hidpp10_profile_type profile_type;
 	struct hidpp10_profile *profiles;
 	unsigned int profile_count;
+
+	struct hidpp10_cached_page page_cache[HIDPP10_PAGE_CACHE_SIZE];
+	unsigned int page_cache_next;	/* slot to replace next */
 };
 
 int
@@ -664,14 +678,18 @@ hidpp10_send_hot_payload(struct hidpp10_device *dev,
 /* 0xA2: Read Sector                                                          */
 /* -------------------------------------------------------------------------- */
 
-#define HIDPP10_PAGE_SIZE		(16 * 2 * 16)
-
 int
 hidpp10_read_memory(struct hidpp10_device *dev,
 		    uint8_t page,
 		    uint16_t offset,
 		    uint8_t bytes[16]);
 
+/**
+ * Read a full flash page and verify its CRC. Pages are cached per device,
+ * a cached page is only re-read if its last 16 bytes, which include the
+ * CRC, differ from the cached copy. Erasing or writing a page through
+ * this device drops it from the cache.
+ */
 int
 hidpp10_read_page(struct hidpp10_device *dev, uint8_t page,
 		  uint8_t bytes[HIDPP10_PAGE_SIZE]);
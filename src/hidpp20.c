@@ -115,24 +115,163 @@ hidpp20_get_quirk_string(enum hidpp20_quirk quirk)
 	abort();
 }
 
+static inline uint8_t
+hidpp20_swid_next(uint8_t swid)
+{
+	return swid >= HIDPP20_SWID_LAST ? HIDPP20_SWID_FIRST : swid + 1;
+}
+
+uint8_t
+hidpp20_swid_alloc(struct hidpp20_device *device)
+{
+	const unsigned int nids = HIDPP20_SWID_LAST - HIDPP20_SWID_FIRST + 1;
+	uint8_t swid = device->next_swid;
+
+	if (swid < HIDPP20_SWID_FIRST || swid > HIDPP20_SWID_LAST)
+		swid = HIDPP20_SWID_FIRST;
+
+	for (unsigned int i = 0; i < nids; i++) {
+		if (!(device->swids_in_flight & (1 << swid)))
+			break;
+
+		swid = hidpp20_swid_next(swid);
+	}
+
+	/* every id is waiting for a late reply, those are most likely lost
+	 * for good */
+	if (device->swids_in_flight & (1 << swid)) {
+		hidpp_log_debug(&device->base,
+				"hidpp20: no late replies for software ids %#06x, reusing them\n",
+				device->swids_in_flight);
+		device->swids_in_flight = 0;
+	}
+
+	device->swids_in_flight |= 1 << swid;
+	device->next_swid = hidpp20_swid_next(swid);
+
+	return swid;
+}
+
+static inline bool
+hidpp20_reply_is_error(const union hidpp20_message *buf)
+{
+	return buf->msg.sub_id == __ERROR_MSG || buf->msg.sub_id == 0xff;
+}
+
+/* the software id of the request buf answers */
+static inline uint8_t
+hidpp20_reply_swid(const union hidpp20_message *buf)
+{
+	if (hidpp20_reply_is_error(buf))
+		return buf->msg.parameters[0] & 0xf;
+
+	return buf->msg.address & 0xf;
+}
+
+/**
+ * Check whether buf is a late reply to an earlier request that timed
+ * out and release that request's software id if so.
+ */
+static bool
+hidpp20_swid_release_late(struct hidpp20_device *device,
+			  const union hidpp20_message *buf,
+			  uint8_t current_swid)
+{
+	uint8_t swid = hidpp20_reply_swid(buf);
+
+	if (swid == current_swid || !(device->swids_in_flight & (1 << swid)))
+		return false;
+
+	hidpp_log_debug(&device->base,
+			"hidpp20: discarding late reply for software id %#x\n",
+			swid);
+	device->swids_in_flight &= ~(1 << swid);
+
+	return true;
+}
+
+/**
+ * Check whether reply answers the request msg and finish the request if
+ * so.
+ *
+ * returns -EAGAIN if reply belongs to another request, 0 for the answer,
+ * the HID++ error code if the device reported an error or -ENOTCONN if
+ * the receiver told us the device is gone.
+ */
+static int
+hidpp20_request_decode_reply(struct hidpp20_device *device,
+			     const union hidpp20_message *msg,
+			     const union hidpp20_message *reply,
+			     bool allow_error)
+{
+	uint8_t swid = msg->msg.address & 0xf;
+	uint8_t hidpp_err;
+
+	/* actual answer */
+	if (reply->msg.sub_id == msg->msg.sub_id &&
+	    reply->msg.address == msg->msg.address) {
+		device->swids_in_flight &= ~(1 << swid);
+		hidpp_device_request_done(&device->base, msg->msg.address, 0);
+		return 0;
+	}
+
+	if (!hidpp20_reply_is_error(reply) ||
+	    reply->msg.address != msg->msg.sub_id ||
+	    reply->msg.parameters[0] != msg->msg.address)
+		return -EAGAIN;
+
+	/* error */
+	hidpp_err = reply->msg.parameters[1];
+	device->swids_in_flight &= ~(1 << swid);
+	hidpp_device_request_done(&device->base, msg->msg.address, hidpp_err);
+
+	/* The receiver answers with a HID++ 1.0 error if
+	 * the device is not reachable */
+	if (reply->msg.sub_id == __ERROR_MSG &&
+	    hidpp_err == HIDPP10_ERR_RESOURCE_ERROR) {
+		hidpp_device_set_disconnected(&device->base);
+		return -ENOTCONN;
+	}
+
+	if (allow_error)
+		hidpp_log_debug(&device->base,
+				"    HID++ error from the device (%d): %s (%02x)\n",
+				reply->msg.device_idx,
+				hidpp20_errors[hidpp_err] ? hidpp20_errors[hidpp_err] : "Undocumented error code",
+				hidpp_err);
+	else
+		hidpp_log_error(&device->base,
+				"    HID++ error from the device (%d): %s (%02x)\n",
+				reply->msg.device_idx,
+				hidpp20_errors[hidpp_err] ? hidpp20_errors[hidpp_err] : "Undocumented error code",
+				hidpp_err);
+
+	return hidpp_err;
+}
+
 static int
 hidpp20_request_command_allow_error(struct hidpp20_device *device, union hidpp20_message *msg,
 				    bool allow_error)
 {
 	union hidpp20_message read_buffer;
-	int ret;
+	int ret, rc;
 	uint8_t hidpp_err = 0;
 	size_t msg_len;
+	uint8_t swid;
 
 	/* msg->address is 4 MSB: subcommand, 4 LSB: 4-bit SW identifier so
-	 * the device knows who to respond to. kernel uses 0x1 */
-	const int DEVICE_SW_ID = 0x8;
-
+	 * the device knows who to respond to, see hidpp20_swid_alloc() */
 	if (msg->msg.address & 0xf) {
 		hidpp_log_raw(&device->base, "hidpp20 error: sw address is already set\n");
 		return -EINVAL;
 	}
-	msg->msg.address |= DEVICE_SW_ID;
+
+	/* don't wait for a device the receiver told us is gone */
+	if (hidpp_device_is_disconnected(&device->base, device->index))
+		return -ENOTCONN;
+
+	swid = hidpp20_swid_alloc(device);
+	msg->msg.address |= swid;
 
 	/* some mice don't support short reports */
 	if (msg->msg.report_id == REPORT_ID_SHORT && !(device->base.supported_report_types & HIDPP_REPORT_SHORT))
@@ -148,51 +287,40 @@ hidpp20_request_command_allow_error(struct hidpp20_device *device, union hidpp20
 
 	/* Send the message to the Device */
 	ret = hidpp_write_command(&device->base, msg->data, msg_len);
-	if (ret)
+	if (ret) {
+		device->swids_in_flight &= ~(1 << swid);
 		goto out_err;
+	}
 
 	/*
 	 * Now read the answers from the device:
 	 * loop until we get the actual answer or an error code.
 	 */
 	do {
+		/* hidpp_read_response() backs off and retries on timeouts */
 		ret = hidpp_read_response(&device->base, read_buffer.data, LONG_MESSAGE_LENGTH);
-
-		/* Wait and retry if the USB timed out */
-		if (ret == -ETIMEDOUT) {
-			msleep(10);
-			ret = hidpp_read_response(&device->base, read_buffer.data, LONG_MESSAGE_LENGTH);
-		}
+		if (ret < 0)
+			break;
 
 		if (read_buffer.msg.report_id != REPORT_ID_SHORT &&
 		    read_buffer.msg.report_id != REPORT_ID_LONG)
 			continue;
 
-		/* actual answer */
-		if (read_buffer.msg.sub_id == msg->msg.sub_id &&
-		    read_buffer.msg.address == msg->msg.address)
-			break;
+		if (hidpp_device_update_connection(&device->base, device->index,
+						   read_buffer.data, ret))
+			return -ENOTCONN;
 
-		/* error */
-		if ((read_buffer.msg.sub_id == __ERROR_MSG ||
-		     read_buffer.msg.sub_id == 0xff) &&
-		    read_buffer.msg.address == msg->msg.sub_id &&
-		    read_buffer.msg.parameters[0] == msg->msg.address) {
-			hidpp_err = read_buffer.msg.parameters[1];
-			if (allow_error)
-				hidpp_log_debug(&device->base,
-						"    HID++ error from the device (%d): %s (%02x)\n",
-						read_buffer.msg.device_idx,
-						hidpp20_errors[hidpp_err] ? hidpp20_errors[hidpp_err] : "Undocumented error code",
-						hidpp_err);
-			else
-				hidpp_log_error(&device->base,
-						"    HID++ error from the device (%d): %s (%02x)\n",
-						read_buffer.msg.device_idx,
-						hidpp20_errors[hidpp_err] ? hidpp20_errors[hidpp_err] : "Undocumented error code",
-						hidpp_err);
-			break;
-		}
+		if (hidpp20_swid_release_late(device, &read_buffer, swid))
+			continue;
+
+		rc = hidpp20_request_decode_reply(device, msg, &read_buffer, allow_error);
+		if (rc == -EAGAIN)
+			continue;
+		if (rc < 0)
+			return rc;
+
+		hidpp_err = rc;
+		break;
 	} while (ret > 0);
 
 	if (ret < 0) {
@@ -220,6 +348,153 @@ hidpp20_request_command(struct hidpp20_device *device, union hidpp20_message *ms
 	return ret > 0 ? -EPROTO : ret;
 }
 
+/* number of requests hidpp20_request_commands() keeps in flight */
+#define HIDPP20_REQUEST_WINDOW		4
+
+/*
+ * Send the requests of a batch that are still without a reply one at a
+ * time. Used once the replies of a batch stop coming in, some devices
+ * drop requests when several are queued.
+ */
+static int
+hidpp20_request_commands_sequential(struct hidpp20_device *device,
+				    union hidpp20_message *msgs,
+				    int *rcs,
+				    unsigned int n)
+{
+	int rc;
+
+	for (unsigned int i = 0; i < n; i++) {
+		if (rcs[i] != -EINPROGRESS)
+			continue;
+
+		/* a software id that timed out stays in flight until its
+		 * late reply, the retry gets a new one */
+		msgs[i].msg.address &= 0xf0;
+		rc = hidpp20_request_command_allow_error(device, &msgs[i], false);
+		if (rc < 0)
+			return rc;
+
+		rcs[i] = rc ? -EPROTO : 0;
+	}
+
+	return 0;
+}
+
+int
+hidpp20_request_commands(struct hidpp20_device *device,
+			 union hidpp20_message *msgs,
+			 int *rcs,
+			 unsigned int n)
+{
+	/* index + 1 of the request waiting for each software id */
+	unsigned int slots[HIDPP20_SWID_LAST + 1] = {0};
+	union hidpp20_message read_buffer, *msg;
+	unsigned int i, sent = 0, done = 0, in_flight = 0;
+	uint8_t swid;
+	int ret = 0, rc;
+
+	if (hidpp_device_is_disconnected(&device->base, device->index))
+		return -ENOTCONN;
+
+	for (i = 0; i < n; i++)
+		rcs[i] = -EINPROGRESS;
+
+	while (done < n) {
+		while (sent < n && in_flight < HIDPP20_REQUEST_WINDOW) {
+			size_t msg_len;
+
+			msg = &msgs[sent];
+
+			if ((msg->msg.address & 0xf) ||
+			    (msg->msg.report_id == REPORT_ID_LONG &&
+			     !(device->base.supported_report_types & HIDPP_REPORT_LONG))) {
+				rcs[sent++] = -EINVAL;
+				done++;
+				continue;
+			}
+
+			if (msg->msg.report_id == REPORT_ID_SHORT &&
+			    !(device->base.supported_report_types & HIDPP_REPORT_SHORT))
+				msg->msg.report_id = REPORT_ID_LONG;
+
+			swid = hidpp20_swid_alloc(device);
+			msg->msg.address |= swid;
+			msg_len = msg->msg.report_id == REPORT_ID_SHORT ? SHORT_MESSAGE_LENGTH : LONG_MESSAGE_LENGTH;
+
+			ret = hidpp_write_command(&device->base, msg->data, msg_len);
+			if (ret) {
+				device->swids_in_flight &= ~(1 << swid);
+				goto out_err;
+			}
+
+			slots[swid] = ++sent;
+			in_flight++;
+		}
+
+		if (in_flight == 0)
+			continue;
+
+		ret = hidpp_read_response(&device->base, read_buffer.data, LONG_MESSAGE_LENGTH);
+		if (ret == -ETIMEDOUT) {
+			hidpp_log_debug(&device->base,
+					"hidpp20: batch timed out with %u requests in flight, sending the rest one by one\n",
+					in_flight);
+			ret = hidpp20_request_commands_sequential(device, msgs, rcs, n);
+			if (ret < 0)
+				goto out_err;
+			return 0;
+		}
+		if (ret < 0)
+			goto out_err;
+
+		if (read_buffer.msg.report_id != REPORT_ID_SHORT &&
+		    read_buffer.msg.report_id != REPORT_ID_LONG)
+			continue;
+
+		if (hidpp_device_update_connection(&device->base, device->index,
+						   read_buffer.data, ret)) {
+			ret = -ENOTCONN;
+			goto out_err;
+		}
+
+		swid = hidpp20_reply_swid(&read_buffer);
+		if (!slots[swid]) {
+			hidpp20_swid_release_late(device, &read_buffer, 0);
+			continue;
+		}
+
+		msg = &msgs[slots[swid] - 1];
+		rc = hidpp20_request_decode_reply(device, msg, &read_buffer, false);
+		if (rc == -EAGAIN)
+			continue;
+		if (rc < 0) {
+			ret = rc;
+			goto out_err;
+		}
+
+		if (rc == 0)
+			*msg = read_buffer;
+		rcs[slots[swid] - 1] = rc ? -EPROTO : 0;
+		slots[swid] = 0;
+		in_flight--;
+		done++;
+	}
+
+	return 0;
+
+out_err:
+	if (ret != -ENOTCONN)
+		hidpp_log_error(&device->base, "    USB error: %s (%d)\n", strerror(-ret), -ret);
+	/* software ids still in flight are released by their late replies */
+	for (i = 0; i < n; i++) {
+		if (rcs[i] == -EINPROGRESS)
+			rcs[i] = ret;
+	}
+
+	return ret;
+}
+
 /* -------------------------------------------------------------------------- */
 /* 0x0000: Root                                                               */
 /* -------------------------------------------------------------------------- */
@@ -416,6 +691,47 @@ err:
 	return rc;
 }
 
+/* -------------------------------------------------------------------------- */
+/* 0x0003: Device Info                                                        */
+/* -------------------------------------------------------------------------- */
+
+#define CMD_DEVICE_INFO_GET_FW_INFO			0x10
+
+int
+hidpp20_device_info_get_fw_info(struct hidpp20_device *device,
+				uint8_t entity,
+				struct hidpp20_fw_info *info)
+{
+	uint8_t feature_index;
+	union hidpp20_message msg = {
+		.msg.report_id = REPORT_ID_SHORT,
+		.msg.device_idx = device->index,
+		.msg.address = CMD_DEVICE_INFO_GET_FW_INFO,
+		.msg.parameters[0] = entity,
+	};
+	int rc;
+
+	feature_index = hidpp_root_get_feature_idx(device,
+						   HIDPP_PAGE_DEVICE_INFO);
+	if (feature_index == 0)
+		return -ENOTSUP;
+
+	msg.msg.sub_id = feature_index;
+
+	rc = hidpp20_request_command(device, &msg);
+	if (rc)
+		return rc;
+
+	info->type = msg.msg.parameters[0];
+	memcpy(info->prefix, &msg.msg.parameters[1], 3);
+	info->prefix[3] = '\0';
+	info->number = msg.msg.parameters[4];
+	info->revision = msg.msg.parameters[5];
+	info->build = get_unaligned_be_u16(&msg.msg.parameters[6]);
+
+	return 0;
+}
+
 /* -------------------------------------------------------------------------- */
 /* 0x1000: Battery level status                                               */
 /* -------------------------------------------------------------------------- */
@@ -1287,61 +1603,58 @@ hidpp20_special_keys_buttons_get_count(struct hidpp20_device *device, uint8_t re
 	return msg.msg.parameters[0];
 }
 
-static int
-hidpp20_special_keys_buttons_get_info(struct hidpp20_device *device,
-				    uint8_t reg,
-				    struct hidpp20_control_id *control)
+static void
+hidpp20_special_keys_buttons_info_request(struct hidpp20_device *device,
+					  uint8_t reg,
+					  uint8_t index,
+					  union hidpp20_message *msg)
 {
-	int rc;
-	union hidpp20_message msg = {
+	*msg = (union hidpp20_message) {
 		.msg.report_id = REPORT_ID_SHORT,
 		.msg.device_idx = device->index,
 		.msg.sub_id = reg,
 		.msg.address = CMD_SPECIAL_KEYS_BUTTONS_GET_INFO,
-		.msg.parameters[0] = control->index,
+		.msg.parameters[0] = index,
 	};
-
-	rc = hidpp20_request_command(device, &msg);
-	if (rc)
-		return rc;
-
-	control->control_id = get_unaligned_be_u16(&msg.msg.parameters[0]);
-	control->task_id = get_unaligned_be_u16(&msg.msg.parameters[2]);
-	control->flags = msg.msg.parameters[4];
-	control->position = msg.msg.parameters[5];
-	control->group = msg.msg.parameters[6];
-	control->group_mask = msg.msg.parameters[7];
-	control->raw_XY = msg.msg.parameters[8] & 0x01;
-
-	return 0;
 }
 
+static void
+hidpp20_special_keys_buttons_parse_info(const union hidpp20_message *msg,
+					struct hidpp20_control_id *control)
+{
+	control->control_id = get_unaligned_be_u16(&msg->msg.parameters[0]);
+	control->task_id = get_unaligned_be_u16(&msg->msg.parameters[2]);
+	control->flags = msg->msg.parameters[4];
+	control->position = msg->msg.parameters[5];
+	control->group = msg->msg.parameters[6];
+	control->group_mask = msg->msg.parameters[7];
+	control->raw_XY = msg->msg.parameters[8] & 0x01;
+}
 
-static int
-hidpp20_special_keys_buttons_get_reporting(struct hidpp20_device *device,
-					   uint8_t reg,
-					   struct hidpp20_control_id *control)
+static void
+hidpp20_special_keys_buttons_reporting_request(struct hidpp20_device *device,
+					       uint8_t reg,
+					       const struct hidpp20_control_id *control,
+					       union hidpp20_message *msg)
 {
-	int rc;
-	union hidpp20_message msg = {
+	*msg = (union hidpp20_message) {
 		.msg.report_id = REPORT_ID_SHORT,
 		.msg.device_idx = device->index,
 		.msg.sub_id = reg,
 		.msg.address = CMD_SPECIAL_KEYS_BUTTONS_GET_REPORTING,
 	};
 
-	set_unaligned_be_u16(&msg.msg.parameters[0], control->control_id);
-
-	rc = hidpp20_request_command(device, &msg);
-	if (rc)
-		return rc;
-
-	control->reporting.remapped = get_unaligned_be_u16(&msg.msg.parameters[3]);
-	control->reporting.raw_XY = !!(msg.msg.parameters[2] & 0x10);
-	control->reporting.persist = !!(msg.msg.parameters[2] & 0x04);
-	control->reporting.divert = !!(msg.msg.parameters[2] & 0x01);
+	set_unaligned_be_u16(&msg->msg.parameters[0], control->control_id);
+}
 
-	return 0;
+static void
+hidpp20_special_keys_buttons_parse_reporting(const union hidpp20_message *msg,
+					     struct hidpp20_control_id *control)
+{
+	control->reporting.remapped = get_unaligned_be_u16(&msg->msg.parameters[3]);
+	control->reporting.raw_XY = !!(msg->msg.parameters[2] & 0x10);
+	control->reporting.persist = !!(msg->msg.parameters[2] & 0x04);
+	control->reporting.divert = !!(msg->msg.parameters[2] & 0x01);
 }
 
 int hidpp20_special_key_mouse_get_controls(struct hidpp20_device *device,
@@ -1349,7 +1662,9 @@ int hidpp20_special_key_mouse_get_controls(struct hidpp20_device *device,
 {
 	uint8_t feature_index;
 	struct hidpp20_control_id *c_list, *control;
-	uint8_t num_controls, real_num_controls = 0;
+	_cleanup_free_ union hidpp20_message *msgs = NULL;
+	_cleanup_free_ int *rcs = NULL;
+	uint8_t num_controls, num_info = 0, real_num_controls = 0;
 	unsigned i;
 	int rc;
 
@@ -1372,28 +1687,53 @@ int hidpp20_special_key_mouse_get_controls(struct hidpp20_device *device,
 	hidpp_log_debug(&device->base, "device has %d buttons\n", num_controls);
 
 	c_list = zalloc(num_controls * sizeof(struct hidpp20_control_id));
+	msgs = zalloc(num_controls * sizeof(*msgs));
+	rcs = zalloc(num_controls * sizeof(*rcs));
+
+	/* the reporting request needs the control id, so fetch the info
+	 * of all controls first */
+	for (i = 0; i < num_controls; i++)
+		hidpp20_special_keys_buttons_info_request(device, feature_index, i, &msgs[i]);
+
+	/* a HID++ error only loses that control, but a batch that was cut
+	 * short must not look like a device with fewer controls */
+	rc = hidpp20_request_commands(device, msgs, rcs, num_controls);
+	if (rc < 0)
+		goto err;
 
 	for (i = 0; i < num_controls; i++) {
-		control = &c_list[real_num_controls];
-		control->index = i;
-		rc = hidpp20_special_keys_buttons_get_info(device,
-							   feature_index,
-							   control);
-		if (rc) {
+		if (rcs[i]) {
 			hidpp_log_error(&device->base,
 				"error getting button info for control %d, ignoring\n", i);
 			continue;
 		}
 
-		rc = hidpp20_special_keys_buttons_get_reporting(device,
-								feature_index,
-								control);
-		if (rc) {
+		control = &c_list[num_info++];
+		control->index = i;
+		hidpp20_special_keys_buttons_parse_info(&msgs[i], control);
+	}
+
+	for (i = 0; i < num_info; i++)
+		hidpp20_special_keys_buttons_reporting_request(device, feature_index,
+							       &c_list[i], &msgs[i]);
+
+	rc = hidpp20_request_commands(device, msgs, rcs, num_info);
+	if (rc < 0)
+		goto err;
+
+	for (i = 0; i < num_info; i++) {
+		if (rcs[i]) {
 			hidpp_log_error(&device->base,
-				"error getting button reporting for control %d, ignoring\n", i);
+				"error getting button reporting for control %d, ignoring\n",
+				c_list[i].index);
 			continue;
 		}
 
+		control = &c_list[real_num_controls];
+		if (control != &c_list[i])
+			*control = c_list[i];
+		hidpp20_special_keys_buttons_parse_reporting(&msgs[i], control);
+
 		hidpp_log_raw(&device->base,
 			      "control %d: cid: '%s' (%d) tid: '%s' (%d) flags: 0x%02x pos: %d group: %d gmask: 0x%02x raw_XY: %s\n"
 			      "      reporting: raw_xy: %s persist: %s divert: %s remapped: '%s' (%d)\n",
@@ -1417,6 +1757,10 @@ int hidpp20_special_key_mouse_get_controls(struct hidpp20_device *device,
 	}
 	*controls_list = realloc(c_list, real_num_controls * sizeof(struct hidpp20_control_id));
 	return real_num_controls;
+
+err:
+	free(c_list);
+	return rc;
 }
 
 int
@@ -1867,6 +2211,63 @@ hidpp20_onboard_profiles_get_profiles_desc(struct hidpp20_device *device,
 	return 0;
 }
 
+int
+hidpp20_onboard_profiles_read_sector_pipelined(struct hidpp20_device *device,
+					       uint16_t sector,
+					       uint16_t sector_size,
+					       uint8_t *data)
+{
+	_cleanup_free_ union hidpp20_message *msgs = NULL;
+	_cleanup_free_ int *rcs = NULL;
+	uint8_t feature_index;
+	unsigned int i, n;
+	uint16_t offset;
+	int rc;
+	union hidpp20_message msg = {
+		.msg.report_id = REPORT_ID_LONG,
+		.msg.device_idx = device->index,
+		.msg.address = CMD_ONBOARD_PROFILES_MEMORY_READ,
+	};
+
+	if (sector_size < 16)
+		return -EINVAL;
+
+	feature_index = hidpp_root_get_feature_idx(device,
+						   HIDPP_PAGE_ONBOARD_PROFILES);
+	if (feature_index == 0)
+		return -ENOTSUP;
+
+	msg.msg.sub_id = feature_index;
+	set_unaligned_be_u16(&msg.msg.parameters[0], sector);
+
+	n = (sector_size + 15) / 16;
+	msgs = zalloc(n * sizeof(*msgs));
+	rcs = zalloc(n * sizeof(*rcs));
+
+	for (i = 0; i < n; i++) {
+		/* see hidpp20_onboard_profiles_read_sector() for the last read */
+		offset = min(i * 16, sector_size - 16U);
+		msgs[i] = msg;
+		set_unaligned_be_u16(&msgs[i].msg.parameters[2], offset);
+	}
+
+	rc = hidpp20_request_commands(device, msgs, rcs, n);
+	if (rc)
+		return rc;
+
+	for (i = 0; i < n; i++) {
+		if (rcs[i])
+			return rcs[i];
+	}
+
+	for (i = 0; i < n; i++) {
+		offset = min(i * 16, sector_size - 16U);
+		memcpy(data + offset, msgs[i].msg.parameters, 16);
+	}
+
+	return 0;
+}
+
 int
 hidpp20_onboard_profiles_read_sector(struct hidpp20_device *device,
 				     uint16_t sector,
@@ -1913,30 +2314,50 @@ hidpp20_onboard_profiles_read_sector(struct hidpp20_device *device,
 	return 0;
 }
 
-static bool
-hidpp20_onboard_profiles_is_sector_valid(struct hidpp20_device *device,
-					 uint16_t sector_size,
-					 uint8_t *data)
+bool
+hidpp20_onboard_profiles_sector_crc_is_valid(const uint8_t *data,
+					     uint16_t sector_size)
 {
 	uint16_t crc, read_crc;
 
 	crc = hidpp_crc_ccitt(data, sector_size - 2);
 	read_crc = get_unaligned_be_u16(&data[sector_size - 2]);
 
-	if (crc != read_crc)
-		hidpp_log_debug(&device->base, "Invalid CRC (%04x != %04x)\n", read_crc, crc);
-
 	return crc == read_crc;
 }
 
-static int
-hidpp20_onboard_profiles_write_start(struct hidpp20_device *device,
-				     uint16_t sector,
-				     uint16_t sub_address,
-				     uint16_t count,
-				     uint8_t feature_index)
+void
+hidpp20_onboard_profiles_sector_set_crc(uint8_t *data, uint16_t sector_size)
 {
-	int rc;
+	uint16_t crc;
+
+	crc = hidpp_crc_ccitt(data, sector_size - 2);
+	set_unaligned_be_u16(&data[sector_size - 2], crc);
+}
+
+static bool
+hidpp20_onboard_profiles_is_sector_valid(struct hidpp20_device *device,
+					 uint16_t sector_size,
+					 uint8_t *data)
+{
+	if (hidpp20_onboard_profiles_sector_crc_is_valid(data, sector_size))
+		return true;
+
+	hidpp_log_debug(&device->base, "Invalid CRC (%04x != %04x)\n",
+			get_unaligned_be_u16(&data[sector_size - 2]),
+			hidpp_crc_ccitt(data, sector_size - 2));
+
+	return false;
+}
+
+static int
+hidpp20_onboard_profiles_write_start(struct hidpp20_device *device,
+				     uint16_t sector,
+				     uint16_t sub_address,
+				     uint16_t count,
+				     uint8_t feature_index)
+{
+	int rc;
 	union hidpp20_message msg = {
 		.msg.report_id = REPORT_ID_LONG,
 		.msg.device_idx = device->index,
@@ -2004,7 +2425,6 @@ hidpp20_onboard_profiles_write_sector(struct hidpp20_device *device,
 				      bool write_crc)
 {
 	uint8_t feature_index;
-	uint16_t crc;
 	int rc, transferred;
 
 	feature_index = hidpp_root_get_feature_idx(device,
@@ -2012,10 +2432,8 @@ hidpp20_onboard_profiles_write_sector(struct hidpp20_device *device,
 	if (feature_index == 0)
 		return -ENOTSUP;
 
-	if (write_crc) {
-		crc = hidpp_crc_ccitt(data, sector_size - 2);
-		set_unaligned_be_u16(&data[sector_size - 2], crc);
-	}
+	if (write_crc)
+		hidpp20_onboard_profiles_sector_set_crc(data, sector_size);
 
 	rc = hidpp20_onboard_profiles_write_start(device,
 						  sector,
@@ -2350,111 +2768,208 @@ hidpp20_onboard_profiles_macro_next(struct hidpp20_device *device,
 	return rc;
 }
 
+struct hidpp20_cached_sector {
+	uint16_t sector;
+	int rc;
+	uint8_t *data;
+};
+
+struct hidpp20_sector_cache {
+	unsigned int count;
+	struct hidpp20_cached_sector *sectors;
+};
+
+static void
+hidpp20_sector_cache_release(struct hidpp20_sector_cache *cache)
+{
+	unsigned int i;
+
+	for (i = 0; i < cache->count; i++)
+		free(cache->sectors[i].data);
+
+	cache->sectors = mfree(cache->sectors);
+	cache->count = 0;
+}
+
+/**
+ * Remember the CRC of a sector for hidpp20_onboard_profiles_check_crcs(),
+ * data is NULL if the sector could not be read. ROM sectors never change
+ * and are skipped.
+ */
+static void
+hidpp20_onboard_profiles_set_sector_crc(struct hidpp20_profiles *profiles,
+					uint16_t sector,
+					const uint8_t *data)
+{
+	struct hidpp20_sector_crc *entry = NULL;
+	unsigned int i;
+
+	if ((sector & 0xff00) == HIDPP20_ROM_PROFILES_G402)
+		return;
+
+	for (i = 0; i < profiles->num_sector_crcs; i++) {
+		if (profiles->sector_crcs[i].sector == sector) {
+			entry = &profiles->sector_crcs[i];
+			break;
+		}
+	}
+
+	if (!entry) {
+		profiles->sector_crcs = realloc(profiles->sector_crcs,
+						(profiles->num_sector_crcs + 1) *
+						sizeof(*profiles->sector_crcs));
+		if (!profiles->sector_crcs)
+			abort();
+
+		entry = &profiles->sector_crcs[profiles->num_sector_crcs++];
+		entry->sector = sector;
+	}
+
+	entry->crc = data ? get_unaligned_be_u16(&data[profiles->sector_size - 2]) : -1;
+}
+
+/**
+ * Returns the sector from the cache, reading it from the device on first
+ * use. The read error, if any, is cached too and returned in rc. The data
+ * is owned by the cache.
+ */
+static uint8_t *
+hidpp20_onboard_profiles_read_sector_cached(struct hidpp20_device *device,
+					    struct hidpp20_profiles *profiles,
+					    struct hidpp20_sector_cache *cache,
+					    uint16_t sector,
+					    int *rc)
+{
+	struct hidpp20_cached_sector *cached;
+	unsigned int i;
+
+	for (i = 0; i < cache->count; i++) {
+		cached = &cache->sectors[i];
+		if (cached->sector == sector) {
+			*rc = cached->rc;
+			return cached->data;
+		}
+	}
+
+	cache->sectors = realloc(cache->sectors,
+				 (cache->count + 1) * sizeof(*cache->sectors));
+	if (!cache->sectors)
+		abort();
+
+	cached = &cache->sectors[cache->count++];
+	cached->sector = sector;
+	cached->data = hidpp20_onboard_profiles_allocate_sector(profiles);
+	cached->rc = hidpp20_onboard_profiles_read_sector(device,
+							  sector,
+							  profiles->sector_size,
+							  cached->data);
+	*rc = cached->rc;
+
+	return cached->data;
+}
+
 static int
 hidpp20_onboard_profiles_read_macro(struct hidpp20_device *device,
 				    struct hidpp20_profiles *profiles,
+				    struct hidpp20_sector_cache *cache,
 				    uint8_t page, uint8_t offset,
 				    union hidpp20_macro_data **return_macro)
 {
-	_cleanup_free_ uint8_t *memory = NULL;
-	union hidpp20_macro_data *macro = NULL;
-	unsigned count = 0;
-	unsigned index = 0;
+	union hidpp20_macro_data items[HIDPP20_MACRO_MAX_ITEMS + 1];
+	union hidpp20_macro_data *item;
+	uint8_t *memory = NULL;
+	unsigned int count = 0;
+	unsigned int steps = 0;
 	uint16_t mem_index = offset;
 	int rc = -ENOMEM;
 
-	memory = hidpp20_onboard_profiles_allocate_sector(profiles);
-
-	do {
-		if (count == index) {
-			union hidpp20_macro_data *tmp;
-
-			count += 32;
-			/* manual realloc to have the memory zero-initialized */
-			tmp = zalloc(count * sizeof(union hidpp20_macro_data));
-			if (macro) {
-				memcpy(tmp, macro, (count - 32) * sizeof(union hidpp20_macro_data));
-				free(macro);
-			}
-			macro = tmp;
+	while (true) {
+		/* every step consumes an item, a chunk or a JUMP, this
+		 * only triggers on loops without items */
+		if (++steps > 4 * HIDPP20_MACRO_MAX_ITEMS) {
+			hidpp_log_error(&device->base, "macro at 0x%02x:0x%02x does not terminate\n",
+					page, offset);
+			return -EFAULT;
 		}
 
 		if (rc == -ENOMEM) {
-			rc = hidpp20_onboard_profiles_read_sector(device,
-								  page,
-								  profiles->sector_size,
-								  memory);
+			memory = hidpp20_onboard_profiles_read_sector_cached(device,
+									     profiles,
+									     cache,
+									     page,
+									     &rc);
 			if (rc)
-				goto out_err;
+				return rc < 0 ? rc : -EIO;
 		}
 
+		item = &items[count];
 		rc = hidpp20_onboard_profiles_macro_next(device,
 							 memory,
 							 &mem_index,
-							 &macro[index]);
+							 item);
 		if (rc == -EFAULT)
-			goto out_err;
+			return rc;
+		if (rc == 0) /* HIDPP20_MACRO_END */
+			break;
+
 		if (rc == -ENOMEM) {
 			mem_index = 0;
 			page++;
-		} else if (macro[index].any.type == HIDPP20_MACRO_JUMP) {
-			page = macro[index].jump.page;
-			offset = macro[index].jump.offset;
-			mem_index = offset;
-			/* no need to store the jump in memory */
-			index--;
-			/* force memory fetching */
+		} else if (item->any.type == HIDPP20_MACRO_JUMP) {
+			/* no need to store the jump, fetch the target */
+			page = item->jump.page;
+			mem_index = item->jump.offset;
 			rc = -ENOMEM;
 		} else {
-			index++;
+			switch (item->any.type) {
+			case HIDPP20_MACRO_DELAY:
+				item->delay.time = hidpp_be_u16_to_cpu(item->delay.time);
+				break;
+			case HIDPP20_MACRO_KEY_PRESS:
+			case HIDPP20_MACRO_KEY_RELEASE:
+			case HIDPP20_MACRO_NOOP:
+				break;
+			default:
+				hidpp_log_error(&device->base, "unknown tag: 0x%02x\n", item->any.type);
+			}
+
+			if (++count == HIDPP20_MACRO_MAX_ITEMS) {
+				hidpp_log_info(&device->base,
+					       "macro at 0x%02x:0x%02x is too long, truncating\n",
+					       page, offset);
+				items[count].any.type = HIDPP20_MACRO_END;
+				break;
+			}
 		}
-	} while (rc);
+	}
 
-	*return_macro = macro;
-	return index;
+	/* the terminating HIDPP20_MACRO_END is part of the macro */
+	*return_macro = zalloc((count + 1) * sizeof(**return_macro));
+	memcpy(*return_macro, items, (count + 1) * sizeof(**return_macro));
 
-out_err:
-	free(macro);
-
-	return rc;
+	return count;
 }
 
-static int
+int
 hidpp20_onboard_profiles_parse_macro(struct hidpp20_device *device,
 				     struct hidpp20_profiles *profiles,
 				     uint8_t page, uint8_t offset,
 				     union hidpp20_macro_data **return_macro)
 {
-	union hidpp20_macro_data *m, *macro = NULL;
-	unsigned i, count = 0;
+	struct hidpp20_sector_cache local_cache = {0};
+	struct hidpp20_sector_cache *cache = profiles->sector_cache;
+	union hidpp20_macro_data *macro = NULL;
 	int rc;
 
-	rc = hidpp20_onboard_profiles_read_macro(device, profiles, page, offset, &macro);
-	if (rc <= 0)
-		return rc;
-
-	count = rc;
+	if (!cache)
+		cache = &local_cache;
 
-	for (i = 0; i < count; i++) {
-		m = &macro[i];
-		assert(m != NULL);
-		switch (m->any.type) {
-		case HIDPP20_MACRO_DELAY:
-			m->delay.time = hidpp_be_u16_to_cpu(m->delay.time);
-			break;
-		case HIDPP20_MACRO_KEY_PRESS:
-			break;
-		case HIDPP20_MACRO_KEY_RELEASE:
-			break;
-		case HIDPP20_MACRO_JUMP:
-			break;
-		case HIDPP20_MACRO_END:
-			break;
-		case HIDPP20_MACRO_NOOP:
-			break;
-		default:
-			hidpp_log_error(&device->base, "unknown tag: 0x%02x\n", m->any.type);
-		}
+	rc = hidpp20_onboard_profiles_read_macro(device, profiles, cache,
+						 page, offset, &macro);
+	hidpp20_sector_cache_release(&local_cache);
+	if (rc <= 0) {
+		free(macro);
+		return rc;
 	}
 
 	*return_macro = macro;
@@ -2496,20 +3011,17 @@ hidpp20_onboard_profiles_destroy(struct hidpp20_profiles *profiles_list)
 		}
 	}
 
+	free(profiles_list->sector_crcs);
 	free(profiles_list->profiles);
 	free(profiles_list);
 }
 
-static int
-hidpp20_onboard_profiles_write_dict(struct hidpp20_device *device,
-				    struct hidpp20_profiles *profiles_list)
+void
+hidpp20_onboard_profiles_encode_dict(const struct hidpp20_profiles *profiles_list,
+				     uint8_t *data)
 {
 	unsigned int i, buffer_index = 0;
 	uint16_t sector_size = profiles_list->sector_size;
-	_cleanup_free_ uint8_t *data = NULL;
-	int rc;
-
-	data = hidpp20_onboard_profiles_allocate_sector(profiles_list);
 
 	for (i = 0; i < profiles_list->num_profiles; i++) {
 		data[buffer_index++] = 0x00;
@@ -2526,6 +3038,50 @@ hidpp20_onboard_profiles_write_dict(struct hidpp20_device *device,
 
 	memset(data + buffer_index, 0xff, sector_size - buffer_index);
 
+	hidpp20_onboard_profiles_sector_set_crc(data, sector_size);
+}
+
+int
+hidpp20_onboard_profiles_decode_dict(struct hidpp20_profiles *profiles_list,
+				     const uint8_t *data)
+{
+	unsigned int i;
+	uint16_t addr;
+
+	if (!hidpp20_onboard_profiles_sector_crc_is_valid(data,
+							  profiles_list->sector_size))
+		return -EAGAIN;
+
+	for (i = 0; i < profiles_list->num_profiles; i++) {
+		profiles_list->profiles[i].address = 0;
+		profiles_list->profiles[i].enabled = 0;
+	}
+
+	for (i = 0; i < profiles_list->num_profiles; i++) {
+		const uint8_t *d = data + 4 * i;
+
+		addr = get_unaligned_be_u16(d);
+		if (addr == HIDPP20_PROFILE_DIR_END)
+			break;
+
+		profiles_list->profiles[i].address = addr;
+		profiles_list->profiles[i].enabled = !!d[HIDPP20_PROFILE_DIR_ENABLED];
+	}
+
+	return i;
+}
+
+static int
+hidpp20_onboard_profiles_write_dict(struct hidpp20_device *device,
+				    struct hidpp20_profiles *profiles_list)
+{
+	uint16_t sector_size = profiles_list->sector_size;
+	_cleanup_free_ uint8_t *data = NULL;
+	int rc;
+
+	data = hidpp20_onboard_profiles_allocate_sector(profiles_list);
+	hidpp20_onboard_profiles_encode_dict(profiles_list, data);
+
 	hidpp_log_buf_raw(&device->base,
 			   "dictionary: ",
 			   data,
@@ -2536,26 +3092,27 @@ hidpp20_onboard_profiles_write_dict(struct hidpp20_device *device,
 						   0x0000,
 						   sector_size,
 						   data,
-						   true);
+						   false);
 	if (rc)
 		hidpp_log_error(&device->base, "failed to write profile dictionary\n");
+	else
+		hidpp20_onboard_profiles_set_sector_crc(profiles_list, 0x0000, data);
 
 	return rc;
 }
 
 static void
-hidpp20_buttons_to_cpu(struct hidpp20_device *device,
-		       struct hidpp20_profiles *profiles,
-		       struct hidpp20_profile *profile,
-		       union hidpp20_button_binding *buttons,
+hidpp20_buttons_to_cpu(struct hidpp20_profile *profile,
+		       const union hidpp20_button_binding *buttons,
 		       unsigned int count)
 {
 	unsigned int i;
 
 	for (i = 0; i < count; i++) {
-		union hidpp20_button_binding *b = &buttons[i];
+		const union hidpp20_button_binding *b = &buttons[i];
 		union hidpp20_button_binding *button = &profile->buttons[i];
 
+		memset(button, 0, sizeof(*button));
 		button->any.type = b->any.type;
 
 		switch (b->any.type) {
@@ -2580,17 +3137,8 @@ hidpp20_buttons_to_cpu(struct hidpp20_device *device,
 			button->special.profile = b->special.profile;
 			break;
 		case HIDPP20_BUTTON_MACRO:
-			if (profile->macros[i]) {
-				free(profile->macros[i]);
-				profile->macros[i] = NULL;
-			}
-			hidpp20_onboard_profiles_parse_macro(device,
-							     profiles,
-							     b->macro.page,
-							     b->macro.offset,
-							     &profile->macros[i]);
-
-			/* the actual page is stored in the 'zero' field */
+			/* the actual page is stored in the 'zero' field, the
+			 * macro itself is parsed separately */
 			button->macro.page = i;
 			button->macro.offset = b->macro.offset;
 			button->macro.zero = b->macro.page;
@@ -2598,14 +3146,14 @@ hidpp20_buttons_to_cpu(struct hidpp20_device *device,
 		case HIDPP20_BUTTON_DISABLED:
 			break;
 		default:
-			memcpy(b, button, sizeof(*b));
+			memcpy(button, b, sizeof(*button));
 			break;
 		}
 	}
 }
 
 static void
-hidpp20_buttons_from_cpu(struct hidpp20_profile *profile,
+hidpp20_buttons_from_cpu(const struct hidpp20_profile *profile,
 			 union hidpp20_button_binding *buttons,
 			 unsigned int count)
 {
@@ -2613,7 +3161,7 @@ hidpp20_buttons_from_cpu(struct hidpp20_profile *profile,
 
 	for (i = 0; i < count; i++) {
 		union hidpp20_button_binding *button = &buttons[i];
-		union hidpp20_button_binding *b = &profile->buttons[i];
+		const union hidpp20_button_binding *b = &profile->buttons[i];
 
 		button->any.type = b->any.type;
 
@@ -2622,7 +3170,8 @@ hidpp20_buttons_from_cpu(struct hidpp20_profile *profile,
 			button->subany.subtype = b->subany.subtype;
 			switch (b->subany.subtype) {
 			case HIDPP20_BUTTON_HID_TYPE_MOUSE:
-				button->button.buttons = hidpp_cpu_to_be_u16(1U << (b->button.buttons - 1));
+				button->button.buttons = b->button.buttons ?
+					hidpp_cpu_to_be_u16(1U << (b->button.buttons - 1)) : 0;
 				break;
 			case HIDPP20_BUTTON_HID_TYPE_KEYBOARD:
 				button->keyboard_keys.modifier_flags = b->keyboard_keys.modifier_flags;
@@ -2649,7 +3198,7 @@ hidpp20_buttons_from_cpu(struct hidpp20_profile *profile,
 			button->macro.zero = 0;
 			break;
 		default:
-			memcpy(b, button, sizeof(*b));
+			memcpy(button, b, sizeof(*button));
 			break;
 		}
 	}
@@ -2683,7 +3232,7 @@ hidpp20_onboard_profiles_read_led(struct hidpp20_led *led,
 		led->color = internal_led.effect.breath.color;
 		break;
 	case HIDPP20_LED_RIPPLE:
-		period = hidpp_be_u16_to_cpu(internal_led.effect.breath.period_or_speed);
+		period = hidpp_be_u16_to_cpu(internal_led.effect.ripple.period);
 		led->color = internal_led.effect.ripple.color;
 		break;
 	case HIDPP20_LED_ON:
@@ -2700,39 +3249,15 @@ hidpp20_onboard_profiles_read_led(struct hidpp20_led *led,
 	led->brightness = brightness;
 }
 
-static int
-hidpp20_onboard_profiles_parse_profile(struct hidpp20_device *device,
-				       struct hidpp20_profiles *profiles_list,
-				       unsigned index,
-				       bool check_crc)
+void
+hidpp20_onboard_profiles_decode_profile(const struct hidpp20_profiles *profiles_list,
+					const uint8_t *data,
+					struct hidpp20_profile *profile)
 {
-	union hidpp20_internal_profile *pdata;
-	struct hidpp20_profile *profile = &profiles_list->profiles[index];
-	uint16_t sector = profile->address;
-	_cleanup_free_ uint8_t *data = NULL;
+	const union hidpp20_internal_profile *pdata;
 	unsigned i;
-	int rc;
-
-	if (index >= profiles_list->num_profiles)
-		return -EINVAL;
-
-	data = hidpp20_onboard_profiles_allocate_sector(profiles_list);
-	pdata = (union hidpp20_internal_profile *)data;
-
-	rc = hidpp20_onboard_profiles_read_sector(device,
-						  sector,
-						  profiles_list->sector_size,
-						  data);
-	if (rc < 0)
-		return rc;
 
-	if (check_crc) {
-		if (!hidpp20_onboard_profiles_is_sector_valid(device,
-							      profiles_list->sector_size,
-							      data)) {
-			return -EAGAIN;
-		}
-	}
+	pdata = (const union hidpp20_internal_profile *)data;
 
 	profile->report_rate = 1000 / max(1, pdata->profile.report_rate);
 	profile->default_dpi = pdata->profile.default_dpi;
@@ -2751,7 +3276,7 @@ hidpp20_onboard_profiles_parse_profile(struct hidpp20_device *device,
 		hidpp20_onboard_profiles_read_led(&profile->alt_leds[i], pdata->profile.alt_leds[i]);
 	}
 
-	hidpp20_buttons_to_cpu(device, profiles_list, profile, pdata->profile.buttons, profiles_list->num_buttons);
+	hidpp20_buttons_to_cpu(profile, pdata->profile.buttons, profiles_list->num_buttons);
 
 	memcpy(profile->name, pdata->profile.name.txt, sizeof(profile->name));
 	/* force terminating '\0' */
@@ -2764,19 +3289,78 @@ hidpp20_onboard_profiles_parse_profile(struct hidpp20_device *device,
 	}
 	if (i == sizeof(profile->name))
 		memset(profile->name, 0, sizeof(profile->name));
+}
+
+static int
+hidpp20_onboard_profiles_parse_profile(struct hidpp20_device *device,
+				       struct hidpp20_profiles *profiles_list,
+				       unsigned index,
+				       bool check_crc)
+{
+	struct hidpp20_profile *profile = &profiles_list->profiles[index];
+	uint16_t sector = profile->address;
+	_cleanup_free_ uint8_t *buffer = NULL;
+	uint8_t *data;
+	unsigned i;
+	int rc;
+
+	if (index >= profiles_list->num_profiles)
+		return -EINVAL;
+
+	if (profiles_list->sector_cache) {
+		/* several profiles may fall back to the same ROM profile */
+		data = hidpp20_onboard_profiles_read_sector_cached(device,
+								   profiles_list,
+								   profiles_list->sector_cache,
+								   sector,
+								   &rc);
+	} else {
+		buffer = hidpp20_onboard_profiles_allocate_sector(profiles_list);
+		data = buffer;
+		rc = hidpp20_onboard_profiles_read_sector(device,
+							  sector,
+							  profiles_list->sector_size,
+							  data);
+	}
+	if (rc < 0)
+		return rc;
+
+	if (check_crc) {
+		if (!hidpp20_onboard_profiles_is_sector_valid(device,
+							      profiles_list->sector_size,
+							      data)) {
+			return -EAGAIN;
+		}
+	}
+
+	hidpp20_onboard_profiles_decode_profile(profiles_list, data, profile);
+
+	for (i = 0; i < profiles_list->num_buttons; i++) {
+		union hidpp20_button_binding *b = &profile->buttons[i];
+
+		if (b->any.type != HIDPP20_BUTTON_MACRO)
+			continue;
+
+		free(profile->macros[i]);
+		profile->macros[i] = NULL;
+		hidpp20_onboard_profiles_parse_macro(device,
+						     profiles_list,
+						     b->macro.zero,
+						     b->macro.offset,
+						     &profile->macros[i]);
+	}
 
 	return 0;
 }
 
-int
-hidpp20_onboard_profiles_initialize(struct hidpp20_device *device,
-				    struct hidpp20_profiles *profiles)
+static int
+hidpp20_onboard_profiles_read_profiles(struct hidpp20_device *device,
+				       struct hidpp20_profiles *profiles)
 {
 	_cleanup_free_ uint8_t *data = NULL;
 	int rc;
 	unsigned i;
 	uint16_t addr;
-	bool crc_valid;
 	bool read_userdata = true;
 
 	assert(profiles);
@@ -2792,6 +3376,9 @@ hidpp20_onboard_profiles_initialize(struct hidpp20_device *device,
 						  HIDPP20_USER_PROFILES_G402,
 						  profiles->sector_size,
 						  data);
+	hidpp20_onboard_profiles_set_sector_crc(profiles,
+						HIDPP20_USER_PROFILES_G402,
+						rc ? NULL : data);
 
 	if (rc && device->quirk == HIDPP20_QUIRK_G305) {
 		/* The G305 has a bug where it throws an ERR_INVALID_ARGUMENT
@@ -2804,29 +3391,18 @@ hidpp20_onboard_profiles_initialize(struct hidpp20_device *device,
 	if (rc < 0)
 		return rc; // ignore_clang_sa_mem_leak
 
-	crc_valid = hidpp20_onboard_profiles_is_sector_valid(device,
-							     profiles->sector_size,
-							     data);
-	if (crc_valid) {
-		for (i = 0; i < profiles->num_profiles; i++) {
-			uint8_t *d = data + 4 * i;
-
-			addr = get_unaligned_be_u16(d);
-
-			if(addr == HIDPP20_PROFILE_DIR_END)
-				break;
-
-			profiles->profiles[i].address = addr;
+	rc = hidpp20_onboard_profiles_decode_dict(profiles, data);
+	if (rc >= 0) {
+		for (i = 0; i < (unsigned int)rc; i++) {
+			addr = profiles->profiles[i].address;
 
 			/* profile address sanity check */
-			if (profiles->profiles[i].address != (HIDPP20_USER_PROFILES_G402 | (i + 1)))
+			if (addr != (HIDPP20_USER_PROFILES_G402 | (i + 1)))
 				hidpp_log_info(&device->base,
 					       "profile %d: error in the address: 0x%04x instead of 0x%04x\n",
 					       i + 1,
-					       profiles->profiles[i].address,
+					       addr,
 					       HIDPP20_USER_PROFILES_G402 | (i + 1));
-
-			profiles->profiles[i].enabled = !!d[HIDPP20_PROFILE_DIR_ENABLED];
 		}
 	} else {
 		hidpp_log_debug(&device->base, "Profile directory has an invalid CRC... Reading ROM profiles.\n");
@@ -2869,9 +3445,92 @@ read_profiles:
 	return profiles->num_profiles;
 }
 
+int
+hidpp20_onboard_profiles_initialize(struct hidpp20_device *device,
+				    struct hidpp20_profiles *profiles)
+{
+	struct hidpp20_sector_cache cache = {0};
+	struct hidpp20_cached_sector *cached;
+	unsigned int i;
+	int rc;
+
+	profiles->sector_crcs = mfree(profiles->sector_crcs);
+	profiles->num_sector_crcs = 0;
+
+	/* buttons of several profiles often point to the same macro
+	 * sectors, read each sector once for the whole probe */
+	profiles->sector_cache = &cache;
+	rc = hidpp20_onboard_profiles_read_profiles(device, profiles);
+	profiles->sector_cache = NULL;
+
+	for (i = 0; i < cache.count; i++) {
+		cached = &cache.sectors[i];
+		hidpp20_onboard_profiles_set_sector_crc(profiles,
+							cached->sector,
+							cached->rc ? NULL : cached->data);
+	}
+
+	hidpp20_sector_cache_release(&cache);
+
+	return rc;
+}
+
+int
+hidpp20_onboard_profiles_check_crcs(struct hidpp20_device *device,
+				    struct hidpp20_profiles *profiles)
+{
+	_cleanup_free_ union hidpp20_message *msgs = NULL;
+	_cleanup_free_ int *rcs = NULL;
+	unsigned int i, n = profiles->num_sector_crcs;
+	uint8_t feature_index;
+	int32_t crc;
+	int rc;
+	union hidpp20_message msg = {
+		.msg.report_id = REPORT_ID_LONG,
+		.msg.device_idx = device->index,
+		.msg.address = CMD_ONBOARD_PROFILES_MEMORY_READ,
+	};
+
+	if (n == 0)
+		return 0;
+
+	feature_index = hidpp_root_get_feature_idx(device,
+						   HIDPP_PAGE_ONBOARD_PROFILES);
+	if (feature_index == 0)
+		return -ENOTSUP;
+
+	msg.msg.sub_id = feature_index;
+	/* the CRC is in the last two bytes of the sector */
+	set_unaligned_be_u16(&msg.msg.parameters[2], profiles->sector_size - 16);
+
+	msgs = zalloc(n * sizeof(*msgs));
+	rcs = zalloc(n * sizeof(*rcs));
+
+	for (i = 0; i < n; i++) {
+		msgs[i] = msg;
+		set_unaligned_be_u16(&msgs[i].msg.parameters[0],
+				     profiles->sector_crcs[i].sector);
+	}
+
+	rc = hidpp20_request_commands(device, msgs, rcs, n);
+	if (rc)
+		return rc;
+
+	for (i = 0; i < n; i++) {
+		crc = rcs[i] ? -1 : get_unaligned_be_u16(&msgs[i].msg.parameters[14]);
+		if (crc != profiles->sector_crcs[i].crc) {
+			hidpp_log_debug(&device->base, "sector 0x%04x changed\n",
+					profiles->sector_crcs[i].sector);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
 void
 hidpp20_onboard_profiles_write_led(struct hidpp20_internal_led *internal_led,
-				   struct hidpp20_led *led)
+				   const struct hidpp20_led *led)
 {
 	uint16_t period = led->period;
 	uint8_t brightness = led->brightness;
@@ -2916,28 +3575,19 @@ hidpp20_onboard_profiles_write_led(struct hidpp20_internal_led *internal_led,
 	}
 }
 
-static int
-hidpp20_onboard_profiles_write_profile(struct hidpp20_device *device,
-				       struct hidpp20_profiles *profiles_list,
-				       unsigned int index)
+void
+hidpp20_onboard_profiles_encode_profile(const struct hidpp20_profiles *profiles_list,
+					const struct hidpp20_profile *profile,
+					uint8_t *data)
 {
 	union hidpp20_internal_profile *pdata;
-	_cleanup_free_ uint8_t *data = NULL;
-	uint16_t sector_size = profiles_list->sector_size;
-	uint16_t sector = index + 1;
-	struct hidpp20_profile *profile = &profiles_list->profiles[index];
 	unsigned i;
-	int rc;
 
-	if (index >= profiles_list->num_profiles)
-		return -EINVAL;
-
-	data = hidpp20_onboard_profiles_allocate_sector(profiles_list);
 	pdata = (union hidpp20_internal_profile *)data;
 
 	memset(data, 0xff, profiles_list->sector_size);
 
-	pdata->profile.report_rate = 1000 / profile->report_rate;
+	pdata->profile.report_rate = 1000 / max(1U, profile->report_rate);
 	pdata->profile.default_dpi = profile->default_dpi;
 	pdata->profile.switched_dpi = profile->switched_dpi;
 
@@ -2959,12 +3609,35 @@ hidpp20_onboard_profiles_write_profile(struct hidpp20_device *device,
 
 	memcpy(pdata->profile.name.txt, profile->name, sizeof(profile->name));
 
-	rc = hidpp20_onboard_profiles_write_sector(device, sector, sector_size, data, true);
+	hidpp20_onboard_profiles_sector_set_crc(data, profiles_list->sector_size);
+}
+
+static int
+hidpp20_onboard_profiles_write_profile(struct hidpp20_device *device,
+				       struct hidpp20_profiles *profiles_list,
+				       unsigned int index)
+{
+	_cleanup_free_ uint8_t *data = NULL;
+	uint16_t sector_size = profiles_list->sector_size;
+	uint16_t sector = index + 1;
+	int rc;
+
+	if (index >= profiles_list->num_profiles)
+		return -EINVAL;
+
+	data = hidpp20_onboard_profiles_allocate_sector(profiles_list);
+	hidpp20_onboard_profiles_encode_profile(profiles_list,
+						&profiles_list->profiles[index],
+						data);
+
+	rc = hidpp20_onboard_profiles_write_sector(device, sector, sector_size, data, false);
 	if (rc < 0) {
 		hidpp_log_error(&device->base, "failed to write profile\n");
 		return rc;
 	}
 
+	hidpp20_onboard_profiles_set_sector_crc(profiles_list, sector, data);
+
 	return 0;
 }
 
@@ -3055,6 +3728,8 @@ hidpp20_device_new(const struct hidpp_device *base, unsigned int idx, struct hid
 
 	dev->index = idx;
 	dev->base = *base;
+	/* the low nibble of the address is the software id */
+	dev->base.address_mask = 0xf0;
 
 	dev->proto_major = 1;
 	dev->proto_minor = 0;
@@ -66,10 +66,44 @@ struct hidpp20_device {
 	struct hidpp20_feature *feature_list;
 	enum hidpp20_quirk quirk;
 	unsigned int led_ext_caps;
+	uint8_t next_swid;		/* software id of the next request */
+	uint16_t swids_in_flight;	/* bitmask of ids without a reply yet */
 };
 
 int hidpp20_request_command(struct hidpp20_device *dev, union hidpp20_message *msg);
 
+/* Software ids 0x0 is used by notifications and the kernel uses 0x1 */
+#define HIDPP20_SWID_FIRST	0x2
+#define HIDPP20_SWID_LAST	0xf
+
+/**
+ * Pick the software id for the next request, in [HIDPP20_SWID_FIRST,
+ * HIDPP20_SWID_LAST]. Ids of requests that timed out are skipped until
+ * their late reply shows up, so a late reply can never be mistaken for
+ * the answer to a newer request. If every id is still in flight, they are
+ * all considered lost and reused.
+ */
+uint8_t
+hidpp20_swid_alloc(struct hidpp20_device *device);
+
+/**
+ * Send the n requests in msgs with several of them in flight at a time.
+ * Replies are matched by software id, so they may arrive in any order.
+ * Each message is replaced by its reply and rcs[i] is set to 0, -EPROTO
+ * for a HID++ error or a negative errno.
+ *
+ * If the replies stop coming in, the requests without a reply are sent
+ * again one at a time. Only batch requests that can be repeated, i.e.
+ * reads.
+ *
+ * returns 0 if the batch completed, or the negative errno that aborted it
+ * in which case the requests without a reply have that errno in rcs.
+ */
+int hidpp20_request_commands(struct hidpp20_device *dev,
+			     union hidpp20_message *msgs,
+			     int *rcs,
+			     unsigned int n);
+
 #define CASE_RETURN_STRING(a) case a: return #a; break
 
 const char *hidpp20_feature_get_name(uint16_t feature);
@@ -113,6 +147,25 @@ int hidpp20_root_get_protocol_version(struct hidpp20_device *dev,
 
 #define HIDPP_PAGE_DEVICE_INFO				0x0003
 
+struct hidpp20_fw_info {
+	uint8_t type;		/* 0: main application, 1: bootloader, ... */
+	char prefix[4];		/* e.g. "RQM", NUL-terminated */
+	uint8_t number;		/* BCD */
+	uint8_t revision;	/* BCD */
+	uint16_t build;
+};
+
+/**
+ * Retrieves the firmware version of the given entity, entity 0 is usually
+ * the main application.
+ *
+ * @return 0 on success or a negative errno on error
+ */
+int
+hidpp20_device_info_get_fw_info(struct hidpp20_device *device,
+				uint8_t entity,
+				struct hidpp20_fw_info *info);
+
 /* -------------------------------------------------------------------------- */
 /* 0x0005: Device Name                                                        */
 /* -------------------------------------------------------------------------- */
@@ -339,9 +392,13 @@ int hidpp20_kbd_reprogrammable_keys_get_controls(struct hidpp20_device *device,
 #define HIDPP_PAGE_SPECIAL_KEYS_BUTTONS			0x1b04
 
 /**
- * allocates a list of controls that has to be freed by the caller.
+ * allocates a list of controls that has to be freed by the caller. The
+ * info and reporting requests of all controls are batched, see
+ * hidpp20_request_commands(). Controls the device answers with a HID++
+ * error for are left out.
  *
- * returns the elements in the list or a negative error
+ * returns the elements in the list or a negative error if a batch could
+ * not be completed
  */
 int hidpp20_special_key_mouse_get_controls(struct hidpp20_device *device,
 					   struct hidpp20_control_id **controls_list);
@@ -847,6 +904,8 @@ struct hidpp20_led {
 #define HIDPP20_MACRO_XY			0x61
 
 
+struct hidpp20_sector_cache;
+
 union hidpp20_macro_data {
 	struct {
 		uint8_t type;
@@ -871,6 +930,9 @@ union hidpp20_macro_data {
 } __attribute__((packed));
 _Static_assert(sizeof(union hidpp20_macro_data) == 3, "Invalid size");
 
+/* upper bound for the items of a macro, JUMPs may form loops */
+#define HIDPP20_MACRO_MAX_ITEMS		256
+
 struct hidpp20_profile {
 	uint16_t address;
 	uint8_t enabled;
@@ -917,6 +979,19 @@ struct hidpp20_profiles {
 	uint16_t sector_size;
 	uint8_t active_profile_index;
 	struct hidpp20_profile *profiles;
+
+	/* only set while hidpp20_onboard_profiles_initialize() runs */
+	struct hidpp20_sector_cache *sector_cache;
+
+	/* the user sectors the profiles were read from, see
+	 * hidpp20_onboard_profiles_check_crcs() */
+	struct hidpp20_sector_crc *sector_crcs;
+	unsigned int num_sector_crcs;
+};
+
+struct hidpp20_sector_crc {
+	uint16_t sector;
+	int32_t crc; /* -1 if the sector could not be read */
 };
 
 /**
@@ -946,11 +1021,44 @@ hidpp20_onboard_profiles_destroy(struct hidpp20_profiles *profiles_list);
 /**
  * initialize a struct hidpp20_profiles previous allocated with
  * hidpp20_onboard_profiles_allocate().
+ *
+ * Every sector is read at most once, profiles and macros that share a
+ * sector are parsed from the same copy.
  */
 int
 hidpp20_onboard_profiles_initialize(struct hidpp20_device *device,
 				    struct hidpp20_profiles *profiles);
 
+/**
+ * Read the macro starting at offset in sector page, following JUMPs.
+ * While hidpp20_onboard_profiles_initialize() runs, sectors shared with
+ * other macros are read once. A macro longer than HIDPP20_MACRO_MAX_ITEMS
+ * items is truncated, a macro that doesn't reach an item or END within
+ * 4 * HIDPP20_MACRO_MAX_ITEMS steps is rejected.
+ *
+ * returns 0 or a negative error. On success, return_macro is set to a
+ * HIDPP20_MACRO_END terminated array the caller must free, or left
+ * untouched if the macro is empty.
+ */
+int
+hidpp20_onboard_profiles_parse_macro(struct hidpp20_device *device,
+				     struct hidpp20_profiles *profiles,
+				     uint8_t page, uint8_t offset,
+				     union hidpp20_macro_data **return_macro);
+
+/**
+ * Check whether the user sectors hidpp20_onboard_profiles_initialize()
+ * read the profiles and macros from, including the profile directory,
+ * were written since. Only the last 16 bytes of each sector are read to
+ * compare the sector CRC, all in one batch. Writes through
+ * hidpp20_onboard_profiles_commit() are accounted for.
+ *
+ * returns 1 if a sector changed, 0 if none did or a negative error.
+ */
+int
+hidpp20_onboard_profiles_check_crcs(struct hidpp20_device *device,
+				    struct hidpp20_profiles *profiles);
+
 /**
  * return the current profile index or a negative error.
  */
@@ -1001,6 +1109,20 @@ hidpp20_onboard_profiles_read_sector(struct hidpp20_device *device,
 				     uint16_t sector_size,
 				     uint8_t *data);
 
+/**
+ * Like hidpp20_onboard_profiles_read_sector() but with several memory
+ * reads in flight, see hidpp20_request_commands(). Meant for tools that
+ * read the whole memory, the driver reads sector by sector.
+ *
+ * returns 0 or a negative errno, -EPROTO if the device answered any of
+ * the reads with a HID++ error
+ */
+int
+hidpp20_onboard_profiles_read_sector_pipelined(struct hidpp20_device *device,
+					       uint16_t sector,
+					       uint16_t sector_size,
+					       uint8_t *data);
+
 int
 hidpp20_onboard_profiles_write_sector(struct hidpp20_device *device,
 				      uint16_t sector,
@@ -1020,7 +1142,65 @@ hidpp20_onboard_profiles_read_led(struct hidpp20_led *led,
 
 void
 hidpp20_onboard_profiles_write_led(struct hidpp20_internal_led *internal_led,
-				   struct hidpp20_led *led);
+				   const struct hidpp20_led *led);
+
+/*
+ * Codec for the onboard profile sectors. These functions work on sector
+ * images of profiles->sector_size bytes in memory and do not talk to the
+ * device, so images can be prepared and checked offline and written with
+ * hidpp20_onboard_profiles_write_sector() later.
+ */
+
+/**
+ * @return true if the CRC in the last two bytes of the sector matches
+ */
+bool
+hidpp20_onboard_profiles_sector_crc_is_valid(const uint8_t *data,
+					     uint16_t sector_size);
+
+/**
+ * Compute the CRC of the sector and store it in its last two bytes.
+ */
+void
+hidpp20_onboard_profiles_sector_set_crc(uint8_t *data, uint16_t sector_size);
+
+/**
+ * Decode the profile stored in data. The CRC is not checked. Macro
+ * buttons are decoded as references, the macro's sector is stored in the
+ * 'zero' field of the binding, profile->macros is left untouched.
+ * profile->address and profile->enabled are not modified.
+ */
+void
+hidpp20_onboard_profiles_decode_profile(const struct hidpp20_profiles *profiles,
+					const uint8_t *data,
+					struct hidpp20_profile *profile);
+
+/**
+ * Encode the profile into data, including the CRC. The alternate LEDs
+ * are written as copies of the current LEDs.
+ */
+void
+hidpp20_onboard_profiles_encode_profile(const struct hidpp20_profiles *profiles,
+					const struct hidpp20_profile *profile,
+					uint8_t *data);
+
+/**
+ * Encode the profile directory into data, including the CRC. User
+ * profile n + 1 is stored in sector n + 1.
+ */
+void
+hidpp20_onboard_profiles_encode_dict(const struct hidpp20_profiles *profiles,
+				     uint8_t *data);
+
+/**
+ * Decode the profile directory in data into the address and enabled
+ * fields of profiles->profiles.
+ *
+ * @return the number of directory entries or -EAGAIN if the CRC is invalid
+ */
+int
+hidpp20_onboard_profiles_decode_dict(struct hidpp20_profiles *profiles,
+				     const uint8_t *data);
 
 /* -------------------------------------------------------------------------- */
 /* 0x8110 - Mouse Button Spy                                                  */
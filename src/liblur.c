@@ -27,9 +27,11 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <sys/ioctl.h>
+#include <unistd.h>
 #include <linux/hidraw.h>
 
 #include "usb-ids.h"
@@ -47,14 +49,33 @@ cleanup_hidpp10_device_destroy(struct hidpp10_device **hidpp10_device) {
 }
 #define _cleanup_hidpp10_device_destroy_ _cleanup_(cleanup_hidpp10_device_destroy)
 
+/* What we know about one pairing slot of the receiver */
+struct lur_slot {
+	struct lur_device *dev;	/* NULL if empty or not readable */
+	bool dirty;		/* needs to be re-read on the next enumerate */
+};
+
 struct lur_receiver {
 	int refcount;
-	int fd;
+	int fd;		/* the caller's fd, only handed back */
+	int hidraw_fd;	/* our duplicate of fd, used for all I/O */
 	void *userdata;
 
 	struct hidpp10_device *hidppdev;
+	/* shared by the receiver and all paired devices on hidraw_fd */
+	struct hidpp_mux mux;
 
 	struct list devices;
+
+	/* The slot table is kept up to date from the receiver's connection
+	 * notifications, only slots that changed are re-read. Without
+	 * notifications, every enumerate re-reads all slots. */
+	struct lur_slot slots[MAX_DEVICES];
+	bool enumerated;	/* notifications were requested */
+	bool notifications;
+	bool restore_notifications;
+	uint32_t old_notifications; /* register value before we changed it */
+	uint64_t mux_dropped;	/* mux->dropped at the last enumerate */
 };
 
 struct lur_device {
@@ -105,6 +126,23 @@ lur_device_get_serial(struct lur_device *dev)
 	return dev->serial;
 }
 
+/**
+ * Drop all references of the slot table to dev, the slots are re-read on
+ * the next enumerate.
+ */
+static void
+lur_receiver_forget_device(struct lur_receiver *lur, struct lur_device *dev)
+{
+	int i;
+
+	for (i = 0; i < MAX_DEVICES; i++) {
+		if (lur->slots[i].dev == dev) {
+			lur->slots[i].dev = NULL;
+			lur->slots[i].dirty = true;
+		}
+	}
+}
+
 _EXPORT_ int
 lur_device_disconnect(struct lur_device *dev)
 {
@@ -112,6 +150,7 @@ lur_device_disconnect(struct lur_device *dev)
 
 	rc = hidpp10_disconnect(dev->receiver->hidppdev, dev->hidppidx);
 	if (rc == 0) {
+		lur_receiver_forget_device(dev->receiver, dev);
 		list_remove(&dev->node);
 		list_init(&dev->node);
 	}
@@ -141,16 +180,154 @@ hidraw_is_receiver(int fd)
 }
 
 static int
-hidpp10_init(int fd, struct hidpp10_device **out)
+hidpp10_init(int fd, struct hidpp_mux *mux, struct hidpp10_device **out)
 {
 	struct hidpp_device base;
 
 	hidpp_device_init(&base, fd);
+	hidpp_device_set_mux(&base, mux);
 
 	return hidpp10_device_new(&base, HIDPP_RECEIVER_IDX,
 				  HIDPP10_PROFILE_UNKNOWN, 1, out);
 }
 
+/**
+ * Ask the receiver to send 0x40/0x41 notifications when a device is
+ * paired, unpaired, connects or disconnects. The register is shared with
+ * everyone else using the receiver, lur_receiver_restore_notifications()
+ * puts back the previous value.
+ */
+static bool
+lur_receiver_enable_notifications(struct lur_receiver *lur)
+{
+	uint32_t flags;
+	int rc;
+
+	rc = hidpp10_get_hidpp_notifications(lur->hidppdev, &flags);
+	if (rc)
+		return false;
+
+	if (flags & HIDPP10_NOTIFICATIONS_WIRELESS_NOTIFICATIONS)
+		return true;
+
+	rc = hidpp10_set_hidpp_notifications(lur->hidppdev,
+					     flags | HIDPP10_NOTIFICATIONS_WIRELESS_NOTIFICATIONS);
+	if (rc)
+		return false;
+
+	lur->old_notifications = flags;
+	lur->restore_notifications = true;
+
+	return true;
+}
+
+static void
+lur_receiver_restore_notifications(struct lur_receiver *lur)
+{
+	if (!lur->restore_notifications)
+		return;
+
+	hidpp10_set_hidpp_notifications(lur->hidppdev, lur->old_notifications);
+	lur->restore_notifications = false;
+}
+
+/**
+ * Consume all pending messages without blocking and mark the slots named
+ * in connection notifications as dirty. If the mux had to drop messages
+ * since the last call, we may have missed a notification and all slots
+ * are marked dirty.
+ */
+static void
+lur_receiver_process_notifications(struct lur_receiver *lur)
+{
+	uint8_t buf[LONG_MESSAGE_LENGTH];
+	int i, rc;
+
+	while ((rc = hidpp_mux_read_pending(&lur->mux, buf, sizeof(buf))) > 0) {
+		uint8_t idx = buf[1];
+
+		if (rc < 3 ||
+		    (buf[0] != REPORT_ID_SHORT && buf[0] != REPORT_ID_LONG))
+			continue;
+
+		if (buf[2] != HIDPP_DEVICE_CONNECTION_NOTIF &&
+		    buf[2] != HIDPP_DEVICE_DISCONNECTION_NOTIF)
+			continue;
+
+		if (idx < MAX_DEVICES)
+			lur->slots[idx].dirty = true;
+	}
+
+	if (!lur->notifications || rc < 0 ||
+	    lur->mux.dropped != lur->mux_dropped) {
+		for (i = 0; i < MAX_DEVICES; i++)
+			lur->slots[i].dirty = true;
+	}
+
+	lur->mux_dropped = lur->mux.dropped;
+}
+
+/**
+ * Read the pairing information of the slot and return the matching
+ * device, a new one if it is not known yet. Returns NULL if the slot is
+ * empty or the device cannot be read.
+ */
+static struct lur_device *
+lur_receiver_read_slot(struct lur_receiver *lur, int i)
+{
+	_cleanup_hidpp10_device_destroy_ struct hidpp10_device *d = NULL;
+	struct hidpp_device base;
+	size_t name_size = 64;
+	char name[name_size];
+	uint8_t interval, type;
+	uint16_t wpid;
+	uint32_t serial;
+	struct lur_device *dev;
+	int rc;
+
+	hidpp_device_init(&base, lur->hidraw_fd);
+	hidpp_device_set_mux(&base, &lur->mux);
+
+	rc = hidpp10_device_new(&base, i, HIDPP10_PROFILE_UNKNOWN, 1, &d);
+	if (rc)
+		return NULL;
+
+	rc = hidpp10_get_pairing_information_device_name(d, name, &name_size);
+	if (rc)
+		return NULL;
+
+	rc = hidpp10_get_pairing_information(d, &interval, &wpid, &type);
+	if (rc)
+		return NULL;
+
+	rc = hidpp10_get_extended_pairing_information(d, &serial);
+	if (rc)
+		return NULL;
+
+	/* check if we have the device already in the list */
+	list_for_each(dev, &lur->devices, node) {
+		if (dev->pid == wpid &&
+		    dev->type == type &&
+		    dev->serial == serial &&
+		    streq(dev->name, name))
+			return dev;
+	}
+
+	dev = zalloc(sizeof *dev);
+	dev->receiver = lur;
+	lur_receiver_ref(lur);
+	dev->refcount = 1;
+	dev->name = strdup_safe(name);
+	dev->vid = USB_VENDOR_ID_LOGITECH;
+	dev->pid = wpid;
+	dev->type = type;
+	dev->serial = serial;
+	dev->hidppidx = i;
+	list_insert(&lur->devices, &dev->node);
+
+	return dev;
+}
+
 _EXPORT_ int
 lur_receiver_new_from_hidraw(int fd, void *userdata, struct lur_receiver **out)
 {
@@ -166,7 +343,18 @@ lur_receiver_new_from_hidraw(int fd, void *userdata, struct lur_receiver **out)
 	receiver->userdata = userdata;
 	list_init(&receiver->devices);
 
-	rc = hidpp10_init(fd, &receiver->hidppdev);
+	/* unref has to write to the receiver, the caller may have closed
+	 * fd by then */
+	receiver->hidraw_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	if (receiver->hidraw_fd < 0) {
+		rc = -errno;
+		free(receiver);
+		return rc;
+	}
+
+	hidpp_mux_init(&receiver->mux, receiver->hidraw_fd);
+
+	rc = hidpp10_init(receiver->hidraw_fd, &receiver->mux, &receiver->hidppdev);
 	if (rc)
 		goto error;
 
@@ -174,6 +362,7 @@ lur_receiver_new_from_hidraw(int fd, void *userdata, struct lur_receiver **out)
 	return 0;
 
 error:
+	close(receiver->hidraw_fd);
 	free(receiver);
 	return rc;
 }
@@ -182,72 +371,49 @@ _EXPORT_ int
 lur_receiver_enumerate(struct lur_receiver *lur,
 		       struct lur_device ***devices_out)
 {
-	int i;
+	int i, j;
 	int ndevices = 0;
-	struct hidpp_device base;
 	struct lur_device *dev, *tmp;
-	int rc;
 	struct lur_device **devices;
 
-	hidpp_device_init(&base, lur->fd);
+	/* Only enumerating needs the notifications, so don't touch the
+	 * register of a receiver that is merely opened. Nothing is known
+	 * about the slots yet on the first call. */
+	if (!lur->enumerated) {
+		lur->enumerated = true;
+		lur->notifications = lur_receiver_enable_notifications(lur);
+		for (i = 0; i < MAX_DEVICES; i++)
+			lur->slots[i].dirty = true;
+	}
 
-	list_for_each(dev, &lur->devices, node)
-		dev->present = false;
+	lur_receiver_process_notifications(lur);
 
 	for (i = 0; i < MAX_DEVICES; i++) {
-		_cleanup_hidpp10_device_destroy_ struct hidpp10_device *d = NULL;
-		size_t name_size = 64;
-		char name[name_size];
-		uint8_t interval, type;
-		uint16_t wpid;
-		uint32_t serial;
-		bool is_new_device = true;
-
-		rc = hidpp10_device_new(&base, i, HIDPP10_PROFILE_UNKNOWN, 1, &d);
-		if (rc)
-			continue;
+		struct lur_slot *slot = &lur->slots[i];
 
-		rc = hidpp10_get_pairing_information_device_name(d, name, &name_size);
-		if (rc)
+		if (!slot->dirty)
 			continue;
 
-		rc = hidpp10_get_pairing_information(d, &interval, &wpid, &type);
-		if (rc)
+		slot->dirty = false;
+		slot->dev = lur_receiver_read_slot(lur, i);
+		if (!slot->dev)
 			continue;
 
-		rc = hidpp10_get_extended_pairing_information(d, &serial);
-		if (rc)
-			continue;
-
-		/* check if we have the device already in the list */
-		list_for_each(dev, &lur->devices, node) {
-			if (dev->pid == wpid &&
-			    dev->type == type &&
-			    dev->serial == serial &&
-			    streq(dev->name, name)) {
-				/* index may have changed, doesn't make it a
-				 * new device, just update it */
-				dev->hidppidx = i;
-				dev->present = true;
-				is_new_device = false;
-				break;
-			}
+		/* index may have changed, doesn't make it a new device,
+		 * just update it */
+		slot->dev->hidppidx = i;
+		for (j = 0; j < MAX_DEVICES; j++) {
+			if (j != i && lur->slots[j].dev == slot->dev)
+				lur->slots[j].dev = NULL;
 		}
+	}
 
-		if (is_new_device) {
-			dev = zalloc(sizeof *dev);
-			dev->receiver = lur;
-			lur_receiver_ref(lur);
-			dev->refcount = 1;
-			dev->name = strdup_safe(name);
-			dev->vid = USB_VENDOR_ID_LOGITECH;
-			dev->pid = wpid;
-			dev->type = type;
-			dev->serial = serial;
-			dev->hidppidx = i;
-			dev->present = true;
-			list_insert(&lur->devices, &dev->node);
-		}
+	list_for_each(dev, &lur->devices, node)
+		dev->present = false;
+
+	for (i = 0; i < MAX_DEVICES; i++) {
+		if (lur->slots[i].dev)
+			lur->slots[i].dev->present = true;
 	}
 
 	devices = zalloc(MAX_DEVICES * sizeof(*devices));
@@ -310,7 +476,9 @@ lur_receiver_unref(struct lur_receiver *lur)
 	/* when we get here, all the devices have already been removed from
 	 * the receiver */
 
+	lur_receiver_restore_notifications(lur);
 	hidpp10_device_destroy(lur->hidppdev);
+	close(lur->hidraw_fd);
 	free(lur);
 
 	return NULL;
@@ -349,6 +517,7 @@ lur_device_unref(struct lur_device *dev)
 	if (dev->refcount > 0)
 		return NULL;
 
+	lur_receiver_forget_device(dev->receiver, dev);
 	list_remove(&dev->node);
 	lur_receiver_unref(dev->receiver);
 	free(dev->name);
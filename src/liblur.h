@@ -101,8 +101,9 @@ lur_is_receiver(uint16_t vid, uint16_t pid);
  *
  * The returned struct has a refcount of at least 1, use lur_device_unref()
  * to release resources associated with it.
- * It is the caller's responsibility to close the fd after the
- * resources associated with this object have been freed.
+ * The receiver does its I/O on a duplicate of fd that is closed when the
+ * receiver is destroyed. The caller still owns fd and may close it at any
+ * time.
  *
  * @param fd An O_RDWR file descriptor pointing to a /dev/hidraw node
  * @param userdata Caller-specific data
@@ -128,6 +129,14 @@ lur_receiver_new_from_hidraw(int fd, void *userdata, struct lur_receiver **lur);
  * lur_receiver_enumerate(). Otherwise, the diff between the two lists
  * indicate the set of newly added and/or removed devices.
  *
+ * The receiver's pairing slots are only re-read when the receiver sent a
+ * connection or disconnection notification for them since the last call,
+ * these notifications are consumed from the fd by this function. If the
+ * receiver does not support notifications, all slots are re-read on every
+ * call. The first call enables the receiver's wireless notifications if
+ * necessary, the previous setting is restored when the receiver is
+ * destroyed, see lur_receiver_unref().
+ *
  * The devices returned have a refcount of at least 1, use
  * lur_device_unref(). Repeated calls to this function do not increase the
  * devices' refcount.
@@ -171,7 +180,8 @@ lur_receiver_close(struct lur_receiver *lur);
  * Return the file descriptor used to initialize this receiver.
  *
  * @param lur A valid receiver object
- * @return The file descriptor passed into lur_receiver_new_from_hidraw
+ * @return The file descriptor passed into lur_receiver_new_from_hidraw,
+ * it may have been closed by the caller since
  */
 int
 lur_receiver_get_fd(struct lur_receiver* lur);
@@ -189,7 +199,9 @@ lur_receiver_ref(struct lur_receiver *lur);
 /**
  * Dereference the context. After this, the context may have been
  * destroyed, if the last reference was dereferenced. If so, the context is
- * invalid and may not be interacted with.
+ * invalid and may not be interacted with. Destroying the context restores
+ * the receiver's notification setting changed by lur_receiver_enumerate(),
+ * this uses the receiver's own duplicate of the fd, not the caller's.
  *
  * @param lur A valid receiver object
  * @retval NULL
@@ -115,6 +115,7 @@ struct ratbag_device_data {
 
 	enum driver drivertype;
 	enum ratbag_device_type devicetype;
+	unsigned int request_timeout;
 
 	union {
 		struct data_hidpp20 hidpp20;
@@ -475,6 +476,12 @@ ratbag_device_data_get_device_type(const struct ratbag_device_data *data)
 	return data->devicetype;
 }
 
+unsigned int
+ratbag_device_data_get_request_timeout(const struct ratbag_device_data *data)
+{
+	return data->request_timeout;
+}
+
 struct ratbag_device_data *
 ratbag_device_data_ref(struct ratbag_device_data *data)
 {
@@ -566,7 +573,9 @@ file_data_matches(struct ratbag *ratbag,
 	_cleanup_(g_error_freep) GError *error = NULL;
 	_cleanup_(g_strfreevp) char **match_strv = NULL;
 	_cleanup_(ratbag_device_data_unrefp) struct ratbag_device_data *data = NULL;
+	_cleanup_(g_error_freep) GError *timeout_error = NULL;
 	_cleanup_free_ char *devicetype = NULL;
+	int timeout;
 	int rc;
 
 	keyfile = g_key_file_new();
@@ -634,6 +643,15 @@ file_data_matches(struct ratbag *ratbag,
 		return false;
 	}
 
+	timeout = g_key_file_get_integer(keyfile, GROUP_DEVICE, "RequestTimeout", &timeout_error);
+	if (!timeout_error) {
+		if (timeout < RTT_TIMEOUT_MIN_MS || timeout > RTT_TIMEOUT_MAX_MS)
+			log_error(ratbag, "Invalid RequestTimeout %d in '%s', ignoring\n",
+				  timeout, basename(path));
+		else
+			data->request_timeout = timeout;
+	}
+
 	*data_out = data;
 	data = NULL;
 
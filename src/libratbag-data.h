@@ -44,6 +44,11 @@ const char *
 ratbag_device_data_get_name(const struct ratbag_device_data *data);
 enum ratbag_device_type
 ratbag_device_data_get_device_type(const struct ratbag_device_data *data);
+/**
+ * @return The request timeout ceiling in ms or 0 if not set
+ */
+unsigned int
+ratbag_device_data_get_request_timeout(const struct ratbag_device_data *data);
 
 /* HID++ 1.0 */
 /**
@@ -304,3 +304,35 @@ enum ratbag_device_type {
 	 */
 	TYPE_KEYBOARD,
 };
+
+/**
+ * @ingroup enums
+ *
+ * The type of a request sent to the device, see ratbag_device_get_stats().
+ */
+enum ratbag_io_request_type {
+	/**
+	 * A HID feature report read, the ID is the report ID.
+	 */
+	RATBAG_IO_FEATURE_GET_REPORT = 0,
+	/**
+	 * A HID feature report write, the ID is the report ID.
+	 */
+	RATBAG_IO_FEATURE_SET_REPORT,
+	/**
+	 * A HID output report write, the ID is the report ID.
+	 */
+	RATBAG_IO_OUTPUT_REPORT,
+	/**
+	 * An input report read in reply to a request. The ID is the report
+	 * ID of the request that preceded it.
+	 */
+	RATBAG_IO_INPUT_REPORT,
+	/**
+	 * A HID++ request and its reply. The ID is the sub ID (HID++ 1.0)
+	 * or feature index (HID++ 2.0) in the upper 8 bits and the
+	 * register address (HID++ 1.0) or function ID (HID++ 2.0) in the
+	 * lower 8 bits.
+	 */
+	RATBAG_IO_HIDPP,
+};
@@ -0,0 +1,1609 @@
+/*
+ * Copyright © 2026 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Device state export and import, see ratbag_device_export().
+ *
+ * Both formats are decoded into a struct ratbag_export first, import
+ * then validates the whole state against the device before it changes
+ * anything and only calls the setters for values that differ.
+ *
+ * The binary format is little-endian throughout:
+ *
+ *   header:     "RBPF", u16 version, u16 num_profiles,
+ *               u16 num_resolutions, u16 num_buttons, u16 num_leds,
+ *               u16 reserved
+ *   profile:    u8 flags (enabled, active), u8 reserved[3], u32 hz,
+ *               s32 angle_snapping, s32 debounce, string name,
+ *               followed by its resolutions, buttons and LEDs
+ *   resolution: u32 dpi_x, u32 dpi_y, u8 flags (active, default, disabled)
+ *   button:     u8 action type (0xff for unknown), u32 value
+ *               for macros: string name, string group, u16 nevents,
+ *               nevents * (u8 type, u32 key or timeout)
+ *   LED:        u8 mode, u8 red, u8 green, u8 blue, u32 ms, u32 brightness
+ *   string:     u16 length, length bytes without terminator, a length of
+ *               0xffff is NULL
+ *
+ * A NULL profile name, an angle snapping or debounce of -1 and an active
+ * profile or resolution that is not set on any entry leave the device's
+ * value untouched on import. So do buttons of the unknown action type.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <json-glib/json-glib.h>
+
+#include "libratbag-private.h"
+#include "libratbag-util.h"
+
+#define EXPORT_MAGIC "RBPF"
+#define EXPORT_VERSION 1
+#define EXPORT_STRING_NULL 0xffff
+#define EXPORT_ACTION_UNKNOWN 0xff
+
+#define EXPORT_PROFILE_ENABLED		(1 << 0)
+#define EXPORT_PROFILE_ACTIVE		(1 << 1)
+#define EXPORT_RESOLUTION_ACTIVE	(1 << 0)
+#define EXPORT_RESOLUTION_DEFAULT	(1 << 1)
+#define EXPORT_RESOLUTION_DISABLED	(1 << 2)
+
+struct ratbag_export_resolution {
+	unsigned int dpi_x;
+	unsigned int dpi_y;
+	bool is_active;
+	bool is_default;
+	bool is_disabled;
+};
+
+struct ratbag_export_button {
+	enum ratbag_button_action_type type;
+	unsigned int value; /* button, special or key */
+	char *name;	    /* macros only */
+	char *group;
+	unsigned int nevents;
+	struct ratbag_macro_event *events;
+};
+
+struct ratbag_export_led {
+	enum ratbag_led_mode mode;
+	struct ratbag_color color;
+	unsigned int ms;
+	unsigned int brightness;
+};
+
+struct ratbag_export_profile {
+	char *name;
+	bool is_enabled;
+	bool is_active;
+	unsigned int hz;
+	int angle_snapping;
+	int debounce;
+};
+
+struct ratbag_export {
+	unsigned int num_profiles;
+	unsigned int num_resolutions;
+	unsigned int num_buttons;
+	unsigned int num_leds;
+
+	/* indexed by profile * num_<object> + index */
+	struct ratbag_export_profile *profiles;
+	struct ratbag_export_resolution *resolutions;
+	struct ratbag_export_button *buttons;
+	struct ratbag_export_led *leds;
+};
+
+static struct ratbag_export *
+ratbag_export_new(unsigned int num_profiles, unsigned int num_resolutions,
+		  unsigned int num_buttons, unsigned int num_leds)
+{
+	struct ratbag_export *export = zalloc(sizeof(*export));
+
+	export->num_profiles = num_profiles;
+	export->num_resolutions = num_resolutions;
+	export->num_buttons = num_buttons;
+	export->num_leds = num_leds;
+	export->profiles = zalloc(max(num_profiles, 1U) *
+				  sizeof(*export->profiles));
+	export->resolutions = zalloc(max(num_profiles * num_resolutions, 1U) *
+				     sizeof(*export->resolutions));
+	export->buttons = zalloc(max(num_profiles * num_buttons, 1U) *
+				 sizeof(*export->buttons));
+	export->leds = zalloc(max(num_profiles * num_leds, 1U) *
+			      sizeof(*export->leds));
+
+	return export;
+}
+
+static void
+ratbag_export_destroy(struct ratbag_export *export)
+{
+	if (!export)
+		return;
+
+	for (unsigned int i = 0; i < export->num_profiles; i++)
+		free(export->profiles[i].name);
+
+	for (unsigned int i = 0; i < export->num_profiles * export->num_buttons; i++) {
+		free(export->buttons[i].name);
+		free(export->buttons[i].group);
+		free(export->buttons[i].events);
+	}
+
+	free(export->profiles);
+	free(export->resolutions);
+	free(export->buttons);
+	free(export->leds);
+	free(export);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(struct ratbag_export *, ratbag_export_destroy);
+#define _cleanup_export_ _cleanup_(ratbag_export_destroyp)
+
+static inline struct ratbag_export_resolution *
+export_resolution(const struct ratbag_export *export,
+		  unsigned int profile, unsigned int index)
+{
+	return &export->resolutions[profile * export->num_resolutions + index];
+}
+
+static inline struct ratbag_export_button *
+export_button(const struct ratbag_export *export,
+	      unsigned int profile, unsigned int index)
+{
+	return &export->buttons[profile * export->num_buttons + index];
+}
+
+static inline struct ratbag_export_led *
+export_led(const struct ratbag_export *export,
+	   unsigned int profile, unsigned int index)
+{
+	return &export->leds[profile * export->num_leds + index];
+}
+
+static bool
+export_macro_event_is_valid(const struct ratbag_macro_event *event)
+{
+	switch (event->type) {
+	case RATBAG_MACRO_EVENT_KEY_PRESSED:
+	case RATBAG_MACRO_EVENT_KEY_RELEASED:
+	case RATBAG_MACRO_EVENT_WAIT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool
+export_button_is_valid(const struct ratbag_export_button *button)
+{
+	switch (button->type) {
+	case RATBAG_BUTTON_ACTION_TYPE_NONE:
+	case RATBAG_BUTTON_ACTION_TYPE_BUTTON:
+	case RATBAG_BUTTON_ACTION_TYPE_SPECIAL:
+	case RATBAG_BUTTON_ACTION_TYPE_KEY:
+	case RATBAG_BUTTON_ACTION_TYPE_UNKNOWN:
+		return true;
+	case RATBAG_BUTTON_ACTION_TYPE_MACRO:
+		break;
+	default:
+		return false;
+	}
+
+	if (button->nevents > MAX_MACRO_EVENTS)
+		return false;
+
+	for (unsigned int i = 0; i < button->nevents; i++) {
+		if (!export_macro_event_is_valid(&button->events[i]))
+			return false;
+	}
+
+	return true;
+}
+
+static void
+export_from_device(struct ratbag_export *export, struct ratbag_device *device)
+{
+	struct ratbag_profile *profile;
+	struct ratbag_resolution *resolution;
+	struct ratbag_button *button;
+	struct ratbag_led *led;
+
+	ratbag_device_for_each_profile(device, profile) {
+		struct ratbag_export_profile *p = &export->profiles[profile->index];
+
+		p->name = strdup_safe(profile->name);
+		p->is_enabled = profile->is_enabled;
+		p->is_active = profile->is_active;
+		p->hz = profile->hz;
+		p->angle_snapping = profile->angle_snapping;
+		p->debounce = profile->debounce;
+
+		ratbag_profile_for_each_resolution(profile, resolution) {
+			struct ratbag_export_resolution *r;
+
+			r = export_resolution(export, profile->index, resolution->index);
+			r->dpi_x = resolution->dpi_x;
+			r->dpi_y = resolution->dpi_y;
+			r->is_active = resolution->is_active;
+			r->is_default = resolution->is_default;
+			r->is_disabled = resolution->is_disabled;
+		}
+
+		ratbag_profile_for_each_button(profile, button) {
+			const struct ratbag_macro *macro = button->action.macro;
+			struct ratbag_export_button *b;
+
+			b = export_button(export, profile->index, button->index);
+			b->type = button->action.type;
+
+			switch (b->type) {
+			case RATBAG_BUTTON_ACTION_TYPE_BUTTON:
+				b->value = button->action.action.button;
+				break;
+			case RATBAG_BUTTON_ACTION_TYPE_SPECIAL:
+				b->value = button->action.action.special;
+				break;
+			case RATBAG_BUTTON_ACTION_TYPE_KEY:
+				b->value = button->action.action.key.key;
+				break;
+			case RATBAG_BUTTON_ACTION_TYPE_MACRO:
+				if (!macro)
+					break;
+				b->name = strdup_safe(macro->name);
+				b->group = strdup_safe(macro->group);
+				b->nevents = macro->nevents;
+				b->events = zalloc(max(macro->nevents, 1U) *
+						   sizeof(*b->events));
+				memcpy(b->events, macro->events,
+				       macro->nevents * sizeof(*b->events));
+				break;
+			default:
+				break;
+			}
+		}
+
+		ratbag_profile_for_each_led(profile, led) {
+			struct ratbag_export_led *l;
+
+			l = export_led(export, profile->index, led->index);
+			l->mode = led->mode;
+			l->color = led->color;
+			l->ms = led->ms;
+			l->brightness = led->brightness;
+		}
+	}
+}
+
+/* Binary format */
+
+struct export_writer {
+	uint8_t *data;
+	size_t len;
+	size_t size;
+};
+
+static void
+writer_put(struct export_writer *w, const void *data, size_t len)
+{
+	if (w->len + len > w->size) {
+		w->size = max(w->size * 2, w->len + len);
+		w->data = realloc(w->data, w->size);
+		if (!w->data)
+			abort();
+	}
+
+	memcpy(w->data + w->len, data, len);
+	w->len += len;
+}
+
+static void
+writer_put_u8(struct export_writer *w, uint8_t value)
+{
+	writer_put(w, &value, 1);
+}
+
+static void
+writer_put_u16(struct export_writer *w, uint16_t value)
+{
+	uint8_t buf[2];
+
+	set_unaligned_le_u16(buf, value);
+	writer_put(w, buf, sizeof(buf));
+}
+
+static void
+writer_put_u32(struct export_writer *w, uint32_t value)
+{
+	uint8_t buf[4] = {
+		value & 0xff,
+		(value >> 8) & 0xff,
+		(value >> 16) & 0xff,
+		(value >> 24) & 0xff,
+	};
+
+	writer_put(w, buf, sizeof(buf));
+}
+
+static void
+writer_put_string(struct export_writer *w, const char *str)
+{
+	size_t len;
+
+	if (!str) {
+		writer_put_u16(w, EXPORT_STRING_NULL);
+		return;
+	}
+
+	len = min(strlen(str), (size_t)EXPORT_STRING_NULL - 1);
+	writer_put_u16(w, len);
+	writer_put(w, str, len);
+}
+
+static void
+export_write_binary(const struct ratbag_export *export,
+		    struct export_writer *w)
+{
+	writer_put(w, EXPORT_MAGIC, 4);
+	writer_put_u16(w, EXPORT_VERSION);
+	writer_put_u16(w, export->num_profiles);
+	writer_put_u16(w, export->num_resolutions);
+	writer_put_u16(w, export->num_buttons);
+	writer_put_u16(w, export->num_leds);
+	writer_put_u16(w, 0);
+
+	for (unsigned int p = 0; p < export->num_profiles; p++) {
+		const struct ratbag_export_profile *profile = &export->profiles[p];
+		uint8_t flags = 0;
+
+		if (profile->is_enabled)
+			flags |= EXPORT_PROFILE_ENABLED;
+		if (profile->is_active)
+			flags |= EXPORT_PROFILE_ACTIVE;
+
+		writer_put_u8(w, flags);
+		writer_put_u8(w, 0);
+		writer_put_u16(w, 0);
+		writer_put_u32(w, profile->hz);
+		writer_put_u32(w, (uint32_t)profile->angle_snapping);
+		writer_put_u32(w, (uint32_t)profile->debounce);
+		writer_put_string(w, profile->name);
+
+		for (unsigned int i = 0; i < export->num_resolutions; i++) {
+			const struct ratbag_export_resolution *r = export_resolution(export, p, i);
+
+			flags = 0;
+			if (r->is_active)
+				flags |= EXPORT_RESOLUTION_ACTIVE;
+			if (r->is_default)
+				flags |= EXPORT_RESOLUTION_DEFAULT;
+			if (r->is_disabled)
+				flags |= EXPORT_RESOLUTION_DISABLED;
+
+			writer_put_u32(w, r->dpi_x);
+			writer_put_u32(w, r->dpi_y);
+			writer_put_u8(w, flags);
+		}
+
+		for (unsigned int i = 0; i < export->num_buttons; i++) {
+			const struct ratbag_export_button *b = export_button(export, p, i);
+
+			if (b->type == RATBAG_BUTTON_ACTION_TYPE_UNKNOWN)
+				writer_put_u8(w, EXPORT_ACTION_UNKNOWN);
+			else
+				writer_put_u8(w, b->type);
+			writer_put_u32(w, b->value);
+
+			if (b->type != RATBAG_BUTTON_ACTION_TYPE_MACRO)
+				continue;
+
+			writer_put_string(w, b->name);
+			writer_put_string(w, b->group);
+			writer_put_u16(w, b->nevents);
+			for (unsigned int e = 0; e < b->nevents; e++) {
+				writer_put_u8(w, b->events[e].type);
+				writer_put_u32(w, b->events[e].event.key);
+			}
+		}
+
+		for (unsigned int i = 0; i < export->num_leds; i++) {
+			const struct ratbag_export_led *l = export_led(export, p, i);
+
+			writer_put_u8(w, l->mode);
+			writer_put_u8(w, l->color.red);
+			writer_put_u8(w, l->color.green);
+			writer_put_u8(w, l->color.blue);
+			writer_put_u32(w, l->ms);
+			writer_put_u32(w, l->brightness);
+		}
+	}
+}
+
+struct export_reader {
+	const uint8_t *data;
+	size_t len;
+	size_t pos;
+	bool error;
+};
+
+static const uint8_t *
+reader_get(struct export_reader *r, size_t len)
+{
+	const uint8_t *data;
+
+	if (r->error || r->len - r->pos < len) {
+		r->error = true;
+		return NULL;
+	}
+
+	data = r->data + r->pos;
+	r->pos += len;
+
+	return data;
+}
+
+static uint8_t
+reader_get_u8(struct export_reader *r)
+{
+	const uint8_t *data = reader_get(r, 1);
+
+	return data ? data[0] : 0;
+}
+
+static uint16_t
+reader_get_u16(struct export_reader *r)
+{
+	const uint8_t *data = reader_get(r, 2);
+
+	return data ? get_unaligned_le_u16(data) : 0;
+}
+
+static uint32_t
+reader_get_u32(struct export_reader *r)
+{
+	const uint8_t *data = reader_get(r, 4);
+
+	if (!data)
+		return 0;
+
+	return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static char *
+reader_get_string(struct export_reader *r)
+{
+	const uint8_t *data;
+	uint16_t len;
+	char *str;
+
+	len = reader_get_u16(r);
+	if (len == EXPORT_STRING_NULL)
+		return NULL;
+
+	data = reader_get(r, len);
+	if (!data)
+		return NULL;
+
+	str = zalloc(len + 1);
+	memcpy(str, data, len);
+
+	return str;
+}
+
+static struct ratbag_export *
+export_read_binary(const uint8_t *data, size_t len)
+{
+	struct export_reader r = { .data = data, .len = len };
+	_cleanup_export_ struct ratbag_export *export = NULL;
+	struct ratbag_export *result;
+	unsigned int num_profiles, num_resolutions, num_buttons, num_leds;
+	const uint8_t *magic;
+	uint16_t version;
+
+	magic = reader_get(&r, 4);
+	if (!magic || memcmp(magic, EXPORT_MAGIC, 4) != 0)
+		return NULL;
+
+	version = reader_get_u16(&r);
+	if (version != EXPORT_VERSION)
+		return NULL;
+
+	num_profiles = reader_get_u16(&r);
+	num_resolutions = reader_get_u16(&r);
+	num_buttons = reader_get_u16(&r);
+	num_leds = reader_get_u16(&r);
+	reader_get_u16(&r);
+	if (r.error)
+		return NULL;
+
+	/* reject counts that can't possibly fit before allocating */
+	if ((uint64_t)num_profiles * (18 + num_resolutions * 9 +
+				      num_buttons * 5 + num_leds * 12) > len)
+		return NULL;
+
+	export = ratbag_export_new(num_profiles, num_resolutions,
+				   num_buttons, num_leds);
+
+	for (unsigned int p = 0; p < num_profiles && !r.error; p++) {
+		struct ratbag_export_profile *profile = &export->profiles[p];
+		uint8_t flags;
+
+		flags = reader_get_u8(&r);
+		reader_get(&r, 3);
+		profile->is_enabled = !!(flags & EXPORT_PROFILE_ENABLED);
+		profile->is_active = !!(flags & EXPORT_PROFILE_ACTIVE);
+		profile->hz = reader_get_u32(&r);
+		profile->angle_snapping = (int32_t)reader_get_u32(&r);
+		profile->debounce = (int32_t)reader_get_u32(&r);
+		profile->name = reader_get_string(&r);
+
+		for (unsigned int i = 0; i < num_resolutions; i++) {
+			struct ratbag_export_resolution *res = export_resolution(export, p, i);
+
+			res->dpi_x = reader_get_u32(&r);
+			res->dpi_y = reader_get_u32(&r);
+			flags = reader_get_u8(&r);
+			res->is_active = !!(flags & EXPORT_RESOLUTION_ACTIVE);
+			res->is_default = !!(flags & EXPORT_RESOLUTION_DEFAULT);
+			res->is_disabled = !!(flags & EXPORT_RESOLUTION_DISABLED);
+		}
+
+		for (unsigned int i = 0; i < num_buttons && !r.error; i++) {
+			struct ratbag_export_button *b = export_button(export, p, i);
+
+			b->type = reader_get_u8(&r);
+			if (b->type == EXPORT_ACTION_UNKNOWN)
+				b->type = RATBAG_BUTTON_ACTION_TYPE_UNKNOWN;
+			b->value = reader_get_u32(&r);
+
+			if (b->type != RATBAG_BUTTON_ACTION_TYPE_MACRO)
+				continue;
+
+			b->name = reader_get_string(&r);
+			b->group = reader_get_string(&r);
+			b->nevents = reader_get_u16(&r);
+			if (b->nevents > MAX_MACRO_EVENTS)
+				return NULL;
+
+			b->events = zalloc(max(b->nevents, 1U) * sizeof(*b->events));
+			for (unsigned int e = 0; e < b->nevents; e++) {
+				b->events[e].type = reader_get_u8(&r);
+				b->events[e].event.key = reader_get_u32(&r);
+			}
+		}
+
+		for (unsigned int i = 0; i < num_leds; i++) {
+			struct ratbag_export_led *l = export_led(export, p, i);
+
+			l->mode = reader_get_u8(&r);
+			l->color.red = reader_get_u8(&r);
+			l->color.green = reader_get_u8(&r);
+			l->color.blue = reader_get_u8(&r);
+			l->ms = reader_get_u32(&r);
+			l->brightness = reader_get_u32(&r);
+		}
+	}
+
+	if (r.error || r.pos != r.len)
+		return NULL;
+
+	result = export;
+	export = NULL;
+
+	return result;
+}
+
+/* JSON view */
+
+static const char *export_action_types[] = {
+	[RATBAG_BUTTON_ACTION_TYPE_NONE] = "none",
+	[RATBAG_BUTTON_ACTION_TYPE_BUTTON] = "button",
+	[RATBAG_BUTTON_ACTION_TYPE_SPECIAL] = "special",
+	[RATBAG_BUTTON_ACTION_TYPE_KEY] = "key",
+	[RATBAG_BUTTON_ACTION_TYPE_MACRO] = "macro",
+};
+
+static const char *export_led_modes[] = {
+	[RATBAG_LED_OFF] = "off",
+	[RATBAG_LED_ON] = "on",
+	[RATBAG_LED_CYCLE] = "cycle",
+	[RATBAG_LED_BREATHING] = "breathing",
+};
+
+static const char *export_macro_events[] = {
+	[RATBAG_MACRO_EVENT_KEY_PRESSED] = "press",
+	[RATBAG_MACRO_EVENT_KEY_RELEASED] = "release",
+	[RATBAG_MACRO_EVENT_WAIT] = "wait",
+};
+
+static const char *
+export_lookup_name(const char **names, size_t nnames, int value)
+{
+	if (value < 0 || (size_t)value >= nnames)
+		return NULL;
+
+	return names[value];
+}
+
+static int
+export_lookup_value(const char **names, size_t nnames, const char *name)
+{
+	for (size_t i = 0; i < nnames; i++) {
+		if (names[i] && streq(names[i], name))
+			return i;
+	}
+
+	return -1;
+}
+
+static void
+json_add_string_or_null(JsonBuilder *builder, const char *member,
+			const char *value)
+{
+	json_builder_set_member_name(builder, member);
+	if (value)
+		json_builder_add_string_value(builder, value);
+	else
+		json_builder_add_null_value(builder);
+}
+
+static void
+json_add_int(JsonBuilder *builder, const char *member, gint64 value)
+{
+	json_builder_set_member_name(builder, member);
+	json_builder_add_int_value(builder, value);
+}
+
+static void
+json_add_bool(JsonBuilder *builder, const char *member, gboolean value)
+{
+	json_builder_set_member_name(builder, member);
+	json_builder_add_boolean_value(builder, value);
+}
+
+static void
+export_write_json_button(JsonBuilder *builder,
+			 const struct ratbag_export_button *b)
+{
+	const char *type = export_lookup_name(export_action_types,
+					      ARRAY_LENGTH(export_action_types),
+					      b->type);
+
+	json_builder_begin_object(builder);
+	json_add_string_or_null(builder, "type", type ? type : "unknown");
+
+	switch (b->type) {
+	case RATBAG_BUTTON_ACTION_TYPE_BUTTON:
+		json_add_int(builder, "button", b->value);
+		break;
+	case RATBAG_BUTTON_ACTION_TYPE_SPECIAL:
+		json_add_int(builder, "special", b->value);
+		break;
+	case RATBAG_BUTTON_ACTION_TYPE_KEY:
+		json_add_int(builder, "key", b->value);
+		break;
+	case RATBAG_BUTTON_ACTION_TYPE_MACRO:
+		json_add_string_or_null(builder, "name", b->name);
+		json_add_string_or_null(builder, "group", b->group);
+		json_builder_set_member_name(builder, "events");
+		json_builder_begin_array(builder);
+		for (unsigned int e = 0; e < b->nevents; e++) {
+			json_builder_begin_array(builder);
+			json_builder_add_string_value(builder,
+				export_lookup_name(export_macro_events,
+						   ARRAY_LENGTH(export_macro_events),
+						   b->events[e].type));
+			json_builder_add_int_value(builder, b->events[e].event.key);
+			json_builder_end_array(builder);
+		}
+		json_builder_end_array(builder);
+		break;
+	default:
+		break;
+	}
+
+	json_builder_end_object(builder);
+}
+
+static char *
+export_write_json(const struct ratbag_export *export, size_t *len)
+{
+	g_autoptr(JsonBuilder) builder = json_builder_new();
+	g_autoptr(JsonGenerator) generator = NULL;
+	g_autoptr(JsonNode) root = NULL;
+	g_autofree gchar *json = NULL;
+	gsize json_len;
+	char *data;
+
+	json_builder_begin_object(builder);
+	json_add_int(builder, "version", EXPORT_VERSION);
+	json_builder_set_member_name(builder, "profiles");
+	json_builder_begin_array(builder);
+
+	for (unsigned int p = 0; p < export->num_profiles; p++) {
+		const struct ratbag_export_profile *profile = &export->profiles[p];
+
+		json_builder_begin_object(builder);
+		json_add_string_or_null(builder, "name", profile->name);
+		json_add_bool(builder, "enabled", profile->is_enabled);
+		json_add_bool(builder, "active", profile->is_active);
+		json_add_int(builder, "report_rate", profile->hz);
+		json_add_int(builder, "angle_snapping", profile->angle_snapping);
+		json_add_int(builder, "debounce", profile->debounce);
+
+		json_builder_set_member_name(builder, "resolutions");
+		json_builder_begin_array(builder);
+		for (unsigned int i = 0; i < export->num_resolutions; i++) {
+			const struct ratbag_export_resolution *r = export_resolution(export, p, i);
+
+			json_builder_begin_object(builder);
+			json_builder_set_member_name(builder, "dpi");
+			json_builder_begin_array(builder);
+			json_builder_add_int_value(builder, r->dpi_x);
+			json_builder_add_int_value(builder, r->dpi_y);
+			json_builder_end_array(builder);
+			json_add_bool(builder, "active", r->is_active);
+			json_add_bool(builder, "default", r->is_default);
+			json_add_bool(builder, "disabled", r->is_disabled);
+			json_builder_end_object(builder);
+		}
+		json_builder_end_array(builder);
+
+		json_builder_set_member_name(builder, "buttons");
+		json_builder_begin_array(builder);
+		for (unsigned int i = 0; i < export->num_buttons; i++)
+			export_write_json_button(builder, export_button(export, p, i));
+		json_builder_end_array(builder);
+
+		json_builder_set_member_name(builder, "leds");
+		json_builder_begin_array(builder);
+		for (unsigned int i = 0; i < export->num_leds; i++) {
+			const struct ratbag_export_led *l = export_led(export, p, i);
+
+			json_builder_begin_object(builder);
+			json_add_string_or_null(builder, "mode",
+				export_lookup_name(export_led_modes,
+						   ARRAY_LENGTH(export_led_modes),
+						   l->mode));
+			json_builder_set_member_name(builder, "color");
+			json_builder_begin_array(builder);
+			json_builder_add_int_value(builder, l->color.red);
+			json_builder_add_int_value(builder, l->color.green);
+			json_builder_add_int_value(builder, l->color.blue);
+			json_builder_end_array(builder);
+			json_add_int(builder, "duration", l->ms);
+			json_add_int(builder, "brightness", l->brightness);
+			json_builder_end_object(builder);
+		}
+		json_builder_end_array(builder);
+
+		json_builder_end_object(builder);
+	}
+
+	json_builder_end_array(builder);
+	json_builder_end_object(builder);
+
+	root = json_builder_get_root(builder);
+	generator = json_generator_new();
+	json_generator_set_pretty(generator, TRUE);
+	json_generator_set_root(generator, root);
+	json = json_generator_to_data(generator, &json_len);
+
+	/* handed to the caller, so use malloc rather than the glib allocator */
+	data = zalloc(json_len + 1);
+	memcpy(data, json, json_len);
+	*len = json_len;
+
+	return data;
+}
+
+struct export_json_reader {
+	bool error;
+};
+
+static JsonNode *
+json_get_member(struct export_json_reader *r, JsonObject *obj,
+		const char *member, JsonNodeType type)
+{
+	JsonNode *node;
+
+	node = obj ? json_object_get_member(obj, member) : NULL;
+	if (!node || JSON_NODE_TYPE(node) != type) {
+		r->error = true;
+		return NULL;
+	}
+
+	return node;
+}
+
+static gint64
+json_get_int(struct export_json_reader *r, JsonObject *obj,
+	     const char *member, gint64 min, gint64 max)
+{
+	JsonNode *node = json_get_member(r, obj, member, JSON_NODE_VALUE);
+	gint64 value;
+
+	if (!node || json_node_get_value_type(node) != G_TYPE_INT64) {
+		r->error = true;
+		return 0;
+	}
+
+	value = json_node_get_int(node);
+	if (value < min || value > max) {
+		r->error = true;
+		return 0;
+	}
+
+	return value;
+}
+
+static bool
+json_get_bool(struct export_json_reader *r, JsonObject *obj, const char *member)
+{
+	JsonNode *node = json_get_member(r, obj, member, JSON_NODE_VALUE);
+
+	if (!node || json_node_get_value_type(node) != G_TYPE_BOOLEAN) {
+		r->error = true;
+		return false;
+	}
+
+	return json_node_get_boolean(node);
+}
+
+/* A string or null */
+static char *
+json_get_string(struct export_json_reader *r, JsonObject *obj, const char *member)
+{
+	JsonNode *node = obj ? json_object_get_member(obj, member) : NULL;
+
+	if (node && JSON_NODE_HOLDS_NULL(node))
+		return NULL;
+
+	if (!node || !JSON_NODE_HOLDS_VALUE(node) ||
+	    json_node_get_value_type(node) != G_TYPE_STRING) {
+		r->error = true;
+		return NULL;
+	}
+
+	return strdup_safe(json_node_get_string(node));
+}
+
+static JsonArray *
+json_get_array(struct export_json_reader *r, JsonObject *obj,
+	       const char *member, unsigned int length)
+{
+	JsonNode *node = json_get_member(r, obj, member, JSON_NODE_ARRAY);
+	JsonArray *array;
+
+	if (!node)
+		return NULL;
+
+	array = json_node_get_array(node);
+	if (json_array_get_length(array) != length) {
+		r->error = true;
+		return NULL;
+	}
+
+	return array;
+}
+
+static unsigned int
+json_get_length(struct export_json_reader *r, JsonObject *obj, const char *member)
+{
+	JsonNode *node = json_get_member(r, obj, member, JSON_NODE_ARRAY);
+	unsigned int length;
+
+	if (!node)
+		return 0;
+
+	length = json_array_get_length(json_node_get_array(node));
+	if (length > UINT16_MAX) {
+		r->error = true;
+		return 0;
+	}
+
+	return length;
+}
+
+static JsonObject *
+json_array_get_object(struct export_json_reader *r, JsonArray *array,
+		      unsigned int index)
+{
+	JsonNode *node;
+
+	if (!array || index >= json_array_get_length(array)) {
+		r->error = true;
+		return NULL;
+	}
+
+	node = json_array_get_element(array, index);
+	if (!JSON_NODE_HOLDS_OBJECT(node)) {
+		r->error = true;
+		return NULL;
+	}
+
+	return json_node_get_object(node);
+}
+
+static gint64
+json_array_get_int(struct export_json_reader *r, JsonArray *array,
+		   unsigned int index, gint64 min, gint64 max)
+{
+	JsonNode *node;
+	gint64 value;
+
+	if (!array || index >= json_array_get_length(array)) {
+		r->error = true;
+		return 0;
+	}
+
+	node = json_array_get_element(array, index);
+	if (!JSON_NODE_HOLDS_VALUE(node) ||
+	    json_node_get_value_type(node) != G_TYPE_INT64) {
+		r->error = true;
+		return 0;
+	}
+
+	value = json_node_get_int(node);
+	if (value < min || value > max) {
+		r->error = true;
+		return 0;
+	}
+
+	return value;
+}
+
+static int
+json_get_enum(struct export_json_reader *r, JsonObject *obj,
+	      const char *member, const char **names, size_t nnames)
+{
+	_cleanup_free_ char *name = json_get_string(r, obj, member);
+	int value;
+
+	if (!name) {
+		r->error = true;
+		return -1;
+	}
+
+	value = export_lookup_value(names, nnames, name);
+	if (value < 0)
+		r->error = true;
+
+	return value;
+}
+
+static void
+export_read_json_button(struct export_json_reader *r, JsonObject *obj,
+			struct ratbag_export_button *b)
+{
+	_cleanup_free_ char *type = json_get_string(r, obj, "type");
+	JsonArray *events;
+	int value;
+
+	if (!type) {
+		r->error = true;
+		return;
+	}
+
+	if (streq(type, "unknown")) {
+		b->type = RATBAG_BUTTON_ACTION_TYPE_UNKNOWN;
+		return;
+	}
+
+	value = export_lookup_value(export_action_types,
+				    ARRAY_LENGTH(export_action_types), type);
+	if (value < 0) {
+		r->error = true;
+		return;
+	}
+
+	b->type = value;
+	switch (b->type) {
+	case RATBAG_BUTTON_ACTION_TYPE_BUTTON:
+		b->value = json_get_int(r, obj, "button", 0, UINT_MAX);
+		break;
+	case RATBAG_BUTTON_ACTION_TYPE_SPECIAL:
+		b->value = json_get_int(r, obj, "special", 0, UINT_MAX);
+		break;
+	case RATBAG_BUTTON_ACTION_TYPE_KEY:
+		b->value = json_get_int(r, obj, "key", 0, UINT_MAX);
+		break;
+	case RATBAG_BUTTON_ACTION_TYPE_MACRO:
+		b->name = json_get_string(r, obj, "name");
+		b->group = json_get_string(r, obj, "group");
+
+		b->nevents = json_get_length(r, obj, "events");
+		if (r->error || b->nevents > MAX_MACRO_EVENTS) {
+			r->error = true;
+			break;
+		}
+
+		events = json_object_get_array_member(obj, "events");
+
+		b->events = zalloc(max(b->nevents, 1U) * sizeof(*b->events));
+		for (unsigned int e = 0; e < b->nevents; e++) {
+			JsonNode *node = json_array_get_element(events, e);
+			JsonArray *event;
+			const char *name;
+
+			if (!JSON_NODE_HOLDS_ARRAY(node)) {
+				r->error = true;
+				break;
+			}
+
+			event = json_node_get_array(node);
+			if (json_array_get_length(event) != 2) {
+				r->error = true;
+				break;
+			}
+
+			node = json_array_get_element(event, 0);
+			if (!JSON_NODE_HOLDS_VALUE(node) ||
+			    json_node_get_value_type(node) != G_TYPE_STRING) {
+				r->error = true;
+				break;
+			}
+
+			name = json_node_get_string(node);
+			b->events[e].type = export_lookup_value(export_macro_events,
+								ARRAY_LENGTH(export_macro_events),
+								name);
+			b->events[e].event.key = json_array_get_int(r, event, 1,
+								    0, UINT_MAX);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+static struct ratbag_export *
+export_read_json(const char *data, size_t len)
+{
+	g_autoptr(JsonParser) parser = json_parser_new();
+	_cleanup_export_ struct ratbag_export *export = NULL;
+	struct ratbag_export *result;
+	struct export_json_reader r = {0};
+	JsonObject *root, *profile, *first;
+	JsonArray *profiles, *array;
+	JsonNode *node;
+	unsigned int num_profiles, num_resolutions, num_buttons, num_leds;
+
+	if (!json_parser_load_from_data(parser, data, len, NULL))
+		return NULL;
+
+	node = json_parser_get_root(parser);
+	if (!node || !JSON_NODE_HOLDS_OBJECT(node))
+		return NULL;
+
+	root = json_node_get_object(node);
+	if (json_get_int(&r, root, "version", 0, G_MAXINT) != EXPORT_VERSION)
+		return NULL;
+
+	node = json_get_member(&r, root, "profiles", JSON_NODE_ARRAY);
+	if (!node)
+		return NULL;
+
+	profiles = json_node_get_array(node);
+	num_profiles = json_array_get_length(profiles);
+	if (num_profiles == 0 || num_profiles > UINT16_MAX)
+		return NULL;
+
+	/* all profiles have the same layout as the first one */
+	first = json_array_get_object(&r, profiles, 0);
+	num_resolutions = json_get_length(&r, first, "resolutions");
+	num_buttons = json_get_length(&r, first, "buttons");
+	num_leds = json_get_length(&r, first, "leds");
+	if (r.error)
+		return NULL;
+
+	export = ratbag_export_new(num_profiles, num_resolutions,
+				   num_buttons, num_leds);
+
+	for (unsigned int p = 0; p < num_profiles && !r.error; p++) {
+		struct ratbag_export_profile *prof = &export->profiles[p];
+
+		profile = json_array_get_object(&r, profiles, p);
+		prof->name = json_get_string(&r, profile, "name");
+		prof->is_enabled = json_get_bool(&r, profile, "enabled");
+		prof->is_active = json_get_bool(&r, profile, "active");
+		prof->hz = json_get_int(&r, profile, "report_rate", 0, UINT_MAX);
+		prof->angle_snapping = json_get_int(&r, profile, "angle_snapping",
+						    INT_MIN, INT_MAX);
+		prof->debounce = json_get_int(&r, profile, "debounce",
+					      INT_MIN, INT_MAX);
+
+		array = json_get_array(&r, profile, "resolutions",
+				       export->num_resolutions);
+		for (unsigned int i = 0; i < export->num_resolutions && !r.error; i++) {
+			struct ratbag_export_resolution *res = export_resolution(export, p, i);
+			JsonObject *obj = json_array_get_object(&r, array, i);
+			JsonArray *dpi = json_get_array(&r, obj, "dpi", 2);
+
+			res->dpi_x = json_array_get_int(&r, dpi, 0, 0, UINT_MAX);
+			res->dpi_y = json_array_get_int(&r, dpi, 1, 0, UINT_MAX);
+			res->is_active = json_get_bool(&r, obj, "active");
+			res->is_default = json_get_bool(&r, obj, "default");
+			res->is_disabled = json_get_bool(&r, obj, "disabled");
+		}
+
+		array = json_get_array(&r, profile, "buttons",
+				       export->num_buttons);
+		for (unsigned int i = 0; i < export->num_buttons && !r.error; i++) {
+			JsonObject *obj = json_array_get_object(&r, array, i);
+
+			export_read_json_button(&r, obj, export_button(export, p, i));
+		}
+
+		array = json_get_array(&r, profile, "leds", export->num_leds);
+		for (unsigned int i = 0; i < export->num_leds && !r.error; i++) {
+			struct ratbag_export_led *l = export_led(export, p, i);
+			JsonObject *obj = json_array_get_object(&r, array, i);
+			JsonArray *color = json_get_array(&r, obj, "color", 3);
+
+			l->mode = json_get_enum(&r, obj, "mode", export_led_modes,
+						ARRAY_LENGTH(export_led_modes));
+			l->color.red = json_array_get_int(&r, color, 0, 0, 255);
+			l->color.green = json_array_get_int(&r, color, 1, 0, 255);
+			l->color.blue = json_array_get_int(&r, color, 2, 0, 255);
+			l->ms = json_get_int(&r, obj, "duration", 0, UINT_MAX);
+			l->brightness = json_get_int(&r, obj, "brightness", 0, UINT_MAX);
+		}
+	}
+
+	if (r.error)
+		return NULL;
+
+	result = export;
+	export = NULL;
+
+	return result;
+}
+
+/* Import */
+
+static bool
+export_button_matches(const struct ratbag_export_button *b,
+		      const struct ratbag_button *button)
+{
+	const struct ratbag_macro *macro = button->action.macro;
+	unsigned int nevents = macro ? macro->nevents : 0;
+
+	if (b->type != button->action.type)
+		return false;
+
+	switch (b->type) {
+	case RATBAG_BUTTON_ACTION_TYPE_BUTTON:
+		return b->value == button->action.action.button;
+	case RATBAG_BUTTON_ACTION_TYPE_SPECIAL:
+		return b->value == (unsigned int)button->action.action.special;
+	case RATBAG_BUTTON_ACTION_TYPE_KEY:
+		return b->value == button->action.action.key.key;
+	case RATBAG_BUTTON_ACTION_TYPE_MACRO:
+		if (b->nevents != nevents ||
+		    !streq_ptr(b->name, macro ? macro->name : NULL) ||
+		    !streq_ptr(b->group, macro ? macro->group : NULL))
+			return false;
+
+		for (unsigned int i = 0; i < nevents; i++) {
+			if (b->events[i].type != macro->events[i].type ||
+			    b->events[i].event.key != macro->events[i].event.key)
+				return false;
+		}
+		return true;
+	default:
+		return true;
+	}
+}
+
+static bool
+export_led_matches(const struct ratbag_export_led *l,
+		   const struct ratbag_led *led)
+{
+	return l->mode == led->mode &&
+	       l->color.red == led->color.red &&
+	       l->color.green == led->color.green &&
+	       l->color.blue == led->color.blue &&
+	       l->ms == led->ms &&
+	       l->brightness == led->brightness;
+}
+
+static bool
+value_in_list(unsigned int value, const unsigned int *list, size_t nlist)
+{
+	for (size_t i = 0; i < nlist; i++) {
+		if (list[i] == value)
+			return true;
+	}
+
+	return false;
+}
+
+static enum ratbag_error_code
+export_check_profile(const struct ratbag_export *export,
+		     const struct ratbag_profile *profile)
+{
+	const struct ratbag_export_profile *p = &export->profiles[profile->index];
+	struct ratbag_resolution *resolution;
+	struct ratbag_button *button;
+	struct ratbag_led *led;
+	unsigned int nactive = 0, ndefault = 0;
+
+	if (p->name && !streq_ptr(p->name, profile->name) && !profile->name)
+		return RATBAG_ERROR_CAPABILITY;
+
+	if (p->is_enabled != profile->is_enabled &&
+	    !ratbag_profile_has_capability(profile, RATBAG_PROFILE_CAP_DISABLE))
+		return RATBAG_ERROR_CAPABILITY;
+
+	if (p->hz != profile->hz &&
+	    !value_in_list(p->hz, profile->rates, profile->nrates))
+		return RATBAG_ERROR_VALUE;
+
+	if (p->angle_snapping != -1 &&
+	    p->angle_snapping != profile->angle_snapping &&
+	    profile->angle_snapping == -1)
+		return RATBAG_ERROR_CAPABILITY;
+
+	if (p->debounce != -1 && p->debounce != profile->debounce) {
+		if (profile->debounce == -1)
+			return RATBAG_ERROR_CAPABILITY;
+		if (profile->ndebounces > 0 &&
+		    !value_in_list(p->debounce, profile->debounces,
+				   profile->ndebounces))
+			return RATBAG_ERROR_VALUE;
+	}
+
+	ratbag_profile_for_each_resolution(profile, resolution) {
+		const struct ratbag_export_resolution *r =
+			export_resolution(export, profile->index, resolution->index);
+
+		if (r->is_active || r->is_default) {
+			if (r->is_disabled)
+				return RATBAG_ERROR_VALUE;
+			nactive += r->is_active;
+			ndefault += r->is_default;
+		}
+
+		if (r->is_disabled != resolution->is_disabled &&
+		    !ratbag_resolution_has_capability(resolution,
+						      RATBAG_RESOLUTION_CAP_DISABLE))
+			return RATBAG_ERROR_CAPABILITY;
+
+		if (r->dpi_x == resolution->dpi_x && r->dpi_y == resolution->dpi_y)
+			continue;
+
+		if (r->dpi_x != r->dpi_y &&
+		    !ratbag_resolution_has_capability(resolution,
+						      RATBAG_RESOLUTION_CAP_SEPARATE_XY_RESOLUTION))
+			return RATBAG_ERROR_CAPABILITY;
+
+		if (!ratbag_resolution_has_dpi(resolution, r->dpi_x) ||
+		    !ratbag_resolution_has_dpi(resolution, r->dpi_y))
+			return RATBAG_ERROR_VALUE;
+	}
+
+	if (nactive > 1 || ndefault > 1)
+		return RATBAG_ERROR_VALUE;
+
+	ratbag_profile_for_each_button(profile, button) {
+		const struct ratbag_export_button *b =
+			export_button(export, profile->index, button->index);
+
+		if (!export_button_is_valid(b))
+			return RATBAG_ERROR_VALUE;
+
+		if (b->type == RATBAG_BUTTON_ACTION_TYPE_UNKNOWN ||
+		    export_button_matches(b, button))
+			continue;
+
+		if (!ratbag_button_has_action_type(button, b->type))
+			return RATBAG_ERROR_CAPABILITY;
+	}
+
+	ratbag_profile_for_each_led(profile, led) {
+		const struct ratbag_export_led *l =
+			export_led(export, profile->index, led->index);
+
+		if (l->mode > RATBAG_LED_BREATHING)
+			return RATBAG_ERROR_VALUE;
+
+		if (l->mode != led->mode && !ratbag_led_has_mode(led, l->mode))
+			return RATBAG_ERROR_CAPABILITY;
+	}
+
+	return RATBAG_SUCCESS;
+}
+
+static enum ratbag_error_code
+export_check(const struct ratbag_export *export,
+	     const struct ratbag_device *device)
+{
+	struct ratbag_profile *profile;
+	unsigned int nactive = 0;
+	enum ratbag_error_code rc;
+
+	if (export->num_profiles != device->num_profiles ||
+	    export->num_buttons != device->num_buttons ||
+	    export->num_leds != device->num_leds)
+		return RATBAG_ERROR_VALUE;
+
+	ratbag_device_for_each_profile(device, profile) {
+		const struct ratbag_export_profile *p = &export->profiles[profile->index];
+
+		if (export->num_resolutions != profile->num_resolutions)
+			return RATBAG_ERROR_VALUE;
+
+		if (p->is_active) {
+			if (!p->is_enabled)
+				return RATBAG_ERROR_VALUE;
+			nactive++;
+		}
+
+		rc = export_check_profile(export, profile);
+		if (rc != RATBAG_SUCCESS)
+			return rc;
+	}
+
+	if (nactive > 1)
+		return RATBAG_ERROR_VALUE;
+
+	return RATBAG_SUCCESS;
+}
+
+static enum ratbag_error_code
+export_apply_button(const struct ratbag_export_button *b,
+		    struct ratbag_button *button)
+{
+	switch (b->type) {
+	case RATBAG_BUTTON_ACTION_TYPE_NONE:
+		return ratbag_button_disable(button);
+	case RATBAG_BUTTON_ACTION_TYPE_BUTTON:
+		return ratbag_button_set_button(button, b->value);
+	case RATBAG_BUTTON_ACTION_TYPE_SPECIAL:
+		return ratbag_button_set_special(button, b->value);
+	case RATBAG_BUTTON_ACTION_TYPE_KEY:
+		return ratbag_button_set_key(button, b->value);
+	case RATBAG_BUTTON_ACTION_TYPE_MACRO:
+		ratbag_button_set_macro_events(button, b->name, b->group,
+					       b->events, b->nevents);
+		button->dirty = true;
+		button->generation++;
+		button->profile->dirty = true;
+		button->profile->generation++;
+		return RATBAG_SUCCESS;
+	default:
+		return RATBAG_ERROR_IMPLEMENTATION;
+	}
+}
+
+static enum ratbag_error_code
+export_apply_profile(const struct ratbag_export *export,
+		     struct ratbag_profile *profile)
+{
+	const struct ratbag_export_profile *p = &export->profiles[profile->index];
+	struct ratbag_resolution *resolution;
+	struct ratbag_button *button;
+	struct ratbag_led *led;
+	enum ratbag_error_code rc = RATBAG_SUCCESS;
+
+	if (p->name && !streq_ptr(p->name, profile->name))
+		rc = ratbag_profile_set_name(profile, p->name);
+	if (rc == RATBAG_SUCCESS)
+		rc = ratbag_profile_set_report_rate(profile, p->hz);
+	if (rc == RATBAG_SUCCESS && p->angle_snapping != -1)
+		rc = ratbag_profile_set_angle_snapping(profile, p->angle_snapping);
+	if (rc == RATBAG_SUCCESS && p->debounce != -1)
+		rc = ratbag_profile_set_debounce(profile, p->debounce);
+	if (rc != RATBAG_SUCCESS)
+		return rc;
+
+	/* Enable first and disable last, the active and default resolution
+	 * can neither be set to nor moved away from a disabled one */
+	ratbag_profile_for_each_resolution(profile, resolution) {
+		const struct ratbag_export_resolution *r =
+			export_resolution(export, profile->index, resolution->index);
+
+		if (r->dpi_x == resolution->dpi_x && r->dpi_y == resolution->dpi_y)
+			rc = RATBAG_SUCCESS;
+		else if (r->dpi_x == r->dpi_y)
+			rc = ratbag_resolution_set_dpi(resolution, r->dpi_x);
+		else
+			rc = ratbag_resolution_set_dpi_xy(resolution, r->dpi_x, r->dpi_y);
+		if (rc == RATBAG_SUCCESS && !r->is_disabled && resolution->is_disabled)
+			rc = ratbag_resolution_set_disabled(resolution, false);
+		if (rc != RATBAG_SUCCESS)
+			return rc;
+	}
+
+	ratbag_profile_for_each_resolution(profile, resolution) {
+		const struct ratbag_export_resolution *r =
+			export_resolution(export, profile->index, resolution->index);
+
+		if (r->is_active && !resolution->is_active)
+			rc = ratbag_resolution_set_active(resolution);
+		if (rc == RATBAG_SUCCESS && r->is_default && !resolution->is_default)
+			rc = ratbag_resolution_set_default(resolution);
+		if (rc != RATBAG_SUCCESS)
+			return rc;
+	}
+
+	ratbag_profile_for_each_resolution(profile, resolution) {
+		const struct ratbag_export_resolution *r =
+			export_resolution(export, profile->index, resolution->index);
+
+		if (r->is_disabled && !resolution->is_disabled) {
+			rc = ratbag_resolution_set_disabled(resolution, true);
+			if (rc != RATBAG_SUCCESS)
+				return rc;
+		}
+	}
+
+	ratbag_profile_for_each_button(profile, button) {
+		const struct ratbag_export_button *b =
+			export_button(export, profile->index, button->index);
+
+		if (b->type == RATBAG_BUTTON_ACTION_TYPE_UNKNOWN ||
+		    export_button_matches(b, button))
+			continue;
+
+		rc = export_apply_button(b, button);
+		if (rc != RATBAG_SUCCESS)
+			return rc;
+	}
+
+	/* the LED setters mark the LED dirty unconditionally */
+	ratbag_profile_for_each_led(profile, led) {
+		const struct ratbag_export_led *l =
+			export_led(export, profile->index, led->index);
+
+		if (export_led_matches(l, led))
+			continue;
+
+		if (l->mode != led->mode)
+			ratbag_led_set_mode(led, l->mode);
+		if (l->color.red != led->color.red ||
+		    l->color.green != led->color.green ||
+		    l->color.blue != led->color.blue)
+			ratbag_led_set_color(led, l->color);
+		if (l->ms != led->ms)
+			ratbag_led_set_effect_duration(led, l->ms);
+		if (l->brightness != led->brightness)
+			ratbag_led_set_brightness(led, l->brightness);
+	}
+
+	return RATBAG_SUCCESS;
+}
+
+static enum ratbag_error_code
+export_apply(const struct ratbag_export *export, struct ratbag_device *device)
+{
+	struct ratbag_profile *profile;
+	enum ratbag_error_code rc;
+
+	ratbag_device_for_each_profile(device, profile) {
+		const struct ratbag_export_profile *p = &export->profiles[profile->index];
+
+		rc = export_apply_profile(export, profile);
+		if (rc == RATBAG_SUCCESS && p->is_enabled && !profile->is_enabled)
+			rc = ratbag_profile_set_enabled(profile, true);
+		if (rc != RATBAG_SUCCESS)
+			return rc;
+	}
+
+	ratbag_device_for_each_profile(device, profile) {
+		const struct ratbag_export_profile *p = &export->profiles[profile->index];
+
+		if (p->is_active && !profile->is_active) {
+			rc = ratbag_profile_set_active(profile);
+			if (rc != RATBAG_SUCCESS)
+				return rc;
+		}
+	}
+
+	ratbag_device_for_each_profile(device, profile) {
+		const struct ratbag_export_profile *p = &export->profiles[profile->index];
+
+		if (!p->is_enabled && profile->is_enabled) {
+			rc = ratbag_profile_set_enabled(profile, false);
+			if (rc != RATBAG_SUCCESS)
+				return rc;
+		}
+	}
+
+	return RATBAG_SUCCESS;
+}
+
+LIBRATBAG_EXPORT enum ratbag_error_code
+ratbag_device_export(struct ratbag_device *device,
+		     enum ratbag_export_format format,
+		     void **data, size_t *size)
+{
+	_cleanup_export_ struct ratbag_export *export = NULL;
+	struct export_writer w = {0};
+	unsigned int num_resolutions = 0;
+
+	if (!data || !size)
+		return RATBAG_ERROR_IMPLEMENTATION;
+
+	if (device->num_profiles > 0)
+		num_resolutions = device->profile_store[0].num_resolutions;
+
+	export = ratbag_export_new(device->num_profiles, num_resolutions,
+				   device->num_buttons, device->num_leds);
+	export_from_device(export, device);
+
+	switch (format) {
+	case RATBAG_EXPORT_FORMAT_BINARY:
+		export_write_binary(export, &w);
+		*data = w.data;
+		*size = w.len;
+		break;
+	case RATBAG_EXPORT_FORMAT_JSON:
+		*data = export_write_json(export, size);
+		break;
+	default:
+		return RATBAG_ERROR_VALUE;
+	}
+
+	return RATBAG_SUCCESS;
+}
+
+LIBRATBAG_EXPORT enum ratbag_error_code
+ratbag_device_import(struct ratbag_device *device,
+		     const void *data, size_t size)
+{
+	_cleanup_export_ struct ratbag_export *export = NULL;
+	enum ratbag_error_code rc;
+
+	if (!data)
+		return RATBAG_ERROR_VALUE;
+
+	if (size >= 4 && memcmp(data, EXPORT_MAGIC, 4) == 0)
+		export = export_read_binary(data, size);
+	else
+		export = export_read_json(data, size);
+
+	if (!export) {
+		log_error(device->ratbag, "%s: invalid profile data\n",
+			  device->name);
+		return RATBAG_ERROR_VALUE;
+	}
+
+	rc = export_check(export, device);
+	if (rc != RATBAG_SUCCESS) {
+		log_error(device->ratbag, "%s: profile data does not apply to this device\n",
+			  device->name);
+		return rc;
+	}
+
+	rc = export_apply(export, device);
+	if (rc != RATBAG_SUCCESS)
+		log_bug_libratbag(device->ratbag,
+				  "%s: failed to apply validated profile data\n",
+				  device->name);
+
+	return rc;
+}
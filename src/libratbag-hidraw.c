@@ -1179,6 +1179,36 @@ static const unsigned int hid_consumer_mapping[] = {
 	[HID_CC_AC_DISTRIBUTE_VERTICALLY		] = 0,
 };
 
+_Static_assert(ARRAY_LENGTH(hid_keyboard_mapping) == UINT8_MAX + 1, "keyboard usages must cover uint8_t");
+_Static_assert(ARRAY_LENGTH(hid_consumer_mapping) <= UINT16_MAX + 1, "consumer usages exceed uint16_t");
+
+/* The reverse of the two tables above, indexed by evdev keycode. Where
+ * several usages map to the same keycode the lowest usage wins. Filled
+ * once when the library is loaded. */
+static uint8_t keyboard_usage_from_keycode[KEY_MAX + 1];
+static uint16_t consumer_usage_from_keycode[KEY_MAX + 1];
+
+__attribute__((constructor))
+static void
+hid_usage_tables_init(void)
+{
+	size_t usage;
+
+	for (usage = ARRAY_LENGTH(hid_keyboard_mapping); usage-- > 0; ) {
+		unsigned int keycode = hid_keyboard_mapping[usage];
+
+		if (keycode != 0 && keycode <= KEY_MAX)
+			keyboard_usage_from_keycode[keycode] = usage;
+	}
+
+	for (usage = ARRAY_LENGTH(hid_consumer_mapping); usage-- > 0; ) {
+		unsigned int keycode = hid_consumer_mapping[usage];
+
+		if (keycode != 0 && keycode <= KEY_MAX)
+			consumer_usage_from_keycode[keycode] = usage;
+	}
+}
+
 unsigned int
 ratbag_hidraw_get_keycode_from_keyboard_usage(const struct ratbag_device *device,
 					      uint8_t hid_code)
@@ -1189,34 +1219,29 @@ ratbag_hidraw_get_keycode_from_keyboard_usage(const struct ratbag_device *device
 uint8_t
 ratbag_hidraw_get_keyboard_usage_from_keycode(const struct ratbag_device *device, unsigned keycode)
 {
-	unsigned int j;
-
-	for (j = 0; j < ARRAY_LENGTH(hid_keyboard_mapping); j++) {
-		if (hid_keyboard_mapping[j] == keycode)
-			return j;
-	}
+	if (keycode > KEY_MAX)
+		return 0;
 
-	return 0;
+	return keyboard_usage_from_keycode[keycode];
 }
 
 unsigned int
 ratbag_hidraw_get_keycode_from_consumer_usage(const struct ratbag_device *device,
 					      uint16_t hid_code)
 {
+	if (hid_code >= ARRAY_LENGTH(hid_consumer_mapping))
+		return 0;
+
 	return hid_consumer_mapping[hid_code];
 }
 
 uint16_t
 ratbag_hidraw_get_consumer_usage_from_keycode(const struct ratbag_device *device, unsigned keycode)
 {
-	unsigned int j;
-
-	for (j = 0; j < ARRAY_LENGTH(hid_consumer_mapping); j++) {
-		if (hid_consumer_mapping[j] == keycode)
-			return j;
-	}
+	if (keycode > KEY_MAX)
+		return 0;
 
-	return 0;
+	return consumer_usage_from_keycode[keycode];
 }
 
 static int
@@ -1556,6 +1581,7 @@ ratbag_close_hidraw_index(struct ratbag_device *device, int idx)
 
 	ratbag_close_fd(device, device->hidraw[idx].fd);
 	device->hidraw[idx].fd = -1;
+	device->hidraw[idx].suspended = false;
 
 	if (device->hidraw[idx].reports) {
 		free(device->hidraw[idx].reports);
@@ -1563,11 +1589,108 @@ ratbag_close_hidraw_index(struct ratbag_device *device, int idx)
 	}
 }
 
+int
+ratbag_hidraw_suspend(struct ratbag_device *device)
+{
+	int idx, null_fd, rc;
+
+	for (idx = 0; idx < MAX_HIDRAW; idx++) {
+		struct ratbag_hidraw *hidraw = &device->hidraw[idx];
+
+		/* only nodes we opened have a sysname */
+		if (!hidraw->sysname || hidraw->suspended)
+			continue;
+
+		if (ioctl(hidraw->fd, HIDIOCGRAWINFO, &hidraw->info) < 0)
+			return -errno;
+
+		null_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+		if (null_fd < 0)
+			return -errno;
+
+		/* this closes the hidraw node behind the caller's back,
+		 * close_restricted() is called once the fd is closed for
+		 * good */
+		rc = dup2(null_fd, hidraw->fd);
+		if (rc < 0)
+			rc = -errno;
+		close(null_fd);
+		if (rc < 0)
+			return rc;
+
+		hidraw->suspended = true;
+		log_debug(device->ratbag, "%s: released %s\n",
+			  device->name, hidraw->sysname);
+	}
+
+	return 0;
+}
+
+int
+ratbag_hidraw_resume(struct ratbag_device *device)
+{
+	int idx, fd, rc;
+	bool reopened = false;
+
+	for (idx = 0; idx < MAX_HIDRAW; idx++) {
+		struct ratbag_hidraw *hidraw = &device->hidraw[idx];
+		_cleanup_(udev_device_unrefp) struct udev_device *udev_device = NULL;
+		struct hidraw_devinfo info;
+		const char *devnode;
+
+		if (!hidraw->suspended)
+			continue;
+
+		udev_device = udev_device_new_from_subsystem_sysname(device->ratbag->udev,
+								     "hidraw",
+								     hidraw->sysname);
+		devnode = udev_device ? udev_device_get_devnode(udev_device) : NULL;
+		if (!devnode)
+			return -ENODEV;
+
+		fd = ratbag_open_path(device, devnode, O_RDWR);
+		if (fd < 0)
+			return -ENODEV;
+
+		/* the node may have been reused by another device */
+		if (ioctl(fd, HIDIOCGRAWINFO, &info) < 0 ||
+		    info.bustype != hidraw->info.bustype ||
+		    info.vendor != hidraw->info.vendor ||
+		    info.product != hidraw->info.product) {
+			ratbag_close_fd(device, fd);
+			return -ENODEV;
+		}
+
+		rc = dup2(fd, hidraw->fd);
+		if (rc < 0)
+			rc = -errno;
+		ratbag_close_fd(device, fd);
+		if (rc < 0)
+			return rc;
+
+		hidraw->suspended = false;
+		reopened = true;
+		log_debug(device->ratbag, "%s: reopened %s\n",
+			  device->name, hidraw->sysname);
+	}
+
+	return reopened ? 1 : 0;
+}
+
+static inline void
+hidraw_trace(struct ratbag_device *device, enum ratbag_trace_direction direction,
+	     const uint8_t *buf, size_t len, uint64_t latency_us)
+{
+	ratbag_trace_add(&device->ratbag->trace, device->trace_id, direction,
+			 buf, len, latency_us);
+}
+
 int
 ratbag_hidraw_raw_request(struct ratbag_device *device, unsigned char reportnum,
 			  uint8_t *buf, size_t len, unsigned char rtype, int reqtype)
 {
 	uint8_t tmp_buf[HID_MAX_BUFFER_SIZE];
+	uint64_t start;
 	int rc;
 
 	if (len < 1 || len > HID_MAX_BUFFER_SIZE || !buf || device->hidraw[0].fd < 0)
@@ -1581,10 +1704,19 @@ ratbag_hidraw_raw_request(struct ratbag_device *device, unsigned char reportnum,
 		memset(tmp_buf, 0, len);
 		tmp_buf[0] = reportnum;
 
+		start = now(CLOCK_MONOTONIC) / 1000;
 		rc = ioctl(device->hidraw[0].fd, HIDIOCGFEATURE(len), tmp_buf);
 		if (rc < 0)
-			return -errno;
+			rc = -errno;
+		ratbag_io_stats_record(device->io_stats,
+				       RATBAG_IO_FEATURE_GET_REPORT, reportnum,
+				       rc, 1, max(rc, 0),
+				       now(CLOCK_MONOTONIC) / 1000 - start);
+		if (rc < 0)
+			return rc;
 
+		hidraw_trace(device, RATBAG_TRACE_FEATURE_GET, tmp_buf, rc,
+			     now(CLOCK_MONOTONIC) / 1000 - start);
 		log_buf_raw(device->ratbag, "feature get:   ", tmp_buf, (unsigned)rc);
 
 		memcpy(buf, tmp_buf, rc);
@@ -1593,9 +1725,19 @@ ratbag_hidraw_raw_request(struct ratbag_device *device, unsigned char reportnum,
 		buf[0] = reportnum;
 
 		log_buf_raw(device->ratbag, "feature set:   ", buf, len);
+		hidraw_trace(device, RATBAG_TRACE_FEATURE_SET, buf, len, 0);
+		start = now(CLOCK_MONOTONIC) / 1000;
+		device->hidraw_request_time_us = start;
+		device->hidraw_request_id = reportnum;
 		rc = ioctl(device->hidraw[0].fd, HIDIOCSFEATURE(len), buf);
 		if (rc < 0)
-			return -errno;
+			rc = -errno;
+		ratbag_io_stats_record(device->io_stats,
+				       RATBAG_IO_FEATURE_SET_REPORT, reportnum,
+				       rc, len, 0,
+				       now(CLOCK_MONOTONIC) / 1000 - start);
+		if (rc < 0)
+			return rc;
 
 		return rc;
 	}
@@ -1623,38 +1765,55 @@ ratbag_hidraw_set_feature_report(struct ratbag_device *device, unsigned char rep
 int
 ratbag_hidraw_output_report(struct ratbag_device *device, uint8_t *buf, size_t len)
 {
+	uint64_t start;
 	int rc;
 
 	if (len < 1 || len > HID_MAX_BUFFER_SIZE || !buf || device->hidraw[0].fd < 0)
 		return -EINVAL;
 
 	log_buf_raw(device->ratbag, "output report: ", buf, len);
+	hidraw_trace(device, RATBAG_TRACE_OUTPUT_REPORT, buf, len, 0);
 
+	start = now(CLOCK_MONOTONIC) / 1000;
+	device->hidraw_request_time_us = start;
+	device->hidraw_request_id = buf[0];
 	rc = write(device->hidraw[0].fd, buf, len);
 
 	if (rc < 0)
-		return -errno;
+		rc = -errno;
+	else if (rc != (int)len)
+		rc = -EIO;
 
-	if (rc != (int)len)
-		return -EIO;
+	ratbag_io_stats_record(device->io_stats,
+			       RATBAG_IO_OUTPUT_REPORT, buf[0],
+			       rc, rc < 0 ? 0 : len, 0,
+			       now(CLOCK_MONOTONIC) / 1000 - start);
 
-	return 0;
+	return rc < 0 ? rc : 0;
 }
 
 int
-ratbag_hidraw_read_input_report(const struct ratbag_device *device, uint8_t *buf, size_t len,
+ratbag_hidraw_read_input_report(struct ratbag_device *device, uint8_t *buf, size_t len,
 				 ratbagd_hidraw_filter_t filter)
 {
 	return ratbag_hidraw_read_input_report_index(device, buf, len, 0, filter);
 }
 
+void
+ratbag_hidraw_set_timeout_ceiling(struct ratbag_device *device, unsigned int ms)
+{
+	rtt_estimator_init(&device->hidraw_rtt, ms);
+}
+
 int
-ratbag_hidraw_read_input_report_index(const struct ratbag_device *device, uint8_t *buf, size_t len, int hidrawno,
+ratbag_hidraw_read_input_report_index(struct ratbag_device *device, uint8_t *buf, size_t len, int hidrawno,
 				 ratbagd_hidraw_filter_t filter)
 {
+	struct rtt_estimator *rtt = &device->hidraw_rtt;
+	struct ratbag_io_stats *stats;
 	int rc, nfds;
 	struct pollfd fds;
-	int ts, ts_end;
+	uint64_t ts, ts_end, ts_timeout;
 
 	assert(hidrawno >= 0 && hidrawno < MAX_HIDRAW);
 
@@ -1664,12 +1823,19 @@ ratbag_hidraw_read_input_report_index(const struct ratbag_device *device, uint8_
 	fds.fd = device->hidraw[hidrawno].fd;
 	fds.events = POLLIN;
 
+	stats = ratbag_io_stats_get(device->io_stats, RATBAG_IO_INPUT_REPORT,
+				    device->hidraw_request_id);
+
 	/* convert to ms */
 	ts = now(CLOCK_MONOTONIC_RAW) / 1000 / 1000;
-	ts_end = ts + 1000; /* end in now + 1000ms */
+	/* the estimated timeout backs off a bounded number of times when
+	 * it expires, the ceiling only caps the total wait */
+	ts_end = ts + rtt->ceiling;
+	ts_timeout = ts + rtt_estimator_timeout(rtt);
 
 	while (ts < ts_end) {
-		nfds = poll(&fds, 1, ts_end - ts); /* poll for the remainder of timeout */
+		/* poll for the remainder of timeout */
+		nfds = poll(&fds, 1, min(ts_timeout, ts_end) - ts);
 
 		if (nfds < 0)
 			return -errno;
@@ -1677,19 +1843,50 @@ ratbag_hidraw_read_input_report_index(const struct ratbag_device *device, uint8_
 		if (nfds > 0) {
 			rc = read(device->hidraw[hidrawno].fd, buf, len);
 
-			if (rc < 0)
-  				return -errno;
+			if (rc < 0) {
+				rc = -errno;
+				ratbag_io_stats_record(device->io_stats, RATBAG_IO_INPUT_REPORT,
+						       device->hidraw_request_id, rc, 0, 0, 0);
+  				return rc;
+			}
 
 			if (rc > 0) {
 				if(!filter || (filter && filter(buf, rc))) {
+					uint64_t latency = 0;
+
 					log_buf_raw(device->ratbag, "input report:  ", buf, rc);
+					if (stats) {
+						stats->requests++;
+						stats->bytes_received += rc;
+					}
+					if (device->hidraw_request_time_us) {
+						latency = now(CLOCK_MONOTONIC) / 1000 -
+							  device->hidraw_request_time_us;
+
+						rtt_estimator_sample(rtt, latency);
+						ratbag_io_stats_add_latency(stats, latency);
+						device->hidraw_request_time_us = 0;
+					}
+					hidraw_trace(device, RATBAG_TRACE_INPUT_REPORT,
+						     buf, rc, latency);
 					return rc;
 				}
 			}
 		}
 
 		ts = now(CLOCK_MONOTONIC_RAW) / 1000 / 1000;
+
+		if (ts >= ts_timeout && ts < ts_end) {
+			if (!rtt_estimator_backoff(rtt))
+				break;
+			ts_timeout = ts + rtt_estimator_timeout(rtt);
+			if (stats)
+				stats->retries++;
+		}
 	}
 
+	ratbag_io_stats_record(device->io_stats, RATBAG_IO_INPUT_REPORT,
+			       device->hidraw_request_id, -ETIMEDOUT, 0, 0, 0);
+
 	return -ETIMEDOUT;
 }
@@ -24,6 +24,8 @@
 #pragma once
 
 #include <linux/hid.h>
+#include <linux/hidraw.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "libratbag.h"
@@ -45,6 +47,10 @@ struct ratbag_hidraw {
 	struct ratbag_hid_report *reports;
 	unsigned num_reports;
 	char *sysname;
+
+	/* see ratbag_hidraw_suspend() */
+	bool suspended;
+	struct hidraw_devinfo info;
 };
 
 typedef bool (*ratbagd_hidraw_filter_t)(uint8_t *buf, size_t len);
@@ -98,6 +104,31 @@ void ratbag_close_hidraw(struct ratbag_device *device);
  */
 void ratbag_close_hidraw_index(struct ratbag_device *device, int idx);
 
+/**
+ * Release the hidraw nodes of the device. Drivers keep copies of the file
+ * descriptors, so the descriptors stay allocated but point to /dev/null
+ * until ratbag_hidraw_resume() is called. No I/O may happen in between.
+ *
+ * @param device the ratbag device
+ *
+ * @return 0 on success or a negative errno on error
+ */
+int ratbag_hidraw_suspend(struct ratbag_device *device);
+
+/**
+ * Reopen the hidraw nodes released by ratbag_hidraw_suspend() into the
+ * same file descriptors. Fails with -ENODEV if a node is gone or now
+ * belongs to a different device. Does nothing if the device is not
+ * suspended. The node only identifies the device, the caller has to check
+ * whether the state on the device changed while it was released.
+ *
+ * @param device the ratbag device
+ *
+ * @return 1 if nodes were reopened, 0 if none were suspended or a
+ * negative errno on error
+ */
+int ratbag_hidraw_resume(struct ratbag_device *device);
+
 /**
  * Send report request to device
  *
@@ -173,7 +204,7 @@ int ratbag_hidraw_output_report(struct ratbag_device *device, uint8_t *buf, size
  *
  * @return count of data transferred, or a negative errno on error
  */
-int ratbag_hidraw_read_input_report(const struct ratbag_device *device, uint8_t *buf, size_t len,
+int ratbag_hidraw_read_input_report(struct ratbag_device *device, uint8_t *buf, size_t len,
 				 ratbagd_hidraw_filter_t filter);
 
 /**
@@ -188,9 +219,20 @@ int ratbag_hidraw_read_input_report(const struct ratbag_device *device, uint8_t
  *
  * @return count of data transferred, or a negative errno on error
  */
-int ratbag_hidraw_read_input_report_index(const struct ratbag_device *device, uint8_t *buf, size_t len, int hidrawno,
+int ratbag_hidraw_read_input_report_index(struct ratbag_device *device, uint8_t *buf, size_t len, int hidrawno,
 				 ratbagd_hidraw_filter_t filter);
 
+/**
+ * Set the upper bound in ms for how long ratbag_hidraw_read_input_report()
+ * waits for a report. The actual timeout is derived from the round-trip
+ * times between output/feature reports and the input reports seen so far.
+ *
+ * @param device the ratbag device
+ * @param ms the timeout ceiling in ms
+ */
+void
+ratbag_hidraw_set_timeout_ceiling(struct ratbag_device *device, unsigned int ms);
+
 /**
  * Tells if a given device has the specified report ID.
  *
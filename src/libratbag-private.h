@@ -25,6 +25,7 @@
 
 #include "config.h"
 #include <linux/input.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <assert.h>
@@ -32,6 +33,8 @@
 #include "libratbag.h"
 #include "libratbag-util.h"
 #include "libratbag-hidraw.h"
+#include "libratbag-stats.h"
+#include "libratbag-trace.h"
 
 #ifdef NDEBUG
 #error "libratbag relies on assert(). Do not define NDEBUG"
@@ -53,17 +56,38 @@ log_buffer(struct ratbag *ratbag,
 	const char *header,
 	const uint8_t *buf, size_t len);
 
-#define log_raw(li_, ...) log_msg((li_), RATBAG_LOG_PRIORITY_RAW, __VA_ARGS__)
-#define log_debug(li_, ...) log_msg((li_), RATBAG_LOG_PRIORITY_DEBUG, __VA_ARGS__)
-#define log_info(li_, ...) log_msg((li_), RATBAG_LOG_PRIORITY_INFO, __VA_ARGS__)
-#define log_error(li_, ...) log_msg((li_), RATBAG_LOG_PRIORITY_ERROR, __VA_ARGS__)
-#define log_bug_kernel(li_, ...) log_msg((li_), RATBAG_LOG_PRIORITY_ERROR, "kernel bug: " __VA_ARGS__)
-#define log_bug_libratbag(li_, ...) log_msg((li_), RATBAG_LOG_PRIORITY_ERROR, "libratbag bug: " __VA_ARGS__)
-#define log_bug_client(li_, ...) log_msg((li_), RATBAG_LOG_PRIORITY_ERROR, "client bug: " __VA_ARGS__)
-#define log_buf_raw(li_, h_, buf_, len_) log_buffer(li_, RATBAG_LOG_PRIORITY_RAW, h_, buf_, len_)
-#define log_buf_debug(li_, h_, buf_, len_) log_buffer(li_, RATBAG_LOG_PRIORITY_DEBUG, h_, buf_, len_)
-#define log_buf_info(li_, h_, buf_, len_) log_buffer(li_, RATBAG_LOG_PRIORITY_INFO, h_, buf_, len_)
-#define log_buf_error(li_, h_, buf_, len_) log_buffer(li_, RATBAG_LOG_PRIORITY_ERROR, h_, buf_, len_)
+/* Messages below this priority are compiled out, see the log-level
+ * build option */
+#ifndef RATBAG_LOG_PRIORITY_MIN
+#define RATBAG_LOG_PRIORITY_MIN RATBAG_LOG_PRIORITY_RAW
+#endif
+
+/* The priority is checked before the arguments are evaluated, so a
+ * disabled message costs a compare and a branch. */
+#define log_msg_if_enabled_(li_, p_, ...) \
+	do { \
+		struct ratbag *log_ratbag_ = (li_); \
+		if (log_is_enabled(log_ratbag_, (p_))) \
+			log_msg(log_ratbag_, (p_), __VA_ARGS__); \
+	} while (0)
+#define log_buffer_if_enabled_(li_, p_, h_, buf_, len_) \
+	do { \
+		struct ratbag *log_ratbag_ = (li_); \
+		if (log_is_enabled(log_ratbag_, (p_))) \
+			log_buffer(log_ratbag_, (p_), (h_), (buf_), (len_)); \
+	} while (0)
+
+#define log_raw(li_, ...) log_msg_if_enabled_((li_), RATBAG_LOG_PRIORITY_RAW, __VA_ARGS__)
+#define log_debug(li_, ...) log_msg_if_enabled_((li_), RATBAG_LOG_PRIORITY_DEBUG, __VA_ARGS__)
+#define log_info(li_, ...) log_msg_if_enabled_((li_), RATBAG_LOG_PRIORITY_INFO, __VA_ARGS__)
+#define log_error(li_, ...) log_msg_if_enabled_((li_), RATBAG_LOG_PRIORITY_ERROR, __VA_ARGS__)
+#define log_bug_kernel(li_, ...) log_msg_if_enabled_((li_), RATBAG_LOG_PRIORITY_ERROR, "kernel bug: " __VA_ARGS__)
+#define log_bug_libratbag(li_, ...) log_msg_if_enabled_((li_), RATBAG_LOG_PRIORITY_ERROR, "libratbag bug: " __VA_ARGS__)
+#define log_bug_client(li_, ...) log_msg_if_enabled_((li_), RATBAG_LOG_PRIORITY_ERROR, "client bug: " __VA_ARGS__)
+#define log_buf_raw(li_, h_, buf_, len_) log_buffer_if_enabled_(li_, RATBAG_LOG_PRIORITY_RAW, h_, buf_, len_)
+#define log_buf_debug(li_, h_, buf_, len_) log_buffer_if_enabled_(li_, RATBAG_LOG_PRIORITY_DEBUG, h_, buf_, len_)
+#define log_buf_info(li_, h_, buf_, len_) log_buffer_if_enabled_(li_, RATBAG_LOG_PRIORITY_INFO, h_, buf_, len_)
+#define log_buf_error(li_, h_, buf_, len_) log_buffer_if_enabled_(li_, RATBAG_LOG_PRIORITY_ERROR, h_, buf_, len_)
 
 static inline void
 cleanup_device(struct ratbag_device **d)
@@ -123,8 +147,38 @@ struct ratbag {
 	int refcount;
 	ratbag_log_handler log_handler;
 	enum ratbag_log_priority log_priority;
+
+	/* struct ratbag_macro by hash, for deduplication. The number of
+	 * buckets is a power of two and doubles once there are more than
+	 * two macros per bucket */
+	struct list *macro_buckets;
+	unsigned int nmacro_buckets;
+	unsigned int nmacros;
+	/* protects the buckets and the removal of a macro whose refcount
+	 * drops to zero, ratbagd commits devices on several threads */
+	pthread_mutex_t macro_lock;
+
+	struct ratbag_trace trace;
+	/* the devices seen while tracing, indexed by trace_id - 1. An
+	 * entry is reused once its device is gone and all of its records
+	 * have been overwritten */
+	struct ratbag_trace_device *trace_devices;
+	/* per entry: 0 while the device exists, otherwise the trace head
+	 * at removal plus one, or UINT64_MAX if the entry is unused */
+	uint64_t *trace_removed;
+	unsigned int ntrace_devices;
+
+	char *cache_dir; /* NULL unless enabled with ratbag_cache_enable() */
 };
 
+static inline bool
+log_is_enabled(const struct ratbag *ratbag, enum ratbag_log_priority priority)
+{
+	return (int)priority >= (int)RATBAG_LOG_PRIORITY_MIN &&
+	       ratbag->log_handler &&
+	       ratbag->log_priority <= priority;
+}
+
 #define MAX_CAP 1000
 
 struct ratbag_device {
@@ -134,6 +188,11 @@ struct ratbag_device {
 
 	struct udev_device *udev_device;
 	struct ratbag_hidraw hidraw[MAX_HIDRAW];
+	struct rtt_estimator hidraw_rtt;
+	uint64_t hidraw_request_time_us; /* CLOCK_MONOTONIC of the last request */
+	unsigned int hidraw_request_id;	 /* report ID of the last request */
+	struct ratbag_io_stats_table *io_stats;
+	uint16_t trace_id;		 /* 0 if not traced */
 	int refcount;
 	struct input_id ids;
 	struct ratbag_driver *driver;
@@ -142,6 +201,11 @@ struct ratbag_device {
 
 	unsigned num_profiles;
 	struct list profiles;
+	/* profiles, resolutions, buttons and LEDs are allocated in one
+	 * block by ratbag_device_init_profiles() and indexed directly */
+	void *arena;
+	struct ratbag_profile *profile_store;
+	struct list dpi_tables; /* struct ratbag_dpi_table, for deduplication */
 
 	unsigned num_buttons;
 	unsigned num_leds;
@@ -206,12 +270,40 @@ struct ratbag_driver {
 	 */
 	int (*set_active_profile)(struct ratbag_device *device, unsigned int index);
 
+	/**
+	 * Callback called after the device was reopened by
+	 * ratbag_device_resume(). Something else may have written to the
+	 * device in the meantime, drivers should do a cheap check, e.g.
+	 * compare a CRC or a firmware generation, and re-read the state of
+	 * the device if it differs. Profiles, buttons and LEDs that are
+	 * dirty must be left untouched.
+	 *
+	 * Return 0 if nothing changed, 1 if the state was re-read or a
+	 * negative errno. This callback is optional.
+	 */
+	int (*refresh)(struct ratbag_device *device);
+
 	/* private */
 	int (*test_probe)(struct ratbag_device *device, const void *data);
 
 	struct list link;
 };
 
+/* Upper bound for the number of DPI values of a resolution */
+#define RATBAG_MAX_DPIS 300
+
+/**
+ * The list of DPI values supported by a resolution. Tables are immutable
+ * once created and deduplicated per device, usually all resolutions of a
+ * device share the same table.
+ */
+struct ratbag_dpi_table {
+	int refcount;
+	struct list link;
+	size_t ndpis;
+	unsigned int dpis[];
+};
+
 struct ratbag_resolution {
 	struct ratbag_profile *profile;
 	int refcount;
@@ -219,8 +311,7 @@ struct ratbag_resolution {
 	struct list link;
 	unsigned index;
 
-	unsigned int dpis[300];
-	size_t ndpis;
+	struct ratbag_dpi_table *dpi_table; /**< NULL if no list is set */
 
 	unsigned int dpi_x;	/**< x resolution in dpi */
 	unsigned int dpi_y;	/**< y resolution in dpi */
@@ -230,9 +321,27 @@ struct ratbag_resolution {
 	bool is_default;
 	bool is_disabled;
 	bool dirty;
+	unsigned int generation; /**< bumped whenever the state changes */
 	uint32_t capabilities;
 };
 
+static inline bool
+ratbag_resolution_has_dpi(const struct ratbag_resolution *resolution,
+			  unsigned int dpi)
+{
+	const struct ratbag_dpi_table *table = resolution->dpi_table;
+
+	if (!table)
+		return false;
+
+	for (size_t i = 0; i < table->ndpis; i++) {
+		if (dpi == table->dpis[i])
+			return true;
+	}
+
+	return false;
+}
+
 struct ratbag_led {
 	int refcount;
 	void *userdata;
@@ -246,6 +355,7 @@ struct ratbag_led {
 	unsigned int ms;              /**< duration of action in ms */
 	unsigned int brightness;      /**< brightness of the LED */
 	bool dirty;
+	unsigned int generation;      /**< bumped whenever the state changes */
 };
 
 struct ratbag_profile {
@@ -262,6 +372,12 @@ struct ratbag_profile {
 	struct list resolutions;
 	struct list leds;
 
+	/* num_resolutions, num_buttons and num_leds entries in the
+	 * device's arena, indexed by the object's index */
+	struct ratbag_resolution *resolution_store;
+	struct ratbag_button *button_store;
+	struct ratbag_led *led_store;
+
 	unsigned int hz;	/**< report rate in Hz */
 	unsigned int rates[8];	/**< report rates available */
 	size_t nrates;		/**< number of entries in rates */
@@ -282,6 +398,7 @@ struct ratbag_profile {
 
 	bool is_enabled;
 	bool dirty;       /**< profile changed since last commit */
+	unsigned int generation; /**< bumped whenever the state changes */
 	unsigned long capabilities[NLONGS(MAX_CAP)];
 };
 
@@ -323,17 +440,46 @@ struct ratbag_macro_event {
 };
 
 #define MAX_MACRO_EVENTS 256
+
+/*
+ * The macro assigned to a button. Macros are immutable once created and
+ * deduplicated per context, buttons with identical macros share the same
+ * object. Use ratbag_button_copy_macro() or ratbag_button_set_macro_events()
+ * to change the macro of a button.
+ *
+ * events holds the events up to the first RATBAG_MACRO_EVENT_NONE and is
+ * always followed by one RATBAG_MACRO_EVENT_NONE entry.
+ */
 struct ratbag_macro {
+	int refcount;		/* atomic, see ratbag.macro_lock */
+	uint32_t hash;
+	struct ratbag *ratbag;	/* NULL once the context is gone */
+	struct list link;	/* ratbag.macro_buckets */
 	char *name;
 	char *group;
-	struct ratbag_macro_event events[MAX_MACRO_EVENTS];
+	unsigned int nevents;
+	struct ratbag_macro_event events[];
 };
 
+/*
+ * A macro as handed out to callers, editable. The events are read from
+ * the shared macro until the first ratbag_button_macro_set_event(), only
+ * then a private copy is made.
+ */
 struct ratbag_button_macro {
 	int refcount;
-	struct ratbag_macro macro;
+	char *name;
+	char *group;
+	struct ratbag_macro *shared;		/* may be NULL */
+	struct ratbag_macro_event *events;	/* MAX_MACRO_EVENTS or NULL */
 };
 
+struct ratbag_macro *
+ratbag_macro_ref(struct ratbag_macro *macro);
+
+struct ratbag_macro *
+ratbag_macro_unref(struct ratbag_macro *macro);
+
 #define MODIFIER_LEFTCTRL (1 << 0)
 #define MODIFIER_LEFTSHIFT (1 << 1)
 #define MODIFIER_LEFTALT (1 << 2)
@@ -353,7 +499,7 @@ struct ratbag_button_action {
 			/* FIXME: modifiers */
 		} key;
 	} action;
-	struct ratbag_macro *macro; /* dynamically allocated, so kept aside */
+	struct ratbag_macro *macro; /* refcounted and shared, so kept aside */
 };
 
 struct ratbag_button {
@@ -365,6 +511,7 @@ struct ratbag_button {
 	struct ratbag_button_action action;
 	uint32_t action_caps;
 	bool dirty; /* changed since last commit to device */
+	unsigned int generation; /* bumped whenever the state changes */
 };
 
 void
@@ -406,6 +553,11 @@ ratbag_get_drv_data(const struct ratbag_device *device)
 	return device->drv_data;
 }
 
+/**
+ * Allocate num_profiles profiles with the given number of resolutions,
+ * buttons and LEDs each. All objects live in a single allocation owned by
+ * the device, this must be called once during probe.
+ */
 int
 ratbag_device_init_profiles(struct ratbag_device *device,
 			    unsigned int num_profiles,
@@ -481,58 +633,21 @@ ratbag_resolution_set_resolution(struct ratbag_resolution *res,
 	res->dpi_y = dpi_y;
 }
 
-static inline void
+/**
+ * Set the supported DPI values to min..max with a step size that grows
+ * with the resolution, at most RATBAG_MAX_DPIS values.
+ */
+void
 ratbag_resolution_set_dpi_list_from_range(struct ratbag_resolution *res,
-					  unsigned int min, unsigned int max)
-{
-	unsigned int stepsize = 50;
-	unsigned int dpi = min;
-	bool maxed_out = false;
-
-	res->ndpis = 0;
-
-	while (res->ndpis < ARRAY_LENGTH(res->dpis)) {
-		if (dpi > (unsigned)max) {
-			maxed_out = true;
-			break;
-		}
-
-		res->dpis[res->ndpis] = dpi;
-		res->ndpis++;
-
-		if (dpi < 1000)
-			stepsize = 50;
-		else if (dpi < 2600)
-			stepsize = 100;
-		else if (dpi < 5000)
-			stepsize = 200;
-		else
-			stepsize = 500;
-
-		dpi += stepsize;
-	}
-
-	if (!maxed_out)
-		log_bug_libratbag(res->profile->device->ratbag,
-				  "%s: resolution range exceeds available space.\n",
-				  res->profile->device->name);
-}
+					  unsigned int min, unsigned int max);
 
-static inline void
+/**
+ * Set the supported DPI values, dpis must be in ascending order.
+ */
+void
 ratbag_resolution_set_dpi_list(struct ratbag_resolution *res,
 			       const unsigned int *dpis,
-			       size_t ndpis)
-{
-	assert(ndpis <= ARRAY_LENGTH(res->dpis));
-	_Static_assert(sizeof(*dpis) == sizeof(*res->dpis), "Mismatching size");
-
-	for (size_t i = 0; i < ndpis; i++) {
-		res->dpis[i] = dpis[i];
-		if (i > 0)
-			assert(dpis[i] > dpis[i - 1]);
-	}
-	res->ndpis = ndpis;
-}
+			       size_t ndpis);
 
 static inline void
 ratbag_profile_set_report_rate_list(struct ratbag_profile *profile,
@@ -612,6 +727,31 @@ const char *
 ratbag_device_get_udev_property(const struct ratbag_device* device,
 				const char *name);
 
+/**
+ * Read the blob name of this device from the state cache into data. The
+ * blob must be exactly size bytes. Cache files are keyed by bus, vendor,
+ * product, HID_UNIQ and the firmware version, so the driver has to set
+ * the firmware version before, the cache is not used without it. A hit
+ * only means the device looked the same when the blob was written, the
+ * driver has to validate it against the device, e.g. with a CRC.
+ *
+ * Returns 0 on success, -ENOENT if the cache is disabled, the firmware
+ * version is unknown or there is no blob, or a negative errno. The
+ * content of data is undefined on error.
+ */
+int
+ratbag_device_cache_read(struct ratbag_device *device, const char *name,
+			 void *data, size_t size);
+
+/**
+ * Replace the blob name of this device in the state cache. Does nothing
+ * and returns 0 if the cache is disabled or the firmware version is
+ * unknown.
+ */
+int
+ratbag_device_cache_write(struct ratbag_device *device, const char *name,
+			  const void *data, size_t size);
+
 bool
 ratbag_assign_driver(struct ratbag_device *device,
 		     const struct input_id *dev_id,
@@ -623,3 +763,14 @@ ratbag_register_driver(struct ratbag *ratbag, struct ratbag_driver *driver);
 void
 ratbag_button_copy_macro(struct ratbag_button *button,
 			 const struct ratbag_button_macro *macro);
+
+/**
+ * Set the macro of the button to the given events, up to nevents or the
+ * first RATBAG_MACRO_EVENT_NONE. The name and group are copied.
+ */
+void
+ratbag_button_set_macro_events(struct ratbag_button *button,
+			       const char *name,
+			       const char *group,
+			       const struct ratbag_macro_event *events,
+			       unsigned int nevents);
@@ -0,0 +1,160 @@
+/*
+ * Copyright © 2026 Red Hat, Inc.
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+
+#include "libratbag-stats.h"
+#include "libratbag-util.h"
+
+_Static_assert(RATBAG_IO_STATS_MAX_ENTRIES == 32,
+	       "the used bitmask and the hash expect 32 entries");
+
+static inline unsigned int
+ratbag_io_stats_slot(enum ratbag_io_request_type type, unsigned int id)
+{
+	uint32_t key = ((uint32_t)type << 16) | (id & 0xffff);
+
+	/* Fibonacci hashing to the top 5 bits */
+	return (key * 2654435761U) >> 27;
+}
+
+void
+ratbag_io_stats_table_free(struct ratbag_io_stats_table *table)
+{
+	while (table) {
+		struct ratbag_io_stats_table *next = table->next;
+
+		free(table);
+		table = next;
+	}
+}
+
+struct ratbag_io_stats *
+ratbag_io_stats_get(struct ratbag_io_stats_table *table,
+		    enum ratbag_io_request_type type,
+		    unsigned int id)
+{
+	struct ratbag_io_stats *stats;
+	unsigned int hash, slot, i;
+
+	if (!table)
+		return NULL;
+
+	hash = ratbag_io_stats_slot(type, id);
+
+	/* open addressing with linear probing, entries are never removed.
+	 * A table only gets an overflow table once it is full, so a free
+	 * slot means the entry is not in any of the following tables */
+	for (; table; table = table->next) {
+		for (i = 0; i < RATBAG_IO_STATS_MAX_ENTRIES; i++) {
+			slot = (hash + i) % RATBAG_IO_STATS_MAX_ENTRIES;
+			stats = &table->entries[slot];
+
+			if (!(table->used & (1U << slot))) {
+				table->used |= 1U << slot;
+				stats->type = type;
+				stats->id = id;
+				return stats;
+			}
+
+			if (stats->type == type && stats->id == id)
+				return stats;
+		}
+
+		if (!table->next)
+			table->next = zalloc(sizeof(*table->next));
+	}
+
+	return NULL;
+}
+
+void
+ratbag_io_stats_add_latency(struct ratbag_io_stats *stats, uint64_t latency_us)
+{
+	uint64_t ms = latency_us / 1000;
+	unsigned int bucket = 0;
+
+	if (!stats)
+		return;
+
+	while (ms && bucket < RATBAG_IO_LATENCY_BUCKETS - 1) {
+		ms >>= 1;
+		bucket++;
+	}
+
+	stats->latency[bucket]++;
+	stats->latency_total_us += latency_us;
+}
+
+void
+ratbag_io_stats_record(struct ratbag_io_stats_table *table,
+		       enum ratbag_io_request_type type,
+		       unsigned int id,
+		       int rc,
+		       size_t sent,
+		       size_t received,
+		       uint64_t latency_us)
+{
+	struct ratbag_io_stats *stats;
+
+	stats = ratbag_io_stats_get(table, type, id);
+	if (!stats)
+		return;
+
+	stats->requests++;
+	stats->bytes_sent += sent;
+	stats->bytes_received += received;
+
+	if (rc < 0) {
+		stats->errors++;
+		if (rc == -ETIMEDOUT)
+			stats->timeouts++;
+		return;
+	}
+
+	ratbag_io_stats_add_latency(stats, latency_us);
+}
+
+size_t
+ratbag_io_stats_copy(const struct ratbag_io_stats_table *table,
+		     struct ratbag_io_stats *stats,
+		     size_t nstats)
+{
+	size_t count = 0;
+
+	for (; table; table = table->next) {
+		for (unsigned int i = 0; i < RATBAG_IO_STATS_MAX_ENTRIES; i++) {
+			if (!(table->used & (1U << i)))
+				continue;
+
+			if (count < nstats)
+				stats[count] = table->entries[i];
+			count++;
+		}
+	}
+
+	return count;
+}
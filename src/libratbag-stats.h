@@ -0,0 +1,84 @@
+/*
+ * Copyright © 2026 Red Hat, Inc.
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "libratbag.h"
+
+/*
+ * Per-device I/O statistics, filled in by the hidraw and HID++ transports.
+ * All functions accept a NULL table so that callers without statistics
+ * (e.g. the tools) don't need to special-case anything.
+ */
+
+#define RATBAG_IO_STATS_MAX_ENTRIES	32
+
+struct ratbag_io_stats_table {
+	struct ratbag_io_stats entries[RATBAG_IO_STATS_MAX_ENTRIES];
+	uint32_t used; /* bitmask of used entries */
+	/* allocated once this table is full. Entries never move, so
+	 * pointers returned by ratbag_io_stats_get() stay valid */
+	struct ratbag_io_stats_table *next;
+};
+
+/**
+ * Frees the table and its overflow tables.
+ */
+void
+ratbag_io_stats_table_free(struct ratbag_io_stats_table *table);
+
+/**
+ * Returns the entry for the given type and id, creating it if needed.
+ * Returns NULL if table is NULL.
+ */
+struct ratbag_io_stats *
+ratbag_io_stats_get(struct ratbag_io_stats_table *table,
+		    enum ratbag_io_request_type type,
+		    unsigned int id);
+
+void
+ratbag_io_stats_add_latency(struct ratbag_io_stats *stats, uint64_t latency_us);
+
+/**
+ * Account for one completed request. rc is the negative errno on failure.
+ */
+void
+ratbag_io_stats_record(struct ratbag_io_stats_table *table,
+		       enum ratbag_io_request_type type,
+		       unsigned int id,
+		       int rc,
+		       size_t sent,
+		       size_t received,
+		       uint64_t latency_us);
+
+/**
+ * Copies up to nstats non-empty entries into stats and returns the number
+ * of non-empty entries in the table.
+ */
+size_t
+ratbag_io_stats_copy(const struct ratbag_io_stats_table *table,
+		     struct ratbag_io_stats *stats,
+		     size_t nstats);
@@ -81,3 +81,157 @@ ratbag_device_new_test_device(struct ratbag *ratbag,
 
 	return device;
 }
+
+/* xorshift32, the generated devices only need to look varied */
+static uint32_t
+test_rand(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+
+	return *state = x;
+}
+
+static void
+test_generate_button(struct ratbag_test_button *button, uint32_t *state)
+{
+	static const enum ratbag_button_action_special specials[] = {
+		RATBAG_BUTTON_ACTION_SPECIAL_DOUBLECLICK,
+		RATBAG_BUTTON_ACTION_SPECIAL_WHEEL_UP,
+		RATBAG_BUTTON_ACTION_SPECIAL_WHEEL_DOWN,
+		RATBAG_BUTTON_ACTION_SPECIAL_RESOLUTION_CYCLE_UP,
+		RATBAG_BUTTON_ACTION_SPECIAL_RESOLUTION_DOWN,
+		RATBAG_BUTTON_ACTION_SPECIAL_PROFILE_CYCLE_UP,
+		RATBAG_BUTTON_ACTION_SPECIAL_SECOND_MODE,
+		RATBAG_BUTTON_ACTION_SPECIAL_BATTERY_LEVEL,
+	};
+	unsigned int key, nkeys;
+
+	switch (test_rand(state) % 5) {
+	case 0:
+		button->action_type = RATBAG_BUTTON_ACTION_TYPE_NONE;
+		break;
+	case 1:
+		button->action_type = RATBAG_BUTTON_ACTION_TYPE_BUTTON;
+		button->button = 1 + test_rand(state) % 16;
+		break;
+	case 2:
+		button->action_type = RATBAG_BUTTON_ACTION_TYPE_KEY;
+		button->key = KEY_1 + test_rand(state) % (KEY_SLASH - KEY_1);
+		break;
+	case 3:
+		button->action_type = RATBAG_BUTTON_ACTION_TYPE_SPECIAL;
+		button->special = specials[test_rand(state) % ARRAY_LENGTH(specials)];
+		break;
+	case 4:
+		button->action_type = RATBAG_BUTTON_ACTION_TYPE_MACRO;
+		/* press and release each key, with a wait in between */
+		nkeys = 1 + test_rand(state) % 4;
+		for (unsigned int i = 0; i < nkeys; i++) {
+			key = KEY_A + test_rand(state) % (KEY_M - KEY_A);
+			button->macro[i * 3] = (struct ratbag_test_macro_event) {
+				RATBAG_MACRO_EVENT_KEY_PRESSED, key };
+			button->macro[i * 3 + 1] = (struct ratbag_test_macro_event) {
+				RATBAG_MACRO_EVENT_WAIT, 10 + test_rand(state) % 100 };
+			button->macro[i * 3 + 2] = (struct ratbag_test_macro_event) {
+				RATBAG_MACRO_EVENT_KEY_RELEASED, key };
+		}
+		break;
+	}
+}
+
+static void
+test_generate_led(struct ratbag_test_led *led, uint32_t *state)
+{
+	uint32_t color = test_rand(state);
+
+	led->mode = test_rand(state) % (RATBAG_LED_BREATHING + 1);
+	led->color.red = color & 0xff;
+	led->color.green = (color >> 8) & 0xff;
+	led->color.blue = (color >> 16) & 0xff;
+	led->ms = 100 * (1 + test_rand(state) % 50);
+	led->brightness = test_rand(state) % 101;
+}
+
+LIBRATBAG_EXPORT struct ratbag_test_device *
+ratbag_test_device_generate(unsigned int num_profiles,
+			    unsigned int num_resolutions,
+			    unsigned int num_buttons,
+			    unsigned int num_leds,
+			    uint32_t seed)
+{
+	struct ratbag_test_device *td;
+	uint32_t state = seed ^ 0x9e3779b9;
+
+	/* xorshift never leaves 0 */
+	if (state == 0)
+		state = 1;
+
+	td = zalloc(sizeof(*td));
+	td->num_profiles = num_profiles;
+	td->num_resolutions = num_resolutions;
+	td->num_buttons = num_buttons;
+	td->num_leds = num_leds;
+	td->profile_list = zalloc(max(num_profiles, 1U) * sizeof(*td->profile_list));
+
+	for (unsigned int i = 0; i < num_profiles; i++) {
+		struct ratbag_test_profile *p = &td->profile_list[i];
+		static const unsigned int rates[] = { 125, 250, 500, 1000 };
+
+		p->name = asprintf_safe("Generated profile %u", i);
+		p->active = i == 0;
+		p->dflt = i == 0;
+		/* the device-wide report rate list is taken from profile 0 */
+		memcpy(p->report_rates, rates, sizeof(rates));
+		p->hz = rates[test_rand(&state) % ARRAY_LENGTH(rates)];
+
+		p->resolution_list = zalloc(max(num_resolutions, 1U) *
+					    sizeof(*p->resolution_list));
+		for (unsigned int r = 0; r < num_resolutions; r++) {
+			struct ratbag_test_resolution *res = &p->resolution_list[r];
+
+			res->xres = 400 * (r + 1);
+			res->yres = 400 * (r + 1);
+			res->active = r == 0;
+			res->dflt = r == 0;
+			/* the DPI range is taken from the first resolution */
+			res->dpi_min = 100;
+			res->dpi_max = 400 * max(num_resolutions, 4U);
+		}
+
+		p->button_list = zalloc(max(num_buttons, 1U) *
+					sizeof(*p->button_list));
+		for (unsigned int b = 0; b < num_buttons; b++)
+			test_generate_button(&p->button_list[b], &state);
+
+		p->led_list = zalloc(max(num_leds, 1U) * sizeof(*p->led_list));
+		for (unsigned int l = 0; l < num_leds; l++)
+			test_generate_led(&p->led_list[l], &state);
+	}
+
+	return td;
+}
+
+LIBRATBAG_EXPORT void
+ratbag_test_device_free(struct ratbag_test_device *td)
+{
+	if (!td)
+		return;
+
+	if (td->profile_list) {
+		for (unsigned int i = 0; i < td->num_profiles; i++) {
+			struct ratbag_test_profile *p = &td->profile_list[i];
+
+			free(p->name);
+			free(p->resolution_list);
+			free(p->button_list);
+			free(p->led_list);
+		}
+		free(td->profile_list);
+	}
+
+	free(td);
+}
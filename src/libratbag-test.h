@@ -28,6 +28,9 @@
 
 #include "libratbag.h"
 
+/* The sizes of the arrays embedded in the structs below, enough for any
+ * hand-written test device. Larger topologies use the *_list pointers
+ * instead, see ratbag_test_device_generate() */
 #define RATBAG_TEST_MAX_PROFILES 12
 #define RATBAG_TEST_MAX_BUTTONS 25
 #define RATBAG_TEST_MAX_RESOLUTIONS 8
@@ -83,6 +86,12 @@ struct ratbag_test_profile {
 
 	int hz;
 	unsigned int report_rates[5];
+
+	/* if set, used instead of the arrays above and holding the device's
+	 * num_buttons, num_resolutions and num_leds entries respectively */
+	struct ratbag_test_button *button_list;
+	struct ratbag_test_resolution *resolution_list;
+	struct ratbag_test_led *led_list;
 };
 
 struct ratbag_test_device {
@@ -91,10 +100,32 @@ struct ratbag_test_device {
 	unsigned int num_buttons;
 	unsigned int num_leds;
 	struct ratbag_test_profile profiles[RATBAG_TEST_MAX_PROFILES];
+	/* if set, used instead of profiles and holding num_profiles entries */
+	struct ratbag_test_profile *profile_list;
 	void (*destroyed)(struct ratbag_device *device, void *data);
 	void *destroyed_data;
 };
 
+/* The test device is only read while the device is created, it can be
+ * freed or reused once this returns */
 struct ratbag_device* ratbag_device_new_test_device(struct ratbag *ratbag,
 						    const struct ratbag_test_device *test_device);
 
+/**
+ * Generate a test device with the given topology. The contents, i.e.
+ * button actions, LED modes and colors, resolutions, report rates, are
+ * picked pseudo-randomly from seed, the same seed gives the same device.
+ * Profile 0 is the active and default profile.
+ *
+ * Free the result with ratbag_test_device_free().
+ */
+struct ratbag_test_device *
+ratbag_test_device_generate(unsigned int num_profiles,
+			    unsigned int num_resolutions,
+			    unsigned int num_buttons,
+			    unsigned int num_leds,
+			    uint32_t seed);
+
+void
+ratbag_test_device_free(struct ratbag_test_device *test_device);
+
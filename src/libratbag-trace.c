@@ -0,0 +1,246 @@
+/*
+ * Copyright © 2026 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libratbag-trace.h"
+#include "libratbag-util.h"
+
+int
+ratbag_trace_init(struct ratbag_trace *trace, unsigned int nrecords)
+{
+	struct ratbag_trace_slot *slots;
+	uint32_t size = 1;
+
+	ratbag_trace_release(trace);
+
+	if (nrecords == 0)
+		return 0;
+
+	if (nrecords > 1U << 24)
+		return -EINVAL;
+
+	while (size < nrecords)
+		size <<= 1;
+
+	slots = calloc(size, sizeof(*slots));
+	if (!slots)
+		return -ENOMEM;
+
+	/* no writer can see size or head until the slots are published */
+	trace->size = size;
+	__atomic_store_n(&trace->head, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&trace->slots, slots, __ATOMIC_SEQ_CST);
+
+	return 0;
+}
+
+void
+ratbag_trace_release(struct ratbag_trace *trace)
+{
+	struct ratbag_trace_slot *slots;
+
+	/* Writers count themselves in users before they load slots, so
+	 * once slots is NULL and users drops to zero, nobody uses the old
+	 * slots. Writers that see NULL leave immediately. */
+	slots = __atomic_exchange_n(&trace->slots, NULL, __ATOMIC_SEQ_CST);
+	if (!slots)
+		return;
+
+	while (__atomic_load_n(&trace->users, __ATOMIC_SEQ_CST) != 0)
+		msleep(1);
+
+	free(slots);
+	trace->size = 0;
+}
+
+static inline struct ratbag_trace_slot *
+ratbag_trace_get_slots(struct ratbag_trace *trace)
+{
+	__atomic_fetch_add(&trace->users, 1, __ATOMIC_SEQ_CST);
+
+	return __atomic_load_n(&trace->slots, __ATOMIC_SEQ_CST);
+}
+
+static inline void
+ratbag_trace_put_slots(struct ratbag_trace *trace)
+{
+	__atomic_fetch_sub(&trace->users, 1, __ATOMIC_RELEASE);
+}
+
+void
+ratbag_trace_add(struct ratbag_trace *trace,
+		 uint16_t device,
+		 enum ratbag_trace_direction direction,
+		 const uint8_t *buf, size_t len,
+		 uint64_t latency_us)
+{
+	struct ratbag_trace_slot *slots, *slot;
+	struct ratbag_trace_record *record;
+	uint64_t n, seq;
+
+	if (!trace)
+		return;
+
+	slots = ratbag_trace_get_slots(trace);
+	if (!slots)
+		goto out;
+
+	n = __atomic_fetch_add(&trace->head, 1, __ATOMIC_RELAXED);
+	slot = &slots[n & (trace->size - 1)];
+
+	/* An odd seq is a writer that is a whole ring behind us and still
+	 * busy, anything past 2n a writer that is ahead. Either way the
+	 * slot is not ours and the record is lost. */
+	seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+	do {
+		if ((seq & 1) || seq > 2 * n)
+			goto out;
+	} while (!__atomic_compare_exchange_n(&slot->seq, &seq, 2 * n + 1, true,
+					      __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	record = &slot->record;
+	record->timestamp_us = now(CLOCK_MONOTONIC) / 1000;
+	record->latency_us = min(latency_us, (uint64_t)UINT32_MAX);
+	record->device = device;
+	record->direction = direction;
+	record->report_id = len > 0 ? buf[0] : 0;
+	record->length = min(len, (size_t)UINT16_MAX);
+	memset(record->data, 0, sizeof(record->data));
+	memcpy(record->data, buf, min(len, sizeof(record->data)));
+
+	__atomic_store_n(&slot->seq, 2 * n + 2, __ATOMIC_RELEASE);
+out:
+	ratbag_trace_put_slots(trace);
+}
+
+/* Copies record n out of its slot, false if it is incomplete or was
+ * overwritten in the meantime */
+static bool
+ratbag_trace_read_slot(struct ratbag_trace_slot *slot, uint64_t n,
+		       struct ratbag_trace_record *record)
+{
+	uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+	if (seq != 2 * n + 2)
+		return false;
+
+	memcpy(record, &slot->record, sizeof(*record));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	return __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq;
+}
+
+static int
+write_all(int fd, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	ssize_t rc;
+
+	while (len > 0) {
+		rc = write(fd, p, len);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		p += rc;
+		len -= rc;
+	}
+
+	return 0;
+}
+
+int
+ratbag_trace_write_fd(struct ratbag_trace *trace,
+		      const struct ratbag_trace_device *devices,
+		      unsigned int ndevices,
+		      int fd)
+{
+	struct ratbag_trace_header header = {
+		.version = RATBAG_TRACE_VERSION,
+		.record_size = sizeof(struct ratbag_trace_record),
+		.ndevices = ndevices,
+	};
+	_cleanup_free_ struct ratbag_trace_record *records = NULL;
+	struct ratbag_trace_slot *slots;
+	uint64_t head, first;
+	uint32_t nrecords = 0;
+	int rc;
+
+	memcpy(header.magic, RATBAG_TRACE_MAGIC, sizeof(header.magic));
+
+	/* the header needs the number of records, so copy them out first,
+	 * oldest first and without the ones that are torn */
+	slots = ratbag_trace_get_slots(trace);
+	if (slots) {
+		head = __atomic_load_n(&trace->head, __ATOMIC_ACQUIRE);
+		first = head - min(head, (uint64_t)trace->size);
+
+		records = calloc(head - first, sizeof(*records));
+		if (!records && head > first) {
+			ratbag_trace_put_slots(trace);
+			return -ENOMEM;
+		}
+
+		for (uint64_t n = first; n < head; n++) {
+			struct ratbag_trace_slot *slot = &slots[n & (trace->size - 1)];
+
+			if (ratbag_trace_read_slot(slot, n, &records[nrecords]))
+				nrecords++;
+		}
+	}
+	ratbag_trace_put_slots(trace);
+
+	header.nrecords = nrecords;
+
+	rc = write_all(fd, &header, sizeof(header));
+	if (rc)
+		return rc;
+
+	rc = write_all(fd, devices, ndevices * sizeof(*devices));
+	if (rc)
+		return rc;
+
+	return write_all(fd, records, nrecords * sizeof(*records));
+}
+
+const char *
+ratbag_trace_direction_to_str(enum ratbag_trace_direction direction)
+{
+	switch (direction) {
+	case RATBAG_TRACE_OUTPUT_REPORT: return "output";
+	case RATBAG_TRACE_INPUT_REPORT: return "input";
+	case RATBAG_TRACE_FEATURE_GET: return "feature-get";
+	case RATBAG_TRACE_FEATURE_SET: return "feature-set";
+	case RATBAG_TRACE_HIDPP_WRITE: return "hidpp-write";
+	case RATBAG_TRACE_HIDPP_READ: return "hidpp-read";
+	}
+
+	return "unknown";
+}
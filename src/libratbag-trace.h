@@ -0,0 +1,156 @@
+/*
+ * Copyright © 2026 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Binary trace of the HID traffic, kept in a ring buffer of fixed-size
+ * records. This is cheap enough to keep enabled in production, the trace
+ * can be written out with ratbag_trace_write_fd() when something went wrong.
+ *
+ * The file format is a struct ratbag_trace_header, followed by ndevices
+ * struct ratbag_trace_device, followed by nrecords struct
+ * ratbag_trace_record, oldest first. All values are in host byte order.
+ */
+
+#define RATBAG_TRACE_MAGIC		"RBTRACE\0"
+#define RATBAG_TRACE_VERSION		1
+#define RATBAG_TRACE_DATA_LEN		22
+
+enum ratbag_trace_direction {
+	RATBAG_TRACE_OUTPUT_REPORT = 0,
+	RATBAG_TRACE_INPUT_REPORT,
+	RATBAG_TRACE_FEATURE_GET,
+	RATBAG_TRACE_FEATURE_SET,
+	RATBAG_TRACE_HIDPP_WRITE,
+	RATBAG_TRACE_HIDPP_READ,
+};
+
+struct ratbag_trace_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t ndevices;
+	uint32_t nrecords;
+};
+
+struct ratbag_trace_device {
+	uint32_t id;
+	uint16_t vendor;
+	uint16_t product;
+	char name[56];
+};
+
+struct ratbag_trace_record {
+	uint64_t timestamp_us;	/* CLOCK_MONOTONIC */
+	uint32_t latency_us;	/* reads: time since the request, 0 otherwise */
+	uint16_t device;	/* see struct ratbag_trace_device */
+	uint8_t direction;	/* enum ratbag_trace_direction */
+	uint8_t report_id;
+	uint16_t length;	/* length of the full report */
+	uint8_t data[RATBAG_TRACE_DATA_LEN]; /* the first bytes of the report */
+};
+
+_Static_assert(sizeof(struct ratbag_trace_header) == 24, "trace header size changed");
+_Static_assert(sizeof(struct ratbag_trace_device) == 64, "trace device size changed");
+_Static_assert(sizeof(struct ratbag_trace_record) == 40, "trace record size changed");
+
+/*
+ * A record and its sequence number. While record n is filled in, seq is
+ * 2n + 1, once it is complete 2n + 2. Zero means never written.
+ */
+struct ratbag_trace_slot {
+	uint64_t seq;
+	struct ratbag_trace_record record;
+};
+
+/*
+ * Commits may run on several threads, so everything here is lock-free. A
+ * zeroed struct is a disabled trace.
+ */
+struct ratbag_trace {
+	struct ratbag_trace_slot *slots; /* NULL if disabled */
+	uint32_t size;			 /* a power of two */
+	uint64_t head;			 /* records claimed so far */
+	/* threads currently using slots, ratbag_trace_release() waits
+	 * for them before the slots are freed */
+	unsigned int users;
+};
+
+static inline bool
+ratbag_trace_is_enabled(struct ratbag_trace *trace)
+{
+	return __atomic_load_n(&trace->slots, __ATOMIC_ACQUIRE) != NULL;
+}
+
+/**
+ * Allocates space for nrecords records, rounded up to a power of two, and
+ * discards all previous records. nrecords of 0 disables the trace.
+ *
+ * Writers on other threads may run concurrently, see
+ * ratbag_trace_release().
+ *
+ * @return 0 on success or a negative errno
+ */
+int
+ratbag_trace_init(struct ratbag_trace *trace, unsigned int nrecords);
+
+/**
+ * Disables the trace and frees the records. Writers that already picked up
+ * the records are waited for, they only copy one record.
+ */
+void
+ratbag_trace_release(struct ratbag_trace *trace);
+
+/**
+ * Appends a record. Records are numbered with an atomic increment of the
+ * head and the slot's sequence number marks the record as being written
+ * until it is complete. If a writer that wrapped around the whole ring is
+ * still busy with the slot, the record is dropped. trace may be NULL.
+ */
+void
+ratbag_trace_add(struct ratbag_trace *trace,
+		 uint16_t device,
+		 enum ratbag_trace_direction direction,
+		 const uint8_t *buf, size_t len,
+		 uint64_t latency_us);
+
+/**
+ * Write the trace to fd in the file format described above. Records that
+ * are still being written or were overwritten while they were copied are
+ * left out.
+ *
+ * @return 0 on success or a negative errno
+ */
+int
+ratbag_trace_write_fd(struct ratbag_trace *trace,
+		      const struct ratbag_trace_device *devices,
+		      unsigned int ndevices,
+		      int fd);
+
+const char *
+ratbag_trace_direction_to_str(enum ratbag_trace_direction direction);
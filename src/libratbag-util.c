@@ -205,3 +205,60 @@ int mkdir_p(const char *dir, mode_t mode)
 
     return mkdir(dir, mode);
 }
+
+void
+rtt_estimator_init(struct rtt_estimator *rtt, unsigned int ceiling_ms)
+{
+	rtt->srtt = 0;
+	rtt->rttvar = 0;
+	rtt->ceiling = max(ceiling_ms, (unsigned int)RTT_TIMEOUT_MIN_MS);
+	rtt->backoff = 0;
+	rtt->valid = false;
+}
+
+void
+rtt_estimator_sample(struct rtt_estimator *rtt, uint64_t rtt_us)
+{
+	unsigned int r = min(rtt_us, (uint64_t)rtt->ceiling * 1000);
+	unsigned int delta;
+
+	if (!rtt->valid) {
+		rtt->srtt = r;
+		rtt->rttvar = r / 2;
+		rtt->valid = true;
+	} else {
+		delta = rtt->srtt > r ? rtt->srtt - r : r - rtt->srtt;
+		/* RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, SRTT = 7/8 SRTT + 1/8 R */
+		rtt->rttvar = rtt->rttvar - rtt->rttvar / 4 + delta / 4;
+		rtt->srtt = rtt->srtt - rtt->srtt / 8 + r / 8;
+	}
+
+	rtt->backoff = 0;
+}
+
+unsigned int
+rtt_estimator_timeout(const struct rtt_estimator *rtt)
+{
+	uint64_t timeout;
+
+	if (!rtt->valid)
+		return rtt->ceiling;
+
+	timeout = (rtt->srtt + 4ULL * rtt->rttvar + 999) / 1000;
+	timeout = max(timeout, (uint64_t)RTT_TIMEOUT_MIN_MS);
+	timeout <<= min(rtt->backoff, 16U);
+
+	return min(timeout, (uint64_t)rtt->ceiling);
+}
+
+bool
+rtt_estimator_backoff(struct rtt_estimator *rtt)
+{
+	if (rtt->backoff >= RTT_BACKOFF_MAX ||
+	    rtt_estimator_timeout(rtt) >= rtt->ceiling)
+		return false;
+
+	rtt->backoff++;
+
+	return true;
+}
@@ -168,6 +168,47 @@ msleep(unsigned int ms)
 	usleep(ms * 1000);
 }
 
+/*
+ * Round-trip time estimator for device requests, see RFC 6298 for the
+ * SRTT/RTTVAR computation. Samples are in microseconds, timeouts are
+ * handed out in milliseconds and never exceed the configured ceiling.
+ * Until the first sample is taken, the ceiling is used as timeout.
+ *
+ * An expired timeout is doubled at most RTT_BACKOFF_MAX times, so a
+ * device that doesn't answer is given up on after a few round trip
+ * times rather than after the ceiling.
+ */
+#define RTT_TIMEOUT_MIN_MS	50
+#define RTT_TIMEOUT_DEFAULT_MS	1000
+#define RTT_TIMEOUT_MAX_MS	10000
+#define RTT_BACKOFF_MAX		2
+
+struct rtt_estimator {
+	unsigned int srtt;	/* smoothed round-trip time in us */
+	unsigned int rttvar;	/* round-trip time variation in us */
+	unsigned int ceiling;	/* upper bound for timeouts in ms */
+	unsigned int backoff;	/* consecutive timeouts without a sample */
+	bool valid;
+};
+
+void
+rtt_estimator_init(struct rtt_estimator *rtt, unsigned int ceiling_ms);
+
+void
+rtt_estimator_sample(struct rtt_estimator *rtt, uint64_t rtt_us);
+
+unsigned int
+rtt_estimator_timeout(const struct rtt_estimator *rtt);
+
+/**
+ * Call after a timeout expired. Doubles the next timeout and returns true
+ * if the caller should keep waiting, false once the backoff limit or the
+ * ceiling is reached. The backoff is kept until the next sample, so the
+ * requests following a timeout don't wait in vain for as long.
+ */
+bool
+rtt_estimator_backoff(struct rtt_estimator *rtt);
+
 static inline int
 long_bit_is_set(const unsigned long *array, int bit)
 {
@@ -367,6 +408,21 @@ get_unaligned_be_u32(const uint8_t *buf)
 	return (buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
 }
 
+static inline uint32_t
+get_unaligned_le_u32(const uint8_t *buf)
+{
+	return ((uint32_t)buf[3] << 24) | (buf[2] << 16) | (buf[1] << 8) | buf[0];
+}
+
+static inline void
+set_unaligned_le_u32(uint8_t *buf, uint32_t value)
+{
+	buf[0] = value & 0xFF;
+	buf[1] = (value >> 8) & 0xFF;
+	buf[2] = (value >> 16) & 0xFF;
+	buf[3] = value >> 24;
+}
+
 static inline bool
 ratbag_key_is_modifier(const unsigned int key)
 {
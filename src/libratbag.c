@@ -23,7 +23,9 @@
 
 #include "config.h"
 #include <assert.h>
+#include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <libudev.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -39,6 +41,9 @@
 #include "libratbag-util.h"
 #include "libratbag-data.h"
 
+/* initial number of macro hash buckets, a power of two */
+#define RATBAG_MACRO_BUCKETS_MIN 64
+
 static enum ratbag_error_code
 error_code(enum ratbag_error_code code)
 {
@@ -57,13 +62,10 @@ error_code(enum ratbag_error_code code)
 }
 
 static void
-ratbag_profile_destroy(struct ratbag_profile *profile);
-static void
-ratbag_button_destroy(struct ratbag_button *button);
-static void
-ratbag_led_destroy(struct ratbag_led *led);
-static void
-ratbag_resolution_destroy(struct ratbag_resolution *resolution);
+ratbag_device_destroy_profiles(struct ratbag_device *device);
+
+static struct ratbag_dpi_table *
+ratbag_dpi_table_unref(struct ratbag_dpi_table *table);
 
 static void
 ratbag_default_log_func(struct ratbag *ratbag,
@@ -102,8 +104,7 @@ log_msg_va(struct ratbag *ratbag,
 	   const char *format,
 	   va_list args)
 {
-	if (ratbag->log_handler &&
-	    ratbag->log_priority <= priority)
+	if (log_is_enabled(ratbag, priority))
 		ratbag->log_handler(ratbag, priority, format, args);
 }
 
@@ -114,6 +115,9 @@ log_msg(struct ratbag *ratbag,
 {
 	va_list args;
 
+	if (!log_is_enabled(ratbag, priority))
+		return;
+
 	va_start(args, format);
 	log_msg_va(ratbag, priority, format, args);
 	va_end(args);
@@ -130,8 +134,7 @@ log_buffer(struct ratbag *ratbag,
 	unsigned int i, n;
 	unsigned int buf_len;
 
-	if (ratbag->log_handler &&
-	    ratbag->log_priority > priority)
+	if (!log_is_enabled(ratbag, priority))
 		return;
 
 	buf_len = header ? strlen(header) : 0;
@@ -183,6 +186,237 @@ ratbag_log_set_handler(struct ratbag *ratbag,
 	ratbag->log_handler = log_handler;
 }
 
+static bool
+ratbag_trace_entry_is_unused(const struct ratbag *ratbag, unsigned int idx)
+{
+	uint64_t removed = ratbag->trace_removed[idx];
+	uint64_t head;
+
+	if (removed == 0)
+		return false;
+	if (removed == UINT64_MAX)
+		return true;
+
+	/* the ring has wrapped since the removal */
+	head = __atomic_load_n(&ratbag->trace.head, __ATOMIC_RELAXED);
+	return head - (removed - 1) >= ratbag->trace.size;
+}
+
+static void
+ratbag_trace_register_device(struct ratbag *ratbag,
+			     struct ratbag_device *device)
+{
+	struct ratbag_trace_device *entry;
+	unsigned int idx;
+
+	if (!ratbag_trace_is_enabled(&ratbag->trace) || device->trace_id != 0)
+		return;
+
+	for (idx = 0; idx < ratbag->ntrace_devices; idx++) {
+		if (ratbag_trace_entry_is_unused(ratbag, idx))
+			break;
+	}
+
+	if (idx == ratbag->ntrace_devices) {
+		if (ratbag->ntrace_devices >= UINT16_MAX)
+			return;
+
+		ratbag->trace_devices = realloc(ratbag->trace_devices,
+						(idx + 1) * sizeof(*ratbag->trace_devices));
+		ratbag->trace_removed = realloc(ratbag->trace_removed,
+						(idx + 1) * sizeof(*ratbag->trace_removed));
+		if (!ratbag->trace_devices || !ratbag->trace_removed)
+			abort();
+		ratbag->ntrace_devices++;
+	}
+
+	entry = &ratbag->trace_devices[idx];
+	memset(entry, 0, sizeof(*entry));
+	entry->id = idx + 1;
+	ratbag->trace_removed[idx] = 0;
+	entry->vendor = device->ids.vendor;
+	entry->product = device->ids.product;
+	strncpy_safe(entry->name, device->name ? device->name : "", sizeof(entry->name));
+
+	device->trace_id = entry->id;
+}
+
+static void
+ratbag_trace_unregister_device(struct ratbag *ratbag,
+			       struct ratbag_device *device)
+{
+	if (device->trace_id == 0)
+		return;
+
+	ratbag->trace_removed[device->trace_id - 1] =
+		__atomic_load_n(&ratbag->trace.head, __ATOMIC_RELAXED) + 1;
+	device->trace_id = 0;
+}
+
+LIBRATBAG_EXPORT int
+ratbag_trace_enable(struct ratbag *ratbag, unsigned int nrecords)
+{
+	struct ratbag_device *device;
+	int rc;
+
+	rc = ratbag_trace_init(&ratbag->trace, nrecords);
+	if (rc)
+		return rc;
+
+	/* the records are gone, so are the entries of removed devices.
+	 * Otherwise, entries stay valid until the ring has wrapped so
+	 * records of removed devices can still be decoded */
+	for (unsigned int idx = 0; idx < ratbag->ntrace_devices; idx++) {
+		if (ratbag->trace_removed[idx] != 0)
+			ratbag->trace_removed[idx] = UINT64_MAX;
+	}
+
+	list_for_each(device, &ratbag->devices, link)
+		ratbag_trace_register_device(ratbag, device);
+
+	return 0;
+}
+
+LIBRATBAG_EXPORT int
+ratbag_trace_write(struct ratbag *ratbag, int fd)
+{
+	return ratbag_trace_write_fd(&ratbag->trace,
+				     ratbag->trace_devices,
+				     ratbag->ntrace_devices,
+				     fd);
+}
+
+LIBRATBAG_EXPORT int
+ratbag_cache_enable(struct ratbag *ratbag, const char *directory)
+{
+	ratbag->cache_dir = mfree(ratbag->cache_dir);
+
+	if (!directory)
+		return 0;
+
+	if (mkdir_p(directory, 0755) < 0)
+		return -errno;
+
+	ratbag->cache_dir = strdup_safe(directory);
+
+	return 0;
+}
+
+#define RATBAG_CACHE_MAGIC "RBC1"
+
+/* a cache file is this header followed by the payload */
+struct ratbag_cache_header {
+	char magic[4];
+	uint32_t size;
+};
+
+static char *
+ratbag_device_cache_path(struct ratbag_device *device, const char *name)
+{
+	struct udev_device *hid_udev = NULL;
+	const char *uniq = NULL;
+	char *path, *c;
+
+	if (device->udev_device)
+		hid_udev = udev_device_get_parent_with_subsystem_devtype(device->udev_device,
+									 "hid", NULL);
+	if (hid_udev)
+		uniq = udev_device_get_property_value(hid_udev, "HID_UNIQ");
+
+	path = asprintf_safe("%s/%04x-%04x-%04x-%s-%s.%s",
+			     device->ratbag->cache_dir,
+			     device->ids.bustype,
+			     device->ids.vendor,
+			     device->ids.product,
+			     uniq && *uniq ? uniq : "none",
+			     device->firmware_version ? device->firmware_version : "none",
+			     name);
+
+	/* the serial and firmware strings come from the device */
+	for (c = path + strlen(device->ratbag->cache_dir) + 1; *c; c++) {
+		if (!isalnum((unsigned char)*c) && *c != '-' && *c != '.')
+			*c = '_';
+	}
+
+	return path;
+}
+
+int
+ratbag_device_cache_read(struct ratbag_device *device, const char *name,
+			 void *data, size_t size)
+{
+	_cleanup_free_ char *path = NULL;
+	_cleanup_close_ int fd = -1;
+	struct ratbag_cache_header header;
+	char extra;
+
+	/* without a firmware version, a firmware update would go unnoticed */
+	if (!device->ratbag->cache_dir || !device->firmware_version)
+		return -ENOENT;
+
+	path = ratbag_device_cache_path(device, name);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	if (read(fd, &header, sizeof(header)) != sizeof(header) ||
+	    memcmp(header.magic, RATBAG_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+	    header.size != size ||
+	    read(fd, data, size) != (ssize_t)size ||
+	    read(fd, &extra, 1) != 0) {
+		log_debug(device->ratbag, "Ignoring invalid cache file %s\n", path);
+		return -EBADMSG;
+	}
+
+	log_debug(device->ratbag, "%s: using cached %s\n", device->name, name);
+
+	return 0;
+}
+
+int
+ratbag_device_cache_write(struct ratbag_device *device, const char *name,
+			  const void *data, size_t size)
+{
+	_cleanup_free_ char *path = NULL;
+	_cleanup_free_ char *tmp = NULL;
+	_cleanup_close_ int fd = -1;
+	struct ratbag_cache_header header;
+	int rc = 0;
+
+	if (!device->ratbag->cache_dir || !device->firmware_version)
+		return 0;
+
+	if (size > UINT32_MAX)
+		return -EINVAL;
+
+	path = ratbag_device_cache_path(device, name);
+	tmp = asprintf_safe("%s.XXXXXX", path);
+
+	/* write to a temporary file so readers never see a partial file */
+	fd = mkostemp(tmp, O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	memcpy(header.magic, RATBAG_CACHE_MAGIC, sizeof(header.magic));
+	header.size = size;
+
+	/* the data must be on disk before the rename is, or a crash may
+	 * leave a truncated file under the final name */
+	if (write(fd, &header, sizeof(header)) != sizeof(header) ||
+	    write(fd, data, size) != (ssize_t)size)
+		rc = -EIO;
+	else if (fsync(fd) < 0 || rename(tmp, path) < 0)
+		rc = -errno;
+
+	if (rc) {
+		log_debug(device->ratbag, "Failed to write cache file %s: %s\n",
+			  path, strerror(-rc));
+		unlink(tmp);
+	}
+
+	return rc;
+}
+
 struct ratbag_device*
 ratbag_device_new(struct ratbag *ratbag, struct udev_device *udev_device,
 		  const char *name, const struct input_id *id)
@@ -196,11 +430,19 @@ ratbag_device_new(struct ratbag *ratbag, struct udev_device *udev_device,
 	device->udev_device = udev_device_ref(udev_device);
 	device->ids = *id;
 	device->data = ratbag_device_data_new_for_id(ratbag, id);
+	rtt_estimator_init(&device->hidraw_rtt, RTT_TIMEOUT_DEFAULT_MS);
+	if (device->data != NULL &&
+	    ratbag_device_data_get_request_timeout(device->data))
+		ratbag_hidraw_set_timeout_ceiling(device,
+						  ratbag_device_data_get_request_timeout(device->data));
+	device->io_stats = zalloc(sizeof(*device->io_stats));
+	ratbag_trace_register_device(ratbag, device);
 
 	if (device->data != NULL)
 		device->devicetype = ratbag_device_data_get_device_type(device->data);
 
 	list_init(&device->profiles);
+	list_init(&device->dpi_tables);
 
 	list_insert(&ratbag->devices, &device->link);
 
@@ -210,8 +452,6 @@ ratbag_device_new(struct ratbag *ratbag, struct udev_device *udev_device,
 void
 ratbag_device_destroy(struct ratbag_device *device)
 {
-	struct ratbag_profile *profile, *next;
-
 	if (!device)
 		return;
 
@@ -221,18 +461,19 @@ ratbag_device_destroy(struct ratbag_device *device)
 	if (device->driver && device->driver->remove)
 		device->driver->remove(device);
 
-	list_for_each_safe(profile, next, &device->profiles, link)
-		ratbag_profile_destroy(profile);
+	ratbag_device_destroy_profiles(device);
 
 	if (device->udev_device)
 		udev_device_unref(device->udev_device);
 
 	list_remove(&device->link);
 
+	ratbag_trace_unregister_device(device->ratbag, device);
 	ratbag_unref(device->ratbag);
 	ratbag_device_data_unref(device->data);
 	free(device->name);
 	free(device->firmware_version);
+	ratbag_io_stats_table_free(device->io_stats);
 	free(device);
 }
 
@@ -557,8 +798,16 @@ ratbag_create_context(const struct ratbag_interface *interface,
 
 	list_init(&ratbag->drivers);
 	list_init(&ratbag->devices);
+	ratbag->nmacro_buckets = RATBAG_MACRO_BUCKETS_MIN;
+	ratbag->macro_buckets = zalloc(ratbag->nmacro_buckets *
+				       sizeof(*ratbag->macro_buckets));
+	for (unsigned int i = 0; i < ratbag->nmacro_buckets; i++)
+		list_init(&ratbag->macro_buckets[i]);
+	pthread_mutex_init(&ratbag->macro_lock, NULL);
 	ratbag->udev = udev_new();
 	if (!ratbag->udev) {
+		pthread_mutex_destroy(&ratbag->macro_lock);
+		free(ratbag->macro_buckets);
 		free(ratbag);
 		return NULL;
 	}
@@ -601,42 +850,54 @@ ratbag_unref(struct ratbag *ratbag)
 	assert(ratbag->refcount > 0);
 	ratbag->refcount--;
 	if (ratbag->refcount == 0) {
+		struct ratbag_macro *macro, *tmp;
+
+		/* macros may still be referenced by a struct
+		 * ratbag_button_macro, unlink them from the context */
+		for (unsigned int i = 0; i < ratbag->nmacro_buckets; i++) {
+			list_for_each_safe(macro, tmp, &ratbag->macro_buckets[i], link) {
+				list_remove(&macro->link);
+				list_init(&macro->link);
+				macro->ratbag = NULL;
+			}
+		}
+		free(ratbag->macro_buckets);
+		pthread_mutex_destroy(&ratbag->macro_lock);
+
 		ratbag->udev = udev_unref(ratbag->udev);
+		ratbag_trace_release(&ratbag->trace);
+		free(ratbag->trace_devices);
+		free(ratbag->trace_removed);
+		free(ratbag->cache_dir);
 		free(ratbag);
 	}
 
 	return NULL;
 }
 
-static struct ratbag_button *
-ratbag_create_button(struct ratbag_profile *profile, unsigned int index)
+static void
+ratbag_init_button(struct ratbag_profile *profile, unsigned int index)
 {
-	struct ratbag_button *button;
+	struct ratbag_button *button = &profile->button_store[index];
 
-	button = zalloc(sizeof(*button));
 	button->refcount = 0;
 	button->profile = profile;
 	button->index = index;
 
 	list_append(&profile->buttons, &button->link);
-
-	return button;
 }
 
-static struct ratbag_led *
-ratbag_create_led(struct ratbag_profile *profile, unsigned int index)
+static void
+ratbag_init_led(struct ratbag_profile *profile, unsigned int index)
 {
-	struct ratbag_led *led;
+	struct ratbag_led *led = &profile->led_store[index];
 
-	led = zalloc(sizeof(*led));
 	led->refcount = 0;
 	led->profile = profile;
 	led->index = index;
 	led->colordepth = RATBAG_LED_COLORDEPTH_RGB_888;
 
 	list_append(&profile->leds, &led->link);
-
-	return led;
 }
 
 LIBRATBAG_EXPORT bool
@@ -650,11 +911,10 @@ ratbag_profile_has_capability(const struct ratbag_profile *profile,
 }
 
 static inline void
-ratbag_create_resolution(struct ratbag_profile *profile, int index)
+ratbag_init_resolution(struct ratbag_profile *profile, unsigned int index)
 {
-	struct ratbag_resolution *res;
+	struct ratbag_resolution *res = &profile->resolution_store[index];
 
-	res = zalloc(sizeof(*res));
 	res->refcount = 0;
 	res->profile = profile;
 	res->index = index;
@@ -664,18 +924,16 @@ ratbag_create_resolution(struct ratbag_profile *profile, int index)
 	profile->num_resolutions++;
 }
 
-
-static struct ratbag_profile *
-ratbag_create_profile(struct ratbag_device *device,
-		      unsigned int index,
-		      unsigned int num_resolutions,
-		      unsigned int num_buttons,
-		      unsigned int num_leds)
+static void
+ratbag_init_profile(struct ratbag_device *device,
+		    unsigned int index,
+		    unsigned int num_resolutions,
+		    unsigned int num_buttons,
+		    unsigned int num_leds)
 {
-	struct ratbag_profile *profile;
+	struct ratbag_profile *profile = &device->profile_store[index];
 	unsigned i;
 
-	profile = zalloc(sizeof(*profile));
 	profile->refcount = 0;
 	profile->device = device;
 	profile->index = index;
@@ -690,19 +948,24 @@ ratbag_create_profile(struct ratbag_device *device,
 	list_init(&profile->leds);
 	list_init(&profile->resolutions);
 
-	profile->device->num_buttons = num_buttons;
-	profile->device->num_leds = num_leds;
-
 	for (i = 0; i < num_resolutions; i++)
-		ratbag_create_resolution(profile, i);
+		ratbag_init_resolution(profile, i);
 
 	for (i = 0; i < num_buttons; i++)
-		ratbag_create_button(profile, i);
+		ratbag_init_button(profile, i);
 
 	for (i = 0; i < num_leds; i++)
-		ratbag_create_led(profile, i);
+		ratbag_init_led(profile, i);
+}
 
-	return profile;
+static inline size_t
+arena_reserve(size_t *offset, size_t align, size_t size)
+{
+	size_t start = (*offset + align - 1) & ~(align - 1);
+
+	*offset = start + size;
+
+	return start;
 }
 
 int
@@ -712,13 +975,46 @@ ratbag_device_init_profiles(struct ratbag_device *device,
 			    unsigned int num_buttons,
 			    unsigned int num_leds)
 {
+	size_t size = 0, profiles, resolutions, buttons, leds;
 	unsigned int i;
+	uint8_t *arena;
+
+	if (device->arena) {
+		log_bug_libratbag(device->ratbag,
+				  "%s: profiles initialized twice\n",
+				  device->name);
+		ratbag_device_destroy_profiles(device);
+	}
+
+	profiles = arena_reserve(&size, __alignof__(struct ratbag_profile),
+				 num_profiles * sizeof(struct ratbag_profile));
+	resolutions = arena_reserve(&size, __alignof__(struct ratbag_resolution),
+				    num_profiles * num_resolutions * sizeof(struct ratbag_resolution));
+	buttons = arena_reserve(&size, __alignof__(struct ratbag_button),
+				num_profiles * num_buttons * sizeof(struct ratbag_button));
+	leds = arena_reserve(&size, __alignof__(struct ratbag_led),
+			     num_profiles * num_leds * sizeof(struct ratbag_led));
+
+	arena = zalloc(max(size, (size_t)1));
+	device->arena = arena;
+	device->profile_store = (struct ratbag_profile *)(arena + profiles);
 
 	for (i = 0; i < num_profiles; i++) {
-		ratbag_create_profile(device, i, num_resolutions, num_buttons, num_leds);
+		struct ratbag_profile *profile = &device->profile_store[i];
+
+		profile->resolution_store = (struct ratbag_resolution *)(arena + resolutions) +
+					    i * num_resolutions;
+		profile->button_store = (struct ratbag_button *)(arena + buttons) +
+					i * num_buttons;
+		profile->led_store = (struct ratbag_led *)(arena + leds) +
+				     i * num_leds;
+
+		ratbag_init_profile(device, i, num_resolutions, num_buttons, num_leds);
 	}
 
 	device->num_profiles = num_profiles;
+	device->num_buttons = num_buttons;
+	device->num_leds = num_leds;
 
 	return 0;
 }
@@ -736,26 +1032,34 @@ ratbag_profile_ref(struct ratbag_profile *profile)
 static void
 ratbag_profile_destroy(struct ratbag_profile *profile)
 {
-	struct ratbag_button *button, *b_next;
-	struct ratbag_led *led, *l_next;
-	struct ratbag_resolution *res, *r_next;
+	struct ratbag_button *button;
+	struct ratbag_resolution *resolution;
 
 	/* if we get to the point where the profile is destroyed, buttons,
 	 * resolutions , etc. are at a refcount of 0, so we can destroy
-	 * everything */
-	list_for_each_safe(button, b_next, &profile->buttons, link)
-		ratbag_button_destroy(button);
+	 * everything. Their memory is owned by the device's arena. */
+	ratbag_profile_for_each_button(profile, button)
+		ratbag_macro_unref(button->action.macro);
 
-	list_for_each_safe(led, l_next, &profile->leds, link)
-		ratbag_led_destroy(led);
-
-	list_for_each_safe(res, r_next, &profile->resolutions, link)
-		ratbag_resolution_destroy(res);
+	ratbag_profile_for_each_resolution(profile, resolution)
+		ratbag_dpi_table_unref(resolution->dpi_table);
 
 	free(profile->name);
+}
+
+static void
+ratbag_device_destroy_profiles(struct ratbag_device *device)
+{
+	struct ratbag_profile *profile;
 
-	list_remove(&profile->link);
-	free(profile);
+	ratbag_device_for_each_profile(device, profile)
+		ratbag_profile_destroy(profile);
+
+	list_init(&device->profiles);
+	free(device->arena);
+	device->arena = NULL;
+	device->profile_store = NULL;
+	device->num_profiles = 0;
 }
 
 LIBRATBAG_EXPORT struct ratbag_profile *
@@ -775,21 +1079,12 @@ ratbag_profile_unref(struct ratbag_profile *profile)
 LIBRATBAG_EXPORT struct ratbag_profile *
 ratbag_device_get_profile(struct ratbag_device *device, unsigned int index)
 {
-	struct ratbag_profile *profile;
-
 	if (index >= ratbag_device_get_num_profiles(device)) {
 		log_bug_client(device->ratbag, "Requested invalid profile %d\n", index);
 		return NULL;
 	}
 
-	list_for_each(profile, &device->profiles, link) {
-		if (profile->index == index)
-			return ratbag_profile_ref(profile);
-	}
-
-	log_bug_libratbag(device->ratbag, "Profile %d not found\n", index);
-
-	return NULL;
+	return ratbag_profile_ref(&device->profile_store[index]);
 }
 
 LIBRATBAG_EXPORT enum ratbag_error_code
@@ -803,6 +1098,7 @@ ratbag_profile_set_enabled(struct ratbag_profile *profile, bool enabled)
 
 	profile->is_enabled = enabled;
 	profile->dirty = true;
+	profile->generation++;
 
 	return RATBAG_SUCCESS;
 }
@@ -819,6 +1115,12 @@ ratbag_profile_is_dirty(const struct ratbag_profile *profile)
 	return !!profile->dirty;
 }
 
+LIBRATBAG_EXPORT unsigned int
+ratbag_profile_get_generation(const struct ratbag_profile *profile)
+{
+	return profile->generation;
+}
+
 LIBRATBAG_EXPORT bool
 ratbag_profile_is_enabled(const struct ratbag_profile *profile)
 {
@@ -843,6 +1145,76 @@ ratbag_device_get_num_leds(const struct ratbag_device *device)
 	return device->num_leds;
 }
 
+static void
+ratbag_device_bump_generations(struct ratbag_device *device)
+{
+	struct ratbag_profile *profile;
+	struct ratbag_button *button;
+	struct ratbag_led *led;
+	struct ratbag_resolution *resolution;
+
+	list_for_each(profile, &device->profiles, link) {
+		profile->generation++;
+
+		list_for_each(button, &profile->buttons, link)
+			button->generation++;
+
+		list_for_each(led, &profile->leds, link)
+			led->generation++;
+
+		list_for_each(resolution, &profile->resolutions, link)
+			resolution->generation++;
+	}
+}
+
+LIBRATBAG_EXPORT enum ratbag_error_code
+ratbag_device_suspend(struct ratbag_device *device)
+{
+	int rc;
+
+	rc = ratbag_hidraw_suspend(device);
+	if (rc) {
+		log_error(device->ratbag, "%s: failed to release the device (%s)\n",
+			  device->name, strerror(-rc));
+		return RATBAG_ERROR_DEVICE;
+	}
+
+	return RATBAG_SUCCESS;
+}
+
+LIBRATBAG_EXPORT enum ratbag_error_code
+ratbag_device_resume(struct ratbag_device *device)
+{
+	int rc;
+
+	rc = ratbag_hidraw_resume(device);
+	if (rc < 0) {
+		log_error(device->ratbag, "%s: failed to reopen the device (%s)\n",
+			  device->name, strerror(-rc));
+		return RATBAG_ERROR_DEVICE;
+	}
+
+	/* another tool may have written to the device while it was
+	 * released */
+	if (rc == 0 || !device->driver->refresh)
+		return RATBAG_SUCCESS;
+
+	rc = device->driver->refresh(device);
+	if (rc < 0) {
+		log_error(device->ratbag, "%s: failed to refresh the device (%s)\n",
+			  device->name, strerror(-rc));
+		return RATBAG_ERROR_DEVICE;
+	}
+
+	if (rc > 0) {
+		log_debug(device->ratbag, "%s: device changed while it was released\n",
+			  device->name);
+		ratbag_device_bump_generations(device);
+	}
+
+	return RATBAG_SUCCESS;
+}
+
 LIBRATBAG_EXPORT enum ratbag_error_code
 ratbag_device_commit(struct ratbag_device *device)
 {
@@ -858,7 +1230,16 @@ ratbag_device_commit(struct ratbag_device *device)
 		return RATBAG_ERROR_CAPABILITY;
 	}
 
+	rc = ratbag_device_resume(device);
+	if (rc != RATBAG_SUCCESS)
+		return rc;
+
 	rc = device->driver->commit(device);
+
+	/* the dirty state changes and a failed commit may leave the driver
+	 * with a different view of the device than before */
+	ratbag_device_bump_generations(device);
+
 	if (rc)
 		return RATBAG_ERROR_DEVICE;
 
@@ -910,12 +1291,14 @@ ratbag_profile_set_active(struct ratbag_profile *profile)
 			p->is_active = false;
 			p->is_active_dirty = true;
 			p->dirty = true;
+			p->generation++;
 		}
 	}
 
 	profile->is_active = true;
 	profile->is_active_dirty = true;
 	profile->dirty = true;
+	profile->generation++;
 	return RATBAG_SUCCESS;
 }
 
@@ -928,8 +1311,6 @@ ratbag_profile_get_num_resolutions(const struct ratbag_profile *profile)
 LIBRATBAG_EXPORT struct ratbag_resolution *
 ratbag_profile_get_resolution(struct ratbag_profile *profile, unsigned int idx)
 {
-	struct ratbag_device *device = profile->device;
-	struct ratbag_resolution *res;
 	unsigned max = ratbag_profile_get_num_resolutions(profile);
 
 	if (idx >= max) {
@@ -938,15 +1319,7 @@ ratbag_profile_get_resolution(struct ratbag_profile *profile, unsigned int idx)
 		return NULL;
 	}
 
-	ratbag_profile_for_each_resolution(profile, res) {
-		if (res->index == idx)
-			return ratbag_resolution_ref(res);
-	}
-
-	log_bug_libratbag(device->ratbag, "Resolution %d, profile %d not found\n",
-			  idx, profile->index);
-
-	return NULL;
+	return ratbag_resolution_ref(&profile->resolution_store[idx]);
 }
 
 LIBRATBAG_EXPORT struct ratbag_resolution *
@@ -982,16 +1355,102 @@ ratbag_resolution_has_capability(const struct ratbag_resolution *resolution,
 	return !!(resolution->capabilities & (1 << cap));
 }
 
-static inline bool
-resolution_has_dpi(const struct ratbag_resolution *resolution,
-		   unsigned int dpi)
+static struct ratbag_dpi_table *
+ratbag_dpi_table_unref(struct ratbag_dpi_table *table)
 {
-	for (size_t i = 0; i < resolution->ndpis; i++) {
-		if (dpi == resolution->dpis[i])
-			return true;
+	if (table == NULL)
+		return NULL;
+
+	assert(table->refcount > 0);
+	table->refcount--;
+	if (table->refcount == 0) {
+		list_remove(&table->link);
+		free(table);
 	}
 
-	return false;
+	return NULL;
+}
+
+/**
+ * Returns a reference to the table with the given values, creating it if
+ * no such table exists on this device yet.
+ */
+static struct ratbag_dpi_table *
+ratbag_dpi_table_intern(struct ratbag_device *device,
+			const unsigned int *dpis, size_t ndpis)
+{
+	struct ratbag_dpi_table *table;
+
+	list_for_each(table, &device->dpi_tables, link) {
+		if (table->ndpis == ndpis &&
+		    memcmp(table->dpis, dpis, ndpis * sizeof(*dpis)) == 0) {
+			assert(table->refcount < INT_MAX);
+			table->refcount++;
+			return table;
+		}
+	}
+
+	table = zalloc(sizeof(*table) + ndpis * sizeof(table->dpis[0]));
+	table->refcount = 1;
+	table->ndpis = ndpis;
+	memcpy(table->dpis, dpis, ndpis * sizeof(*dpis));
+	list_insert(&device->dpi_tables, &table->link);
+
+	return table;
+}
+
+void
+ratbag_resolution_set_dpi_list(struct ratbag_resolution *res,
+			       const unsigned int *dpis,
+			       size_t ndpis)
+{
+	struct ratbag_device *device = res->profile->device;
+
+	assert(ndpis <= RATBAG_MAX_DPIS);
+
+	for (size_t i = 1; i < ndpis; i++)
+		assert(dpis[i] > dpis[i - 1]);
+
+	ratbag_dpi_table_unref(res->dpi_table);
+	res->dpi_table = ndpis ? ratbag_dpi_table_intern(device, dpis, ndpis) : NULL;
+}
+
+void
+ratbag_resolution_set_dpi_list_from_range(struct ratbag_resolution *res,
+					  unsigned int min, unsigned int max)
+{
+	unsigned int dpis[RATBAG_MAX_DPIS];
+	unsigned int stepsize = 50;
+	unsigned int dpi = min;
+	size_t ndpis = 0;
+	bool maxed_out = false;
+
+	while (ndpis < ARRAY_LENGTH(dpis)) {
+		if (dpi > max) {
+			maxed_out = true;
+			break;
+		}
+
+		dpis[ndpis++] = dpi;
+
+		if (dpi < 1000)
+			stepsize = 50;
+		else if (dpi < 2600)
+			stepsize = 100;
+		else if (dpi < 5000)
+			stepsize = 200;
+		else
+			stepsize = 500;
+
+		dpi += stepsize;
+	}
+
+	if (!maxed_out)
+		log_bug_libratbag(res->profile->device->ratbag,
+				  "%s: resolution range exceeds available space.\n",
+				  res->profile->device->name);
+
+	ratbag_resolution_set_dpi_list(res, dpis, ndpis);
 }
 
 LIBRATBAG_EXPORT enum ratbag_error_code
@@ -1000,14 +1459,16 @@ ratbag_resolution_set_dpi(struct ratbag_resolution *resolution,
 {
 	struct ratbag_profile *profile = resolution->profile;
 
-	if (!resolution_has_dpi(resolution, dpi))
+	if (!ratbag_resolution_has_dpi(resolution, dpi))
 		return RATBAG_ERROR_VALUE;
 
 	if (resolution->dpi_x != dpi || resolution->dpi_y != dpi) {
 		resolution->dpi_x = dpi;
 		resolution->dpi_y = dpi;
 		resolution->dirty = true;
+		resolution->generation++;
 		profile->dirty = true;
+		profile->generation++;
 	}
 
 	return RATBAG_SUCCESS;
@@ -1026,14 +1487,16 @@ ratbag_resolution_set_dpi_xy(struct ratbag_resolution *resolution,
 	if ((x == 0 && y != 0) || (x != 0 && y == 0))
 		return RATBAG_ERROR_VALUE;
 
-	if (!resolution_has_dpi(resolution, x) || !resolution_has_dpi(resolution, y))
+	if (!ratbag_resolution_has_dpi(resolution, x) || !ratbag_resolution_has_dpi(resolution, y))
 		return RATBAG_ERROR_VALUE;
 
 	if (resolution->dpi_x != x || resolution->dpi_y != y) {
 		resolution->dpi_x = x;
 		resolution->dpi_y = y;
 		resolution->dirty = true;
+		resolution->generation++;
 		profile->dirty = true;
+		profile->generation++;
 	}
 
 	return RATBAG_SUCCESS;
@@ -1046,6 +1509,7 @@ ratbag_profile_set_report_rate(struct ratbag_profile *profile,
 	if (profile->hz != hz) {
 		profile->hz = hz;
 		profile->dirty = true;
+		profile->generation++;
 		profile->rate_dirty = true;
 	}
 
@@ -1059,6 +1523,7 @@ ratbag_profile_set_angle_snapping(struct ratbag_profile *profile,
 	if (profile->angle_snapping != value) {
 		profile->angle_snapping = value;
 		profile->dirty = true;
+		profile->generation++;
 		profile->angle_snapping_dirty = true;
 	}
 
@@ -1072,6 +1537,7 @@ ratbag_profile_set_debounce(struct ratbag_profile *profile,
 	if (profile->debounce != value) {
 		profile->debounce = value;
 		profile->dirty = true;
+		profile->generation++;
 		profile->debounce_dirty = true;
 	}
 
@@ -1089,17 +1555,19 @@ ratbag_resolution_get_dpi_list(const struct ratbag_resolution *resolution,
 			       unsigned int *resolutions,
 			       size_t nres)
 {
-	_Static_assert(sizeof(*resolutions) == sizeof(*resolution->dpis), "type mismatch");
+	const struct ratbag_dpi_table *table = resolution->dpi_table;
+
+	_Static_assert(sizeof(*resolutions) == sizeof(*table->dpis), "type mismatch");
 
 	assert(nres > 0);
 
-	if (resolution->ndpis == 0)
+	if (!table)
 		return 0;
 
-	memcpy(resolutions, resolution->dpis,
-	       sizeof(unsigned int) * min(nres, resolution->ndpis));
+	memcpy(resolutions, table->dpis,
+	       sizeof(unsigned int) * min(nres, table->ndpis));
 
-	return resolution->ndpis;
+	return table->ndpis;
 }
 
 LIBRATBAG_EXPORT int
@@ -1185,12 +1653,17 @@ ratbag_resolution_set_active(struct ratbag_resolution *resolution)
 		return RATBAG_ERROR_VALUE;
 	}
 
-	ratbag_profile_for_each_resolution(profile, res)
+	ratbag_profile_for_each_resolution(profile, res) {
+		if (res->is_active)
+			res->generation++;
 		res->is_active = false;
+	}
 
 	resolution->is_active = true;
 	resolution->dirty = true;
+	resolution->generation++;
 	profile->dirty = true;
+	profile->generation++;
 	return RATBAG_SUCCESS;
 }
 
@@ -1217,14 +1690,19 @@ ratbag_resolution_set_default(struct ratbag_resolution *resolution)
 			continue;
 
 		other->is_default = false;
+		other->generation++;
 		resolution->dirty = true;
+		resolution->generation++;
 		profile->dirty = true;
+		profile->generation++;
 	}
 
 	if (!resolution->is_default) {
 		resolution->is_default = true;
 		resolution->dirty = true;
+		resolution->generation++;
 		profile->dirty = true;
+		profile->generation++;
 	}
 
 	return RATBAG_SUCCESS;
@@ -1236,6 +1714,12 @@ ratbag_resolution_is_disabled(const struct ratbag_resolution *resolution)
 	return !!resolution->is_disabled;
 }
 
+LIBRATBAG_EXPORT unsigned int
+ratbag_resolution_get_generation(const struct ratbag_resolution *resolution)
+{
+	return resolution->generation;
+}
+
 LIBRATBAG_EXPORT enum ratbag_error_code
 ratbag_resolution_set_disabled(struct ratbag_resolution *resolution, bool disable)
 {
@@ -1257,7 +1741,9 @@ ratbag_resolution_set_disabled(struct ratbag_resolution *resolution, bool disabl
 
 	resolution->is_disabled = disable;
 	resolution->dirty = true;
+	resolution->generation++;
 	profile->dirty = true;
+	profile->generation++;
 
 	return RATBAG_SUCCESS;
 }
@@ -1267,22 +1753,13 @@ ratbag_profile_get_button(struct ratbag_profile *profile,
 				   unsigned int index)
 {
 	struct ratbag_device *device = profile->device;
-	struct ratbag_button *button;
 
 	if (index >= ratbag_device_get_num_buttons(device)) {
 		log_bug_client(device->ratbag, "Requested invalid button %d\n", index);
 		return NULL;
 	}
 
-	list_for_each(button, &profile->buttons, link) {
-		if (button->index == index)
-			return ratbag_button_ref(button);
-	}
-
-	log_bug_libratbag(device->ratbag, "Button %d, profile %d not found\n",
-			  index, profile->index);
-
-	return NULL;
+	return ratbag_button_ref(&profile->button_store[index]);
 }
 
 LIBRATBAG_EXPORT enum ratbag_button_action_type
@@ -1291,6 +1768,12 @@ ratbag_button_get_action_type(const struct ratbag_button *button)
 	return button->action.type;
 }
 
+LIBRATBAG_EXPORT unsigned int
+ratbag_button_get_generation(const struct ratbag_button *button)
+{
+	return button->generation;
+}
+
 LIBRATBAG_EXPORT bool
 ratbag_button_has_action_type(const struct ratbag_button *button,
 			      enum ratbag_button_action_type action_type)
@@ -1325,8 +1808,12 @@ ratbag_button_set_action(struct ratbag_button *button,
 	struct ratbag_macro *macro = button->action.macro;
 
 	button->action = *action;
-	if (action->type != RATBAG_BUTTON_ACTION_TYPE_MACRO)
+	if (action->type == RATBAG_BUTTON_ACTION_TYPE_MACRO && action->macro) {
+		button->action.macro = ratbag_macro_ref(action->macro);
+		ratbag_macro_unref(macro);
+	} else {
 		button->action.macro = macro;
+	}
 }
 
 LIBRATBAG_EXPORT enum ratbag_error_code
@@ -1343,7 +1830,9 @@ ratbag_button_set_button(struct ratbag_button *button, unsigned int btn)
 
 	ratbag_button_set_action(button, &action);
 	button->dirty = true;
+	button->generation++;
 	button->profile->dirty = true;
+	button->profile->generation++;
 
 	return RATBAG_SUCCESS;
 }
@@ -1374,7 +1863,9 @@ ratbag_button_set_special(struct ratbag_button *button,
 
 	ratbag_button_set_action(button, &action);
 	button->dirty = true;
+	button->generation++;
 	button->profile->dirty = true;
+	button->profile->generation++;
 
 	return RATBAG_SUCCESS;
 }
@@ -1404,7 +1895,9 @@ ratbag_button_set_key(struct ratbag_button *button, unsigned int key)
 
 	ratbag_button_set_action(button, &action);
 	button->dirty = true;
+	button->generation++;
 	button->profile->dirty = true;
+	button->profile->generation++;
 
 	return RATBAG_SUCCESS;
 }
@@ -1422,7 +1915,9 @@ ratbag_button_disable(struct ratbag_button *button)
 
 	ratbag_button_set_action(button, &action);
 	button->dirty = true;
+	button->generation++;
 	button->profile->dirty = true;
+	button->profile->generation++;
 
 	return RATBAG_SUCCESS;
 }
@@ -1447,32 +1942,6 @@ ratbag_led_ref(struct ratbag_led *led)
 	return led;
 }
 
-static void
-ratbag_button_destroy(struct ratbag_button *button)
-{
-	list_remove(&button->link);
-	if (button->action.macro) {
-		free(button->action.macro->name);
-		free(button->action.macro->group);
-		free(button->action.macro);
-	}
-	free(button);
-}
-
-static void
-ratbag_led_destroy(struct ratbag_led *led)
-{
-	list_remove(&led->link);
-	free(led);
-}
-
-static void
-ratbag_resolution_destroy(struct ratbag_resolution *res)
-{
-	list_remove(&res->link);
-	free(res);
-}
-
 LIBRATBAG_EXPORT struct ratbag_button *
 ratbag_button_unref(struct ratbag_button *button)
 {
@@ -1537,12 +2006,20 @@ ratbag_led_get_brightness(const struct ratbag_led *led)
 	return led->brightness;
 }
 
+LIBRATBAG_EXPORT unsigned int
+ratbag_led_get_generation(const struct ratbag_led *led)
+{
+	return led->generation;
+}
+
 LIBRATBAG_EXPORT enum ratbag_error_code
 ratbag_led_set_mode(struct ratbag_led *led, enum ratbag_led_mode mode)
 {
 	led->mode = mode;
 	led->dirty = true;
+	led->generation++;
 	led->profile->dirty = true;
+	led->profile->generation++;
 	return RATBAG_SUCCESS;
 }
 
@@ -1551,7 +2028,9 @@ ratbag_led_set_color(struct ratbag_led *led, struct ratbag_color color)
 {
 	led->color = color;
 	led->dirty = true;
+	led->generation++;
 	led->profile->dirty = true;
+	led->profile->generation++;
 	return RATBAG_SUCCESS;
 }
 
@@ -1566,7 +2045,9 @@ ratbag_led_set_effect_duration(struct ratbag_led *led, unsigned int ms)
 {
 	led->ms = ms;
 	led->dirty = true;
+	led->generation++;
 	led->profile->dirty = true;
+	led->profile->generation++;
 	return RATBAG_SUCCESS;
 }
 
@@ -1575,7 +2056,9 @@ ratbag_led_set_brightness(struct ratbag_led *led, unsigned int brightness)
 {
 	led->brightness = brightness;
 	led->dirty = true;
+	led->generation++;
 	led->profile->dirty = true;
+	led->profile->generation++;
 	return RATBAG_SUCCESS;
 }
 
@@ -1584,22 +2067,13 @@ ratbag_profile_get_led(struct ratbag_profile *profile,
 		       unsigned int index)
 {
 	struct ratbag_device *device = profile->device;
-	struct ratbag_led *led;
 
 	if (index >= ratbag_device_get_num_leds(device)) {
 		log_bug_client(device->ratbag, "Requested invalid led %d\n", index);
 		return NULL;
 	}
 
-	list_for_each(led, &profile->leds, link) {
-		if (led->index == index)
-			return ratbag_led_ref(led);
-	}
-
-	log_bug_libratbag(device->ratbag, "Led %d, profile %d not found\n",
-			  index, profile->index);
-
-	return NULL;
+	return ratbag_led_ref(&profile->led_store[index]);
 }
 
 LIBRATBAG_EXPORT const char *
@@ -1623,6 +2097,7 @@ ratbag_profile_set_name(struct ratbag_profile *profile,
 
 	profile->name = name_copy;
 	profile->dirty = true;
+	profile->generation++;
 
 	return 0;
 }
@@ -1682,6 +2157,14 @@ ratbag_device_set_firmware_version(struct ratbag_device *device, const char* fw)
 	device->firmware_version = strdup_safe(fw);
 }
 
+LIBRATBAG_EXPORT size_t
+ratbag_device_get_stats(const struct ratbag_device *device,
+			struct ratbag_io_stats *stats,
+			size_t nstats)
+{
+	return ratbag_io_stats_copy(device->io_stats, stats, nstats);
+}
+
 LIBRATBAG_EXPORT void*
 ratbag_profile_get_user_data(const struct ratbag_profile *ratbag_profile)
 {
@@ -1700,40 +2183,248 @@ ratbag_resolution_get_user_data(const struct ratbag_resolution *ratbag_resolutio
 	return ratbag_resolution->userdata;
 }
 
+static uint32_t
+ratbag_macro_hash(const char *name, const char *group,
+		  const struct ratbag_macro_event *events, unsigned int nevents)
+{
+	/* FNV-1a */
+	uint32_t hash = 2166136261u;
+
+#define HASH_BYTE(b_) do { hash ^= (uint8_t)(b_); hash *= 16777619u; } while (0)
+	for (const char *c = name ? name : ""; *c; c++)
+		HASH_BYTE(*c);
+	HASH_BYTE(0);
+	for (const char *c = group ? group : ""; *c; c++)
+		HASH_BYTE(*c);
+	HASH_BYTE(0);
+	for (unsigned int i = 0; i < nevents; i++) {
+		HASH_BYTE(events[i].type);
+		HASH_BYTE(events[i].event.key);
+		HASH_BYTE(events[i].event.key >> 8);
+		HASH_BYTE(events[i].event.key >> 16);
+		HASH_BYTE(events[i].event.key >> 24);
+	}
+#undef HASH_BYTE
+
+	return hash;
+}
+
+static inline bool
+streq_null(const char *a, const char *b)
+{
+	if (!a || !b)
+		return a == b;
+	return streq(a, b);
+}
+
+static bool
+ratbag_macro_equal(const struct ratbag_macro *macro,
+		   const char *name, const char *group,
+		   const struct ratbag_macro_event *events, unsigned int nevents)
+{
+	if (macro->nevents != nevents ||
+	    !streq_null(macro->name, name) ||
+	    !streq_null(macro->group, group))
+		return false;
+
+	for (unsigned int i = 0; i < nevents; i++) {
+		if (macro->events[i].type != events[i].type ||
+		    macro->events[i].event.key != events[i].event.key)
+			return false;
+	}
+
+	return true;
+}
+
+static void
+ratbag_macro_buckets_grow(struct ratbag *ratbag)
+{
+	unsigned int nbuckets = ratbag->nmacro_buckets * 2;
+	struct list *buckets;
+
+	buckets = zalloc(nbuckets * sizeof(*buckets));
+	for (unsigned int i = 0; i < nbuckets; i++)
+		list_init(&buckets[i]);
+
+	for (unsigned int i = 0; i < ratbag->nmacro_buckets; i++) {
+		struct ratbag_macro *macro, *tmp;
+
+		list_for_each_safe(macro, tmp, &ratbag->macro_buckets[i], link) {
+			list_remove(&macro->link);
+			list_insert(&buckets[macro->hash & (nbuckets - 1)],
+				    &macro->link);
+		}
+	}
+
+	free(ratbag->macro_buckets);
+	ratbag->macro_buckets = buckets;
+	ratbag->nmacro_buckets = nbuckets;
+}
+
+/**
+ * Returns a reference to the macro with the given content, creating it if
+ * no such macro exists in this context yet.
+ */
+static struct ratbag_macro *
+ratbag_macro_intern(struct ratbag *ratbag,
+		    const char *name, const char *group,
+		    const struct ratbag_macro_event *events, unsigned int nevents)
+{
+	struct ratbag_macro *macro;
+	struct list *bucket;
+	uint32_t hash;
+	unsigned int i;
+
+	for (i = 0; i < nevents && i < MAX_MACRO_EVENTS; i++) {
+		if (events[i].type == RATBAG_MACRO_EVENT_NONE ||
+		    events[i].type == RATBAG_MACRO_EVENT_INVALID)
+			break;
+	}
+	nevents = i;
+
+	hash = ratbag_macro_hash(name, group, events, nevents);
+
+	pthread_mutex_lock(&ratbag->macro_lock);
+	bucket = &ratbag->macro_buckets[hash & (ratbag->nmacro_buckets - 1)];
+
+	list_for_each(macro, bucket, link) {
+		if (macro->hash == hash &&
+		    ratbag_macro_equal(macro, name, group, events, nevents)) {
+			ratbag_macro_ref(macro);
+			pthread_mutex_unlock(&ratbag->macro_lock);
+			return macro;
+		}
+	}
+
+	/* zalloc leaves the terminating event as RATBAG_MACRO_EVENT_NONE */
+	macro = zalloc(sizeof(*macro) + (nevents + 1) * sizeof(macro->events[0]));
+	macro->refcount = 1;
+	macro->hash = hash;
+	macro->ratbag = ratbag;
+	macro->name = strdup_safe(name);
+	macro->group = strdup_safe(group);
+	macro->nevents = nevents;
+	if (nevents)
+		memcpy(macro->events, events, nevents * sizeof(macro->events[0]));
+	list_insert(bucket, &macro->link);
+
+	if (++ratbag->nmacros > 2 * ratbag->nmacro_buckets)
+		ratbag_macro_buckets_grow(ratbag);
+	pthread_mutex_unlock(&ratbag->macro_lock);
+
+	return macro;
+}
+
+struct ratbag_macro *
+ratbag_macro_ref(struct ratbag_macro *macro)
+{
+	if (macro == NULL)
+		return NULL;
+
+	assert(__atomic_load_n(&macro->refcount, __ATOMIC_RELAXED) < INT_MAX);
+
+	/* the caller holds a reference, so this never revives a macro
+	 * that is being removed */
+	__atomic_add_fetch(&macro->refcount, 1, __ATOMIC_RELAXED);
+	return macro;
+}
+
+struct ratbag_macro *
+ratbag_macro_unref(struct ratbag_macro *macro)
+{
+	struct ratbag *ratbag;
+	bool last;
+
+	if (macro == NULL)
+		return NULL;
+
+	assert(__atomic_load_n(&macro->refcount, __ATOMIC_RELAXED) > 0);
+
+	/* under the lock, so ratbag_macro_intern() can't find and ref the
+	 * macro between the last unref and its removal */
+	ratbag = macro->ratbag;
+	if (ratbag)
+		pthread_mutex_lock(&ratbag->macro_lock);
+	last = __atomic_sub_fetch(&macro->refcount, 1, __ATOMIC_ACQ_REL) == 0;
+	if (last) {
+		list_remove(&macro->link);
+		if (ratbag)
+			ratbag->nmacros--;
+	}
+	if (ratbag)
+		pthread_mutex_unlock(&ratbag->macro_lock);
+
+	if (last) {
+		free(macro->name);
+		free(macro->group);
+		free(macro);
+	}
+
+	return NULL;
+}
+
+static inline void
+ratbag_button_replace_macro(struct ratbag_button *button,
+			    struct ratbag_macro *macro)
+{
+	ratbag_macro_unref(button->action.macro);
+	button->action.type = RATBAG_BUTTON_ACTION_TYPE_MACRO;
+	button->action.macro = macro;
+}
+
 LIBRATBAG_EXPORT struct ratbag_button_macro *
 ratbag_button_get_macro(struct ratbag_button *button)
 {
 	struct ratbag_button_macro *macro;
 
-	if (button->action.type != RATBAG_BUTTON_ACTION_TYPE_MACRO)
+	if (button->action.type != RATBAG_BUTTON_ACTION_TYPE_MACRO ||
+	    !button->action.macro)
 		return NULL;
 
 	macro = ratbag_button_macro_new(button->action.macro->name);
-	memcpy(macro->macro.events,
-	       button->action.macro->events,
-	       sizeof(macro->macro.events));
+	macro->group = strdup_safe(button->action.macro->group);
+	macro->shared = ratbag_macro_ref(button->action.macro);
 
 	return macro;
 }
 
+void
+ratbag_button_set_macro_events(struct ratbag_button *button,
+			       const char *name,
+			       const char *group,
+			       const struct ratbag_macro_event *events,
+			       unsigned int nevents)
+{
+	struct ratbag *ratbag = button->profile->device->ratbag;
+
+	ratbag_button_replace_macro(button,
+				    ratbag_macro_intern(ratbag, name, group,
+							events, nevents));
+}
+
 void
 ratbag_button_copy_macro(struct ratbag_button *button,
 			 const struct ratbag_button_macro *macro)
 {
-	if (!button->action.macro)
-		button->action.macro = zalloc(sizeof(struct ratbag_macro));
-	else {
-		free(button->action.macro->name);
-		free(button->action.macro->group);
-		memset(button->action.macro, 0, sizeof(struct ratbag_macro));
+	/* unmodified copy of a stored macro, share it */
+	if (!macro->events && macro->shared &&
+	    streq_null(macro->name, macro->shared->name) &&
+	    streq_null(macro->group, macro->shared->group)) {
+		ratbag_button_replace_macro(button,
+					    ratbag_macro_ref(macro->shared));
+		return;
 	}
 
-	button->action.type = RATBAG_BUTTON_ACTION_TYPE_MACRO;
-	memcpy(button->action.macro->events,
-	       macro->macro.events,
-	       sizeof(macro->macro.events));
-	button->action.macro->name = strdup_safe(macro->macro.name);
-	button->action.macro->group = strdup_safe(macro->macro.group);
+	if (macro->events)
+		ratbag_button_set_macro_events(button, macro->name, macro->group,
+					       macro->events, MAX_MACRO_EVENTS);
+	else if (macro->shared)
+		ratbag_button_set_macro_events(button, macro->name, macro->group,
+					       macro->shared->events,
+					       macro->shared->nevents);
+	else
+		ratbag_button_set_macro_events(button, macro->name, macro->group,
+					       NULL, 0);
 }
 
 LIBRATBAG_EXPORT enum ratbag_error_code
@@ -1746,18 +2437,37 @@ ratbag_button_set_macro(struct ratbag_button *button,
 
 	ratbag_button_copy_macro(button, macro);
 	button->dirty = true;
+	button->generation++;
 	button->profile->dirty = true;
+	button->profile->generation++;
 
 	return RATBAG_SUCCESS;
 }
 
+static const struct ratbag_macro_event *
+ratbag_button_macro_get_event(const struct ratbag_button_macro *macro,
+			      unsigned int index)
+{
+	static const struct ratbag_macro_event none = {
+		.type = RATBAG_MACRO_EVENT_NONE,
+	};
+
+	if (macro->events)
+		return &macro->events[index];
+
+	if (macro->shared && index < macro->shared->nevents)
+		return &macro->shared->events[index];
+
+	return &none;
+}
+
 LIBRATBAG_EXPORT enum ratbag_error_code
-ratbag_button_macro_set_event(struct ratbag_button_macro *m,
+ratbag_button_macro_set_event(struct ratbag_button_macro *macro,
 			      unsigned int index,
 			      enum ratbag_macro_event_type type,
 			      unsigned int data)
 {
-	struct ratbag_macro *macro = &m->macro;
+	struct ratbag_macro_event *event;
 
 	if (index >= MAX_MACRO_EVENTS)
 		return RATBAG_ERROR_VALUE;
@@ -1765,20 +2475,37 @@ ratbag_button_macro_set_event(struct ratbag_button_macro *m,
 	switch (type) {
 	case RATBAG_MACRO_EVENT_KEY_PRESSED:
 	case RATBAG_MACRO_EVENT_KEY_RELEASED:
-		macro->events[index].type = type;
-		macro->events[index].event.key = data;
-		break;
 	case RATBAG_MACRO_EVENT_WAIT:
-		macro->events[index].type = type;
-		macro->events[index].event.timeout = data;
-		break;
 	case RATBAG_MACRO_EVENT_NONE:
-		macro->events[index].type = type;
 		break;
 	default:
 		return RATBAG_ERROR_VALUE;
 	}
 
+	/* copy on first write */
+	if (!macro->events) {
+		macro->events = zalloc(MAX_MACRO_EVENTS * sizeof(*macro->events));
+		if (macro->shared) {
+			memcpy(macro->events, macro->shared->events,
+			       macro->shared->nevents * sizeof(*macro->events));
+			macro->shared = ratbag_macro_unref(macro->shared);
+		}
+	}
+
+	event = &macro->events[index];
+	event->type = type;
+	switch (type) {
+	case RATBAG_MACRO_EVENT_KEY_PRESSED:
+	case RATBAG_MACRO_EVENT_KEY_RELEASED:
+		event->event.key = data;
+		break;
+	case RATBAG_MACRO_EVENT_WAIT:
+		event->event.timeout = data;
+		break;
+	default:
+		break;
+	}
+
 	return 0;
 }
 
@@ -1789,58 +2516,72 @@ ratbag_button_macro_get_event_type(const struct ratbag_button_macro *macro,
 	if (index >= MAX_MACRO_EVENTS)
 		return RATBAG_MACRO_EVENT_INVALID;
 
-	return macro->macro.events[index].type;
+	return ratbag_button_macro_get_event(macro, index)->type;
 }
 
 LIBRATBAG_EXPORT int
-ratbag_button_macro_get_event_key(const struct ratbag_button_macro *m,
+ratbag_button_macro_get_event_key(const struct ratbag_button_macro *macro,
 				  unsigned int index)
 {
-	const struct ratbag_macro *macro = &m->macro;
+	const struct ratbag_macro_event *event;
 
 	if (index >= MAX_MACRO_EVENTS)
 		return 0;
 
-	if (macro->events[index].type != RATBAG_MACRO_EVENT_KEY_PRESSED &&
-	    macro->events[index].type != RATBAG_MACRO_EVENT_KEY_RELEASED)
+	event = ratbag_button_macro_get_event(macro, index);
+	if (event->type != RATBAG_MACRO_EVENT_KEY_PRESSED &&
+	    event->type != RATBAG_MACRO_EVENT_KEY_RELEASED)
 		return -EINVAL;
 
-	return macro->events[index].event.key;
+	return event->event.key;
 }
 
 LIBRATBAG_EXPORT int
-ratbag_button_macro_get_event_timeout(const struct ratbag_button_macro *m,
+ratbag_button_macro_get_event_timeout(const struct ratbag_button_macro *macro,
 				      unsigned int index)
 {
-	const struct ratbag_macro *macro = &m->macro;
+	const struct ratbag_macro_event *event;
 
 	if (index >= MAX_MACRO_EVENTS)
 		return 0;
 
-	if (macro->events[index].type != RATBAG_MACRO_EVENT_WAIT)
+	event = ratbag_button_macro_get_event(macro, index);
+	if (event->type != RATBAG_MACRO_EVENT_WAIT)
 		return 0;
 
-	return macro->events[index].event.timeout;
+	return event->event.timeout;
 }
 
 LIBRATBAG_EXPORT unsigned int
 ratbag_button_macro_get_num_events(const struct ratbag_button_macro *macro)
 {
-	return MAX_MACRO_EVENTS;
+	unsigned int nevents = 0;
+
+	if (macro->events) {
+		while (nevents < MAX_MACRO_EVENTS &&
+		       macro->events[nevents].type != RATBAG_MACRO_EVENT_NONE)
+			nevents++;
+	} else if (macro->shared) {
+		nevents = macro->shared->nevents;
+	}
+
+	return nevents;
 }
 
 LIBRATBAG_EXPORT const char *
 ratbag_button_macro_get_name(const struct ratbag_button_macro *macro)
 {
-	return macro->macro.name;
+	return macro->name;
 }
 
 static void
 ratbag_button_macro_destroy(struct ratbag_button_macro *macro)
 {
 	assert(macro->refcount == 0);
-	free(macro->macro.name);
-	free(macro->macro.group);
+	ratbag_macro_unref(macro->shared);
+	free(macro->events);
+	free(macro->name);
+	free(macro->group);
 	free(macro);
 }
 
@@ -1874,7 +2615,7 @@ ratbag_button_macro_new(const char *name)
 
 	macro = zalloc(sizeof *macro);
 	macro->refcount = 1;
-	macro->macro.name = strdup_safe(name);
+	macro->name = strdup_safe(name);
 
 	return macro;
 }
@@ -1943,7 +2684,7 @@ ratbag_action_macro_num_keys(const struct ratbag_button_action *action)
 {
 	const struct ratbag_macro *macro = action->macro;
 	int count = 0;
-	for (int i = 0; i < MAX_MACRO_EVENTS; i++) {
+	for (unsigned int i = 0; i < macro->nevents; i++) {
 		struct ratbag_macro_event event = macro->events[i];
 		if (event.type == RATBAG_MACRO_EVENT_NONE ||
 		    event.type == RATBAG_MACRO_EVENT_INVALID) {
@@ -1978,7 +2719,8 @@ ratbag_action_keycode_from_macro(const struct ratbag_button_action *action,
 	if (ratbag_action_macro_num_keys(action) != 1)
 		return -EINVAL;
 
-	for (i = 0; i < MAX_MACRO_EVENTS; i++) {
+	/* the event after the last one is always RATBAG_MACRO_EVENT_NONE */
+	for (i = 0; i <= macro->nevents; i++) {
 		struct ratbag_macro_event event;
 
 		event = macro->events[i];
@@ -139,6 +139,37 @@ struct ratbag_color {
 	unsigned int blue;
 };
 
+#define RATBAG_IO_LATENCY_BUCKETS 12
+
+/**
+ * @ingroup device
+ * @struct ratbag_io_stats
+ *
+ * I/O statistics for one type of request to a device, see
+ * ratbag_device_get_stats().
+ */
+struct ratbag_io_stats {
+	enum ratbag_io_request_type type;
+	/** type-specific identifier, see @ref ratbag_io_request_type */
+	unsigned int id;
+	uint64_t requests;
+	/** failed requests, including timeouts */
+	uint64_t errors;
+	uint64_t timeouts;
+	/** number of times the wait for a reply was extended */
+	uint64_t retries;
+	uint64_t bytes_sent;
+	uint64_t bytes_received;
+	/** sum of all latencies in us */
+	uint64_t latency_total_us;
+	/**
+	 * latency histogram: bucket 0 counts requests below 1ms, bucket n
+	 * counts requests in [2^(n-1), 2^n) ms, the last bucket counts
+	 * everything above.
+	 */
+	uint64_t latency[RATBAG_IO_LATENCY_BUCKETS];
+};
+
 /**
  * @ingroup led
  * @struct ratbag_led
@@ -248,6 +279,57 @@ void
 ratbag_log_set_handler(struct ratbag *ratbag,
 		       ratbag_log_handler log_handler);
 
+/**
+ * @ingroup base
+ *
+ * Enable the binary trace of the HID traffic of all devices of this
+ * context. The last nrecords reports sent to or received from the devices
+ * are kept in memory and can be written out with ratbag_trace_write().
+ * Each record holds the timestamp, the latency of the reply and the first
+ * bytes of the report.
+ *
+ * Calling this function discards previously recorded traffic. An nrecords
+ * of 0 disables the trace, this is the default.
+ *
+ * @param ratbag A previously initialized ratbag context
+ * @param nrecords The number of records to keep
+ * @return 0 on success or a negative errno on failure
+ */
+int
+ratbag_trace_enable(struct ratbag *ratbag, unsigned int nrecords);
+
+/**
+ * @ingroup base
+ *
+ * Write the recorded HID traffic to the given file descriptor, oldest
+ * record first. See libratbag-trace.h for the file format, the
+ * ratbag-trace tool decodes these files.
+ *
+ * @param ratbag A previously initialized ratbag context
+ * @param fd The file descriptor to write to
+ * @return 0 on success or a negative errno on failure
+ */
+int
+ratbag_trace_write(struct ratbag *ratbag, int fd);
+
+/**
+ * @ingroup base
+ *
+ * Enable the device state cache in the given directory, creating it if
+ * needed. Drivers store raw device memory there that is expensive to read,
+ * e.g. flash pages, and only re-read what changed the next time the device
+ * is probed, possibly by another process.
+ *
+ * The cache is disabled by default, a directory of NULL disables it.
+ * Devices that were already probed are not affected.
+ *
+ * @param ratbag A previously initialized ratbag context
+ * @param directory The cache directory or NULL
+ * @return 0 on success or a negative errno on failure
+ */
+int
+ratbag_cache_enable(struct ratbag *ratbag, const char *directory);
+
 
 /**
  * @ingroup base
@@ -441,6 +523,26 @@ ratbag_device_set_firmware_version(struct ratbag_device *device, const char* fw)
 const char*
 ratbag_device_get_firmware_version(const struct ratbag_device *device);
 
+/**
+ * @ingroup device
+ *
+ * Fills stats with the I/O statistics of this device, one entry per
+ * request type and ID seen so far. At most nstats entries are filled in,
+ * the return value is the number of entries available, so a caller may
+ * pass nstats of 0 to query the required size.
+ *
+ * The statistics are collected for the lifetime of the device.
+ *
+ * @param device A previously initialized ratbag device
+ * @param stats Array of at least nstats elements to fill
+ * @param nstats The number of elements in stats
+ * @return The number of statistics entries available for this device
+ */
+size_t
+ratbag_device_get_stats(const struct ratbag_device *device,
+			struct ratbag_io_stats *stats,
+			size_t nstats);
+
 /**
  * @ingroup device
  *
@@ -512,6 +614,104 @@ ratbag_device_get_product_version(const struct ratbag_device *device);
 enum ratbag_error_code
 ratbag_device_commit(struct ratbag_device *device);
 
+/**
+ * @ingroup device
+ *
+ * Release the device nodes while the device is idle. The device, its
+ * profiles, resolutions, buttons and LEDs stay valid and can be queried
+ * and modified as usual. The nodes are reopened by the next
+ * ratbag_device_commit(), which fails if the device node is gone or now
+ * belongs to a different device.
+ *
+ * @param device A previously initialized ratbag device
+ * @return 0 on success or an error code otherwise
+ */
+enum ratbag_error_code
+ratbag_device_suspend(struct ratbag_device *device);
+
+/**
+ * @ingroup device
+ *
+ * Reopen the device nodes released by ratbag_device_suspend(). This is a
+ * no-op if the device is not suspended. ratbag_device_commit() resumes
+ * the device itself, calling this first allows a caller to do the device
+ * lookup in the thread that owns the ratbag context and the commit
+ * elsewhere.
+ *
+ * If the driver supports it, the device is checked for changes made while
+ * it was released, e.g. by another tool. Profiles, resolutions, buttons
+ * and LEDs that are not dirty are then re-read from the device and their
+ * generation changes.
+ *
+ * @param device A previously initialized ratbag device
+ * @return 0 on success or an error code otherwise
+ */
+enum ratbag_error_code
+ratbag_device_resume(struct ratbag_device *device);
+
+/**
+ * @ingroup device
+ *
+ * The format used by ratbag_device_export().
+ */
+enum ratbag_export_format {
+	/**
+	 * A compact, versioned binary format.
+	 */
+	RATBAG_EXPORT_FORMAT_BINARY,
+	/**
+	 * A JSON view of the same data, for inspection and editing.
+	 */
+	RATBAG_EXPORT_FORMAT_JSON,
+};
+
+/**
+ * @ingroup device
+ *
+ * Serialize the state of all profiles of this device, i.e. their
+ * resolutions, buttons and LEDs, for use with ratbag_device_import() on
+ * this or another device with the same layout. The data contains no
+ * information identifying the device. Uncommitted changes are included.
+ *
+ * @param device A previously initialized ratbag device
+ * @param format The format to export in
+ * @param[out] data Set to the exported data, to be released with free()
+ * @param[out] size Set to the size of data in bytes. For @ref
+ * RATBAG_EXPORT_FORMAT_JSON the data is also null-terminated.
+ * @return 0 on success or an error code otherwise
+ */
+enum ratbag_error_code
+ratbag_device_export(struct ratbag_device *device,
+		     enum ratbag_export_format format,
+		     void **data, size_t *size);
+
+/**
+ * @ingroup device
+ *
+ * Apply data previously exported with ratbag_device_export(), in either
+ * format. The device must have the same number of profiles, resolutions,
+ * buttons and LEDs as the exported one.
+ *
+ * Only the values that differ from the current state are changed, so only
+ * those objects are marked as dirty. Call ratbag_device_commit() to write
+ * the changes to the device.
+ *
+ * The data is validated against the device before anything is changed, if
+ * an error is returned the device state is unmodified.
+ *
+ * @param device A previously initialized ratbag device
+ * @param data The exported data
+ * @param size The size of data in bytes
+ * @return 0 on success or an error code otherwise
+ * @retval RATBAG_ERROR_VALUE The data is invalid, has a different layout or
+ * contains a value not supported by the device
+ * @retval RATBAG_ERROR_CAPABILITY The data requires a change the device does
+ * not support
+ */
+enum ratbag_error_code
+ratbag_device_import(struct ratbag_device *device,
+		     const void *data, size_t size);
+
 /**
  * @ingroup device
  *
@@ -715,6 +915,21 @@ ratbag_profile_is_active(const struct ratbag_profile *profile);
 bool
 ratbag_profile_is_dirty(const struct ratbag_profile *profile);
 
+/**
+ * @ingroup profile
+ *
+ * Get the generation counter of this profile. The counter changes whenever
+ * the state of the profile changes, either through a setter or because the
+ * device was committed or re-read. Callers can cache anything derived from the
+ * profile as long as the generation stays the same.
+ *
+ * @param profile A previously initialized ratbag profile
+ *
+ * @return The current generation of the profile
+ */
+unsigned int
+ratbag_profile_get_generation(const struct ratbag_profile *profile);
+
 /**
  * @ingroup profile
  *
@@ -1190,6 +1405,21 @@ ratbag_resolution_set_disabled(struct ratbag_resolution *resolution, bool disabl
 bool
 ratbag_resolution_is_disabled(const struct ratbag_resolution *resolution);
 
+/**
+ * @ingroup resolution
+ *
+ * Get the generation counter of this resolution. The counter changes whenever
+ * the state of the resolution changes, either through a setter or because the
+ * device was committed or re-read. Callers can cache anything derived from the
+ * resolution as long as the generation stays the same.
+ *
+ * @param resolution A previously initialized ratbag resolution
+ *
+ * @return The current generation of the resolution
+ */
+unsigned int
+ratbag_resolution_get_generation(const struct ratbag_resolution *resolution);
+
 /**
  * @ingroup profile
  *
@@ -1245,6 +1475,21 @@ ratbag_button_get_user_data(const struct ratbag_button *button);
 enum ratbag_button_action_type
 ratbag_button_get_action_type(const struct ratbag_button *button);
 
+/**
+ * @ingroup button
+ *
+ * Get the generation counter of this button. The counter changes whenever
+ * the state of the button changes, either through a setter or because the
+ * device was committed or re-read. Callers can cache anything derived from the
+ * button as long as the generation stays the same.
+ *
+ * @param button A previously initialized ratbag button
+ *
+ * @return The current generation of the button
+ */
+unsigned int
+ratbag_button_get_generation(const struct ratbag_button *button);
+
 /**
  * @ingroup button
  *
@@ -1423,6 +1668,21 @@ ratbag_led_get_effect_duration(const struct ratbag_led *led);
 unsigned int
 ratbag_led_get_brightness(const struct ratbag_led *led);
 
+/**
+ * @ingroup led
+ *
+ * Get the generation counter of this LED. The counter changes whenever
+ * the state of the LED changes, either through a setter or because the
+ * device was committed or re-read. Callers can cache anything derived from the
+ * LED as long as the generation stays the same.
+ *
+ * @param led A previously initialized ratbag LED
+ *
+ * @return The current generation of the LED
+ */
+unsigned int
+ratbag_led_get_generation(const struct ratbag_led *led);
+
 /**
  * @ingroup led
  *
@@ -1562,7 +1822,8 @@ ratbag_button_macro_get_name(const struct ratbag_button_macro *macro);
  *
  * @param macro A previously initialized ratbag button macro
  *
- * @return The maximum number of events that can be assigned to this macro
+ * @return The number of events in this macro, i.e. the index of the first
+ * @ref RATBAG_MACRO_EVENT_NONE event
  */
 unsigned int
 ratbag_button_macro_get_num_events(const struct ratbag_button_macro *macro);
@@ -1573,8 +1834,10 @@ ratbag_button_macro_get_num_events(const struct ratbag_button_macro *macro);
  * Returns the macro event type configured for the event at the
  * given index.
  *
- * The behavior of this function for an index equal to or greater than the
- * return value of ratbag_button_macro_get_num_events() is undefined.
+ * For an index equal to or greater than the return value of
+ * ratbag_button_macro_get_num_events() this function returns @ref
+ * RATBAG_MACRO_EVENT_NONE, or @ref RATBAG_MACRO_EVENT_INVALID past the
+ * maximum macro length.
  *
  * @param macro A previously initialized ratbag button macro
  * @param index An index of the event within the macro we are interested in.
@@ -1683,10 +1946,11 @@ ratbag_button_get_macro(struct ratbag_button *button);
  * @ingroup button
  *
  * Sets the macro's event at the given index to the given type with the
- * key code or timeout given.
+ * key code or timeout given. A macro holds up to 256 events, the events
+ * after the first @ref RATBAG_MACRO_EVENT_NONE are ignored.
  *
- * The behavior of this function for an index equal to or greater than the
- * return value of ratbag_button_macro_get_num_events() is undefined.
+ * @return 0 on success or @ref RATBAG_ERROR_VALUE if the index or type is
+ * invalid
  */
 enum ratbag_error_code
 ratbag_button_macro_set_event(struct ratbag_button_macro *macro,
@@ -0,0 +1,123 @@
+/*
+ * Copyright © 2026 Red Hat, Inc.
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Measures the offline onboard profile codec: encoding a profile into a
+ * sector image (including the CRC), decoding it back, and checking the
+ * CRC alone. Useful to size offline batch jobs that prepare profile
+ * images for many devices.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hidpp20.h"
+#include "libratbag-util.h"
+
+#define ITERATIONS 200000
+#define SECTOR_SIZE 255
+
+static struct hidpp20_profiles profiles = {
+	.num_buttons = 16,
+	.num_leds = HIDPP20_LED_COUNT,
+	.sector_size = SECTOR_SIZE,
+};
+
+static struct hidpp20_profile profile;
+static uint8_t sector[SECTOR_SIZE];
+
+static void
+setup_profile(void)
+{
+	unsigned int i;
+
+	profile.report_rate = 1000;
+	profile.default_dpi = 1;
+	profile.switched_dpi = 0;
+	for (i = 0; i < HIDPP20_DPI_COUNT; i++)
+		profile.dpi[i] = 400 * (i + 1);
+	snprintf(profile.name, sizeof(profile.name), "benchmark profile");
+
+	for (i = 0; i < profiles.num_buttons; i++) {
+		profile.buttons[i].button.type = HIDPP20_BUTTON_HID_TYPE;
+		profile.buttons[i].button.subtype = HIDPP20_BUTTON_HID_TYPE_MOUSE;
+		profile.buttons[i].button.buttons = i + 1;
+	}
+
+	for (i = 0; i < profiles.num_leds; i++) {
+		profile.leds[i].mode = HIDPP20_LED_BREATHING;
+		profile.leds[i].color.red = 0xff;
+		profile.leds[i].period = 2000;
+		profile.leds[i].brightness = 50;
+	}
+}
+
+static void
+encode(void)
+{
+	hidpp20_onboard_profiles_encode_profile(&profiles, &profile, sector);
+}
+
+static void
+decode(void)
+{
+	hidpp20_onboard_profiles_decode_profile(&profiles, sector, &profile);
+}
+
+static void
+check_crc(void)
+{
+	if (!hidpp20_onboard_profiles_sector_crc_is_valid(sector, SECTOR_SIZE))
+		abort();
+}
+
+static void
+bench(const char *name, void (*func)(void))
+{
+	uint64_t start, end;
+	double ns;
+
+	start = now(CLOCK_MONOTONIC);
+	for (unsigned int i = 0; i < ITERATIONS; i++)
+		func();
+	end = now(CLOCK_MONOTONIC);
+
+	ns = (double)(end - start) / ITERATIONS;
+	printf("%-16s %10.1f ns/sector %10.1f MB/s\n", name, ns,
+	       SECTOR_SIZE * 1000.0 / ns);
+}
+
+int
+main(void)
+{
+	setup_profile();
+
+	bench("encode", encode);
+	bench("decode", decode);
+	bench("crc", check_crc);
+
+	return EXIT_SUCCESS;
+}
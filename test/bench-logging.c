@@ -0,0 +1,152 @@
+/*
+ * Copyright © 2026 Red Hat, Inc.
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Measures the logging overhead per HID++ request with RAW logging
+ * disabled (the default) and enabled. Each iteration logs what the
+ * transport logs for one request: the hidraw write, the HID++ write and
+ * the HID++ read.
+ *
+ * The "unconditional" row formats the buffers the way the transport did
+ * before the priority was checked up front.
+ */
+
+#include <config.h>
+
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "libratbag-private.h"
+#include "hidpp-generic.h"
+
+#define ITERATIONS 200000
+
+static int
+open_restricted(const char *path, int flags, void *user_data)
+{
+	int fd = open(path, flags);
+
+	return fd < 0 ? -errno : fd;
+}
+
+static void
+close_restricted(int fd, void *user_data)
+{
+	close(fd);
+}
+
+static const struct ratbag_interface iface = {
+	.open_restricted = open_restricted,
+	.close_restricted = close_restricted,
+};
+
+static void
+ratbag_discard(struct ratbag *ratbag, enum ratbag_log_priority priority,
+	       const char *format, va_list args)
+{
+}
+
+static void
+hidpp_discard(void *userdata, enum hidpp_log_priority priority,
+	      const char *format, va_list args)
+{
+}
+
+static uint8_t request[LONG_MESSAGE_LENGTH] = {
+	0x11, 0xff, 0x0b, 0x18, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+	0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10,
+};
+
+static void
+log_request(struct ratbag *ratbag, struct hidpp_device *dev)
+{
+	log_buf_raw(ratbag, "output report: ", request, sizeof(request));
+	hidpp_log_buf_raw(dev, "hidpp write: ", request, sizeof(request));
+	hidpp_log_buf_raw(dev, "hidpp read:  ", request, sizeof(request));
+}
+
+static void
+log_request_unconditional(struct ratbag *ratbag, struct hidpp_device *dev)
+{
+	for (int i = 0; i < 3; i++) {
+		_cleanup_free_ char *bytes = NULL;
+		_cleanup_free_ char *output_buf = NULL;
+
+		bytes = hidpp_buffer_to_string(request, sizeof(request));
+		if (asprintf(&output_buf, "%s %s", "hidpp write: ", bytes) < 0)
+			abort();
+		log_raw(ratbag, "%s\n", output_buf);
+	}
+}
+
+static void
+bench(const char *name,
+      void (*func)(struct ratbag *ratbag, struct hidpp_device *dev),
+      struct ratbag *ratbag, struct hidpp_device *dev)
+{
+	uint64_t start, end;
+
+	start = now(CLOCK_MONOTONIC);
+	for (unsigned int i = 0; i < ITERATIONS; i++)
+		func(ratbag, dev);
+	end = now(CLOCK_MONOTONIC);
+
+	printf("%-32s %10.1f ns/request\n", name,
+	       (double)(end - start) / ITERATIONS);
+}
+
+int
+main(void)
+{
+	struct ratbag *ratbag;
+	struct hidpp_device dev;
+
+	ratbag = ratbag_create_context(&iface, NULL);
+	if (!ratbag)
+		return EXIT_FAILURE;
+
+	ratbag_log_set_handler(ratbag, ratbag_discard);
+	hidpp_device_init(&dev, -1);
+
+	printf("compiled-in minimum log priority: %d\n", RATBAG_LOG_PRIORITY_MIN);
+
+	ratbag_log_set_priority(ratbag, RATBAG_LOG_PRIORITY_INFO);
+	hidpp_device_set_log_handler(&dev, hidpp_discard,
+				     HIDPP_LOG_PRIORITY_INFO, NULL);
+	bench("RAW disabled", log_request, ratbag, &dev);
+	bench("RAW disabled, unconditional", log_request_unconditional,
+	      ratbag, &dev);
+
+	ratbag_log_set_priority(ratbag, RATBAG_LOG_PRIORITY_RAW);
+	hidpp_device_set_log_handler(&dev, hidpp_discard,
+				     HIDPP_LOG_PRIORITY_RAW, NULL);
+	bench("RAW enabled", log_request, ratbag, &dev);
+
+	ratbag_unref(ratbag);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,231 @@
+/*
+ * Copyright © 2026 Red Hat, Inc.
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Measures how many test devices per second ratbagd's devel mode can load
+ * through LoadTestDevice(): parsing the JSON description alone, and
+ * parsing plus creating the libratbag test device. The bus registration
+ * is not included, it doesn't depend on the JSON.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "libratbag-util.h"
+#include "ratbagd.h"
+#include "ratbagd-json.h"
+
+#define ITERATIONS 20000
+
+void log_info(const char *fmt, ...) { }
+void log_verbose(const char *fmt, ...) { }
+
+void log_error(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+}
+
+static int
+open_restricted(const char *path, int flags, void *user_data)
+{
+	int fd = open(path, flags);
+
+	return fd < 0 ? -errno : fd;
+}
+
+static void
+close_restricted(int fd, void *user_data)
+{
+	close(fd);
+}
+
+static const struct ratbag_interface interface = {
+	.open_restricted = open_restricted,
+	.close_restricted = close_restricted,
+};
+
+/* same as ratbagd's default test device */
+static const struct ratbag_test_device default_device = {
+	.num_profiles = 1,
+	.num_resolutions = 1,
+	.num_buttons = 1,
+	.num_leds = 0,
+	.profiles = {
+		{
+			.buttons = {
+				{ .action_type = RATBAG_BUTTON_ACTION_TYPE_BUTTON,
+				  .button = 0 },
+			},
+			.resolutions = {
+				{ .xres = 1000, .yres = 1000,
+				  .dpi_min = 1000, .dpi_max = 1000},
+			},
+			.active = true,
+			.dflt = true,
+			.hz = 1000,
+			.report_rates = {1000},
+		},
+	},
+};
+
+static const char *minimal_json =
+	"{\"profiles\": [{\"is_active\": true, \"is_default\": true}]}";
+
+static char full_json[65536];
+
+/* a device close to the test device limits with every key in use */
+static void
+setup_full_json(void)
+{
+	static const char *specials[] = {
+		"wheel-up", "wheel-down", "resolution-cycle-up",
+		"profile-cycle-up", "battery-level",
+	};
+	size_t len = 0;
+
+#define append(...) \
+	len += snprintf(full_json + len, sizeof(full_json) - len, __VA_ARGS__)
+
+	append("{\"profiles\": [");
+	for (int p = 0; p < 5; p++) {
+		append("%s{\"name\": \"profile %d\", \"is_active\": %s, "
+		       "\"is_default\": %s, \"is_disabled\": false, "
+		       "\"rate\": 1000, \"report_rates\": [125, 250, 500, 1000], "
+		       "\"capabilities\": [1, 2], \"resolutions\": [",
+		       p ? ", " : "", p, p ? "false" : "true", p ? "false" : "true");
+		for (int r = 0; r < RATBAG_TEST_MAX_RESOLUTIONS; r++)
+			append("%s{\"xres\": %d, \"yres\": %d, \"dpi_min\": 100, "
+			       "\"dpi_max\": 16000, \"is_active\": %s, "
+			       "\"is_default\": %s, \"capabilities\": [1]}",
+			       r ? ", " : "", 400 * (r + 1), 400 * (r + 1),
+			       r ? "false" : "true", r ? "false" : "true");
+		append("], \"buttons\": [");
+		for (int b = 0; b < 20; b++) {
+			const char *sep = b ? ", " : "";
+
+			switch (b % 4) {
+			case 0:
+				append("%s{\"action_type\": \"button\", \"button\": %d}",
+				       sep, b % 32);
+				break;
+			case 1:
+				append("%s{\"action_type\": \"key\", \"key\": %d}",
+				       sep, 30 + b);
+				break;
+			case 2:
+				append("%s{\"action_type\": \"special\", \"special\": \"%s\"}",
+				       sep, specials[b % ARRAY_LENGTH(specials)]);
+				break;
+			case 3:
+				append("%s{\"action_type\": \"macro\", "
+				       "\"macro\": [\"+A\", \"-A\", \"t100\", \"+B\", \"-B\"]}",
+				       sep);
+				break;
+			}
+		}
+		append("], \"leds\": [");
+		for (int l = 0; l < 4; l++)
+			append("%s{\"mode\": %d, \"color\": [255, 128, 0], "
+			       "\"duration\": 1000, \"brightness\": 50}",
+			       l ? ", " : "", l % 4);
+		append("]}");
+	}
+	append("]}");
+
+#undef append
+
+	if (len >= sizeof(full_json))
+		abort();
+}
+
+static void
+free_names(struct ratbag_test_device *td)
+{
+	for (unsigned int i = 0; i < ARRAY_LENGTH(td->profiles); i++)
+		free(td->profiles[i].name);
+}
+
+static void
+bench(const char *name, const char *json, struct ratbag *ratbag)
+{
+	uint64_t start, end;
+	double us;
+
+	start = now(CLOCK_MONOTONIC);
+	for (unsigned int i = 0; i < ITERATIONS; i++) {
+		struct ratbag_test_device td = default_device;
+		struct ratbag_device *device;
+
+		if (ratbagd_parse_json(json, &td) != 0)
+			abort();
+
+		if (ratbag) {
+			device = ratbag_device_new_test_device(ratbag, &td);
+			if (!device)
+				abort();
+			ratbag_device_unref(device);
+		}
+
+		free_names(&td);
+	}
+	end = now(CLOCK_MONOTONIC);
+
+	us = (double)(end - start) / ITERATIONS / 1000.0;
+	printf("%-24s %10.2f us/device %10.0f devices/s\n", name, us,
+	       1000000.0 / us);
+}
+
+int
+main(void)
+{
+	struct ratbag *ratbag;
+
+	setenv("RATBAG_TEST", "1", 0);
+	setup_full_json();
+
+	ratbag = ratbag_create_context(&interface, NULL);
+	if (!ratbag)
+		return EXIT_FAILURE;
+
+	printf("full device: %zu bytes of JSON\n", strlen(full_json));
+
+	bench("parse minimal", minimal_json, NULL);
+	bench("parse full", full_json, NULL);
+	bench("load minimal", minimal_json, ratbag);
+	bench("load full", full_json, ratbag);
+
+	ratbag_unref(ratbag);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,514 @@
+/*
+ * Copyright © 2026 Red Hat, Inc.
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Measures the CPU time per read of an "au" property with a large DPI
+ * list, the way ratbagd's Resolution.Resolutions getter used to build the
+ * reply (one sd_bus_message_append() per element), with a single
+ * sd_bus_message_append_array(), and from the values cached in a struct
+ * ratbagd_u32_cache. Every row includes the cost of a new message.
+ *
+ * The second part compares Properties.GetAll and Properties.Get replies
+ * of a profile built by calling getters like the ones in
+ * ratbagd-profile.c, the way sd-bus does, with copies of the same a{sv}
+ * pre-marshalled once into a sealed message. sd_bus_message_copy()
+ * re-appends every element, so the copies are slower than the getters.
+ * This is why ratbagd only caches decoded array values.
+ *
+ * The messages are never sent. sd-bus only creates messages on a started
+ * bus, so the bus is started on one end of a socketpair, without a bus
+ * daemon.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <systemd/sd-bus.h>
+#include <unistd.h>
+
+#include "libratbag-util.h"
+#include "libratbag-test.h"
+
+#define ITERATIONS 20000
+#define MAX_DPIS 1024
+
+static int
+open_restricted(const char *path, int flags, void *user_data)
+{
+	int fd = open(path, flags);
+
+	return fd < 0 ? -errno : fd;
+}
+
+static void
+close_restricted(int fd, void *user_data)
+{
+	close(fd);
+}
+
+static const struct ratbag_interface interface = {
+	.open_restricted = open_restricted,
+	.close_restricted = close_restricted,
+};
+
+/* one resolution with the widest DPI range the test driver allows */
+static const struct ratbag_test_device device = {
+	.num_profiles = 1,
+	.num_resolutions = 1,
+	.num_buttons = 1,
+	.num_leds = 0,
+	.profiles = {
+		{
+			.buttons = {
+				{ .action_type = RATBAG_BUTTON_ACTION_TYPE_BUTTON,
+				  .button = 0 },
+			},
+			.resolutions = {
+				{ .xres = 1000, .yres = 1000,
+				  .dpi_min = 50, .dpi_max = 36000,
+				  .active = true, .dflt = true },
+			},
+			.active = true,
+			.dflt = true,
+			.hz = 1000,
+			.report_rates = {1000},
+		},
+	},
+};
+
+static uint32_t cached[MAX_DPIS];
+static size_t ncached;
+
+static int
+append_per_element(sd_bus_message *m, struct ratbag_resolution *res)
+{
+	unsigned int dpis[MAX_DPIS];
+	size_t ndpis;
+	int r;
+
+	ndpis = ratbag_resolution_get_dpi_list(res, dpis, ARRAY_LENGTH(dpis));
+
+	r = sd_bus_message_open_container(m, 'a', "u");
+	if (r < 0)
+		return r;
+
+	for (size_t i = 0; i < ndpis; i++) {
+		r = sd_bus_message_append(m, "u", dpis[i]);
+		if (r < 0)
+			return r;
+	}
+
+	return sd_bus_message_close_container(m);
+}
+
+static int
+append_array(sd_bus_message *m, struct ratbag_resolution *res)
+{
+	unsigned int dpis[MAX_DPIS];
+	size_t ndpis;
+
+	ndpis = ratbag_resolution_get_dpi_list(res, dpis, ARRAY_LENGTH(dpis));
+
+	return sd_bus_message_append_array(m, 'u', dpis, ndpis * sizeof(*dpis));
+}
+
+static int
+append_cached(sd_bus_message *m, struct ratbag_resolution *res)
+{
+	return sd_bus_message_append_array(m, 'u', cached,
+					   ncached * sizeof(*cached));
+}
+
+static void
+bench(const char *name,
+      int (*func)(sd_bus_message *m, struct ratbag_resolution *res),
+      sd_bus *bus, struct ratbag_resolution *res)
+{
+	uint64_t start, end;
+
+	start = now(CLOCK_MONOTONIC);
+	for (unsigned int i = 0; i < ITERATIONS; i++) {
+		sd_bus_message *m = NULL;
+
+		if (sd_bus_message_new_signal(bus, &m, "/", "org.freedesktop.ratbag1.Bench",
+					      "Bench") < 0 ||
+		    func(m, res) < 0)
+			abort();
+
+		sd_bus_message_unref(m);
+	}
+	end = now(CLOCK_MONOTONIC);
+
+	printf("%-24s %10.2f us/read\n", name,
+	       (double)(end - start) / ITERATIONS / 1000.0);
+}
+
+/* enough of a ratbagd profile for its getters */
+struct bench_profile {
+	struct ratbag_profile *lib_profile;
+	unsigned int index;
+	unsigned int report_rates[8];
+	size_t nreport_rates;
+};
+
+static int
+get_name(sd_bus *bus, const char *path, const char *interface,
+	 const char *property, sd_bus_message *reply, void *userdata,
+	 sd_bus_error *error)
+{
+	struct bench_profile *profile = userdata;
+	const char *name = ratbag_profile_get_name(profile->lib_profile);
+	char *copy = strdup(name ? name : "");
+	int r;
+
+	r = sd_bus_message_append(reply, "s", copy);
+	free(copy);
+
+	return r;
+}
+
+static int
+get_disabled(sd_bus *bus, const char *path, const char *interface,
+	     const char *property, sd_bus_message *reply, void *userdata,
+	     sd_bus_error *error)
+{
+	struct bench_profile *profile = userdata;
+
+	return sd_bus_message_append(reply, "b",
+				     !ratbag_profile_is_enabled(profile->lib_profile));
+}
+
+static int
+get_capabilities(sd_bus *bus, const char *path, const char *interface,
+		 const char *property, sd_bus_message *reply, void *userdata,
+		 sd_bus_error *error)
+{
+	struct bench_profile *profile = userdata;
+	enum ratbag_profile_capability caps[] = {
+		RATBAG_PROFILE_CAP_SET_DEFAULT,
+		RATBAG_PROFILE_CAP_DISABLE,
+		RATBAG_PROFILE_CAP_WRITE_ONLY,
+	};
+	uint32_t values[ARRAY_LENGTH(caps)];
+	const enum ratbag_profile_capability *cap;
+	size_t n = 0;
+
+	ARRAY_FOR_EACH(caps, cap) {
+		if (ratbag_profile_has_capability(profile->lib_profile, *cap))
+			values[n++] = *cap;
+	}
+
+	return sd_bus_message_append_array(reply, 'u', values, n * sizeof(*values));
+}
+
+static int
+get_resolutions(sd_bus *bus, const char *path, const char *interface,
+		const char *property, sd_bus_message *reply, void *userdata,
+		sd_bus_error *error)
+{
+	struct bench_profile *profile = userdata;
+	unsigned int n = ratbag_profile_get_num_resolutions(profile->lib_profile);
+	char buf[128];
+	int r;
+
+	r = sd_bus_message_open_container(reply, 'a', "o");
+	for (unsigned int i = 0; r >= 0 && i < n; i++) {
+		snprintf(buf, sizeof(buf),
+			 "/org/freedesktop/ratbag1/resolution/hidraw0/p%u/r%u",
+			 profile->index, i);
+		r = sd_bus_message_append(reply, "o", buf);
+	}
+	if (r >= 0)
+		r = sd_bus_message_close_container(reply);
+
+	return r;
+}
+
+static int
+get_is_active(sd_bus *bus, const char *path, const char *interface,
+	      const char *property, sd_bus_message *reply, void *userdata,
+	      sd_bus_error *error)
+{
+	struct bench_profile *profile = userdata;
+
+	return sd_bus_message_append(reply, "b",
+				     ratbag_profile_is_active(profile->lib_profile));
+}
+
+static int
+get_is_dirty(sd_bus *bus, const char *path, const char *interface,
+	     const char *property, sd_bus_message *reply, void *userdata,
+	     sd_bus_error *error)
+{
+	struct bench_profile *profile = userdata;
+
+	return sd_bus_message_append(reply, "b",
+				     ratbag_profile_is_dirty(profile->lib_profile));
+}
+
+static int
+get_report_rate(sd_bus *bus, const char *path, const char *interface,
+		const char *property, sd_bus_message *reply, void *userdata,
+		sd_bus_error *error)
+{
+	struct bench_profile *profile = userdata;
+
+	return sd_bus_message_append(reply, "u",
+				     ratbag_profile_get_report_rate(profile->lib_profile));
+}
+
+static int
+get_report_rates(sd_bus *bus, const char *path, const char *interface,
+		 const char *property, sd_bus_message *reply, void *userdata,
+		 sd_bus_error *error)
+{
+	struct bench_profile *profile = userdata;
+
+	/* cached like a struct ratbagd_u32_cache */
+	return sd_bus_message_append_array(reply, 'u', profile->report_rates,
+					   profile->nreport_rates * sizeof(*profile->report_rates));
+}
+
+static int
+get_angle_snapping(sd_bus *bus, const char *path, const char *interface,
+		   const char *property, sd_bus_message *reply, void *userdata,
+		   sd_bus_error *error)
+{
+	struct bench_profile *profile = userdata;
+
+	return sd_bus_message_append(reply, "i",
+				     ratbag_profile_get_angle_snapping(profile->lib_profile));
+}
+
+static int
+get_debounce(sd_bus *bus, const char *path, const char *interface,
+	     const char *property, sd_bus_message *reply, void *userdata,
+	     sd_bus_error *error)
+{
+	struct bench_profile *profile = userdata;
+
+	return sd_bus_message_append(reply, "i",
+				     ratbag_profile_get_debounce(profile->lib_profile));
+}
+
+/* the shape of ratbagd_profile_vtable, without the setters */
+static const sd_bus_vtable profile_vtable[] = {
+	SD_BUS_VTABLE_START(0),
+	SD_BUS_PROPERTY("Name", "s", get_name, 0, 0),
+	SD_BUS_PROPERTY("Disabled", "b", get_disabled, 0, 0),
+	SD_BUS_PROPERTY("Index", "u", NULL, offsetof(struct bench_profile, index), SD_BUS_VTABLE_PROPERTY_CONST),
+	SD_BUS_PROPERTY("Capabilities", "au", get_capabilities, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+	SD_BUS_PROPERTY("Resolutions", "ao", get_resolutions, 0, 0),
+	SD_BUS_PROPERTY("Buttons", "ao", get_resolutions, 0, 0),
+	SD_BUS_PROPERTY("Leds", "ao", get_resolutions, 0, 0),
+	SD_BUS_PROPERTY("IsActive", "b", get_is_active, 0, 0),
+	SD_BUS_PROPERTY("IsDirty", "b", get_is_dirty, 0, 0),
+	SD_BUS_PROPERTY("ReportRate", "u", get_report_rate, 0, 0),
+	SD_BUS_PROPERTY("AngleSnapping", "i", get_angle_snapping, 0, 0),
+	SD_BUS_PROPERTY("Debounce", "i", get_debounce, 0, 0),
+	SD_BUS_PROPERTY("ReportRates", "au", get_report_rates, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+	SD_BUS_PROPERTY("Debounces", "au", get_report_rates, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+	SD_BUS_VTABLE_END,
+};
+
+static struct bench_profile bench_profile;
+static sd_bus_message *premarshalled;
+
+static int
+append_property(sd_bus_message *m, const sd_bus_vtable *v)
+{
+	struct bench_profile *profile = &bench_profile;
+	int r;
+
+	r = sd_bus_message_open_container(m, 'v', v->x.property.signature);
+	if (r < 0)
+		return r;
+
+	if (v->x.property.get)
+		r = v->x.property.get(NULL, "/", "", v->x.property.member, m,
+				      profile, NULL);
+	else
+		r = sd_bus_message_append(m, "u", profile->index);
+	if (r < 0)
+		return r;
+
+	return sd_bus_message_close_container(m);
+}
+
+/* what sd-bus does for GetAll */
+static int
+getall_getters(sd_bus_message *m)
+{
+	int r;
+
+	r = sd_bus_message_open_container(m, 'a', "{sv}");
+	for (const sd_bus_vtable *v = profile_vtable + 1;
+	     r >= 0 && v->type != _SD_BUS_VTABLE_END;
+	     v++) {
+		r = sd_bus_message_open_container(m, 'e', "sv");
+		if (r >= 0)
+			r = sd_bus_message_append(m, "s", v->x.property.member);
+		if (r >= 0)
+			r = append_property(m, v);
+		if (r >= 0)
+			r = sd_bus_message_close_container(m);
+	}
+	if (r >= 0)
+		r = sd_bus_message_close_container(m);
+
+	return r;
+}
+
+static int
+getall_cached(sd_bus_message *m)
+{
+	int r;
+
+	r = sd_bus_message_rewind(premarshalled, true);
+	if (r < 0)
+		return r;
+
+	return sd_bus_message_copy(m, premarshalled, true);
+}
+
+/* what sd-bus does for Get, ReportRates is near the end of the a{sv} */
+static int
+get_getter(sd_bus_message *m)
+{
+	return append_property(m, &profile_vtable[ARRAY_LENGTH(profile_vtable) - 3]);
+}
+
+static int
+get_cached(sd_bus_message *m)
+{
+	const char *name;
+	int r;
+
+	r = sd_bus_message_rewind(premarshalled, true);
+	if (r >= 0)
+		r = sd_bus_message_enter_container(premarshalled, 'a', "{sv}");
+
+	while (r >= 0 &&
+	       (r = sd_bus_message_enter_container(premarshalled, 'e', "sv")) > 0) {
+		r = sd_bus_message_read(premarshalled, "s", &name);
+		if (r >= 0 && streq(name, "ReportRates"))
+			return sd_bus_message_copy(m, premarshalled, false);
+		if (r >= 0)
+			r = sd_bus_message_skip(premarshalled, "v");
+		if (r >= 0)
+			r = sd_bus_message_exit_container(premarshalled);
+	}
+
+	return r < 0 ? r : -ENOENT;
+}
+
+static void
+bench_reply(const char *name, int (*func)(sd_bus_message *m), sd_bus *bus)
+{
+	uint64_t start, end;
+
+	start = now(CLOCK_MONOTONIC);
+	for (unsigned int i = 0; i < ITERATIONS; i++) {
+		sd_bus_message *m = NULL;
+
+		if (sd_bus_message_new_signal(bus, &m, "/", "org.freedesktop.ratbag1.Bench",
+					      "Bench") < 0 ||
+		    func(m) < 0)
+			abort();
+
+		sd_bus_message_unref(m);
+	}
+	end = now(CLOCK_MONOTONIC);
+
+	printf("%-24s %10.2f us/read\n", name,
+	       (double)(end - start) / ITERATIONS / 1000.0);
+}
+
+int
+main(void)
+{
+	struct ratbag *ratbag;
+	struct ratbag_device *d;
+	struct ratbag_profile *p;
+	struct ratbag_resolution *res;
+	sd_bus *bus = NULL;
+	int fds[2];
+
+	setenv("RATBAG_TEST", "1", 0);
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0 ||
+	    sd_bus_new(&bus) < 0 ||
+	    sd_bus_set_fd(bus, fds[0], fds[0]) < 0 ||
+	    sd_bus_start(bus) < 0)
+		return EXIT_FAILURE;
+
+	ratbag = ratbag_create_context(&interface, NULL);
+	if (!ratbag)
+		return EXIT_FAILURE;
+
+	d = ratbag_device_new_test_device(ratbag, &device);
+	if (!d)
+		return EXIT_FAILURE;
+	p = ratbag_device_get_profile(d, 0);
+	res = ratbag_profile_get_resolution(p, 0);
+
+	ncached = ratbag_resolution_get_dpi_list(res, cached, ARRAY_LENGTH(cached));
+	printf("%zu DPI values per read\n", ncached);
+
+	bench("append per element", append_per_element, bus, res);
+	bench("append array", append_array, bus, res);
+	bench("append cached", append_cached, bus, res);
+
+	bench_profile.lib_profile = p;
+	bench_profile.nreport_rates =
+		ratbag_profile_get_report_rate_list(p, bench_profile.report_rates,
+						    ARRAY_LENGTH(bench_profile.report_rates));
+	if (sd_bus_message_new_signal(bus, &premarshalled, "/",
+				      "org.freedesktop.ratbag1.Bench", "Bench") < 0 ||
+	    getall_getters(premarshalled) < 0 ||
+	    sd_bus_message_seal(premarshalled, 0, 0) < 0)
+		return EXIT_FAILURE;
+
+	printf("\nprofile with %zu properties\n", ARRAY_LENGTH(profile_vtable) - 2);
+	bench_reply("GetAll from getters", getall_getters, bus);
+	bench_reply("GetAll cached", getall_cached, bus);
+	bench_reply("Get from getter", get_getter, bus);
+	bench_reply("Get cached", get_cached, bus);
+
+	sd_bus_message_unref(premarshalled);
+
+	ratbag_resolution_unref(res);
+	ratbag_profile_unref(p);
+	ratbag_device_unref(d);
+	ratbag_unref(ratbag);
+	sd_bus_flush_close_unref(bus);
+	close(fds[1]);
+
+	return EXIT_SUCCESS;
+}
@@ -56,9 +56,10 @@ def check_devicetype_str(string):
 
 def check_section_device(section: configparser.SectionProxy):
     required_keys = ["Name", "Driver", "DeviceMatch", "DeviceType"]
+    optional_keys = ["RequestTimeout"]
 
     for key in section:
-        assert key in required_keys
+        assert key in required_keys or key in optional_keys
 
     for r in required_keys:
         assert r in section
@@ -67,6 +68,13 @@ def check_section_device(section: configparser.SectionProxy):
 
     check_match_str(section["DeviceMatch"])
 
+    try:
+        timeout = int(section["RequestTimeout"])
+        assert timeout >= 50 and timeout <= 10000
+    except KeyError:
+        # No such key - not an error.
+        pass
+
 
 def check_dpi_range_str(string: str):
     m = re.search("^([0-9]+):([0-9]+)@([0-9.]+)$", string)
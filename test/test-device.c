@@ -26,11 +26,14 @@
 #include <check.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <limits.h>
+#include <dirent.h>
 #include <sys/resource.h>
 
 #include "libratbag-private.h"
@@ -407,6 +410,7 @@ START_TEST(device_resolutions)
 	int xres, yres, rate;
 	int device_freed_count = 0;
 	bool is_active;
+	const struct ratbag_dpi_table *table = NULL;
 
 	struct ratbag_test_device td = {
 		.num_profiles = 3,
@@ -470,6 +474,11 @@ START_TEST(device_resolutions)
 			ck_assert_int_lt(ndpis, ARRAY_LENGTH(dpis));
 			ck_assert_int_gt(ndpis, 20);
 
+			/* identical DPI lists are stored once per device */
+			if (!table)
+				table = res->dpi_table;
+			ck_assert_ptr_eq(res->dpi_table, table);
+
 			ck_assert_int_eq(xres, i * 1000 + (j + 1) * 100);
 			ck_assert_int_eq(yres, i * 1000 + (j + 1) * 100 + 100);
 			ck_assert_int_eq(xres, ratbag_resolution_get_dpi(res));
@@ -515,6 +524,49 @@ START_TEST(device_resolutions_ref_unref)
 }
 END_TEST
 
+START_TEST(device_resolutions_generation)
+{
+	struct ratbag *r;
+	struct ratbag_device *d;
+	struct ratbag_profile *p;
+	struct ratbag_resolution *res0, *res1;
+	unsigned int gen0, gen1, pgen;
+	struct ratbag_test_device td = sane_device;
+
+	r = ratbag_create_context(&abort_iface, NULL);
+	d = ratbag_device_new_test_device(r, &td);
+	p = ratbag_device_get_profile(d, 0);
+	res0 = ratbag_profile_get_resolution(p, 0);
+	res1 = ratbag_profile_get_resolution(p, 1);
+
+	ck_assert(ratbag_resolution_set_active(res0) == RATBAG_SUCCESS);
+
+	gen0 = ratbag_resolution_get_generation(res0);
+	gen1 = ratbag_resolution_get_generation(res1);
+	pgen = ratbag_profile_get_generation(p);
+
+	/* getters leave the generation alone */
+	ratbag_resolution_get_dpi(res0);
+	ck_assert_int_eq(ratbag_resolution_get_generation(res0), gen0);
+
+	/* the previously active resolution changes too */
+	ck_assert(ratbag_resolution_set_active(res1) == RATBAG_SUCCESS);
+	ck_assert_int_ne(ratbag_resolution_get_generation(res0), gen0);
+	ck_assert_int_ne(ratbag_resolution_get_generation(res1), gen1);
+	ck_assert_int_ne(ratbag_profile_get_generation(p), pgen);
+
+	gen0 = ratbag_resolution_get_generation(res0);
+	ck_assert(ratbag_device_commit(d) == RATBAG_SUCCESS);
+	ck_assert_int_ne(ratbag_resolution_get_generation(res0), gen0);
+
+	ratbag_resolution_unref(res0);
+	ratbag_resolution_unref(res1);
+	ratbag_profile_unref(p);
+	ratbag_device_unref(d);
+	ratbag_unref(r);
+}
+END_TEST
+
 START_TEST(device_resolutions_num_0)
 {
 	struct ratbag *r;
@@ -851,6 +903,202 @@ START_TEST(device_buttons_set)
 }
 END_TEST
 
+START_TEST(device_buttons_macro_shared)
+{
+	struct ratbag *r;
+	struct ratbag_device *d;
+	struct ratbag_profile *p0, *p1;
+	struct ratbag_button *b0, *b1;
+	struct ratbag_button_macro *m;
+	struct ratbag_test_device td = sane_device;
+	const struct ratbag_test_macro_event events[] = {
+		{ RATBAG_MACRO_EVENT_KEY_PRESSED, KEY_A },
+		{ RATBAG_MACRO_EVENT_KEY_RELEASED, KEY_A },
+	};
+
+	td.num_buttons = 10;
+	for (unsigned int i = 0; i < 2; i++) {
+		td.profiles[i].buttons[8].action_type = RATBAG_BUTTON_ACTION_TYPE_MACRO;
+		memcpy(td.profiles[i].buttons[8].macro, events, sizeof(events));
+	}
+
+	r = ratbag_create_context(&abort_iface, NULL);
+	d = ratbag_device_new_test_device(r, &td);
+	p0 = ratbag_device_get_profile(d, 0);
+	p1 = ratbag_device_get_profile(d, 1);
+	b0 = ratbag_profile_get_button(p0, 8);
+	b1 = ratbag_profile_get_button(p1, 8);
+
+	/* identical macros are stored once */
+	ck_assert_ptr_eq(b0->action.macro, b1->action.macro);
+	ck_assert_int_eq(b0->action.macro->nevents, 2);
+	ck_assert_int_eq(b0->action.macro->events[2].type, RATBAG_MACRO_EVENT_NONE);
+
+	/* modifying a copy does not affect the buttons */
+	m = ratbag_button_get_macro(b1);
+	ck_assert_int_eq(ratbag_button_macro_get_num_events(m), 2);
+	ck_assert_int_eq(ratbag_button_macro_get_event_key(m, 1), KEY_A);
+	ratbag_button_macro_set_event(m, 2, RATBAG_MACRO_EVENT_WAIT, 50);
+	ck_assert_int_eq(ratbag_button_macro_get_event_timeout(m, 2), 50);
+	ck_assert_int_eq(ratbag_button_macro_get_num_events(m), 3);
+	ck_assert_int_eq(b1->action.macro->nevents, 2);
+
+	ratbag_button_set_macro(b1, m);
+	ck_assert_ptr_ne(b0->action.macro, b1->action.macro);
+	ck_assert_int_eq(b0->action.macro->nevents, 2);
+	ck_assert_int_eq(b1->action.macro->nevents, 3);
+	ratbag_button_macro_unref(m);
+
+	/* an unmodified copy is shared again */
+	m = ratbag_button_get_macro(b0);
+	ratbag_button_set_macro(b1, m);
+	ck_assert_ptr_eq(b0->action.macro, b1->action.macro);
+
+	ratbag_button_unref(b0);
+	ratbag_button_unref(b1);
+	ratbag_profile_unref(p0);
+	ratbag_profile_unref(p1);
+	ratbag_device_unref(d);
+	ratbag_unref(r);
+
+	/* the copy outlives the context */
+	ck_assert_int_eq(ratbag_button_macro_get_event_type(m, 0),
+			 RATBAG_MACRO_EVENT_KEY_PRESSED);
+	ratbag_button_macro_unref(m);
+}
+END_TEST
+
+START_TEST(device_buttons_macro_many)
+{
+	struct ratbag *r;
+	struct ratbag_device *d;
+	struct ratbag_profile *p;
+	struct ratbag_button *b;
+	struct ratbag_button_macro *m;
+	struct ratbag_button_macro *copies[500];
+	struct ratbag_test_device td = sane_device;
+	unsigned int nbuckets;
+
+	td.num_buttons = 10;
+	td.profiles[0].buttons[8].action_type = RATBAG_BUTTON_ACTION_TYPE_MACRO;
+
+	r = ratbag_create_context(&abort_iface, NULL);
+	d = ratbag_device_new_test_device(r, &td);
+	p = ratbag_device_get_profile(d, 0);
+	b = ratbag_profile_get_button(p, 8);
+	nbuckets = r->nmacro_buckets;
+
+	m = ratbag_button_macro_new("empty");
+	ck_assert_int_eq(ratbag_button_macro_get_num_events(m), 0);
+	ratbag_button_macro_unref(m);
+
+	/* keep a reference to every macro so they all stay interned */
+	for (unsigned int i = 0; i < ARRAY_LENGTH(copies); i++) {
+		m = ratbag_button_macro_new("macro");
+		ratbag_button_macro_set_event(m, 0, RATBAG_MACRO_EVENT_KEY_PRESSED, KEY_A);
+		ratbag_button_macro_set_event(m, 1, RATBAG_MACRO_EVENT_WAIT, i + 1);
+		ratbag_button_macro_set_event(m, 2, RATBAG_MACRO_EVENT_KEY_RELEASED, KEY_A);
+		ck_assert_int_eq(ratbag_button_set_macro(b, m), RATBAG_SUCCESS);
+		ratbag_button_macro_unref(m);
+
+		copies[i] = ratbag_button_get_macro(b);
+		ck_assert_int_eq(ratbag_button_macro_get_num_events(copies[i]), 3);
+	}
+
+	ck_assert_int_gt(r->nmacro_buckets, nbuckets);
+	ck_assert_int_le(r->nmacros, 2 * r->nmacro_buckets);
+
+	/* the macros are still found after the table grew */
+	for (unsigned int i = 0; i < ARRAY_LENGTH(copies); i++) {
+		ratbag_button_set_macro(b, copies[i]);
+		ck_assert_ptr_eq(b->action.macro, copies[i]->shared);
+		ck_assert_int_eq(ratbag_button_macro_get_event_timeout(copies[i], 1), i + 1);
+	}
+
+	for (unsigned int i = 0; i < ARRAY_LENGTH(copies); i++)
+		ratbag_button_macro_unref(copies[i]);
+	ck_assert_int_eq(r->nmacros, 1);
+
+	ratbag_button_unref(b);
+	ratbag_profile_unref(p);
+	ratbag_device_unref(d);
+	ratbag_unref(r);
+}
+END_TEST
+
+struct macro_thread {
+	pthread_t thread;
+	struct ratbag_button *button;
+};
+
+static void *
+macro_setter(void *data)
+{
+	struct macro_thread *t = data;
+	struct ratbag_button_macro *m;
+
+	/* every thread uses the same few macros, so interning finds the
+	 * other threads' macros and their last unref races with it */
+	for (unsigned int i = 0; i < 2000; i++) {
+		m = ratbag_button_macro_new("macro");
+		ratbag_button_macro_set_event(m, 0, RATBAG_MACRO_EVENT_KEY_PRESSED, KEY_A);
+		ratbag_button_macro_set_event(m, 1, RATBAG_MACRO_EVENT_WAIT, i % 4 + 1);
+		ratbag_button_macro_set_event(m, 2, RATBAG_MACRO_EVENT_KEY_RELEASED, KEY_A);
+		ratbag_button_set_macro(t->button, m);
+		ratbag_button_macro_unref(m);
+	}
+
+	return NULL;
+}
+
+START_TEST(device_buttons_macro_threads)
+{
+	struct ratbag *r;
+	struct ratbag_device *d[4];
+	struct ratbag_profile *p[4];
+	struct macro_thread threads[4];
+	struct ratbag_test_device td = sane_device;
+	struct ratbag_button_macro *m;
+
+	td.num_buttons = 10;
+	td.profiles[0].buttons[8].action_type = RATBAG_BUTTON_ACTION_TYPE_MACRO;
+
+	r = ratbag_create_context(&abort_iface, NULL);
+
+	/* one device per thread like ratbagd's ApplyToDevices(), they only
+	 * share the context */
+	for (unsigned int i = 0; i < ARRAY_LENGTH(threads); i++) {
+		d[i] = ratbag_device_new_test_device(r, &td);
+		p[i] = ratbag_device_get_profile(d[i], 0);
+		threads[i].button = ratbag_profile_get_button(p[i], 8);
+		ck_assert_int_eq(pthread_create(&threads[i].thread, NULL,
+						macro_setter, &threads[i]), 0);
+	}
+
+	for (unsigned int i = 0; i < ARRAY_LENGTH(threads); i++)
+		pthread_join(threads[i].thread, NULL);
+
+	/* all threads ended on the macro waiting 4ms */
+	ck_assert_int_eq(r->nmacros, 1);
+	for (unsigned int i = 0; i < ARRAY_LENGTH(threads); i++) {
+		ck_assert_ptr_eq(threads[i].button->action.macro,
+				 threads[0].button->action.macro);
+		m = ratbag_button_get_macro(threads[i].button);
+		ck_assert_int_eq(ratbag_button_macro_get_event_timeout(m, 1), 4);
+		ratbag_button_macro_unref(m);
+	}
+	ck_assert_int_eq(threads[0].button->action.macro->refcount,
+			 (int)ARRAY_LENGTH(threads));
+
+	for (unsigned int i = 0; i < ARRAY_LENGTH(threads); i++) {
+		ratbag_button_unref(threads[i].button);
+		ratbag_profile_unref(p[i]);
+		ratbag_device_unref(d[i]);
+	}
+	ratbag_unref(r);
+}
+END_TEST
+
 static void
 assert_led_equals(struct ratbag_led *l, struct ratbag_test_led e_l)
 {
@@ -964,6 +1212,431 @@ START_TEST(device_leds_set)
 }
 END_TEST
 
+static int
+count_dir_entries(const char *path)
+{
+	DIR *dir = opendir(path);
+	struct dirent *entry;
+	int count = 0;
+
+	ck_assert(dir != NULL);
+	while ((entry = readdir(dir))) {
+		if (!streq(entry->d_name, ".") && !streq(entry->d_name, ".."))
+			count++;
+	}
+	closedir(dir);
+
+	return count;
+}
+
+/* removes a directory with files but no subdirectories */
+static void
+remove_dir(const char *path)
+{
+	DIR *dir = opendir(path);
+	struct dirent *entry;
+
+	ck_assert(dir != NULL);
+	while ((entry = readdir(dir))) {
+		if (streq(entry->d_name, ".") || streq(entry->d_name, ".."))
+			continue;
+		ck_assert_int_eq(unlinkat(dirfd(dir), entry->d_name, 0), 0);
+	}
+	closedir(dir);
+
+	ck_assert_int_eq(rmdir(path), 0);
+}
+
+START_TEST(device_cache)
+{
+	struct ratbag *r;
+	struct ratbag_device *d;
+	struct ratbag_test_device td = sane_device;
+	char dir[] = "/tmp/ratbag-test-cache.XXXXXX";
+	uint8_t data[64], read_back[64];
+	int rc;
+
+	ck_assert(mkdtemp(dir) != NULL);
+	for (size_t i = 0; i < sizeof(data); i++)
+		data[i] = i;
+
+	r = ratbag_create_context(&abort_iface, NULL);
+	d = ratbag_device_new_test_device(r, &td);
+	ck_assert(d != NULL);
+
+	/* disabled by default */
+	rc = ratbag_device_cache_write(d, "blob", data, sizeof(data));
+	ck_assert_int_eq(rc, 0);
+	rc = ratbag_device_cache_read(d, "blob", read_back, sizeof(read_back));
+	ck_assert_int_eq(rc, -ENOENT);
+
+	rc = ratbag_cache_enable(r, dir);
+	ck_assert_int_eq(rc, 0);
+
+	/* not used without a firmware version */
+	rc = ratbag_device_cache_write(d, "blob", data, sizeof(data));
+	ck_assert_int_eq(rc, 0);
+	rc = ratbag_device_cache_read(d, "blob", read_back, sizeof(read_back));
+	ck_assert_int_eq(rc, -ENOENT);
+	ck_assert_int_eq(count_dir_entries(dir), 0);
+
+	ratbag_device_set_firmware_version(d, "1.0.0");
+	rc = ratbag_device_cache_read(d, "blob", read_back, sizeof(read_back));
+	ck_assert_int_eq(rc, -ENOENT);
+	rc = ratbag_device_cache_write(d, "blob", data, sizeof(data));
+	ck_assert_int_eq(rc, 0);
+	rc = ratbag_device_cache_read(d, "blob", read_back, sizeof(read_back));
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(memcmp(data, read_back, sizeof(data)), 0);
+
+	/* a blob of a different size is never handed out */
+	rc = ratbag_device_cache_read(d, "blob", read_back, sizeof(read_back) - 1);
+	ck_assert_int_eq(rc, -EBADMSG);
+
+	/* the firmware version is part of the key */
+	ratbag_device_set_firmware_version(d, "1.2/3");
+	rc = ratbag_device_cache_read(d, "blob", read_back, sizeof(read_back));
+	ck_assert_int_eq(rc, -ENOENT);
+
+	/* no temporary files are left behind */
+	ck_assert_int_eq(count_dir_entries(dir), 1);
+
+	ratbag_device_unref(d);
+	ratbag_unref(r);
+
+	remove_dir(dir);
+}
+END_TEST
+
+static unsigned int
+device_count_dirty(struct ratbag_device *d)
+{
+	struct ratbag_profile *p;
+	struct ratbag_resolution *res;
+	struct ratbag_button *b;
+	struct ratbag_led *l;
+	unsigned int count = 0;
+
+	ratbag_device_for_each_profile(d, p) {
+		count += p->dirty;
+		ratbag_profile_for_each_resolution(p, res)
+			count += res->dirty;
+		ratbag_profile_for_each_button(p, b)
+			count += b->dirty;
+		ratbag_profile_for_each_led(p, l)
+			count += l->dirty;
+	}
+
+	return count;
+}
+
+static void
+device_export_import(enum ratbag_export_format format)
+{
+	struct ratbag *r;
+	struct ratbag_device *d1, *d2;
+	struct ratbag_profile *p;
+	struct ratbag_resolution *res;
+	struct ratbag_button *b;
+	struct ratbag_led *l;
+	struct ratbag_test_device td = sane_device;
+	struct ratbag_macro_event events[] = {
+		{ RATBAG_MACRO_EVENT_KEY_PRESSED, { KEY_B } },
+		{ RATBAG_MACRO_EVENT_WAIT, { 20 } },
+		{ RATBAG_MACRO_EVENT_KEY_RELEASED, { KEY_B } },
+	};
+	void *data;
+	size_t size;
+	int rc;
+
+	td.num_buttons = 3;
+
+	r = ratbag_create_context(&abort_iface, NULL);
+	d1 = ratbag_device_new_test_device(r, &td);
+	d2 = ratbag_device_new_test_device(r, &td);
+
+	/* identical devices, nothing to do */
+	rc = ratbag_device_export(d1, format, &data, &size);
+	ck_assert_int_eq(rc, RATBAG_SUCCESS);
+	rc = ratbag_device_import(d2, data, size);
+	ck_assert_int_eq(rc, RATBAG_SUCCESS);
+	ck_assert_int_eq(device_count_dirty(d2), 0);
+	free(data);
+
+	p = ratbag_device_get_profile(d1, 0);
+	res = ratbag_profile_get_resolution(p, 0);
+	ck_assert_int_eq(ratbag_resolution_set_dpi(res, 1000), RATBAG_SUCCESS);
+	ratbag_resolution_unref(res);
+	ratbag_profile_unref(p);
+
+	p = ratbag_device_get_profile(d1, 1);
+	b = ratbag_profile_get_button(p, 2);
+	ck_assert_int_eq(ratbag_button_set_key(b, KEY_A), RATBAG_SUCCESS);
+	ratbag_button_unref(b);
+	b = ratbag_profile_get_button(p, 1);
+	ratbag_button_set_macro_events(b, "macro", NULL, events, ARRAY_LENGTH(events));
+	ratbag_button_unref(b);
+	ratbag_profile_unref(p);
+
+	p = ratbag_device_get_profile(d1, 2);
+	l = ratbag_profile_get_led(p, 1);
+	ck_assert_int_eq(ratbag_led_set_brightness(l, 50), RATBAG_SUCCESS);
+	ratbag_led_unref(l);
+	ratbag_profile_unref(p);
+
+	rc = ratbag_device_export(d1, format, &data, &size);
+	ck_assert_int_eq(rc, RATBAG_SUCCESS);
+	rc = ratbag_device_import(d2, data, size);
+	ck_assert_int_eq(rc, RATBAG_SUCCESS);
+	free(data);
+
+	/* three profiles, one resolution, two buttons and one LED */
+	ck_assert_int_eq(device_count_dirty(d2), 7);
+
+	p = ratbag_device_get_profile(d2, 0);
+	ck_assert(p->dirty);
+	ck_assert(!p->rate_dirty);
+	res = ratbag_profile_get_resolution(p, 0);
+	ck_assert(res->dirty);
+	ck_assert_int_eq(ratbag_resolution_get_dpi_x(res), 1000);
+	ck_assert_int_eq(ratbag_resolution_get_dpi_y(res), 1000);
+	ratbag_resolution_unref(res);
+	ratbag_profile_unref(p);
+
+	p = ratbag_device_get_profile(d2, 1);
+	b = ratbag_profile_get_button(p, 0);
+	ck_assert(!b->dirty);
+	ratbag_button_unref(b);
+	b = ratbag_profile_get_button(p, 1);
+	ck_assert(b->dirty);
+	ck_assert_int_eq(b->action.macro->nevents, 3);
+	ck_assert_int_eq(b->action.macro->events[1].event.timeout, 20);
+	ratbag_button_unref(b);
+	b = ratbag_profile_get_button(p, 2);
+	ck_assert(b->dirty);
+	ck_assert_int_eq(ratbag_button_get_key(b), KEY_A);
+	ratbag_button_unref(b);
+	ratbag_profile_unref(p);
+
+	p = ratbag_device_get_profile(d2, 2);
+	l = ratbag_profile_get_led(p, 0);
+	ck_assert(!l->dirty);
+	ratbag_led_unref(l);
+	l = ratbag_profile_get_led(p, 1);
+	ck_assert(l->dirty);
+	ck_assert_int_eq(ratbag_led_get_brightness(l), 50);
+	ck_assert_int_eq(ratbag_led_get_effect_duration(l), 333);
+	ratbag_led_unref(l);
+	ratbag_profile_unref(p);
+
+	ratbag_device_unref(d1);
+	ratbag_device_unref(d2);
+	ratbag_unref(r);
+}
+
+START_TEST(device_export_import_binary)
+{
+	device_export_import(RATBAG_EXPORT_FORMAT_BINARY);
+}
+END_TEST
+
+START_TEST(device_export_import_json)
+{
+	device_export_import(RATBAG_EXPORT_FORMAT_JSON);
+}
+END_TEST
+
+START_TEST(device_import_invalid)
+{
+	struct ratbag *r;
+	struct ratbag_device *d1, *d2;
+	struct ratbag_profile *p;
+	struct ratbag_resolution *res;
+	struct ratbag_test_device td = sane_device;
+	uint8_t *data;
+	size_t size;
+	int rc;
+
+	r = ratbag_create_context(&abort_iface, NULL);
+	d1 = ratbag_device_new_test_device(r, &td);
+
+	p = ratbag_device_get_profile(d1, 0);
+	res = ratbag_profile_get_resolution(p, 0);
+	ck_assert_int_eq(ratbag_resolution_set_dpi(res, 1000), RATBAG_SUCCESS);
+	ratbag_resolution_unref(res);
+	ratbag_profile_unref(p);
+
+	rc = ratbag_device_export(d1, RATBAG_EXPORT_FORMAT_BINARY,
+				  (void **)&data, &size);
+	ck_assert_int_eq(rc, RATBAG_SUCCESS);
+
+	td.num_leds = 1;
+	d2 = ratbag_device_new_test_device(r, &td);
+
+	/* different layout */
+	rc = ratbag_device_import(d2, data, size);
+	ck_assert_int_eq(rc, RATBAG_ERROR_VALUE);
+	ck_assert_int_eq(device_count_dirty(d2), 0);
+
+	/* truncated or garbage */
+	rc = ratbag_device_import(d1, data, size - 1);
+	ck_assert_int_eq(rc, RATBAG_ERROR_VALUE);
+	rc = ratbag_device_import(d1, "{ }", 3);
+	ck_assert_int_eq(rc, RATBAG_ERROR_VALUE);
+	data[4] = 0xff;
+	rc = ratbag_device_import(d1, data, size);
+	ck_assert_int_eq(rc, RATBAG_ERROR_VALUE);
+	free(data);
+
+	ratbag_device_unref(d1);
+	ratbag_device_unref(d2);
+	ratbag_unref(r);
+}
+END_TEST
+
+START_TEST(device_generated)
+{
+	struct ratbag *r;
+	struct ratbag_device *d;
+	struct ratbag_test_device *td, *td2;
+	const struct ratbag_test_profile *tp;
+	int device_freed_count = 0;
+	unsigned int i;
+
+	/* more buttons and LEDs than fit into the inline arrays */
+	td = ratbag_test_device_generate(16, 16, 200, 40, 1);
+	td->destroyed = device_destroyed;
+	td->destroyed_data = &device_freed_count;
+
+	/* same seed, same device */
+	td2 = ratbag_test_device_generate(16, 16, 200, 40, 1);
+	for (i = 0; i < td->num_profiles; i++) {
+		ck_assert(memcmp(td->profile_list[i].button_list,
+				 td2->profile_list[i].button_list,
+				 200 * sizeof(struct ratbag_test_button)) == 0);
+		ck_assert(memcmp(td->profile_list[i].led_list,
+				 td2->profile_list[i].led_list,
+				 40 * sizeof(struct ratbag_test_led)) == 0);
+	}
+	ratbag_test_device_free(td2);
+
+	r = ratbag_create_context(&abort_iface, NULL);
+	d = ratbag_device_new_test_device(r, td);
+	ck_assert(d != NULL);
+
+	ck_assert_int_eq(ratbag_device_get_num_profiles(d), 16);
+	ck_assert_int_eq(ratbag_device_get_num_buttons(d), 200);
+	ck_assert_int_eq(ratbag_device_get_num_leds(d), 40);
+
+	for (i = 0; i < td->num_profiles; i++) {
+		struct ratbag_profile *p;
+		struct ratbag_resolution *res;
+		struct ratbag_button *b;
+		struct ratbag_led *l;
+		struct ratbag_color c;
+
+		tp = &td->profile_list[i];
+		p = ratbag_device_get_profile(d, i);
+		ck_assert(p != NULL);
+		ck_assert_int_eq(ratbag_profile_is_active(p), i == 0);
+		ck_assert_int_eq(ratbag_profile_get_num_resolutions(p), 16);
+
+		res = ratbag_profile_get_resolution(p, 15);
+		ck_assert_int_eq(ratbag_resolution_get_dpi(res),
+				 tp->resolution_list[15].xres);
+		ratbag_resolution_unref(res);
+
+		b = ratbag_profile_get_button(p, 199);
+		ck_assert_int_eq(ratbag_button_get_action_type(b),
+				 tp->button_list[199].action_type);
+		ratbag_button_unref(b);
+
+		l = ratbag_profile_get_led(p, 39);
+		c = ratbag_led_get_color(l);
+		ck_assert_int_eq(ratbag_led_get_mode(l), tp->led_list[39].mode);
+		ck_assert_int_eq(c.red, tp->led_list[39].color.red);
+		ck_assert_int_eq(c.green, tp->led_list[39].color.green);
+		ck_assert_int_eq(c.blue, tp->led_list[39].color.blue);
+		ratbag_led_unref(l);
+
+		ratbag_profile_unref(p);
+	}
+
+	/* the description is no longer needed once the device exists */
+	ratbag_test_device_free(td);
+
+	ratbag_device_unref(d);
+	ck_assert_int_eq(device_freed_count, 1);
+	ratbag_unref(r);
+}
+END_TEST
+
+START_TEST(device_generated_too_large)
+{
+	struct ratbag *r;
+	struct ratbag_device *d;
+	struct ratbag_test_device td = sane_device;
+
+	r = ratbag_create_context(&abort_iface, NULL);
+
+	/* without button_list, the inline array is the limit */
+	td.num_buttons = RATBAG_TEST_MAX_BUTTONS + 1;
+	d = ratbag_device_new_test_device(r, &td);
+	ck_assert(d == NULL);
+
+	ratbag_unref(r);
+}
+END_TEST
+
+START_TEST(device_trace_entries)
+{
+	struct ratbag *r;
+	struct ratbag_device *d;
+	struct ratbag_test_device td = sane_device;
+	const uint8_t report[] = { 0x10, 0xff, 0x00, 0x00 };
+
+	r = ratbag_create_context(&abort_iface, NULL);
+	ck_assert_int_eq(ratbag_trace_enable(r, 4), 0);
+
+	d = ratbag_device_new_test_device(r, &td);
+	ck_assert_int_eq(d->trace_id, 1);
+	ratbag_device_unref(d);
+
+	/* the ring may still hold records of the removed device */
+	d = ratbag_device_new_test_device(r, &td);
+	ck_assert_int_eq(d->trace_id, 2);
+	ck_assert_int_eq(r->ntrace_devices, 2);
+
+	/* once the ring wrapped, the entry is reused */
+	for (unsigned int i = 0; i < 100; i++) {
+		struct ratbag_device *d2;
+
+		for (unsigned int j = 0; j < 4; j++)
+			ratbag_trace_add(&r->trace, d->trace_id,
+					 RATBAG_TRACE_OUTPUT_REPORT,
+					 report, sizeof(report), 0);
+
+		d2 = ratbag_device_new_test_device(r, &td);
+		ck_assert_int_ne(d2->trace_id, 0);
+		ck_assert_int_ne(d2->trace_id, d->trace_id);
+		ratbag_device_unref(d);
+		d = d2;
+	}
+	ck_assert_int_eq(r->ntrace_devices, 2);
+
+	ratbag_device_unref(d);
+
+	/* re-enabling discards the records and the removed devices */
+	ck_assert_int_eq(ratbag_trace_enable(r, 4), 0);
+	d = ratbag_device_new_test_device(r, &td);
+	ck_assert_int_eq(d->trace_id, 1);
+	ck_assert_int_eq(r->ntrace_devices, 2);
+
+	ratbag_device_unref(d);
+	ratbag_unref(r);
+}
+END_TEST
+
 static Suite *
 test_context_suite(void)
 {
@@ -975,6 +1648,13 @@ test_context_suite(void)
 	tcase_add_test(tc, device_init);
 	tcase_add_test(tc, device_ref_unref);
 	tcase_add_test(tc, device_free_context_before_device);
+	tcase_add_test(tc, device_cache);
+	tcase_add_test(tc, device_export_import_binary);
+	tcase_add_test(tc, device_export_import_json);
+	tcase_add_test(tc, device_import_invalid);
+	tcase_add_test(tc, device_generated);
+	tcase_add_test(tc, device_generated_too_large);
+	tcase_add_test(tc, device_trace_entries);
 	suite_add_tcase(s, tc);
 
 	tc = tcase_create("profiles");
@@ -995,6 +1675,7 @@ test_context_suite(void)
 	tc = tcase_create("resolutions");
 	tcase_add_test(tc, device_resolutions);
 	tcase_add_test(tc, device_resolutions_ref_unref);
+	tcase_add_test(tc, device_resolutions_generation);
 	tcase_add_test(tc, device_resolutions_num_0);
 	suite_add_tcase(s, tc);
 
@@ -1002,6 +1683,9 @@ test_context_suite(void)
 	tcase_add_test(tc, device_buttons);
 	tcase_add_test(tc, device_buttons_ref_unref);
 	tcase_add_test(tc, device_buttons_set);
+	tcase_add_test(tc, device_buttons_macro_shared);
+	tcase_add_test(tc, device_buttons_macro_many);
+	tcase_add_test(tc, device_buttons_macro_threads);
 	suite_add_tcase(s, tc);
 
 	tc = tcase_create("led");
@@ -0,0 +1,962 @@
+/*
+ * Copyright © 2026 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <check.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "hidpp-image.h"
+#include "hidpp20.h"
+#include "libratbag-util.h"
+
+#define ROUNDTRIP_ITERATIONS 2000
+
+/* xorshift32, seeded so failures are reproducible */
+static uint32_t
+rng_next(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+
+	return x;
+}
+
+static void
+random_color(struct hidpp20_color *color, uint32_t *rng)
+{
+	color->red = rng_next(rng);
+	color->green = rng_next(rng);
+	color->blue = rng_next(rng);
+}
+
+/* Fills only the fields the sector format stores for the mode */
+static void
+random_led(struct hidpp20_led *led, uint32_t *rng)
+{
+	static const enum hidpp20_led_mode modes[] = {
+		HIDPP20_LED_OFF,
+		HIDPP20_LED_ON,
+		HIDPP20_LED_CYCLE,
+		HIDPP20_LED_STARLIGHT,
+		HIDPP20_LED_BREATHING,
+		HIDPP20_LED_RIPPLE,
+		HIDPP20_LED_CUSTOM,
+	};
+	unsigned int i;
+
+	memset(led, 0, sizeof(*led));
+	led->mode = modes[rng_next(rng) % ARRAY_LENGTH(modes)];
+
+	switch (led->mode) {
+	case HIDPP20_LED_ON:
+		random_color(&led->color, rng);
+		break;
+	case HIDPP20_LED_CYCLE:
+		led->period = rng_next(rng);
+		led->brightness = 1 + rng_next(rng) % 100;
+		break;
+	case HIDPP20_LED_STARLIGHT:
+		random_color(&led->color, rng);
+		random_color(&led->extra_color, rng);
+		break;
+	case HIDPP20_LED_BREATHING:
+		random_color(&led->color, rng);
+		led->period = rng_next(rng);
+		led->brightness = 1 + rng_next(rng) % 100;
+		break;
+	case HIDPP20_LED_RIPPLE:
+		random_color(&led->color, rng);
+		led->period = rng_next(rng);
+		break;
+	case HIDPP20_LED_OFF:
+		break;
+	default:
+		/* unknown modes are passed through as raw bytes */
+		led->original[0] = led->mode;
+		for (i = 1; i < sizeof(led->original); i++)
+			led->original[i] = rng_next(rng);
+		break;
+	}
+}
+
+static void
+random_button(union hidpp20_button_binding *button, unsigned int index,
+	      uint32_t *rng)
+{
+	memset(button, 0, sizeof(*button));
+
+	switch (rng_next(rng) % 8) {
+	case 0:
+		button->button.type = HIDPP20_BUTTON_HID_TYPE;
+		button->button.subtype = HIDPP20_BUTTON_HID_TYPE_MOUSE;
+		button->button.buttons = 1 + rng_next(rng) % 16;
+		break;
+	case 1:
+		button->keyboard_keys.type = HIDPP20_BUTTON_HID_TYPE;
+		button->keyboard_keys.subtype = HIDPP20_BUTTON_HID_TYPE_KEYBOARD;
+		button->keyboard_keys.modifier_flags = rng_next(rng);
+		button->keyboard_keys.key = rng_next(rng);
+		break;
+	case 2:
+		button->consumer_control.type = HIDPP20_BUTTON_HID_TYPE;
+		button->consumer_control.subtype = HIDPP20_BUTTON_HID_TYPE_CONSUMER_CONTROL;
+		button->consumer_control.consumer_control = rng_next(rng);
+		break;
+	case 3:
+		button->subany.type = HIDPP20_BUTTON_HID_TYPE;
+		button->subany.subtype = HIDPP20_BUTTON_HID_TYPE_NOOP;
+		break;
+	case 4:
+		button->special.type = HIDPP20_BUTTON_SPECIAL;
+		button->special.special = rng_next(rng) % 0x0c;
+		button->special.profile = rng_next(rng);
+		break;
+	case 5:
+		/* the decoded form keeps the sector in 'zero' */
+		button->macro.type = HIDPP20_BUTTON_MACRO;
+		button->macro.page = index;
+		button->macro.zero = rng_next(rng);
+		button->macro.offset = rng_next(rng);
+		break;
+	case 6:
+		button->disabled.type = HIDPP20_BUTTON_DISABLED;
+		break;
+	default:
+		/* unknown types are passed through as raw bytes */
+		button->any.type = 0x20;
+		button->macro.page = rng_next(rng);
+		button->macro.zero = rng_next(rng);
+		button->macro.offset = rng_next(rng);
+		break;
+	}
+}
+
+static void
+random_profile(const struct hidpp20_profiles *profiles,
+	       struct hidpp20_profile *profile,
+	       uint32_t *rng)
+{
+	static const unsigned int rates[] = { 125, 142, 166, 200, 250, 333, 500, 1000 };
+	unsigned int i, len;
+
+	memset(profile, 0, sizeof(*profile));
+
+	profile->report_rate = rates[rng_next(rng) % ARRAY_LENGTH(rates)];
+	profile->default_dpi = rng_next(rng) % HIDPP20_DPI_COUNT;
+	profile->switched_dpi = rng_next(rng) % HIDPP20_DPI_COUNT;
+	profile->powersave_timeout = rng_next(rng);
+	profile->poweroff_timeout = rng_next(rng);
+
+	for (i = 0; i < HIDPP20_DPI_COUNT; i++)
+		profile->dpi[i] = rng_next(rng);
+
+	len = rng_next(rng) % (sizeof(profile->name) - 1);
+	for (i = 0; i < len; i++)
+		profile->name[i] = 'a' + rng_next(rng) % 26;
+
+	for (i = 0; i < profiles->num_buttons; i++)
+		random_button(&profile->buttons[i], i, rng);
+
+	for (i = 0; i < profiles->num_leds; i++) {
+		random_led(&profile->leds[i], rng);
+		/* the alternate LEDs are written as copies of the LEDs */
+		profile->alt_leds[i] = profile->leds[i];
+	}
+}
+
+static void
+assert_led_eq(const struct hidpp20_led *a, const struct hidpp20_led *b)
+{
+	ck_assert_int_eq(a->mode, b->mode);
+	ck_assert_int_eq(a->color.red, b->color.red);
+	ck_assert_int_eq(a->color.green, b->color.green);
+	ck_assert_int_eq(a->color.blue, b->color.blue);
+	ck_assert_int_eq(a->extra_color.red, b->extra_color.red);
+	ck_assert_int_eq(a->extra_color.green, b->extra_color.green);
+	ck_assert_int_eq(a->extra_color.blue, b->extra_color.blue);
+	ck_assert_int_eq(a->period, b->period);
+	ck_assert_int_eq(a->brightness, b->brightness);
+	ck_assert(memcmp(a->original, b->original, sizeof(a->original)) == 0);
+}
+
+static void
+assert_profile_eq(const struct hidpp20_profiles *profiles,
+		  const struct hidpp20_profile *a,
+		  const struct hidpp20_profile *b)
+{
+	unsigned int i;
+
+	ck_assert_int_eq(a->report_rate, b->report_rate);
+	ck_assert_int_eq(a->default_dpi, b->default_dpi);
+	ck_assert_int_eq(a->switched_dpi, b->switched_dpi);
+	ck_assert_int_eq(a->powersave_timeout, b->powersave_timeout);
+	ck_assert_int_eq(a->poweroff_timeout, b->poweroff_timeout);
+	for (i = 0; i < HIDPP20_DPI_COUNT; i++)
+		ck_assert_int_eq(a->dpi[i], b->dpi[i]);
+	ck_assert_str_eq(a->name, b->name);
+	ck_assert(memcmp(a->buttons, b->buttons,
+			 profiles->num_buttons * sizeof(a->buttons[0])) == 0);
+	for (i = 0; i < profiles->num_leds; i++) {
+		assert_led_eq(&a->leds[i], &b->leds[i]);
+		assert_led_eq(&a->alt_leds[i], &b->alt_leds[i]);
+	}
+}
+
+START_TEST(codec_profile_roundtrip)
+{
+	/* the sector sizes seen on devices */
+	const uint16_t sector_sizes[] = { 255, 256, 0x400 };
+	struct hidpp20_profiles profiles = {
+		.num_buttons = 16,
+		.num_leds = HIDPP20_LED_COUNT,
+	};
+	const uint16_t *size;
+	struct hidpp20_profile *in, *out;
+	uint32_t rng = 0x1b04;
+	unsigned int i, s;
+
+	in = zalloc(sizeof(*in));
+	out = zalloc(sizeof(*out));
+
+	ARRAY_FOR_EACH(sector_sizes, size) {
+		_cleanup_free_ uint8_t *data = NULL;
+		_cleanup_free_ uint8_t *again = NULL;
+
+		profiles.sector_size = *size;
+		data = zalloc(*size);
+		again = zalloc(*size);
+
+		for (i = 0; i < ROUNDTRIP_ITERATIONS; i++) {
+			random_profile(&profiles, in, &rng);
+
+			hidpp20_onboard_profiles_encode_profile(&profiles, in, data);
+			ck_assert(hidpp20_onboard_profiles_sector_crc_is_valid(data, *size));
+
+			memset(out, 0, sizeof(*out));
+			hidpp20_onboard_profiles_decode_profile(&profiles, data, out);
+			assert_profile_eq(&profiles, in, out);
+
+			/* the encoding is canonical */
+			hidpp20_onboard_profiles_encode_profile(&profiles, out, again);
+			ck_assert(memcmp(data, again, *size) == 0);
+
+			/* any flipped bit breaks the CRC */
+			s = rng_next(&rng) % *size;
+			data[s] ^= 1 << (rng_next(&rng) % 8);
+			ck_assert(!hidpp20_onboard_profiles_sector_crc_is_valid(data, *size));
+		}
+	}
+
+	free(in);
+	free(out);
+}
+END_TEST
+
+START_TEST(codec_profile_default_name)
+{
+	struct hidpp20_profiles profiles = {
+		.num_buttons = 16,
+		.num_leds = HIDPP20_LED_COUNT,
+		.sector_size = 255,
+	};
+	struct hidpp20_profile *profile;
+	uint8_t data[255];
+
+	profile = zalloc(sizeof(*profile));
+	strcpy(profile->name, "stale");
+
+	/* an unset name is all 0xff and decodes as empty */
+	memset(data, 0xff, sizeof(data));
+	hidpp20_onboard_profiles_decode_profile(&profiles, data, profile);
+	ck_assert_str_eq(profile->name, "");
+
+	free(profile);
+}
+END_TEST
+
+START_TEST(codec_dict_roundtrip)
+{
+	struct hidpp20_profile profile_list[5] = {0};
+	struct hidpp20_profiles profiles = {
+		.num_profiles = ARRAY_LENGTH(profile_list),
+		.sector_size = 255,
+		.profiles = profile_list,
+	};
+	uint8_t data[255];
+	uint32_t rng = 0x8100;
+	bool enabled[ARRAY_LENGTH(profile_list)];
+	unsigned int i, n;
+	int rc;
+
+	for (n = 0; n < 100; n++) {
+		for (i = 0; i < profiles.num_profiles; i++) {
+			enabled[i] = rng_next(&rng) & 0x1;
+			profile_list[i].enabled = enabled[i];
+			profile_list[i].address = 0xdead;
+		}
+
+		hidpp20_onboard_profiles_encode_dict(&profiles, data);
+
+		rc = hidpp20_onboard_profiles_decode_dict(&profiles, data);
+		ck_assert_int_eq(rc, profiles.num_profiles);
+		for (i = 0; i < profiles.num_profiles; i++) {
+			ck_assert_int_eq(profile_list[i].address, i + 1);
+			ck_assert_int_eq(profile_list[i].enabled, enabled[i]);
+		}
+	}
+
+	data[0] ^= 0x80;
+	rc = hidpp20_onboard_profiles_decode_dict(&profiles, data);
+	ck_assert_int_eq(rc, -EAGAIN);
+}
+END_TEST
+
+START_TEST(swid_alloc)
+{
+	struct hidpp20_device device = {0};
+	const uint16_t all = ((1 << (HIDPP20_SWID_LAST + 1)) - 1) &
+			     ~((1 << HIDPP20_SWID_FIRST) - 1);
+	uint32_t rng = 0x3700;
+	uint16_t seen = 0;
+	uint8_t swid;
+
+	hidpp_device_init(&device.base, -1);
+
+	/* every id is handed out once before any is reused */
+	for (unsigned int i = HIDPP20_SWID_FIRST; i <= HIDPP20_SWID_LAST; i++) {
+		swid = hidpp20_swid_alloc(&device);
+		ck_assert_int_ge(swid, HIDPP20_SWID_FIRST);
+		ck_assert_int_le(swid, HIDPP20_SWID_LAST);
+		ck_assert(!(seen & (1 << swid)));
+		seen |= 1 << swid;
+	}
+	ck_assert_int_eq(device.swids_in_flight, all);
+
+	/* all ids in flight, whatever id the scan starts at */
+	for (unsigned int start = 0; start <= 0x10; start++) {
+		device.swids_in_flight = all;
+		device.next_swid = start;
+
+		swid = hidpp20_swid_alloc(&device);
+		ck_assert_int_ge(swid, HIDPP20_SWID_FIRST);
+		ck_assert_int_le(swid, HIDPP20_SWID_LAST);
+		ck_assert_int_eq(device.swids_in_flight, 1 << swid);
+		ck_assert_int_ge(device.next_swid, HIDPP20_SWID_FIRST);
+		ck_assert_int_le(device.next_swid, HIDPP20_SWID_LAST);
+	}
+
+	/* random releases, a free id is never skipped */
+	device.swids_in_flight = 0;
+	for (unsigned int i = 0; i < 10000; i++) {
+		uint16_t before = device.swids_in_flight;
+
+		swid = hidpp20_swid_alloc(&device);
+		ck_assert_int_ge(swid, HIDPP20_SWID_FIRST);
+		ck_assert_int_le(swid, HIDPP20_SWID_LAST);
+		if (before != all)
+			ck_assert(!(before & (1 << swid)));
+		ck_assert_int_eq(device.swids_in_flight & ~all, 0);
+
+		if (rng_next(&rng) & 0x1)
+			device.swids_in_flight &= ~(1 << swid);
+	}
+}
+END_TEST
+
+static int
+answer(struct hidpp_device *dev, int fd, const uint8_t *msg, size_t len)
+{
+	uint8_t reply[LONG_MESSAGE_LENGTH];
+	int rc;
+
+	ck_assert_int_eq(write(fd, msg, len), len);
+	rc = hidpp_read_response(dev, reply, sizeof(reply));
+	ck_assert_int_eq(rc, len);
+	hidpp_device_request_done(dev, reply[3], 0);
+
+	return rc;
+}
+
+START_TEST(request_rtt_pipelined)
+{
+	struct hidpp20_device device = {0};
+	struct ratbag_io_stats_table *table = zalloc(sizeof(*table));
+	struct ratbag_io_stats *first, *second;
+	const struct hidpp_request *request;
+	uint8_t a[SHORT_MESSAGE_LENGTH] = { REPORT_ID_SHORT, 0xff, 0x05, 0x12 };
+	uint8_t b[SHORT_MESSAGE_LENGTH] = { REPORT_ID_SHORT, 0xff, 0x06, 0x23 };
+	int fds[2];
+
+	ck_assert_int_eq(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds), 0);
+	hidpp_device_init(&device.base, fds[0]);
+	device.base.address_mask = 0xf0;
+	hidpp_device_set_io_stats(&device.base, table);
+	first = ratbag_io_stats_get(table, RATBAG_IO_HIDPP, 0x0510);
+	second = ratbag_io_stats_get(table, RATBAG_IO_HIDPP, 0x0620);
+
+	/* both in flight, the second one is answered first */
+	ck_assert_int_eq(hidpp_write_command(&device.base, a, sizeof(a)), 0);
+	msleep(50);
+	ck_assert_int_eq(hidpp_write_command(&device.base, b, sizeof(b)), 0);
+	answer(&device.base, fds[1], b, sizeof(b));
+	answer(&device.base, fds[1], a, sizeof(a));
+
+	ck_assert_int_eq(first->requests, 1);
+	ck_assert_int_eq(second->requests, 1);
+	ck_assert_int_eq(first->bytes_received, sizeof(a));
+	ck_assert_int_eq(second->bytes_received, sizeof(b));
+	ck_assert_int_ge(first->latency_total_us, 50000);
+	ck_assert_int_lt(second->latency_total_us, 50000);
+
+	/* without software ids, the replies come in order */
+	device.base.address_mask = 0xff;
+	a[3] = 0x10;
+	b[3] = 0x20;
+	ck_assert_int_eq(hidpp_write_command(&device.base, a, sizeof(a)), 0);
+	msleep(50);
+	ck_assert_int_eq(hidpp_write_command(&device.base, b, sizeof(b)), 0);
+	answer(&device.base, fds[1], a, sizeof(a));
+	answer(&device.base, fds[1], b, sizeof(b));
+
+	ck_assert_int_eq(first->requests, 2);
+	ck_assert_int_ge(first->latency_total_us, 100000);
+	ck_assert_int_lt(second->latency_total_us, 50000);
+
+	ARRAY_FOR_EACH(device.base.requests, request)
+		ck_assert_int_eq(request->time_us, 0);
+
+	close(fds[0]);
+	close(fds[1]);
+	ratbag_io_stats_table_free(table);
+}
+END_TEST
+
+/* echoes every request as its reply, except the first copy of the
+ * request for parameter 1 */
+static void *
+drop_one_responder(void *data)
+{
+	int fd = *(int *)data;
+	union hidpp20_message msg;
+	bool dropped = false;
+	ssize_t len;
+
+	while ((len = read(fd, msg.data, sizeof(msg.data))) > 0) {
+		if (msg.msg.parameters[0] == 1 && !dropped) {
+			dropped = true;
+			continue;
+		}
+		if (write(fd, msg.data, len) != len)
+			break;
+	}
+
+	return NULL;
+}
+
+START_TEST(request_batch_timeout)
+{
+	struct hidpp20_device device = {0};
+	union hidpp20_message msgs[6];
+	int rcs[ARRAY_LENGTH(msgs)];
+	pthread_t thread;
+	int fds[2];
+
+	ck_assert_int_eq(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds), 0);
+	hidpp_device_init(&device.base, fds[0]);
+	hidpp_device_set_timeout_ceiling(&device.base, 50);
+	device.base.address_mask = 0xf0;
+	device.base.supported_report_types = HIDPP_REPORT_SHORT | HIDPP_REPORT_LONG;
+	device.index = 1;
+	ck_assert_int_eq(pthread_create(&thread, NULL, drop_one_responder, &fds[1]), 0);
+
+	for (unsigned int i = 0; i < ARRAY_LENGTH(msgs); i++) {
+		msgs[i] = (union hidpp20_message) {
+			.msg.report_id = REPORT_ID_LONG,
+			.msg.device_idx = device.index,
+			.msg.sub_id = 0x05,
+			.msg.address = 0x10,
+			.msg.parameters[0] = i,
+		};
+	}
+
+	/* the lost request stalls the batch, the rest is sent one by one */
+	ck_assert_int_eq(hidpp20_request_commands(&device, msgs, rcs, ARRAY_LENGTH(msgs)), 0);
+	for (unsigned int i = 0; i < ARRAY_LENGTH(msgs); i++) {
+		ck_assert_int_eq(rcs[i], 0);
+		ck_assert_int_eq(msgs[i].msg.parameters[0], i);
+	}
+
+	shutdown(fds[0], SHUT_RDWR);
+	pthread_join(thread, NULL);
+	close(fds[0]);
+	close(fds[1]);
+}
+END_TEST
+
+struct log_state {
+	struct hidpp_device dev;
+	enum hidpp_log_priority priority;
+	unsigned int messages;
+	unsigned int lookups;
+};
+
+static void
+count_log(void *userdata, enum hidpp_log_priority priority,
+	  const char *format, va_list args)
+{
+	struct log_state *state = userdata;
+
+	state->messages++;
+}
+
+static enum hidpp_log_priority
+log_priority(void *userdata)
+{
+	struct log_state *state = userdata;
+
+	return state->priority;
+}
+
+static struct hidpp_device *
+log_device(struct log_state *state)
+{
+	state->lookups++;
+
+	return &state->dev;
+}
+
+START_TEST(log_priority_change)
+{
+	struct log_state state = { .priority = HIDPP_LOG_PRIORITY_ERROR };
+	uint8_t buf[4] = {0};
+
+	hidpp_device_init(&state.dev, -1);
+	hidpp_device_set_log_handler(&state.dev, count_log, log_priority, &state);
+
+	hidpp_log_debug(log_device(&state), "hidden\n");
+	hidpp_log_buf_debug(log_device(&state), "hidden", buf, sizeof(buf));
+	ck_assert_int_eq(state.messages, 0);
+
+	/* a priority changed after the setup applies to the next message */
+	state.priority = HIDPP_LOG_PRIORITY_DEBUG;
+	hidpp_log_debug(log_device(&state), "shown\n");
+	hidpp_log_buf_debug(log_device(&state), "shown", buf, sizeof(buf));
+	ck_assert_int_eq(state.messages, 2);
+
+	/* the device argument is evaluated once per message */
+	ck_assert_int_eq(state.lookups, 4);
+}
+END_TEST
+
+#define FLASH_SECTOR_SIZE 256
+
+struct flash {
+	int fd;
+	pthread_t thread;
+	uint8_t sectors[4][FLASH_SECTOR_SIZE];
+};
+
+/* answers 0x8100 memory reads from flash, anything outside of it gets an
+ * ERR_INVALID_ARGUMENT */
+static void *
+flash_responder(void *data)
+{
+	struct flash *flash = data;
+	union hidpp20_message msg;
+	uint16_t sector, offset;
+	ssize_t len;
+
+	while ((len = read(flash->fd, msg.data, sizeof(msg.data))) > 0) {
+		sector = get_unaligned_be_u16(&msg.msg.parameters[0]);
+		offset = get_unaligned_be_u16(&msg.msg.parameters[2]);
+
+		if (sector < ARRAY_LENGTH(flash->sectors) &&
+		    offset <= FLASH_SECTOR_SIZE - 16) {
+			memcpy(msg.msg.parameters, &flash->sectors[sector][offset], 16);
+		} else {
+			msg.msg.parameters[0] = msg.msg.address;
+			msg.msg.parameters[1] = HIDPP20_ERR_INVALID_ARGUMENT;
+			msg.msg.address = msg.msg.sub_id;
+			msg.msg.sub_id = 0xff;
+		}
+
+		if (write(flash->fd, msg.data, len) != len)
+			break;
+	}
+
+	return NULL;
+}
+
+static struct hidpp20_feature flash_features[] = {
+	{ .feature = 0x0000 },
+	{ .feature = HIDPP_PAGE_ONBOARD_PROFILES },
+};
+
+/* a device with onboard profiles in flash, the caller fills in the
+ * sectors before the first request */
+static void
+flash_setup(struct flash *flash, struct hidpp20_device *device)
+{
+	int fds[2];
+
+	ck_assert_int_eq(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds), 0);
+	*device = (struct hidpp20_device) {
+		.feature_list = flash_features,
+		.feature_count = ARRAY_LENGTH(flash_features),
+		.index = 1,
+	};
+	hidpp_device_init(&device->base, fds[0]);
+	device->base.address_mask = 0xf0;
+	device->base.supported_report_types = HIDPP_REPORT_SHORT | HIDPP_REPORT_LONG;
+
+	flash->fd = fds[1];
+	memset(flash->sectors, 0xff, sizeof(flash->sectors));
+	ck_assert_int_eq(pthread_create(&flash->thread, NULL, flash_responder, flash), 0);
+}
+
+static void
+flash_teardown(struct flash *flash, struct hidpp20_device *device)
+{
+	shutdown(device->base.hidraw_fd, SHUT_RDWR);
+	pthread_join(flash->thread, NULL);
+	close(device->base.hidraw_fd);
+	close(flash->fd);
+}
+
+START_TEST(onboard_profiles_check_crcs)
+{
+	struct hidpp20_device device;
+	struct hidpp20_profile profile_list[2] = {0};
+	struct hidpp20_profiles profiles = {
+		.num_profiles = ARRAY_LENGTH(profile_list),
+		.num_rom_profiles = 1,
+		.sector_size = FLASH_SECTOR_SIZE,
+		.profiles = profile_list,
+	};
+	struct flash flash;
+	uint32_t rng = 0x1234;
+
+	flash_setup(&flash, &device);
+
+	/* a directory with two profiles in sectors 1 and 2 */
+	for (unsigned int i = 0; i < profiles.num_profiles; i++) {
+		random_profile(&profiles, &profile_list[i], &rng);
+		profile_list[i].enabled = 1;
+		hidpp20_onboard_profiles_encode_profile(&profiles, &profile_list[i],
+							flash.sectors[i + 1]);
+	}
+	hidpp20_onboard_profiles_encode_dict(&profiles, flash.sectors[0]);
+
+	ck_assert_int_eq(hidpp20_onboard_profiles_initialize(&device, &profiles),
+			 profiles.num_profiles);
+	ck_assert_int_eq(profiles.num_sector_crcs, 3);
+	ck_assert_int_eq(hidpp20_onboard_profiles_check_crcs(&device, &profiles), 0);
+
+	/* something else rewrote the second profile */
+	flash.sectors[2][0] ^= 0x1;
+	hidpp20_onboard_profiles_sector_set_crc(flash.sectors[2], FLASH_SECTOR_SIZE);
+	ck_assert_int_eq(hidpp20_onboard_profiles_check_crcs(&device, &profiles), 1);
+
+	ck_assert_int_eq(hidpp20_onboard_profiles_initialize(&device, &profiles),
+			 profiles.num_profiles);
+	ck_assert_int_eq(hidpp20_onboard_profiles_check_crcs(&device, &profiles), 0);
+
+	/* a sector that can no longer be read counts as changed */
+	profiles.sector_crcs[0].sector = ARRAY_LENGTH(flash.sectors);
+	ck_assert_int_eq(hidpp20_onboard_profiles_check_crcs(&device, &profiles), 1);
+
+	flash_teardown(&flash, &device);
+	free(profiles.sector_crcs);
+}
+END_TEST
+
+START_TEST(onboard_profiles_macro)
+{
+	struct hidpp20_device device;
+	struct hidpp20_profiles profiles = { .sector_size = FLASH_SECTOR_SIZE };
+	union hidpp20_macro_data *macro = NULL;
+	struct flash flash;
+	const uint8_t jump_first[] = {
+		HIDPP20_MACRO_JUMP, 3, 1,
+		HIDPP20_MACRO_JUMP, 0, ARRAY_LENGTH(flash.sectors), /* unreadable */
+		0x30, 0x00, 0x00, /* unknown tag */
+	};
+	const uint8_t items[] = {
+		HIDPP20_MACRO_KEY_PRESS, 0x00, 0x04,
+		HIDPP20_MACRO_DELAY, 0x01, 0x02,
+		HIDPP20_MACRO_KEY_RELEASE, 0x00, 0x04,
+		HIDPP20_MACRO_END,
+	};
+	const uint8_t endless[] = {
+		HIDPP20_MACRO_KEY_PRESS, 0x00, 0x05,
+		HIDPP20_MACRO_JUMP, 0, 2,
+	};
+	const uint8_t jump_loop[] = {
+		HIDPP20_MACRO_JUMP, 0, 3,
+	};
+
+	flash_setup(&flash, &device);
+	memcpy(&flash.sectors[0][0], jump_first, sizeof(jump_first));
+	memcpy(&flash.sectors[1][3], items, sizeof(items));
+	memcpy(&flash.sectors[2][0], endless, sizeof(endless));
+	memcpy(&flash.sectors[3][0], jump_loop, sizeof(jump_loop));
+
+	/* a JUMP as the first item is followed, not stored */
+	ck_assert_int_eq(hidpp20_onboard_profiles_parse_macro(&device, &profiles, 0, 0, &macro), 0);
+	ck_assert_ptr_nonnull(macro);
+	ck_assert_int_eq(macro[0].key.type, HIDPP20_MACRO_KEY_PRESS);
+	ck_assert_int_eq(macro[0].key.key, 0x04);
+	ck_assert_int_eq(macro[1].delay.type, HIDPP20_MACRO_DELAY);
+	ck_assert_int_eq(macro[1].delay.time, 0x0102);
+	ck_assert_int_eq(macro[2].key.type, HIDPP20_MACRO_KEY_RELEASE);
+	ck_assert_int_eq(macro[3].end.type, HIDPP20_MACRO_END);
+	macro = mfree(macro);
+
+	/* items in a loop are truncated */
+	ck_assert_int_eq(hidpp20_onboard_profiles_parse_macro(&device, &profiles, 2, 0, &macro), 0);
+	ck_assert_ptr_nonnull(macro);
+	for (unsigned int i = 0; i < HIDPP20_MACRO_MAX_ITEMS; i++)
+		ck_assert_int_eq(macro[i].key.type, HIDPP20_MACRO_KEY_PRESS);
+	ck_assert_int_eq(macro[HIDPP20_MACRO_MAX_ITEMS].end.type, HIDPP20_MACRO_END);
+	macro = mfree(macro);
+
+	/* a loop of JUMPs hits the step limit */
+	ck_assert_int_eq(hidpp20_onboard_profiles_parse_macro(&device, &profiles, 3, 0, &macro), -EFAULT);
+	ck_assert_ptr_null(macro);
+
+	/* a JUMP into a sector that can't be read */
+	ck_assert_int_lt(hidpp20_onboard_profiles_parse_macro(&device, &profiles, 0, 3, &macro), 0);
+	ck_assert_ptr_null(macro);
+
+
+	/* an unknown tag */
+	ck_assert_int_eq(hidpp20_onboard_profiles_parse_macro(&device, &profiles, 0, 6, &macro), -EFAULT);
+	ck_assert_ptr_null(macro);
+
+	flash_teardown(&flash, &device);
+}
+END_TEST
+
+/* the image in buf as read by hidpp_image_read_fd() */
+static int
+image_from_bytes(const uint8_t *buf, size_t len, struct hidpp_image **image)
+{
+	FILE *fp = tmpfile();
+	int rc;
+
+	ck_assert_ptr_nonnull(fp);
+	ck_assert_int_eq(fwrite(buf, 1, len, fp), len);
+	fflush(fp);
+	rewind(fp);
+	rc = hidpp_image_read_fd(fileno(fp), image);
+	fclose(fp);
+
+	return rc;
+}
+
+static size_t
+image_to_bytes(const struct hidpp_image *image, uint8_t *buf, size_t size)
+{
+	FILE *fp = tmpfile();
+	size_t len;
+
+	ck_assert_ptr_nonnull(fp);
+	ck_assert_int_eq(hidpp_image_write_fd(image, fileno(fp)), 0);
+	rewind(fp);
+	len = fread(buf, 1, size, fp);
+	ck_assert(feof(fp));
+	fclose(fp);
+
+	return len;
+}
+
+START_TEST(image_roundtrip)
+{
+	struct hidpp_image *image, *copy;
+	enum hidpp_image_sector_status status;
+	uint8_t sector[16];
+	uint8_t buf[512];
+	size_t len;
+
+	image = hidpp_image_new(sizeof(sector));
+	image->header.bustype = 0x0003;
+	image->header.vendor = 0x046d;
+	image->header.product = 0xc082;
+	image->header.proto_major = 4;
+	image->header.proto_minor = 2;
+	memcpy(image->header.fw_prefix, "MPM", 3);
+	image->header.fw_major = 0x12;
+	image->header.fw_minor = 0x34;
+	image->header.fw_build = 0xabcd;
+	for (unsigned int i = 0; i < sizeof(sector); i++)
+		sector[i] = i;
+	hidpp_image_add_sector(image, 0x0001, HIDPP_IMAGE_SECTOR_OK, sector);
+	hidpp_image_add_sector(image, 0x0102, HIDPP_IMAGE_SECTOR_BAD_CRC, sector);
+	hidpp_image_add_sector(image, 0x0203, HIDPP_IMAGE_SECTOR_UNREADABLE, NULL);
+
+	len = image_to_bytes(image, buf, sizeof(buf));
+	ck_assert_int_eq(len, sizeof(struct hidpp_image_header) +
+			 3 * (sizeof(struct hidpp_image_sector) + sizeof(sector)));
+
+	/* little-endian on every host */
+	ck_assert_int_eq(buf[offsetof(struct hidpp_image_header, version)], HIDPP_IMAGE_VERSION);
+	ck_assert_int_eq(buf[offsetof(struct hidpp_image_header, vendor)], 0x6d);
+	ck_assert_int_eq(buf[offsetof(struct hidpp_image_header, vendor) + 1], 0x04);
+	ck_assert_int_eq(buf[offsetof(struct hidpp_image_header, fw_build)], 0xcd);
+	ck_assert_int_eq(buf[offsetof(struct hidpp_image_header, nsectors)], 3);
+	ck_assert_int_eq(buf[sizeof(struct hidpp_image_header) + 4], 0x02);
+	ck_assert_int_eq(buf[sizeof(struct hidpp_image_header) + 5], 0x01);
+
+	ck_assert_int_eq(image_from_bytes(buf, len, &copy), 0);
+	ck_assert_int_eq(memcmp(&copy->header, &image->header, sizeof(image->header)), 0);
+	ck_assert_int_eq(memcmp(hidpp_image_get_sector(copy, 0x0001, &status), sector,
+				sizeof(sector)), 0);
+	ck_assert_int_eq(status, HIDPP_IMAGE_SECTOR_OK);
+	ck_assert_ptr_nonnull(hidpp_image_get_sector(copy, 0x0102, &status));
+	ck_assert_int_eq(status, HIDPP_IMAGE_SECTOR_BAD_CRC);
+	ck_assert_ptr_nonnull(hidpp_image_get_sector(copy, 0x0203, &status));
+	ck_assert_int_eq(status, HIDPP_IMAGE_SECTOR_UNREADABLE);
+	ck_assert_ptr_null(hidpp_image_get_sector(copy, 0x0304, &status));
+
+	hidpp_image_destroy(copy);
+	hidpp_image_destroy(image);
+}
+END_TEST
+
+START_TEST(image_corrupt)
+{
+	struct hidpp_image *image, *copy = NULL;
+	uint8_t sector[16] = {0};
+	uint8_t buf[512], bad[512];
+	size_t len, nsectors_offset = offsetof(struct hidpp_image_header, nsectors);
+
+	image = hidpp_image_new(sizeof(sector));
+	hidpp_image_add_sector(image, 1, HIDPP_IMAGE_SECTOR_OK, sector);
+	hidpp_image_add_sector(image, 2, HIDPP_IMAGE_SECTOR_OK, sector);
+	len = image_to_bytes(image, buf, sizeof(buf));
+	hidpp_image_destroy(image);
+
+	/* cut off anywhere */
+	for (size_t l = 0; l < len; l++) {
+		int expected = l < sizeof(struct hidpp_image_header) ? -EINVAL : -EBADMSG;
+
+		ck_assert_int_eq(image_from_bytes(buf, l, &copy), expected);
+	}
+
+	memcpy(bad, buf, len);
+	bad[0] = 'X';
+	ck_assert_int_eq(image_from_bytes(bad, len, &copy), -EINVAL);
+
+	memcpy(bad, buf, len);
+	bad[offsetof(struct hidpp_image_header, version)]++;
+	ck_assert_int_eq(image_from_bytes(bad, len, &copy), -EINVAL);
+
+	/* more sectors than the file has */
+	memcpy(bad, buf, len);
+	bad[nsectors_offset]++;
+	ck_assert_int_eq(image_from_bytes(bad, len, &copy), -EBADMSG);
+
+	/* 0xffff sectors of 0xffff bytes */
+	memcpy(bad, buf, len);
+	memset(&bad[offsetof(struct hidpp_image_header, sector_size)], 0xff, 4);
+	ck_assert_int_eq(image_from_bytes(bad, len, &copy), -EBADMSG);
+
+	memcpy(bad, buf, len);
+	bad[sizeof(struct hidpp_image_header) + offsetof(struct hidpp_image_sector, status)] = 0x7f;
+	ck_assert_int_eq(image_from_bytes(bad, len, &copy), -EBADMSG);
+
+	ck_assert_ptr_null(copy);
+}
+END_TEST
+
+static Suite *
+test_hidpp20_suite(void)
+{
+	TCase *tc;
+	Suite *s;
+
+	s = suite_create("hidpp20");
+	tc = tcase_create("codec");
+	tcase_add_test(tc, codec_profile_roundtrip);
+	tcase_add_test(tc, codec_profile_default_name);
+	tcase_add_test(tc, codec_dict_roundtrip);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("swid");
+	tcase_add_test(tc, swid_alloc);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("request");
+	tcase_add_test(tc, request_rtt_pipelined);
+	tcase_add_test(tc, request_batch_timeout);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("image");
+	tcase_add_test(tc, image_roundtrip);
+	tcase_add_test(tc, image_corrupt);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("log");
+	tcase_add_test(tc, log_priority_change);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("onboard_profiles");
+	tcase_add_test(tc, onboard_profiles_check_crcs);
+	tcase_add_test(tc, onboard_profiles_macro);
+	suite_add_tcase(s, tc);
+	return s;
+}
+
+int main(void)
+{
+	int nfailed;
+	Suite *s;
+	SRunner *sr;
+	const struct rlimit corelimit = { 0, 0 };
+
+	setenv("RATBAG_TEST", "1", 0);
+
+	setrlimit(RLIMIT_CORE, &corelimit);
+
+	s = test_hidpp20_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_ENV);
+	nfailed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return (nfailed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,451 @@
+/*
+ * Copyright © 2026 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <check.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include "libratbag-util.h"
+#include "ratbagd.h"
+#include "ratbagd-json.h"
+
+/* the parser logs every error, the tests trigger plenty of them */
+void log_info(const char *fmt, ...) { }
+void log_verbose(const char *fmt, ...) { }
+void log_error(const char *fmt, ...) { }
+
+static char json[65536];
+
+/* printf into json, the result must fit */
+__attribute__((format(printf, 1, 2)))
+static const char *
+build_json(const char *fmt, ...)
+{
+	va_list args;
+	int n;
+
+	va_start(args, fmt);
+	n = vsnprintf(json, sizeof(json), fmt, args);
+	va_end(args);
+	ck_assert_int_lt(n, sizeof(json));
+
+	return json;
+}
+
+/* a comma-separated list of n copies of elem */
+static char *
+repeat(const char *elem, unsigned int n)
+{
+	size_t len = strlen(elem);
+	char *str = zalloc(n * (len + 2) + 1);
+	char *s = str;
+
+	for (unsigned int i = 0; i < n; i++)
+		s += sprintf(s, "%s%s", i ? ", " : "", elem);
+
+	return str;
+}
+
+static int
+parse(const char *data, struct ratbag_test_device *td)
+{
+	*td = (struct ratbag_test_device) {
+		.num_profiles = 1,
+		.num_resolutions = 1,
+		.num_buttons = 1,
+	};
+
+	return ratbagd_parse_json(data, td);
+}
+
+static void
+free_names(struct ratbag_test_device *td)
+{
+	for (unsigned int i = 0; i < ARRAY_LENGTH(td->profiles); i++) {
+		free(td->profiles[i].name);
+		td->profiles[i].name = NULL;
+	}
+}
+
+/* parses {"profiles": [{"name": <name>}]}, name is the JSON string */
+static int
+parse_name(const char *name, struct ratbag_test_device *td)
+{
+	return parse(build_json("{\"profiles\": [{\"name\": %s}]}", name), td);
+}
+
+START_TEST(json_minimal)
+{
+	struct ratbag_test_device td;
+
+	ck_assert_int_eq(parse("{\"profiles\": [{}]}", &td), 0);
+	ck_assert_int_eq(td.num_profiles, 1);
+	ck_assert_int_eq(td.num_resolutions, 1);
+	ck_assert_int_eq(td.num_buttons, 1);
+
+	/* unknown top-level members are skipped */
+	ck_assert_int_eq(parse("{\"x\": {\"a\": [1, -2.5e3, true, null, \"s\"]},"
+			       " \"profiles\": []}", &td), 0);
+	ck_assert_int_eq(td.num_profiles, 0);
+
+	ck_assert_int_eq(parse("{}", &td), -EINVAL);
+	ck_assert_int_eq(parse("", &td), -EINVAL);
+	ck_assert_int_eq(parse("[]", &td), -EINVAL);
+	ck_assert_int_eq(parse("{\"profiles\": [{\"bogus\": 1}]}", &td), -EINVAL);
+}
+END_TEST
+
+START_TEST(json_string_escapes)
+{
+	struct ratbag_test_device td;
+
+	ck_assert_int_eq(parse_name("\"a\\\"b\\\\c\\/d\\n\\t\"", &td), 0);
+	ck_assert_str_eq(td.profiles[0].name, "a\"b\\c/d\n\t");
+	free_names(&td);
+
+	/* one, two and three byte UTF-8 */
+	ck_assert_int_eq(parse_name("\"\\u0041\\u00e9\\u20AC\"", &td), 0);
+	ck_assert_str_eq(td.profiles[0].name, "A\xc3\xa9\xe2\x82\xac");
+	free_names(&td);
+
+	/* NUL would truncate the string */
+	ck_assert_int_eq(parse_name("\"a\\u0000b\"", &td), -EINVAL);
+	/* surrogates, alone or as a pair, aren't supported */
+	ck_assert_int_eq(parse_name("\"\\ud83d\"", &td), -EINVAL);
+	ck_assert_int_eq(parse_name("\"\\ud83d\\ude00\"", &td), -EINVAL);
+	ck_assert_int_eq(parse_name("\"\\udfff\"", &td), -EINVAL);
+	/* short or invalid escapes */
+	ck_assert_int_eq(parse_name("\"\\u12\"", &td), -EINVAL);
+	ck_assert_int_eq(parse_name("\"\\u12g4\"", &td), -EINVAL);
+	ck_assert_int_eq(parse_name("\"\\x41\"", &td), -EINVAL);
+	/* control characters must be escaped */
+	ck_assert_int_eq(parse_name("\"a\tb\"", &td), -EINVAL);
+	/* unterminated */
+	ck_assert_int_eq(parse_name("\"abc", &td), -EINVAL);
+	free_names(&td);
+}
+END_TEST
+
+START_TEST(json_string_limit)
+{
+	struct ratbag_test_device td;
+	char name[300];
+
+	/* 255 bytes plus the NUL fill the buffer */
+	memset(name, 'a', sizeof(name));
+	name[0] = '"';
+	name[256] = '"';
+	name[257] = '\0';
+	ck_assert_int_eq(parse_name(name, &td), 0);
+	ck_assert_int_eq(strlen(td.profiles[0].name), 255);
+	free_names(&td);
+
+	name[256] = 'a';
+	name[257] = '"';
+	name[258] = '\0';
+	ck_assert_int_eq(parse_name(name, &td), -EINVAL);
+
+	/* the limit is on the decoded bytes, 254 + 2 is too much */
+	sprintf(name + 255, "\\u00e9\"");
+	ck_assert_int_eq(parse_name(name, &td), -EINVAL);
+	free_names(&td);
+
+	/* skipped strings are not limited */
+	memset(json, 'a', 1024);
+	memcpy(json, "{\"x\": \"", 7);
+	sprintf(json + 1000, "\", \"profiles\": []}");
+	ck_assert_int_eq(parse(json, &td), 0);
+}
+END_TEST
+
+START_TEST(json_depth_limit)
+{
+	struct ratbag_test_device td;
+	char open[64] = {0}, close[64] = {0};
+
+	/* the skipped value itself is depth 0 */
+	memset(open, '[', 33);
+	memset(close, ']', 33);
+	ck_assert_int_eq(parse(build_json("{\"x\": %s%s, \"profiles\": []}",
+					  open, close), &td), 0);
+
+	open[33] = '[';
+	close[33] = ']';
+	ck_assert_int_eq(parse(build_json("{\"x\": %s%s, \"profiles\": []}",
+					  open, close), &td), -EINVAL);
+
+	/* objects count too */
+	ck_assert_int_eq(parse(build_json("{\"x\": %s{\"a\": {}}%s, \"profiles\": []}",
+					  open + 2, close + 2), &td), -EINVAL);
+}
+END_TEST
+
+START_TEST(json_integers)
+{
+	struct ratbag_test_device td;
+
+	ck_assert_int_eq(parse("{\"profiles\": [{\"rate\": 20000}]}", &td), 0);
+	ck_assert_int_eq(td.profiles[0].hz, 20000);
+	ck_assert_int_eq(parse("{\"profiles\": [{\"rate\": 0}]}", &td), 0);
+	ck_assert_int_eq(td.profiles[0].hz, 0);
+
+	/* out of range */
+	ck_assert_int_eq(parse("{\"profiles\": [{\"rate\": 20001}]}", &td), -EINVAL);
+	ck_assert_int_eq(parse("{\"profiles\": [{\"rate\": -1}]}", &td), -EINVAL);
+
+	/* overflow, caught before the value wraps */
+	ck_assert_int_eq(parse("{\"profiles\": [{\"capabilities\": [2147483647]}]}", &td), 0);
+	ck_assert_int_eq(td.profiles[0].caps[0], 2147483647);
+	ck_assert_int_eq(parse("{\"profiles\": [{\"capabilities\": [2147483648]}]}", &td), -EINVAL);
+	ck_assert_int_eq(parse("{\"profiles\": [{\"rate\": 99999999999999999999999}]}", &td), -EINVAL);
+	ck_assert_int_eq(parse("{\"profiles\": [{\"rate\": 18446744073709552616}]}", &td), -EINVAL);
+
+	/* fractions and exponents */
+	ck_assert_int_eq(parse("{\"profiles\": [{\"rate\": 1000.5}]}", &td), -EINVAL);
+	ck_assert_int_eq(parse("{\"profiles\": [{\"rate\": 1000.0}]}", &td), -EINVAL);
+	ck_assert_int_eq(parse("{\"profiles\": [{\"rate\": 1e3}]}", &td), -EINVAL);
+	ck_assert_int_eq(parse("{\"profiles\": [{\"rate\": 1E3}]}", &td), -EINVAL);
+
+	/* not a number */
+	ck_assert_int_eq(parse("{\"profiles\": [{\"rate\": \"1000\"}]}", &td), -EINVAL);
+	ck_assert_int_eq(parse("{\"profiles\": [{\"rate\": -}]}", &td), -EINVAL);
+	ck_assert_int_eq(parse("{\"profiles\": [{\"rate\": true}]}", &td), -EINVAL);
+}
+END_TEST
+
+START_TEST(json_too_many_profiles)
+{
+	struct ratbag_test_device td;
+	char *profiles;
+
+	profiles = repeat("{}", RATBAG_TEST_MAX_PROFILES);
+	ck_assert_int_eq(parse(build_json("{\"profiles\": [%s]}", profiles), &td), 0);
+	ck_assert_int_eq(td.num_profiles, RATBAG_TEST_MAX_PROFILES);
+	free(profiles);
+
+	profiles = repeat("{}", RATBAG_TEST_MAX_PROFILES + 1);
+	ck_assert_int_eq(parse(build_json("{\"profiles\": [%s]}", profiles), &td), -EINVAL);
+	free(profiles);
+}
+END_TEST
+
+START_TEST(json_too_many_buttons)
+{
+	struct ratbag_test_device td;
+	char *buttons;
+
+	buttons = repeat("{\"action_type\": \"button\", \"button\": 1}",
+			 RATBAG_TEST_MAX_BUTTONS);
+	ck_assert_int_eq(parse(build_json("{\"profiles\": [{\"buttons\": [%s]}]}",
+					  buttons), &td), 0);
+	ck_assert_int_eq(td.num_buttons, RATBAG_TEST_MAX_BUTTONS);
+	free(buttons);
+
+	buttons = repeat("{}", RATBAG_TEST_MAX_BUTTONS + 1);
+	ck_assert_int_eq(parse(build_json("{\"profiles\": [{\"buttons\": [%s]}]}",
+					  buttons), &td), -EINVAL);
+	free(buttons);
+
+	buttons = repeat("{}", RATBAG_TEST_MAX_RESOLUTIONS + 1);
+	ck_assert_int_eq(parse(build_json("{\"profiles\": [{\"resolutions\": [%s]}]}",
+					  buttons), &td), -EINVAL);
+	free(buttons);
+
+	buttons = repeat("{}", RATBAG_TEST_MAX_LEDS + 1);
+	ck_assert_int_eq(parse(build_json("{\"profiles\": [{\"leds\": [%s]}]}",
+					  buttons), &td), -EINVAL);
+	free(buttons);
+}
+END_TEST
+
+START_TEST(json_too_many_macro_events)
+{
+	struct ratbag_test_device td;
+	const unsigned int max = ARRAY_LENGTH(td.profiles[0].buttons[0].macro) - 1;
+	char *events;
+
+	/* one slot stays free for the terminating event */
+	events = repeat("\"t10\"", max);
+	ck_assert_int_eq(parse(build_json("{\"profiles\": [{\"buttons\": [{"
+					  "\"action_type\": \"macro\", \"macro\": [%s]}]}]}",
+					  events), &td), 0);
+	ck_assert_int_eq(td.profiles[0].buttons[0].macro[max - 1].type,
+			 RATBAG_MACRO_EVENT_WAIT);
+	ck_assert_int_eq(td.profiles[0].buttons[0].macro[max - 1].value, 10);
+	ck_assert_int_eq(td.profiles[0].buttons[0].macro[max].type,
+			 RATBAG_MACRO_EVENT_NONE);
+	free(events);
+
+	events = repeat("\"t10\"", max + 1);
+	ck_assert_int_eq(parse(build_json("{\"profiles\": [{\"buttons\": [{"
+					  "\"action_type\": \"macro\", \"macro\": [%s]}]}]}",
+					  events), &td), -EINVAL);
+	free(events);
+
+	ck_assert_int_eq(parse("{\"profiles\": [{\"buttons\": [{"
+			       "\"macro\": [\"x10\"]}]}]}", &td), -EINVAL);
+}
+END_TEST
+
+START_TEST(json_too_many_capabilities)
+{
+	struct ratbag_test_device td;
+	const unsigned int max = ARRAY_LENGTH(td.profiles[0].caps) - 1;
+	char *caps;
+
+	/* the arrays stay zero-terminated */
+	caps = repeat("1", max);
+	ck_assert_int_eq(parse(build_json("{\"profiles\": [{\"capabilities\": [%s]}]}",
+					  caps), &td), 0);
+	ck_assert_int_eq(td.profiles[0].caps[max - 1], 1);
+	ck_assert_int_eq(td.profiles[0].caps[max], 0);
+	ck_assert_int_eq(parse(build_json("{\"profiles\": [{\"resolutions\": [{"
+					  "\"capabilities\": [%s]}]}]}", caps), &td), 0);
+	free(caps);
+
+	caps = repeat("1", max + 1);
+	ck_assert_int_eq(parse(build_json("{\"profiles\": [{\"capabilities\": [%s]}]}",
+					  caps), &td), -EINVAL);
+	ck_assert_int_eq(parse(build_json("{\"profiles\": [{\"resolutions\": [{"
+					  "\"capabilities\": [%s]}]}]}", caps), &td), -EINVAL);
+	free(caps);
+
+	caps = repeat("1", ARRAY_LENGTH(td.profiles[0].report_rates));
+	ck_assert_int_eq(parse(build_json("{\"profiles\": [{\"report_rates\": [%s]}]}",
+					  caps), &td), -EINVAL);
+	free(caps);
+}
+END_TEST
+
+START_TEST(json_color)
+{
+	struct ratbag_test_device td;
+
+	ck_assert_int_eq(parse("{\"profiles\": [{\"leds\": [{\"color\": [255, 128, 0]}]}]}",
+			       &td), 0);
+	ck_assert_int_eq(td.num_leds, 1);
+	ck_assert_int_eq(td.profiles[0].leds[0].color.red, 255);
+	ck_assert_int_eq(td.profiles[0].leds[0].color.green, 128);
+	ck_assert_int_eq(td.profiles[0].leds[0].color.blue, 0);
+
+	ck_assert_int_eq(parse("{\"profiles\": [{\"leds\": [{\"color\": []}]}]}",
+			       &td), -EINVAL);
+	ck_assert_int_eq(parse("{\"profiles\": [{\"leds\": [{\"color\": [1, 2]}]}]}",
+			       &td), -EINVAL);
+	ck_assert_int_eq(parse("{\"profiles\": [{\"leds\": [{\"color\": [1, 2, 3, 4]}]}]}",
+			       &td), -EINVAL);
+	ck_assert_int_eq(parse("{\"profiles\": [{\"leds\": [{\"color\": [256, 0, 0]}]}]}",
+			       &td), -EINVAL);
+	ck_assert_int_eq(parse("{\"profiles\": [{\"leds\": [{\"color\": 255}]}]}",
+			       &td), -EINVAL);
+}
+END_TEST
+
+START_TEST(json_trailing_garbage)
+{
+	struct ratbag_test_device td;
+
+	ck_assert_int_eq(parse("{\"profiles\": []} \n\t", &td), 0);
+
+	ck_assert_int_eq(parse("{\"profiles\": []} x", &td), -EINVAL);
+	ck_assert_int_eq(parse("{\"profiles\": []}}", &td), -EINVAL);
+	ck_assert_int_eq(parse("{\"profiles\": []}{\"profiles\": []}", &td), -EINVAL);
+	ck_assert_int_eq(parse("{\"profiles\": [],}", &td), -EINVAL);
+	ck_assert_int_eq(parse("{\"profiles\": [{},]}", &td), -EINVAL);
+	ck_assert_int_eq(parse("{\"profiles\": [{}]", &td), -EINVAL);
+}
+END_TEST
+
+START_TEST(json_error_not_sticky)
+{
+	struct ratbag_test_device td;
+
+	ck_assert_int_eq(parse("{\"profiles\": [{\"rate\": 1.5}]}", &td), -EINVAL);
+	ck_assert_int_eq(parse("{\"profiles\": [{\"rate\": 500}]}", &td), 0);
+	ck_assert_int_eq(td.profiles[0].hz, 500);
+
+	ck_assert_int_eq(parse("{\"profiles\": [{\"bogus\": 1}]}", &td), -EINVAL);
+	ck_assert_int_eq(parse("{\"profiles\": [{}, {}]}", &td), 0);
+	ck_assert_int_eq(td.num_profiles, 2);
+}
+END_TEST
+
+START_TEST(json_keyword_tables)
+{
+	ck_assert_int_eq(ratbagd_json_check_keywords(), 0);
+}
+END_TEST
+
+static Suite *
+test_ratbagd_json_suite(void)
+{
+	TCase *tc;
+	Suite *s;
+
+	s = suite_create("ratbagd-json");
+	tc = tcase_create("syntax");
+	tcase_add_test(tc, json_keyword_tables);
+	tcase_add_test(tc, json_minimal);
+	tcase_add_test(tc, json_string_escapes);
+	tcase_add_test(tc, json_string_limit);
+	tcase_add_test(tc, json_depth_limit);
+	tcase_add_test(tc, json_integers);
+	tcase_add_test(tc, json_trailing_garbage);
+	tcase_add_test(tc, json_error_not_sticky);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("limits");
+	tcase_add_test(tc, json_too_many_profiles);
+	tcase_add_test(tc, json_too_many_buttons);
+	tcase_add_test(tc, json_too_many_macro_events);
+	tcase_add_test(tc, json_too_many_capabilities);
+	tcase_add_test(tc, json_color);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
+
+int main(void)
+{
+	int nfailed;
+	Suite *s;
+	SRunner *sr;
+	const struct rlimit corelimit = { 0, 0 };
+
+	setrlimit(RLIMIT_CORE, &corelimit);
+
+	s = test_ratbagd_json_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_ENV);
+	nfailed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return (nfailed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -26,6 +26,7 @@
 #include <check.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -34,6 +35,8 @@
 #include <sys/resource.h>
 
 #include "libratbag-util.h"
+#include "libratbag-stats.h"
+#include "libratbag-trace.h"
 
 START_TEST(dpi_range_parser)
 {
@@ -122,6 +125,329 @@ START_TEST(dpi_list_parser)
 }
 END_TEST
 
+START_TEST(rtt_estimator)
+{
+	struct rtt_estimator rtt;
+	unsigned int timeout;
+
+	rtt_estimator_init(&rtt, 1000);
+	/* no samples yet, the ceiling is the timeout */
+	ck_assert_int_eq(rtt_estimator_timeout(&rtt), 1000);
+	ck_assert(!rtt_estimator_backoff(&rtt));
+
+	/* 10ms round trips end up at the minimum timeout */
+	for (int i = 0; i < 20; i++)
+		rtt_estimator_sample(&rtt, 10000);
+	ck_assert_int_eq(rtt_estimator_timeout(&rtt), RTT_TIMEOUT_MIN_MS);
+
+	/* backoff doubles a bounded number of times, well below the
+	 * ceiling */
+	ck_assert(rtt_estimator_backoff(&rtt));
+	ck_assert_int_eq(rtt_estimator_timeout(&rtt), RTT_TIMEOUT_MIN_MS * 2);
+	while (rtt_estimator_backoff(&rtt))
+		;
+	ck_assert_int_eq(rtt_estimator_timeout(&rtt),
+			 RTT_TIMEOUT_MIN_MS << RTT_BACKOFF_MAX);
+	ck_assert(!rtt_estimator_backoff(&rtt));
+
+	/* a new sample resets the backoff */
+	rtt_estimator_sample(&rtt, 10000);
+	ck_assert_int_eq(rtt_estimator_timeout(&rtt), RTT_TIMEOUT_MIN_MS);
+	ck_assert(rtt_estimator_backoff(&rtt));
+	rtt_estimator_sample(&rtt, 10000);
+
+	/* the ceiling caps the backoff too */
+	rtt_estimator_init(&rtt, RTT_TIMEOUT_MIN_MS * 2);
+	for (int i = 0; i < 20; i++)
+		rtt_estimator_sample(&rtt, 10000);
+	ck_assert(rtt_estimator_backoff(&rtt));
+	ck_assert(!rtt_estimator_backoff(&rtt));
+	ck_assert_int_eq(rtt_estimator_timeout(&rtt), RTT_TIMEOUT_MIN_MS * 2);
+	rtt_estimator_init(&rtt, 1000);
+
+	/* slow round trips push the timeout up, bounded by the ceiling */
+	rtt_estimator_sample(&rtt, 300000);
+	timeout = rtt_estimator_timeout(&rtt);
+	ck_assert_int_gt(timeout, RTT_TIMEOUT_MIN_MS);
+	ck_assert_int_le(timeout, 1000);
+	rtt_estimator_sample(&rtt, 5000000);
+	ck_assert_int_eq(rtt_estimator_timeout(&rtt), 1000);
+
+	/* the ceiling is never below the minimum */
+	rtt_estimator_init(&rtt, 1);
+	ck_assert_int_eq(rtt_estimator_timeout(&rtt), RTT_TIMEOUT_MIN_MS);
+}
+END_TEST
+
+START_TEST(io_stats)
+{
+	struct ratbag_io_stats_table *table = zalloc(sizeof(*table));
+	struct ratbag_io_stats stats[RATBAG_IO_STATS_MAX_ENTRIES + 1];
+	struct ratbag_io_stats *s;
+	size_t n;
+
+	ck_assert_int_eq(ratbag_io_stats_copy(table, stats, ARRAY_LENGTH(stats)), 0);
+	ck_assert_ptr_eq(ratbag_io_stats_get(NULL, RATBAG_IO_HIDPP, 0), NULL);
+	ratbag_io_stats_record(NULL, RATBAG_IO_HIDPP, 0, 0, 1, 1, 1);
+
+	ratbag_io_stats_record(table, RATBAG_IO_OUTPUT_REPORT, 0x10, 0, 7, 0, 500);
+	ratbag_io_stats_record(table, RATBAG_IO_OUTPUT_REPORT, 0x10, 0, 7, 0, 3000);
+	ratbag_io_stats_record(table, RATBAG_IO_OUTPUT_REPORT, 0x10, -ETIMEDOUT, 0, 0, 0);
+	ratbag_io_stats_record(table, RATBAG_IO_FEATURE_GET_REPORT, 0x10, 0, 1, 20, 5000000);
+
+	n = ratbag_io_stats_copy(table, stats, ARRAY_LENGTH(stats));
+	ck_assert_int_eq(n, 2);
+
+	s = ratbag_io_stats_get(table, RATBAG_IO_OUTPUT_REPORT, 0x10);
+	ck_assert_int_eq(s->requests, 3);
+	ck_assert_int_eq(s->errors, 1);
+	ck_assert_int_eq(s->timeouts, 1);
+	ck_assert_int_eq(s->bytes_sent, 14);
+	ck_assert_int_eq(s->latency_total_us, 3500);
+	ck_assert_int_eq(s->latency[0], 1);
+	ck_assert_int_eq(s->latency[2], 1);
+
+	s = ratbag_io_stats_get(table, RATBAG_IO_FEATURE_GET_REPORT, 0x10);
+	ck_assert_int_eq(s->bytes_received, 20);
+	ck_assert_int_eq(s->latency[RATBAG_IO_LATENCY_BUCKETS - 1], 1);
+
+	/* overfill the table, entries go to the overflow tables and the
+	 * existing entries don't move */
+	s = ratbag_io_stats_get(table, RATBAG_IO_OUTPUT_REPORT, 0x10);
+	for (unsigned int i = 0; i < RATBAG_IO_STATS_MAX_ENTRIES * 2; i++)
+		ratbag_io_stats_record(table, RATBAG_IO_HIDPP, i << 8, 0, 20, 20, 100);
+
+	ck_assert_ptr_nonnull(table->next);
+	ck_assert_ptr_nonnull(table->next->next);
+	n = ratbag_io_stats_copy(table, stats, 1);
+	ck_assert_int_eq(n, RATBAG_IO_STATS_MAX_ENTRIES * 2 + 2);
+	ck_assert_ptr_eq(ratbag_io_stats_get(table, RATBAG_IO_OUTPUT_REPORT, 0x10), s);
+	ck_assert_int_eq(s->requests, 3);
+	for (unsigned int i = 0; i < RATBAG_IO_STATS_MAX_ENTRIES * 2; i++) {
+		s = ratbag_io_stats_get(table, RATBAG_IO_HIDPP, i << 8);
+		ck_assert_int_eq(s->requests, 1);
+	}
+	n = ratbag_io_stats_copy(table, stats, 1);
+	ck_assert_int_eq(n, RATBAG_IO_STATS_MAX_ENTRIES * 2 + 2);
+
+	ratbag_io_stats_table_free(table);
+}
+END_TEST
+
+START_TEST(trace_ring)
+{
+	struct ratbag_trace trace = {0};
+	struct ratbag_trace_device device = { .id = 1, .vendor = 0x46d, .product = 0xc539 };
+	struct ratbag_trace_header header;
+	struct ratbag_trace_device device_out;
+	struct ratbag_trace_record records[8];
+	uint8_t report[32];
+	FILE *fp;
+	int rc;
+
+	/* disabled, must not crash */
+	ratbag_trace_add(NULL, 1, RATBAG_TRACE_OUTPUT_REPORT, report, 1, 0);
+	ratbag_trace_add(&trace, 1, RATBAG_TRACE_OUTPUT_REPORT, report, 1, 0);
+
+	rc = ratbag_trace_init(&trace, 3);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(trace.size, 4);
+
+	for (unsigned int i = 0; i < 6; i++) {
+		memset(report, i, sizeof(report));
+		ratbag_trace_add(&trace, 1, RATBAG_TRACE_HIDPP_READ,
+				 report, 7 + 23 * (i % 2), i);
+	}
+
+	fp = tmpfile();
+	ck_assert_ptr_ne(fp, NULL);
+	rc = ratbag_trace_write_fd(&trace, &device, 1, fileno(fp));
+	ck_assert_int_eq(rc, 0);
+	rewind(fp);
+
+	ck_assert_int_eq(fread(&header, sizeof(header), 1, fp), 1);
+	ck_assert_int_eq(memcmp(header.magic, RATBAG_TRACE_MAGIC, 8), 0);
+	ck_assert_int_eq(header.ndevices, 1);
+	ck_assert_int_eq(header.record_size, sizeof(struct ratbag_trace_record));
+	ck_assert_int_eq(fread(&device_out, sizeof(device_out), 1, fp), 1);
+	ck_assert_int_eq(device_out.product, 0xc539);
+
+	/* only the last 4 records survive, oldest first */
+	ck_assert_int_eq(header.nrecords, 4);
+	ck_assert_int_eq(fread(records, sizeof(records[0]), 8, fp), 4);
+	for (unsigned int i = 0; i < 4; i++) {
+		ck_assert_int_eq(records[i].latency_us, i + 2);
+		ck_assert_int_eq(records[i].report_id, i + 2);
+		ck_assert_int_eq(records[i].length, 7 + 23 * (i % 2));
+		ck_assert_int_eq(records[i].data[6], i + 2);
+		/* long reports are truncated, short ones zero-padded */
+		ck_assert_int_eq(records[i].data[RATBAG_TRACE_DATA_LEN - 1],
+				 i % 2 ? i + 2 : 0);
+	}
+	ck_assert_int_ge(records[3].timestamp_us, records[0].timestamp_us);
+
+	fclose(fp);
+	ratbag_trace_release(&trace);
+	ck_assert_ptr_eq(trace.slots, NULL);
+}
+END_TEST
+
+START_TEST(trace_ring_torn)
+{
+	struct ratbag_trace trace = {0};
+	struct ratbag_trace_header header;
+	struct ratbag_trace_record records[8];
+	uint8_t report[8];
+	FILE *fp;
+
+	ck_assert_int_eq(ratbag_trace_init(&trace, 4), 0);
+
+	for (unsigned int i = 0; i < 4; i++) {
+		memset(report, i, sizeof(report));
+		ratbag_trace_add(&trace, 1, RATBAG_TRACE_HIDPP_READ,
+				 report, sizeof(report), i);
+	}
+
+	/* record 1 is being rewritten as record 5, record 2 was
+	 * overwritten by record 6 */
+	trace.slots[1].seq = 2 * 5 + 1;
+	trace.slots[2].seq = 2 * 6 + 2;
+
+	fp = tmpfile();
+	ck_assert_ptr_ne(fp, NULL);
+	ck_assert_int_eq(ratbag_trace_write_fd(&trace, NULL, 0, fileno(fp)), 0);
+	rewind(fp);
+
+	ck_assert_int_eq(fread(&header, sizeof(header), 1, fp), 1);
+	ck_assert_int_eq(header.nrecords, 2);
+	ck_assert_int_eq(fread(records, sizeof(records[0]), 8, fp), 2);
+	ck_assert_int_eq(records[0].latency_us, 0);
+	ck_assert_int_eq(records[1].latency_us, 3);
+	fclose(fp);
+
+	/* a writer that finds its slot busy drops the record */
+	trace.head = 5;
+	ratbag_trace_add(&trace, 1, RATBAG_TRACE_HIDPP_READ, report, 1, 0);
+	ck_assert_int_eq(trace.slots[1].seq, 2 * 5 + 1);
+
+	ratbag_trace_release(&trace);
+}
+END_TEST
+
+struct trace_thread {
+	pthread_t thread;
+	struct ratbag_trace *trace;
+	uint16_t id;
+	bool *stop;
+	unsigned int count;
+};
+
+static void *
+trace_writer(void *data)
+{
+	struct trace_thread *t = data;
+	uint8_t report[RATBAG_TRACE_DATA_LEN];
+
+	memset(report, t->id, sizeof(report));
+	while (!__atomic_load_n(t->stop, __ATOMIC_RELAXED)) {
+		ratbag_trace_add(t->trace, t->id, RATBAG_TRACE_HIDPP_WRITE,
+				 report, t->id, t->id);
+		t->count++;
+	}
+
+	return NULL;
+}
+
+START_TEST(trace_ring_threads)
+{
+	struct ratbag_trace trace = {0};
+	struct trace_thread threads[4];
+	struct ratbag_trace_header header;
+	struct ratbag_trace_record records[8];
+	uint64_t count = 0;
+	bool stop = false;
+	FILE *fp;
+
+	/* a ring smaller than the number of writers, so they keep
+	 * hitting the same slots */
+	ck_assert_int_eq(ratbag_trace_init(&trace, 2), 0);
+
+	for (unsigned int i = 0; i < ARRAY_LENGTH(threads); i++) {
+		threads[i].trace = &trace;
+		threads[i].id = i + 1;
+		threads[i].stop = &stop;
+		threads[i].count = 0;
+		ck_assert_int_eq(pthread_create(&threads[i].thread, NULL,
+						trace_writer, &threads[i]), 0);
+	}
+
+	/* a reader at the same time must only see whole records */
+	for (unsigned int n = 0; n < 1000; n++) {
+		fp = tmpfile();
+		ck_assert_ptr_ne(fp, NULL);
+		ck_assert_int_eq(ratbag_trace_write_fd(&trace, NULL, 0, fileno(fp)), 0);
+		rewind(fp);
+		ck_assert_int_eq(fread(&header, sizeof(header), 1, fp), 1);
+		ck_assert_int_eq(fread(records, sizeof(records[0]), header.nrecords, fp),
+				 header.nrecords);
+		for (unsigned int i = 0; i < header.nrecords; i++) {
+			const struct ratbag_trace_record *r = &records[i];
+
+			ck_assert_int_ne(r->device, 0);
+			ck_assert_int_eq(r->latency_us, r->device);
+			ck_assert_int_eq(r->length, r->device);
+			ck_assert_int_eq(r->report_id, r->device);
+			ck_assert_int_eq(r->data[0], r->device);
+			ck_assert_int_eq(r->data[r->length - 1], r->device);
+			ck_assert_int_eq(r->data[r->length], 0);
+		}
+		fclose(fp);
+	}
+
+	__atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+	for (unsigned int i = 0; i < ARRAY_LENGTH(threads); i++) {
+		pthread_join(threads[i].thread, NULL);
+		count += threads[i].count;
+	}
+
+	ck_assert_int_eq(trace.head, count);
+	ratbag_trace_release(&trace);
+}
+END_TEST
+
+START_TEST(trace_ring_reinit)
+{
+	struct ratbag_trace trace = {0};
+	struct trace_thread threads[4];
+	bool stop = false;
+
+	ck_assert_int_eq(ratbag_trace_init(&trace, 2), 0);
+
+	for (unsigned int i = 0; i < ARRAY_LENGTH(threads); i++) {
+		threads[i].trace = &trace;
+		threads[i].id = i + 1;
+		threads[i].stop = &stop;
+		threads[i].count = 0;
+		ck_assert_int_eq(pthread_create(&threads[i].thread, NULL,
+						trace_writer, &threads[i]), 0);
+	}
+
+	/* the slots are replaced and freed under the writers */
+	for (unsigned int n = 0; n < 200; n++) {
+		ck_assert_int_eq(ratbag_trace_init(&trace, 2 + n % 8), 0);
+		if (n % 4 == 0)
+			ratbag_trace_release(&trace);
+	}
+
+	__atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+	for (unsigned int i = 0; i < ARRAY_LENGTH(threads); i++)
+		pthread_join(threads[i].thread, NULL);
+
+	ratbag_trace_release(&trace);
+	ck_assert_ptr_eq(trace.slots, NULL);
+}
+END_TEST
+
 static Suite *
 test_context_suite(void)
 {
@@ -132,6 +458,12 @@ test_context_suite(void)
 	tc = tcase_create("util");
 	tcase_add_test(tc, dpi_range_parser);
 	tcase_add_test(tc, dpi_list_parser);
+	tcase_add_test(tc, rtt_estimator);
+	tcase_add_test(tc, io_stats);
+	tcase_add_test(tc, trace_ring);
+	tcase_add_test(tc, trace_ring_torn);
+	tcase_add_test(tc, trace_ring_threads);
+	tcase_add_test(tc, trace_ring_reinit);
 
 	suite_add_tcase(s, tc);
 	return s;
@@ -24,8 +24,11 @@
 #include <config.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/hidraw.h>
 
 #include <hidpp10.h>
+#include <hidpp-image.h>
 #include <libratbag-util.h>
 
 static inline int
@@ -70,10 +73,76 @@ dump_all_pages(struct hidpp10_device *dev)
 	return rc;
 }
 
+/**
+ * Read all pages with hidpp10_read_page(), which pipelines the reads and
+ * checks the CRC, and write them as one image to path.
+ */
+static int
+dump_image(struct hidpp10_device *dev, const char *path)
+{
+	_cleanup_close_ int out = -1;
+	struct hidpp_image *image;
+	struct hidraw_devinfo info;
+	uint8_t bytes[HIDPP10_PAGE_SIZE];
+	uint8_t major, minor, build;
+	uint8_t page;
+	int rc;
+
+	image = hidpp_image_new(HIDPP10_PAGE_SIZE);
+	image->header.proto_major = 1;
+	image->header.proto_minor = 0;
+
+	if (ioctl(dev->base.hidraw_fd, HIDIOCGRAWINFO, &info) == 0) {
+		image->header.bustype = info.bustype;
+		image->header.vendor = info.vendor;
+		image->header.product = info.product;
+	}
+
+	if (hidpp10_get_firmware_information(dev, &major, &minor, &build) == 0) {
+		image->header.fw_major = major;
+		image->header.fw_minor = minor;
+		image->header.fw_build = build;
+	}
+
+	/* the first page we cannot read is past the end of the flash, see
+	 * dump_all_pages() */
+	for (page = 0; page <= HIDPP10_MAX_PAGE_NUMBER; page++) {
+		rc = hidpp10_read_page(dev, page, bytes);
+		if (rc == 0)
+			hidpp_image_add_sector(image, page, HIDPP_IMAGE_SECTOR_OK, bytes);
+		else if (rc == -EILSEQ)
+			hidpp_image_add_sector(image, page, HIDPP_IMAGE_SECTOR_BAD_CRC, bytes);
+		else
+			break;
+	}
+
+	out = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (out < 0) {
+		rc = -errno;
+		fprintf(stderr, "Failed to open '%s': %s\n", path, strerror(errno));
+		goto out;
+	}
+
+	rc = hidpp_image_write_fd(image, out);
+	if (rc) {
+		fprintf(stderr, "Failed to write '%s': %s\n", path, strerror(-rc));
+		goto out;
+	}
+
+	printf("Wrote %u pages to %s\n", image->header.nsectors, path);
+
+out:
+	hidpp_image_destroy(image);
+	return rc;
+}
+
 static void
 usage(void)
 {
-	printf("Usage: %s [page] [offset] /dev/hidraw0\n", program_invocation_short_name);
+	printf("Usage: %s [page] [offset] /dev/hidraw0\n"
+	       "       %s --image <file> /dev/hidraw0\n",
+	       program_invocation_short_name,
+	       program_invocation_short_name);
 }
 
 int
@@ -103,7 +172,9 @@ main(int argc, char **argv)
 	if (rc)
 		return rc;
 
-	if (argc == 2)
+	if (argc == 4 && streq(argv[1], "--image"))
+		rc = dump_image(dev, argv[2]);
+	else if (argc == 2)
 		rc = dump_all_pages(dev);
 	else {
 		page = atoi(argv[1]);
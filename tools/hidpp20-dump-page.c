@@ -24,8 +24,11 @@
 #include <config.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/hidraw.h>
 
 #include <hidpp20.h>
+#include <hidpp-image.h>
 #include <libratbag-util.h>
 
 static inline int
@@ -86,10 +89,112 @@ dump_everything(struct hidpp20_device *dev, uint16_t sector_size)
 	return dump_all_pages(dev, sector_size, 1);
 }
 
+static enum hidpp_image_sector_status
+sector_status(const uint8_t *data, uint16_t sector_size)
+{
+	uint16_t crc;
+
+	crc = hidpp_crc_ccitt(data, sector_size - 2);
+	if (crc != get_unaligned_be_u16(&data[sector_size - 2]))
+		return HIDPP_IMAGE_SECTOR_BAD_CRC;
+
+	return HIDPP_IMAGE_SECTOR_OK;
+}
+
+/**
+ * Read all flash sectors the device announces and all ROM sectors and
+ * write them as one image to path, see
+ * hidpp20_onboard_profiles_read_sector_pipelined().
+ */
+static int
+dump_image(struct hidpp20_device *dev,
+	   const struct hidpp20_onboard_profiles_info *info,
+	   const char *path)
+{
+	_cleanup_close_ int out = -1;
+	_cleanup_free_ uint8_t *data = NULL;
+	struct hidpp_image *image;
+	struct hidraw_devinfo devinfo;
+	struct hidpp20_fw_info fw;
+	uint16_t sector_size = info->sector_size;
+	unsigned int nflash;
+	uint16_t sector;
+	int rc;
+
+	if (sector_size < 16) {
+		fprintf(stderr, "Invalid sector size %u\n", sector_size);
+		return -EINVAL;
+	}
+
+	image = hidpp_image_new(sector_size);
+	image->header.proto_major = dev->proto_major;
+	image->header.proto_minor = dev->proto_minor;
+
+	if (ioctl(dev->base.hidraw_fd, HIDIOCGRAWINFO, &devinfo) == 0) {
+		image->header.bustype = devinfo.bustype;
+		image->header.vendor = devinfo.vendor;
+		image->header.product = devinfo.product;
+	}
+
+	if (hidpp20_device_info_get_fw_info(dev, 0, &fw) == 0) {
+		memcpy(image->header.fw_prefix, fw.prefix, 3);
+		image->header.fw_major = fw.number;
+		image->header.fw_minor = fw.revision;
+		image->header.fw_build = fw.build;
+	}
+
+	data = zalloc(sector_size);
+
+	/* flash sectors the device announces are recorded even if they
+	 * cannot be read, ROM sectors end at the first error */
+	nflash = info->sector_count ? info->sector_count : 31;
+	for (sector = 0; sector < nflash; sector++) {
+		rc = hidpp20_onboard_profiles_read_sector_pipelined(dev, sector, sector_size, data);
+		if (rc == 0)
+			hidpp_image_add_sector(image, sector,
+					       sector_status(data, sector_size), data);
+		else if (info->sector_count)
+			hidpp_image_add_sector(image, sector,
+					       HIDPP_IMAGE_SECTOR_UNREADABLE, NULL);
+		else
+			break;
+	}
+
+	for (sector = 0x100; sector < 0x100 + 31; sector++) {
+		rc = hidpp20_onboard_profiles_read_sector_pipelined(dev, sector, sector_size, data);
+		if (rc != 0)
+			break;
+		hidpp_image_add_sector(image, sector,
+				       sector_status(data, sector_size), data);
+	}
+
+	out = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (out < 0) {
+		rc = -errno;
+		fprintf(stderr, "Failed to open '%s': %s\n", path, strerror(errno));
+		goto out;
+	}
+
+	rc = hidpp_image_write_fd(image, out);
+	if (rc) {
+		fprintf(stderr, "Failed to write '%s': %s\n", path, strerror(-rc));
+		goto out;
+	}
+
+	printf("Wrote %u sectors to %s\n", image->header.nsectors, path);
+
+out:
+	hidpp_image_destroy(image);
+	return rc;
+}
+
 static void
 usage(void)
 {
-	printf("Usage: %s [page] [offset] /dev/hidraw0\n", program_invocation_short_name);
+	printf("Usage: %s [page] [offset] /dev/hidraw0\n"
+	       "       %s --image <file> /dev/hidraw0\n",
+	       program_invocation_short_name,
+	       program_invocation_short_name);
 }
 
 int
@@ -124,7 +229,9 @@ main(int argc, char **argv)
 
 	hidpp20_onboard_profiles_get_profiles_desc(dev, &info);
 
-	if (argc == 2)
+	if (argc == 4 && streq(argv[1], "--image"))
+		rc = dump_image(dev, &info, argv[2]);
+	else if (argc == 2)
 		rc = dump_everything(dev, info.sector_size);
 	else {
 		page = atoi(argv[1]);
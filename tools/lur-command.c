@@ -28,13 +28,16 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <libudev.h>
 
 #include <liblur.h>
 #include <libratbag-util.h>
+#include <hidpp-generic.h>
 
 enum options {
 	OPT_HELP,
@@ -60,6 +63,22 @@ open_receiver(const char *path)
 	return receiver;
 }
 
+static const char *
+device_type_to_str(enum lur_device_type type)
+{
+	switch(type) {
+	case LUR_DEVICE_TYPE_UNKNOWN:	return "unknown";
+	case LUR_DEVICE_TYPE_KEYBOARD:	return "keyboard";
+	case LUR_DEVICE_TYPE_MOUSE:	return "mouse";
+	case LUR_DEVICE_TYPE_NUMPAD:	return "numpad";
+	case LUR_DEVICE_TYPE_PRESENTER: return "presenter";
+	case LUR_DEVICE_TYPE_TRACKBALL:	return "trackball";
+	case LUR_DEVICE_TYPE_TOUCHPAD:	return "touchpad";
+	}
+
+	return "<invalid>";
+}
+
 static void
 list_connected_devices(struct lur_receiver *receiver)
 {
@@ -79,26 +98,12 @@ list_connected_devices(struct lur_receiver *receiver)
 	for (i = 0; i < ndevices; i++) {
 		struct lur_device *dev = devices[i];
 		const char *name, *strtype;
-		enum lur_device_type type;
 		uint32_t serial;
 
 		name = lur_device_get_name(dev);
-		type = lur_device_get_type(dev);
+		strtype = device_type_to_str(lur_device_get_type(dev));
 		serial = lur_device_get_serial(dev);
 
-		switch(type) {
-		case LUR_DEVICE_TYPE_UNKNOWN:	strtype = "unknown";	break;
-		case LUR_DEVICE_TYPE_KEYBOARD:	strtype = "keyboard";	break;
-		case LUR_DEVICE_TYPE_MOUSE:	strtype = "mouse";	break;
-		case LUR_DEVICE_TYPE_NUMPAD:	strtype = "numpad";	break;
-		case LUR_DEVICE_TYPE_PRESENTER: strtype = "presenter";	break;
-		case LUR_DEVICE_TYPE_TRACKBALL:	strtype = "trackball";	break;
-		case LUR_DEVICE_TYPE_TOUCHPAD:	strtype = "touchpad";	break;
-		default:
-			strtype = "<invalid>";
-			break;
-		}
-
 		printf("%d: %s (%s) serial %#x\n", i, name, strtype, serial);
 
 		lur_device_unref(dev);
@@ -132,6 +137,301 @@ disconnect_device(struct lur_receiver *receiver, int index)
 		lur_device_unref(devices[i]);
 }
 
+/* One receiver scanned by list --all, each in its own thread */
+struct receiver_scan {
+	pthread_t thread;
+	char *path;
+	char *usb_syspath;
+	bool started;
+};
+
+/* serializes the output of the scanning threads, one line per receiver */
+static pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+json_print_string(FILE *fp, const char *str)
+{
+	const unsigned char *c;
+
+	fputc('"', fp);
+	for (c = (const unsigned char *)str; c && *c; c++) {
+		switch (*c) {
+		case '"':	fputs("\\\"", fp);	break;
+		case '\\':	fputs("\\\\", fp);	break;
+		case '\n':	fputs("\\n", fp);	break;
+		case '\t':	fputs("\\t", fp);	break;
+		default:
+			if (*c < 0x20)
+				fprintf(fp, "\\u%04x", *c);
+			else
+				fputc(*c, fp);
+			break;
+		}
+	}
+	fputc('"', fp);
+}
+
+/**
+ * Print the receiver's devices as one JSON object on a single line. The
+ * line is built in memory first so that it can be written in one go.
+ */
+static void
+print_receiver_json(const char *path, struct lur_device **devices,
+		    int ndevices, const char *error)
+{
+	_cleanup_free_ char *line = NULL;
+	size_t size = 0;
+	FILE *fp;
+	int i;
+
+	fp = open_memstream(&line, &size);
+	if (!fp)
+		return;
+
+	fputs("{\"receiver\": ", fp);
+	json_print_string(fp, path);
+
+	if (error) {
+		fputs(", \"error\": ", fp);
+		json_print_string(fp, error);
+	} else {
+		fputs(", \"devices\": [", fp);
+		for (i = 0; i < ndevices; i++) {
+			struct lur_device *dev = devices[i];
+
+			fprintf(fp, "%s{\"index\": %d, \"name\": ",
+				i > 0 ? ", " : "", i);
+			json_print_string(fp, lur_device_get_name(dev));
+			fprintf(fp, ", \"type\": \"%s\", \"vid\": %u, \"pid\": %u, \"serial\": %u}",
+				device_type_to_str(lur_device_get_type(dev)),
+				lur_device_get_vendor_id(dev),
+				lur_device_get_product_id(dev),
+				lur_device_get_serial(dev));
+		}
+		fputs("]", fp);
+	}
+	fputs("}\n", fp);
+	fclose(fp);
+
+	pthread_mutex_lock(&output_lock);
+	fwrite(line, 1, size, stdout);
+	fflush(stdout);
+	pthread_mutex_unlock(&output_lock);
+}
+
+static void *
+scan_receiver(void *data)
+{
+	struct receiver_scan *scan = data;
+	_cleanup_free_ struct lur_device **devices = NULL;
+	struct lur_receiver *receiver = NULL;
+	int fd, rc, ndevices, i;
+
+	fd = open(scan->path, O_RDWR);
+	if (fd < 0) {
+		print_receiver_json(scan->path, NULL, 0, strerror(errno));
+		return NULL;
+	}
+
+	rc = lur_receiver_new_from_hidraw(fd, NULL, &receiver);
+	if (rc != 0) {
+		print_receiver_json(scan->path, NULL, 0, strerror(-rc));
+		close(fd);
+		return NULL;
+	}
+
+	ndevices = lur_receiver_enumerate(receiver, &devices);
+	if (ndevices < 0) {
+		print_receiver_json(scan->path, NULL, 0,
+				    "failed to enumerate devices");
+	} else {
+		print_receiver_json(scan->path, devices, ndevices, NULL);
+		for (i = 0; i < ndevices; i++)
+			lur_device_unref(devices[i]);
+	}
+
+	lur_receiver_unref(receiver);
+	close(fd);
+
+	return NULL;
+}
+
+/**
+ * Returns true if the report descriptor of the hid device declares the
+ * HID++ short or long report. The descriptor is read from sysfs, so the
+ * hidraw node doesn't need to be opened.
+ */
+static bool
+hid_device_has_hidpp_reports(struct udev_device *hid)
+{
+	_cleanup_close_ int fd = -1;
+	char path[PATH_MAX];
+	uint8_t desc[4096];
+	ssize_t len;
+	size_t i = 0;
+
+	sprintf_safe(path, "%s/report_descriptor", udev_device_get_syspath(hid));
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	len = read(fd, desc, sizeof(desc));
+	if (len <= 0)
+		return false;
+
+	while (i < (size_t)len) {
+		uint8_t prefix = desc[i];
+		size_t size;
+
+		/* long item: size is in the next byte */
+		if (prefix == 0xfe) {
+			if (i + 1 >= (size_t)len)
+				break;
+			i += 3 + desc[i + 1];
+			continue;
+		}
+
+		size = prefix & 0x3;
+		if (size == 3)
+			size = 4;
+
+		/* Report ID, a global item with one byte of data */
+		if ((prefix & 0xfc) == 0x84 && size == 1 && i + 1 < (size_t)len &&
+		    (desc[i + 1] == REPORT_ID_SHORT || desc[i + 1] == REPORT_ID_LONG))
+			return true;
+
+		i += 1 + size;
+	}
+
+	return false;
+}
+
+/**
+ * Returns the hid parent if the hidraw device is the HID++ interface of a
+ * receiver, judging by the HID_ID and the report descriptor so no device
+ * needs to be opened. The other interfaces of the receiver (keyboard,
+ * mouse) would only confuse the HID++ requests.
+ */
+static struct udev_device *
+udev_device_get_receiver(struct udev_device *device)
+{
+	struct udev_device *hid;
+	const char *hid_id;
+	unsigned int bus, vid, pid;
+
+	hid = udev_device_get_parent_with_subsystem_devtype(device, "hid", NULL);
+	if (!hid)
+		return NULL;
+
+	hid_id = udev_device_get_property_value(hid, "HID_ID");
+	if (!hid_id || sscanf(hid_id, "%x:%x:%x", &bus, &vid, &pid) != 3)
+		return NULL;
+
+	if (!lur_is_receiver(vid, pid) || !hid_device_has_hidpp_reports(hid))
+		return NULL;
+
+	return hid;
+}
+
+/* The usb device syspath identifies the receiver across its interfaces */
+static const char *
+receiver_get_usb_syspath(struct udev_device *hid)
+{
+	struct udev_device *usb;
+
+	usb = udev_device_get_parent_with_subsystem_devtype(hid, "usb", "usb_device");
+
+	return usb ? udev_device_get_syspath(usb) : udev_device_get_syspath(hid);
+}
+
+static bool
+receiver_scan_find(const struct receiver_scan *scans, size_t nscans,
+		   const char *usb_syspath)
+{
+	size_t i;
+
+	for (i = 0; i < nscans; i++) {
+		if (streq(scans[i].usb_syspath, usb_syspath))
+			return true;
+	}
+
+	return false;
+}
+
+static int
+list_all_receivers(void)
+{
+	struct udev *udev;
+	struct udev_enumerate *e;
+	struct udev_list_entry *entry;
+	struct receiver_scan *scans = NULL;
+	size_t nscans = 0, i;
+	int rc;
+
+	udev = udev_new();
+	if (!udev)
+		return -ENOMEM;
+
+	e = udev_enumerate_new(udev);
+	udev_enumerate_add_match_subsystem(e, "hidraw");
+	udev_enumerate_scan_devices(e);
+
+	udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(e)) {
+		struct udev_device *device, *hid;
+		const char *devnode, *usb_syspath;
+
+		device = udev_device_new_from_syspath(udev,
+						      udev_list_entry_get_name(entry));
+		if (!device)
+			continue;
+
+		devnode = udev_device_get_devnode(device);
+		hid = devnode ? udev_device_get_receiver(device) : NULL;
+		usb_syspath = hid ? receiver_get_usb_syspath(hid) : NULL;
+
+		/* one entry per receiver, even if it has more than one
+		 * interface with HID++ reports */
+		if (usb_syspath && !receiver_scan_find(scans, nscans, usb_syspath)) {
+			scans = realloc(scans, (nscans + 1) * sizeof(*scans));
+			if (!scans)
+				abort();
+			memset(&scans[nscans], 0, sizeof(*scans));
+			scans[nscans].path = strdup_safe(devnode);
+			scans[nscans].usb_syspath = strdup_safe(usb_syspath);
+			nscans++;
+		}
+
+		udev_device_unref(device);
+	}
+
+	udev_enumerate_unref(e);
+	udev_unref(udev);
+
+	/* Every receiver is a separate hidraw node, so they can be talked
+	 * to in parallel. Receivers we cannot start a thread for are
+	 * scanned synchronously. */
+	for (i = 0; i < nscans; i++) {
+		rc = pthread_create(&scans[i].thread, NULL,
+				    scan_receiver, &scans[i]);
+		scans[i].started = rc == 0;
+		if (!scans[i].started)
+			scan_receiver(&scans[i]);
+	}
+
+	for (i = 0; i < nscans; i++) {
+		if (scans[i].started)
+			pthread_join(scans[i].thread, NULL);
+		free(scans[i].path);
+		free(scans[i].usb_syspath);
+	}
+	free(scans);
+
+	if (nscans == 0)
+		fprintf(stderr, "No receivers found.\n");
+
+	return 0;
+}
+
 static int
 filter_hidraw(const struct dirent *entry)
 {
@@ -173,6 +473,7 @@ usage(void)
 	       "\n"
 	       "Commands:\n"
 	       "  list ............. list devices connected to receiver\n"
+	       "  list --all ....... list devices of all receivers as JSON, one line per receiver\n"
 	       "  open ............. open receiver for pairing (timeout 30s)\n"
 	       "  close ............ close receiver if currently open\n"
 	       "  disconnect N ..... disconnect device N\n"
@@ -219,6 +520,9 @@ main(int argc, char **argv)
 		return EXIT_SUCCESS;
 	}
 
+	if (streq(command, "list") && argc == 3 && streq(argv[2], "--all"))
+		return list_all_receivers() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
 	if (argc < 3) {
 		usage();
 		return EXIT_FAILURE;
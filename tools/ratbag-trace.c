@@ -0,0 +1,158 @@
+/*
+ * Copyright © 2026 Red Hat, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include <libratbag-trace.h>
+#include <libratbag-util.h>
+
+static void
+usage(void)
+{
+	printf("Usage: %s [trace-file]\n"
+	       "\n"
+	       "Decode a HID trace as written by ratbag_trace_write(), e.g. from\n"
+	       "ratbagd's DumpTrace method. Reads from stdin if no file is given.\n",
+	       program_invocation_short_name);
+}
+
+static const struct ratbag_trace_device *
+find_device(const struct ratbag_trace_device *devices, uint32_t ndevices,
+	    uint32_t id)
+{
+	/* ids are assigned sequentially, but don't rely on it */
+	if (id >= 1 && id <= ndevices && devices[id - 1].id == id)
+		return &devices[id - 1];
+
+	for (uint32_t i = 0; i < ndevices; i++) {
+		if (devices[i].id == id)
+			return &devices[i];
+	}
+
+	return NULL;
+}
+
+static void
+print_record(const struct ratbag_trace_record *record,
+	     const struct ratbag_trace_device *devices,
+	     uint32_t ndevices, uint64_t start)
+{
+	const struct ratbag_trace_device *device;
+	size_t len = min(record->length, (uint16_t)RATBAG_TRACE_DATA_LEN);
+
+	printf("%6" PRIu64 ".%06" PRIu64 " ",
+	       (record->timestamp_us - start) / 1000000,
+	       (record->timestamp_us - start) % 1000000);
+
+	device = find_device(devices, ndevices, record->device);
+	if (device)
+		printf("%04x:%04x ", device->vendor, device->product);
+	else
+		printf("dev %-5u ", record->device);
+
+	printf("%-11s ", ratbag_trace_direction_to_str(record->direction));
+
+	if (record->latency_us)
+		printf("%8uus ", record->latency_us);
+	else
+		printf("%10s ", "");
+
+	printf("%3u:", record->length);
+	for (size_t i = 0; i < len; i++)
+		printf(" %02x", record->data[i]);
+	if (record->length > len)
+		printf(" ...");
+	printf("\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	FILE *fp = stdin;
+	struct ratbag_trace_header header;
+	struct ratbag_trace_device *devices = NULL;
+	struct ratbag_trace_record record;
+	uint64_t start = 0;
+	int rc = 1;
+
+	if (argc > 2 || (argc == 2 && streq(argv[1], "--help"))) {
+		usage();
+		return argc > 2;
+	}
+
+	if (argc == 2 && !streq(argv[1], "-")) {
+		fp = fopen(argv[1], "rb");
+		if (!fp) {
+			fprintf(stderr, "Failed to open path '%s': %s\n", argv[1], strerror(errno));
+			return 3;
+		}
+	}
+
+	if (fread(&header, sizeof(header), 1, fp) != 1 ||
+	    memcmp(header.magic, RATBAG_TRACE_MAGIC, sizeof(header.magic)) != 0) {
+		fprintf(stderr, "Not a ratbag trace file\n");
+		goto out;
+	}
+
+	if (header.version != RATBAG_TRACE_VERSION ||
+	    header.record_size != sizeof(record)) {
+		fprintf(stderr, "Unsupported trace version %u\n", header.version);
+		goto out;
+	}
+
+	devices = calloc(header.ndevices, sizeof(*devices));
+	if (header.ndevices && !devices)
+		goto out;
+
+	if (fread(devices, sizeof(*devices), header.ndevices, fp) != header.ndevices) {
+		fprintf(stderr, "Truncated device table\n");
+		goto out;
+	}
+
+	for (uint32_t i = 0; i < header.ndevices; i++) {
+		printf("# device %u: %04x:%04x %.*s\n",
+		       devices[i].id, devices[i].vendor, devices[i].product,
+		       (int)sizeof(devices[i].name), devices[i].name);
+	}
+
+	for (uint32_t i = 0; i < header.nrecords; i++) {
+		if (fread(&record, sizeof(record), 1, fp) != 1) {
+			fprintf(stderr, "Truncated trace after %u records\n", i);
+			goto out;
+		}
+
+		if (i == 0)
+			start = record.timestamp_us;
+
+		print_record(&record, devices, header.ndevices, start);
+	}
+
+	rc = 0;
+out:
+	free(devices);
+	if (fp != stdin)
+		fclose(fp);
+	return rc;
+}